@@ -0,0 +1,81 @@
+// User store benchmark: load, lookup, login and append latency for 100 up
+// to the given number of accounts (default 100000).
+//
+//   gcc -Wall -Wextra -std=c99 -O2 -pthread -o user_store_bench bench/user_store_bench.c
+//   ./user_store_bench [accounts]
+#define BUSFLOW_NO_MAIN
+#include "../src/main.c"
+
+static double bench_seconds(clock_t started) {
+    return (double)(clock() - started) / CLOCKS_PER_SEC;
+}
+
+// Login cost against growing in-memory stores. Works on a temporary file
+// and never touches the real users file.
+static int run_user_store_bench(int accounts) {
+    int cost = password_hash_cost();
+    char password_hash[MAX_STRING_LENGTH * 2];
+    // One stretched hash shared by every account; lookup cost does not depend on it
+    make_password_hash("secret", cost, password_hash);
+
+    printf("Password cost %d (PBKDF2-HMAC-SHA256, %lu iterations)\n\n", cost, 1UL << cost);
+    printf("%-10s %-12s %-14s %-14s %-14s\n", "Accounts", "Load (ms)", "Lookup (us)", "Login (us)", "Append (us)");
+
+    for (int size = 100; ; size *= 10) {
+        if (size > accounts) size = accounts;
+        FILE *file = tmpfile();
+        if (file == NULL) {
+            printf("Cannot create a temporary file.\n");
+            return 1;
+        }
+        for (int i = 0; i < size; i++) fprintf(file, "user%d %s\n", i, password_hash);
+        rewind(file);
+
+        UserStore store;
+        user_store_init(&store);
+        clock_t started = clock();
+        read_users_from_stream(&store, file);
+        double load = bench_seconds(started);
+
+        int lookups = 200000;
+        char username[MAX_STRING_LENGTH];
+        unsigned long long seed = 42;
+        int found = 0;
+        started = clock();
+        for (int i = 0; i < lookups; i++) {
+            seed = mix64(seed);
+            sprintf(username, "user%d", (int)(seed % (unsigned long long)size));
+            found += user_store_find(&store, username) != NULL;
+        }
+        double lookup = bench_seconds(started);
+
+        int logins = 20;
+        started = clock();
+        for (int i = 0; i < logins; i++) {
+            sprintf(username, "user%d", (i * 7919) % size);
+            found += check_credentials(&store, username, "secret");
+        }
+        double login = bench_seconds(started);
+
+        int appends = 1000;
+        started = clock();
+        for (int i = 0; i < appends; i++) {
+            fseek(file, 0L, SEEK_END);
+            fprintf(file, "extra%d %s\n", i, password_hash);
+            fflush(file);
+        }
+        double append = bench_seconds(started);
+
+        printf("%-10d %-12.1f %-14.3f %-14.1f %-14.2f%s\n", size, load * 1000.0, lookup * 1e6 / lookups,
+               login * 1e6 / logins, append * 1e6 / appends, found == lookups + logins ? "" : "  (lookup errors)");
+        user_store_free(&store);
+        fclose(file);
+        if (size >= accounts) break;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int accounts = argc >= 2 ? atoi(argv[1]) : 100000;
+    return run_user_store_bench(accounts > 0 ? accounts : 100000);
+}
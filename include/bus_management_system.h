@@ -1,19 +1,51 @@
 #ifndef BUS_MANAGEMENT_SYSTEM_H
 #define BUS_MANAGEMENT_SYSTEM_H
 
+// Server mode needs POSIX/Linux extensions (open_memstream, accept4, fdopen)
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stddef.h>
 
 #ifdef _WIN32
     #include <conio.h>
     #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <poll.h>
+    #include <pthread.h>
+    #include <unistd.h>
+    #include <sys/file.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <sys/types.h>
+    #include <sys/wait.h>
+#endif
+
+#ifdef __linux__
+    #include <errno.h>
+    #include <signal.h>
+    #include <sys/epoll.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
 #endif
 
 // Constants
-#define MAX_USERS 100
+#define DEFAULT_PASSWORD_COST 17 // 2^cost PBKDF2 iterations; override with BUSFLOW_HASH_COST
+#define MIN_PASSWORD_COST 10
+#define MAX_PASSWORD_COST 24
+#define PASSWORD_HASH_PREFIX "$pbkdf2-sha256$"
+#define LEGACY_HASH_PREFIX "$s1$"
+#define LEGACY_MIN_COST 4
+#define SCREEN_BUFFER_SIZE (256 * 1024)
 #define MAX_STRING_LENGTH 100
 #define MAX_PHONE_LENGTH 15
 #define FILENAME "../data/users.txt"
@@ -22,6 +54,57 @@
 #define EMPLOYEE_FILENAME "../data/employees.txt"
 #define FUNCTION_FILENAME "../data/functions.txt"
 #define TRIP_FILENAME "../data/trips.txt"
+#define TEMPLATE_FILENAME "../data/templates.txt"
+#define DEPARTURE_FILENAME "../data/departures.txt"
+#define BOOKING_FILENAME "../data/bookings.txt"
+#define CREW_FILENAME "../data/crew.txt"
+#define MAINTENANCE_RULE_FILENAME "../data/maintenance_rules.txt"
+#define MAINTENANCE_FILENAME "../data/maintenance.txt"
+#define SERVER_SOCKET_FILENAME "../data/busflow.sock"
+
+// Slotted record files, used instead of the text files for these entities
+// when BUSFLOW_STORAGE=slotted
+#define BUS_SLOT_FILENAME "../data/buses.dat"
+#define CLIENT_SLOT_FILENAME "../data/clients.dat"
+#define EMPLOYEE_SLOT_FILENAME "../data/employees.dat"
+
+// LSM stores, used for clients and employees when BUSFLOW_STORAGE=lsm. Each
+// is a manifest (<path>.lsm), a write-ahead log (<path>.log) and sorted
+// runs (<path>-NNNNNN.run). An open store holds an exclusive flock on
+// <path>.lock, so a second process cannot open it.
+#define CLIENT_STORE_PATH "../data/clients"
+#define EMPLOYEE_STORE_PATH "../data/employees"
+
+// Trip archive: a directory of month partitions listed in <path>/manifest.
+// Each partition is a block index (<yyyy-mm>.blocks) and one file of 32-bit
+// values per column (<yyyy-mm>.plate, .client, .departure, .arrival, .from,
+// .to). Trips that departed more than BUSFLOW_ARCHIVE_DAYS days ago are
+// moved there by busflow archive; 0 disables archiving. Sealed
+// partitions older than BUSFLOW_RETENTION_MONTHS months are dropped; 0
+// keeps them all. Sealed partitions older than BUSFLOW_COLD_MONTHS months
+// are compressed into <yyyy-mm>.cold; 0 leaves them uncompressed
+#define TRIP_ARCHIVE_PATH "../data/trip_archive"
+#define DEFAULT_ARCHIVE_DAYS 90
+#define DEFAULT_RETENTION_MONTHS 0
+#define DEFAULT_COLD_MONTHS 12
+
+// BUSFLOW_STORAGE values
+#define STORAGE_TEXT 0
+#define STORAGE_SLOTTED 1
+#define STORAGE_LSM 2
+
+// Autosave interval in seconds; BUSFLOW_AUTOSAVE overrides it, 0 disables
+#define DEFAULT_AUTOSAVE_SECONDS 300
+
+// Crew rostering rules
+#define CREW_MIN_REST_MINUTES 30
+#define CREW_MAX_DAILY_MINUTES 540
+
+// Table rendering
+#define TABLE_BUFFER_SIZE (64 * 1024)
+#define TABLE_ROW_RESERVE 1024
+#define MONEY_EXACT_LIMIT 1e15   // larger amounts are printed with snprintf
+#define MONEY_TEXT_MAX 48
 
 // Structure definitions
 typedef struct User {
@@ -29,6 +112,15 @@ typedef struct User {
     char password[MAX_STRING_LENGTH * 2]; // Larger buffer for encrypted passwords
 } User;
 
+// Growable user table with an open-addressing index by username
+typedef struct UserStore {
+    User *users;
+    int count;
+    int capacity;
+    int *slots;              // index into users, -1 when empty
+    unsigned int slot_capacity;
+} UserStore;
+
 typedef struct PurchaseDate {
     int day;
     int month;
@@ -85,11 +177,785 @@ typedef struct Trip {
     DateTime arrival_time;
     char departure_city[MAX_STRING_LENGTH];
     char arrival_city[MAX_STRING_LENGTH];
+    unsigned long created_epoch; // first snapshot epoch that sees this trip (0 = always)
+    unsigned long deleted_epoch; // first epoch that no longer sees it (0 = live)
     struct Trip *next;
 } Trip;
 
+// Recurring trip templates; occurrences are generated on demand and only
+// become Trip records when a client is booked on them
+typedef struct TemplateException {
+    long day;        // days since 01/01/1970
+    int cancelled;   // 1 = cancelled, 0 = materialized as trips
+} TemplateException;
+
+typedef struct TripTemplate {
+    int template_id;
+    int license_plate;
+    char departure_city[MAX_STRING_LENGTH];
+    char arrival_city[MAX_STRING_LENGTH];
+    int departure_hour;
+    int departure_minute;
+    int duration_minutes;
+    int days_of_week;    // bit 0 = Monday ... bit 6 = Sunday
+    PurchaseDate valid_from;
+    PurchaseDate valid_to;
+    TemplateException *exceptions;   // sorted by day
+    int exception_count;
+    struct TripTemplate *next;
+} TripTemplate;
+
+// Seat inventory: one departure per bus run, one booking per occupied seat
+typedef unsigned long long SeatWord;
+#define SEAT_WORD_BITS 64
+
+typedef struct Departure {
+    int departure_id;
+    int license_plate;
+    DateTime departure_time;
+    DateTime arrival_time;
+    char departure_city[MAX_STRING_LENGTH];
+    char arrival_city[MAX_STRING_LENGTH];
+    int seat_count;
+    int seats_taken;
+    SeatWord *seat_map;   // bit (n - 1) set = seat n booked; rebuilt from bookings
+    struct Departure *next;
+} Departure;
+
+typedef struct Booking {
+    int booking_id;
+    int departure_id;
+    int client_id;
+    int seat_number;
+    struct Booking *next;
+} Booking;
+
+// Departures ordered by bus and departure time. A converted run keeps one
+// trip row, which finds its seat inventory here by the same two keys.
+typedef struct DepartureLookup {
+    Departure **sorted;
+    int count;
+} DepartureLookup;
+
+// Crew rostering: an employee assigned to one bus run (bus + departure time)
+typedef struct CrewAssignment {
+    int employee_id;
+    int license_plate;
+    DateTime departure_time;
+    DateTime arrival_time;
+    char departure_city[MAX_STRING_LENGTH];
+    char arrival_city[MAX_STRING_LENGTH];
+    struct CrewAssignment *next;
+} CrewAssignment;
+
+typedef struct EmployeeShifts {
+    int employee_id;
+    long *starts;   // sorted; ends[i] belongs to starts[i]
+    long *ends;
+    int count;
+    int capacity;
+} EmployeeShifts;
+
+// Fleet report structures
+typedef struct BusUtilization {
+    int license_plate;
+    float price;
+    PurchaseDate purchase_date;
+    int seat_count;
+    int trip_count;
+    long service_minutes;
+    long idle_minutes;
+} BusUtilization;
+
+// Fleet valuation structures (one array per field so the per-schedule loops vectorize)
+#define DEPRECIATION_STRAIGHT_LINE 0
+#define DEPRECIATION_DECLINING_BALANCE 1
+#define MAX_DEPRECIATION_SCHEDULES 8
+
+typedef struct DepreciationSchedule {
+    char name[MAX_STRING_LENGTH];
+    int method;
+    int life_months;            // straight-line: months until only salvage is left
+    double annual_rate;         // declining balance: yearly rate, applied monthly
+    double salvage_percent;     // floor, as a share of the price
+} DepreciationSchedule;
+
+typedef struct FleetAssets {
+    int count;
+    int *license_plates;
+    PurchaseDate *purchase_dates;
+    double *prices;
+    int *age_months;            // whole months owned at the valuation date
+} FleetAssets;
+
+typedef struct FleetValuation {
+    int schedule_count;
+    int bus_count;
+    double *book_values;        // schedule_count rows of bus_count values
+    double totals[MAX_DEPRECIATION_SCHEDULES];
+} FleetValuation;
+
+// City name interning (open addressing, ids are dense from 0)
+typedef struct CityTable {
+    char **names;
+    int count;
+    int capacity;
+    int *slots;
+    int slot_count;
+} CityTable;
+
+// Trip archive structures. Times are stored as minutes since 1970 and
+// cities as codes into the archive's city table.
+#define ARCHIVE_VERSION 2
+#define ARCHIVE_BLOCK_ROWS 4096
+#define ARCHIVE_PLATE 0
+#define ARCHIVE_CLIENT 1
+#define ARCHIVE_DEPARTURE 2
+#define ARCHIVE_ARRIVAL 3
+#define ARCHIVE_FROM 4
+#define ARCHIVE_TO 5
+#define ARCHIVE_COLUMNS 6
+#define ARCHIVE_KEY_COLUMNS 4   // plate to arrival: the columns queries filter on
+
+// Partition states, in the order a partition goes through them
+#define ARCHIVE_OPEN 0      // takes appends
+#define ARCHIVE_SEALED 1    // read-only column files
+#define ARCHIVE_COLD 2      // compressed into one .cold file
+
+// Value range of every column over one block of rows
+typedef struct ArchiveBlock {
+    int min[ARCHIVE_COLUMNS];
+    int max[ARCHIVE_COLUMNS];
+} ArchiveBlock;
+
+// Usage carried by a bus's archived trips, counted like BusUsage
+typedef struct ArchiveBusTotals {
+    int license_plate;
+    int trip_count;
+    int run_count;
+    long service_minutes;
+} ArchiveBusTotals;
+
+typedef struct ArchiveTotals {
+    ArchiveBusTotals *buses;            // sorted by plate
+    int count;
+    int capacity;
+} ArchiveTotals;
+
+// One month of archived trips. The manifest carries its row count and key
+// ranges; the block index and the column mappings are loaded on first use.
+typedef struct ArchivePartition {
+    int month;                          // year * 12 + month - 1
+    long rows;
+    int state;                          // ARCHIVE_OPEN, ARCHIVE_SEALED or ARCHIVE_COLD
+    int min[ARCHIVE_KEY_COLUMNS];
+    int max[ARCHIVE_KEY_COLUMNS];
+    ArchiveBlock *blocks;
+    int block_count;
+    int block_capacity;
+    const int *columns[ARCHIVE_COLUMNS]; // mapped read-only
+    size_t mapped_size;
+    const unsigned char *cold;          // mapped .cold file of a cold partition
+    size_t cold_size;
+    int loaded;                         // 1 mapped, -1 unreadable, 0 not touched yet
+    int damaged_reported;               // a scan has warned about undecodable blocks
+} ArchivePartition;
+
+// Cold partition file: a COLD_HEADER_SIZE header (magic, version, rows,
+// block count), one directory entry per block and the encoded blocks.
+// Rows are sorted by departure, plate and client. Each row is a byte with
+// one bit per column whose value differs from the previous row, then a
+// zigzag varint delta for each of those columns; arrival is coded as the
+// trip's duration. Blocks start from all-zero values, so any block decodes
+// on its own.
+#define COLD_FILE_MAGIC 0x41434642u // "BFCA"
+#define COLD_FILE_VERSION 1
+#define COLD_HEADER_SIZE 16
+
+typedef struct ColdBlockEntry {
+    unsigned long long offset;
+    unsigned int length;
+    unsigned int rows;
+    ArchiveBlock ranges;
+} ColdBlockEntry;
+
+typedef struct TripArchive {
+    ArchivePartition *partitions;       // sorted by month
+    int partition_count;
+    int partition_capacity;
+    CityTable cities;                   // shared by every partition
+    ArchiveTotals totals;
+    long rows;
+    int loaded;                         // 1 open, -1 unreadable, 0 not opened yet
+} TripArchive;
+
+// Rows matching every field; -1 ids match any, time ranges are inclusive
+typedef struct ArchiveQuery {
+    int license_plate;
+    int client_id;
+    long departure_from;
+    long departure_to;
+    long arrival_from;
+    long arrival_to;
+} ArchiveQuery;
+
+// Fleet optimizer structures
+typedef struct ServiceRun {
+    int departure_city;
+    int arrival_city;
+    long departure;
+    long arrival;
+    int demand;
+    int old_plate;
+    int new_plate;
+    int pinned;       // recurring occurrence: keeps its template's bus
+    Departure *seats; // seat inventory of a converted run, or NULL
+} ServiceRun;
+
+typedef struct FleetPlan {
+    ServiceRun *runs;
+    int run_count;
+    Trip **trips;
+    int *trip_run;
+    int trip_count;
+    int buses_used;
+    int lower_bound;
+    int unassigned_runs;
+    CityTable cities;
+} FleetPlan;
+
+// Journey planner structures
+#define PLANNER_TEMPLATE_DAYS 366   // days of recurring occurrences in a timetable
+
+typedef struct Connection {
+    long departure;
+    long arrival;
+    int departure_city;
+    int arrival_city;
+    int license_plate;
+    int bus_index;
+} Connection;
+
+typedef struct Timetable {
+    Connection *connections;
+    int connection_count;
+    int bus_count;
+    CityTable cities;
+    long templates_from;    // recurring occurrences departing in
+    long templates_to;      // [templates_from, templates_to) are included
+} Timetable;
+
+// Departure board structures (per-city queues ordered by departure time)
+#define BOARD_REFRESH_SECONDS 30
+
+typedef struct DepartureEntry {
+    long departure;
+    Trip *trip;
+} DepartureEntry;
+
+// Treap node: in order by (departure, trip), heap-ordered by priority
+typedef struct DepartureNode {
+    DepartureEntry entry;
+    unsigned int priority;
+    struct DepartureNode *left;
+    struct DepartureNode *right;
+} DepartureNode;
+
+typedef struct DepartureQueue {
+    DepartureNode *root;
+    int count;
+} DepartureQueue;
+
+typedef struct DepartureIndex {
+    CityTable cities;
+    DepartureQueue *queues;
+    int queue_capacity;
+} DepartureIndex;
+
+// One trip of a bulk index update; key is the license plate or the queue id
+typedef struct TripIndexUpdate {
+    long departure;
+    long arrival;
+    int key;
+    Trip *trip;
+} TripIndexUpdate;
+
+// Maintenance planner structures
+typedef struct MaintenanceRule {
+    int rule_id;
+    char description[MAX_STRING_LENGTH];
+    int every_hours;        // service hours between visits, 0 if not usage based
+    int every_months;       // months since purchase between visits, 0 if not calendar based
+    int duration_hours;
+    struct MaintenanceRule *next;
+} MaintenanceRule;
+
+typedef struct MaintenanceBlock {
+    int license_plate;
+    int rule_id;
+    long start;
+    long end;
+    struct MaintenanceBlock *next;
+} MaintenanceBlock;
+
+typedef struct BusRunUsage {
+    long departure;
+    long arrival;
+    int trips;              // passenger trips sharing this bus departure
+} BusRunUsage;
+
+// Per-bus usage, kept up to date by the trip index hooks
+typedef struct BusUsage {
+    int license_plate;
+    BusRunUsage *runs;      // sorted by departure
+    int run_count;
+    int run_capacity;
+    int trip_count;
+    long service_minutes;
+} BusUsage;
+
+// Per-bus maintenance blocks, merged and sorted, for availability checks
+typedef struct BusBlocks {
+    int license_plate;
+    long *starts;
+    long *ends;
+    int count;
+    int capacity;
+} BusBlocks;
+
+// Fleet simulator structures
+typedef struct SimRun {
+    long departure;
+    long arrival;
+    int license_plate;
+    int route;
+    int next_run;           // next run of the same bus, -1 for the last one
+} SimRun;
+
+typedef struct SimSchedule {
+    SimRun *runs;
+    int run_count;
+    int *first_runs;        // first run of each bus
+    int bus_count;
+    long *route_keys;       // departure_city * city count + arrival_city
+    int route_count;
+    CityTable cities;
+} SimSchedule;
+
+typedef struct SimParams {
+    int delay_percent;      // chance that a departure is delayed
+    int mean_delay;         // minutes
+    int turnaround_minutes;
+    int on_time_minutes;    // arrival lateness still counted as on time
+    int replications;
+    int threads;
+    unsigned long long seed;
+} SimParams;
+
+typedef struct SimStats {
+    long long *delay_sum;   // per run, arrival delay summed over replications
+    long *max_delay;
+    int *on_time;
+    long long events;
+} SimStats;
+
+typedef struct SimEvent {
+    long time;
+    int run;
+    int kind;
+} SimEvent;
+
+typedef struct SimEventQueue {
+    SimEvent *heap;
+    int size;
+    int capacity;
+} SimEventQueue;
+
+// Table rendering structures: column layouts are fixed per table at compile
+// time, rows are formatted into one reusable buffer
+typedef struct TableColumn {
+    const char *title;
+    int width;
+} TableColumn;
+
+typedef struct TableWriter {
+    FILE *out;
+    size_t length;
+    char buffer[TABLE_BUFFER_SIZE];
+} TableWriter;
+
+// Export structures: one large buffer reused by every export, so memory use
+// does not depend on the table size
+#define EXPORT_BUFFER_SIZE (1024 * 1024)
+#define EXPORT_ROW_RESERVE 8192
+#define EXPORT_CSV 0
+#define EXPORT_NDJSON 1
+
+typedef struct ExportWriter {
+    FILE *out;
+    int format;
+    size_t length;
+    unsigned long long bytes;   // flushed so far
+    char buffer[EXPORT_BUFFER_SIZE];
+} ExportWriter;
+
+// Files a save writes (SaveSet.files)
+#define SAVE_BUSES 0x001
+#define SAVE_CLIENTS 0x002
+#define SAVE_EMPLOYEES 0x004
+#define SAVE_FUNCTIONS 0x008
+#define SAVE_TRIPS 0x010
+#define SAVE_TEMPLATES 0x020
+#define SAVE_DEPARTURES 0x040    // departures and bookings
+#define SAVE_CREW 0x080
+#define SAVE_MAINTENANCE 0x100   // rules and schedule
+#define SAVE_CORE (SAVE_BUSES | SAVE_CLIENTS | SAVE_EMPLOYEES | SAVE_FUNCTIONS | SAVE_TRIPS) // batch/server sessions
+#define SAVE_ALL 0x1ff
+
+// Autosave structures: one list head per data file written by a full save
+typedef struct SaveSet {
+    Bus *buses;
+    Client *clients;
+    Employee *employees;
+    Function *functions;
+    Trip *trips;
+    TripTemplate *templates;
+    Departure *departures;
+    Booking *bookings;
+    CrewAssignment *crew;
+    MaintenanceRule *maintenance_rules;
+    MaintenanceBlock *maintenance;
+    unsigned int files; // SAVE_* bits of the files to write
+} SaveSet;
+
+// Sent by the background save process to its parent when it finishes
+typedef struct SaveReport {
+    int ok;
+    double duration_ms;
+    long bytes;
+} SaveReport;
+
+typedef struct SaveStats {
+    int foreground_saves;
+    int background_saves;
+    int failed_saves;
+    double last_ms;
+    double max_ms;
+    double total_ms;
+    long last_bytes;
+    long long total_bytes;
+    time_t last_time;
+    int last_background;
+} SaveStats;
+
+// Snapshot (MVCC) structures: every write to the trip list publishes a new
+// epoch; a reader pins the current epoch and sees exactly the trips created
+// at or before it and not yet deleted
+#define MAX_SNAPSHOTS 64
+
+typedef struct SnapshotRegistry {
+    unsigned long current;               // last published epoch
+    unsigned long pinned[MAX_SNAPSHOTS]; // epoch per active reader
+    unsigned char active[MAX_SNAPSHOTS];
+#ifndef _WIN32
+    pthread_mutex_t lock;                // only taken to pin, unpin and find the oldest reader
+#endif
+} SnapshotRegistry;
+
+// Unlinked trip kept until every reader that might still stand on it is gone
+typedef struct RetiredTrip {
+    Trip *trip;
+    unsigned long free_epoch;
+} RetiredTrip;
+
+// Batch command structures
+typedef struct IdSet {
+    int *keys;
+    void **values;          // the record with that id
+    unsigned char *states;  // 0 empty, 1 used, 2 deleted
+    int capacity;
+    int used;               // used + deleted slots, drives growth
+} IdSet;
+
+// Context for exporting archived trips, which arrive through a scan callback
+typedef struct ArchiveExport {
+    ExportWriter *writer;
+    const IdSet *clients;       // joined export when not NULL
+    long rows;
+} ArchiveExport;
+
+// Slotted record file: a 16-byte header (magic, version, slot size) and
+// then fixed-size slots, each a status word followed by the record image
+// (the struct up to its next pointer). Slot n sits at a computable offset,
+// so one record is rewritten or freed with a single positioned write.
+#define SLOT_FILE_MAGIC 0x4C534642u // "BFSL"
+#define SLOT_FILE_VERSION 1
+#define SLOT_HEADER_SIZE 16
+#define SLOT_FREE 0
+#define SLOT_USED 1
+
+typedef struct SlotFile {
+    const char *path;
+    size_t record_size;
+    int attached;           // edits are written through as they happen
+    int fd;                 // open for write-through, -1 until the file matches memory
+    int slot_count;
+    int *free_slots;        // free-slot list, rebuilt from the status words on load
+    int free_count;
+    int free_capacity;
+    IdSet slots;            // record id -> slot + 1, kept in the value pointer
+} SlotFile;
+
+// Storage engine interface: a keyed table of fixed-size record images.
+// get returns 1 and fills record when the key is present, 0 when it is not;
+// put and remove return 0 or -1. scan visits live records in key order
+// until visit returns non-zero; the visitor must not call back into the store.
+typedef struct StorageEngine {
+    const char *name;
+    void* (*open)(const char *path, size_t record_size, int *created);
+    int (*get)(void *state, int key, void *record);
+    int (*put)(void *state, int key, const void *record);
+    int (*remove)(void *state, int key);
+    int (*scan)(void *state, int (*visit)(int key, const void *record, void *context), void *context);
+    void (*describe)(void *state, FILE *out);
+    void (*close)(void *state);
+} StorageEngine;
+
+typedef struct RecordStore {
+    const StorageEngine *engine; // NULL while closed
+    void *state;
+    int created;                 // opened empty, with no files on disk yet
+} RecordStore;
+
+// Log-structured merge tree. Writes go to the log and the memtable; a full
+// memtable is written out as an immutable run sorted by key. Each run keeps
+// a bloom filter and the first key of every block in memory, so a lookup
+// reads at most one block per run whose filter admits the key. A background
+// thread merges LSM_COMPACTION_TRIGGER or more adjacent runs once their sizes
+// are within LSM_TIER_RATIO of each other.
+#define LSM_RUN_MAGIC 0x4E52534Cu // "LSRN"
+#define LSM_VERSION 1
+#define LSM_RUN_HEADER_SIZE 32
+#define LSM_MEMTABLE_LIMIT 4096
+#define LSM_BLOCK_ENTRIES 64
+#define LSM_BLOOM_BITS_PER_KEY 10
+#define LSM_BLOOM_HASHES 7
+#define LSM_COMPACTION_TRIGGER 4
+#define LSM_TIER_RATIO 4
+#define LSM_MAX_RUNS 32
+
+// Memtable entry; runs store entries with the same layout
+typedef struct LsmEntry {
+    int key;
+    int deleted;
+    char record[];
+} LsmEntry;
+
+typedef struct LsmRun {
+    int sequence;
+    int fd;
+    int count;
+    int block_count;
+    int *block_keys;                // first key of each block
+    unsigned long long *bloom;
+    unsigned int bloom_bits;
+} LsmRun;
+
+// Sequential reader over the memtable or one run, used by scans and merges
+typedef struct LsmCursor {
+    const LsmRun *run;              // NULL for the memtable
+    LsmEntry **entries;             // memtable entries sorted by key
+    int position;
+    int count;
+    char *block;
+    int block_start;
+    int block_length;
+    int failed;                     // a block could not be read
+} LsmCursor;
+
+typedef struct LsmRunWriter {
+    FILE *out;
+    int sequence;
+    int count;
+    int *block_keys;
+    unsigned long long *bloom;
+    unsigned int bloom_bits;
+} LsmRunWriter;
+
+// Context for listing a store through a table writer
+typedef struct StoreView {
+    TableWriter *writer;
+    const void *context;    // passed on to the row function
+    int count;
+} StoreView;
+
+// Brings a store in line with a list: records are sorted by id, which is
+// the first field of every entity, and compared with the stored images
+typedef struct StoreSync {
+    void **records;
+    int count;
+    int position;
+    size_t record_size;
+    unsigned char *unchanged;
+    int *removed;
+    int removed_count;
+    int removed_capacity;
+} StoreSync;
+
+#ifndef _WIN32
+typedef struct LsmTree {
+    char path[MAX_STRING_LENGTH];
+    size_t record_size;
+    size_t entry_size;
+    IdSet memtable;                 // key -> LsmEntry
+    int memtable_count;
+    LsmRun *runs[LSM_MAX_RUNS];     // oldest first
+    int run_count;
+    int next_sequence;
+    char *block;                    // lookup buffer, used under the lock
+    FILE *log;
+    int lock_fd;                    // holds the flock on <path>.lock
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_t compactor;
+    int compacting;
+    int stopping;
+    int compactions;
+} LsmTree;
+#endif
+
+typedef struct BatchSession {
+    FILE *out;
+    UserStore users;
+    int authenticated;
+    int dirty;
+    int line_number;
+    int applied;
+    int errors;
+    Bus *buses, *bus_tail;
+    Client *clients, *client_tail;
+    Employee *employees, *employee_tail;
+    Function *functions, *function_tail;
+    Trip *trips, *trip_tail;
+    MaintenanceBlock *maintenance;
+    CrewAssignment *crew;   // read only, to keep rostered employees from being deleted
+    IdSet bus_ids, client_ids, employee_ids, function_ids;
+    void **pending_deletes; // records unlinked in one sweep before the next read or save
+    int pending_count;
+    int pending_capacity;
+    SnapshotRegistry snapshots; // trip versions visible to concurrent readers
+    int trip_deletes_pending;   // trips deleted in an epoch but still linked
+    RetiredTrip *retired_trips;
+    int retired_count;
+    int retired_capacity;
+} BatchSession;
+
+// Server mode: one shared BatchSession, one of these per connected client.
+// Requests are command lines; each response is "<+|-> <length>\n" followed
+// by <length> bytes of command output.
+#define SERVER_MAX_REQUEST 4096
+#define SERVER_MAX_PENDING (16 * SERVER_MAX_REQUEST)   // input buffered per connection
+#define SERVER_MAX_EVENTS 64
+
+typedef struct ServerConnection {
+    int fd;                // -1 once closed while a snapshot read was still running
+    int authenticated;
+    int line_number;
+    int want_write;
+    int busy;              // a snapshot read is answering this connection's current request
+    char *input;
+    size_t input_length, input_capacity;
+    char *output;
+    size_t output_length, output_capacity, output_sent;
+} ServerConnection;
+
+// Trip report run on a pinned snapshot by a reader thread
+#define SNAPSHOT_LIST 0
+#define SNAPSHOT_COUNT 1
+#define SNAPSHOT_TABLE 2
+
+typedef struct SnapshotJob {
+    ServerConnection *conn;
+    Trip *head;
+    unsigned long epoch;
+    int slot;
+    int kind;
+    char *payload;
+    size_t payload_length;
+    struct SnapshotJob *next;
+} SnapshotJob;
+
+// Reload with diff: records of the file and of memory are matched by
+// primary key and compared by a hash of their fields
+typedef struct ReloadEntry {
+    unsigned long long key;
+    unsigned long long hash;
+    int position;           // index in the list, to apply changes in file order
+    int changed;            // matched, but the fields differ
+    void *record;
+    void *partner;          // matched record in the other list, NULL if none
+} ReloadEntry;
+
+typedef struct ReloadReport {
+    int found;              // 0 if the file was missing or empty (nothing reloaded)
+    int inserted;
+    int updated;
+    int deleted;
+    int unchanged;
+    double elapsed_ms;
+} ReloadReport;
+
+// CSV bulk import: a reader thread fills chunks of whole lines while the
+// previous chunk is parsed by the worker threads and then validated and
+// linked in file order
+#define IMPORT_CHUNK_SIZE (4 * 1024 * 1024)
+#define IMPORT_MAX_LINE 4096
+#define IMPORT_MAX_WORKERS 16
+#define IMPORT_MAX_REPORTED_ERRORS 1000
+#define IMPORT_BUSES 0
+#define IMPORT_CLIENTS 1
+#define IMPORT_EMPLOYEES 2
+#define IMPORT_FUNCTIONS 3
+#define IMPORT_TRIPS 4
+
+typedef struct ImportReader {
+    FILE *file;
+    char *buffers[2];       // IMPORT_CHUNK_SIZE + 1 bytes each
+    size_t lengths[2];      // 0 marks the end of the file
+    int ready[2];
+    int stop;
+    int failed;
+    char carry[IMPORT_MAX_LINE]; // partial last line of the previous chunk
+    size_t carry_length;
+#ifndef _WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t thread;
+    int threaded;
+#endif
+} ImportReader;
+
+typedef struct ImportWorker {
+    int entity;
+    char **lines;
+    void **records;         // parsed record, NULL when the row was rejected
+    const char **errors;
+    int first;
+    int end;
+} ImportWorker;
+
 // Function prototypes
 
+// Screen rendering functions
+void ui_init(void);
+int ui_scanf(const char *format, ...);
+void clear_screen(void);
+
+// Table rendering functions
+TableWriter* table_begin(FILE *out);
+void table_flush(TableWriter *writer);
+void table_header(TableWriter *writer, const TableColumn *columns, int count);
+
 // Utility functions
 void safe_string_input(char *buffer, size_t buffer_size);
 int safe_int_input(void);
@@ -102,12 +968,21 @@ void pause_screen(void);
 // Utility functions to check data existence
 int has_buses(Bus *head);
 int has_clients(Client *head);
+int has_employees(Employee *head);
 int has_functions(Function *head);
 
 // Date validation functions
 int is_valid_date(int day, int month, int year);
 int is_leap_year(int year);
 int get_days_in_month(int month, int year);
+int is_valid_time(int hour, int minute);
+int is_valid_datetime(int day, int month, int year, int hour, int minute);
+
+// Time conversion functions (minutes since 01/01/1970 00:00)
+long days_from_civil(int day, int month, int year);
+long datetime_to_minutes(DateTime dt);
+DateTime minutes_to_datetime(long minutes);
+void input_date(const char *label, PurchaseDate *date);
 
 // User authentication functions - Real Encryption
 void generate_key(unsigned char *key, int length);
@@ -115,10 +990,21 @@ void xor_encrypt_decrypt(char *input, char *output, unsigned char *key, int key_
 void hash_password(char *password, char *hashed_password);
 int verify_password(char *input_password, char *stored_hash);
 void secure_encrypt_password(char *password, char *encrypted_password);
-void write_users_to_file(User users[], int num_users);
-int read_users_from_file(User users[]);
-int authenticate_user(User users[], int num_users);
-void register_user(User users[], int *num_users);
+void make_password_hash(const char *password, int cost, char *hash);
+int password_matches(const char *password, const char *stored_hash);
+int password_hash_cost(void);
+int password_needs_rehash(const char *stored_hash);
+void user_store_init(UserStore *store);
+void user_store_free(UserStore *store);
+User* user_store_find(const UserStore *store, const char *username);
+int user_store_add(UserStore *store, const char *username, const char *password_hash);
+void write_users_to_file(const UserStore *store);
+int append_user_to_file(const User *user);
+int update_user_in_file(const User *user);
+int read_users_from_file(UserStore *store);
+int authenticate_user(UserStore *store);
+int check_credentials(UserStore *store, const char *username, const char *password);
+void register_user(UserStore *store);
 
 // Bus management functions
 Bus* add_bus_at_beginning(Bus *head);
@@ -141,6 +1027,11 @@ void search_client(Client *head);
 void save_clients_to_file(Client *head);
 Client* load_clients_from_file(Client *head);
 void free_client_list(Client *head);
+void add_client_to_store(void);
+void display_client_store(void);
+void modify_client_in_store(void);
+void delete_client_from_store(void);
+void search_client_in_store(void);
 
 // Employee management functions
 Employee* add_employee_at_beginning(Employee *head, Function *functions);
@@ -152,6 +1043,11 @@ void search_employee(Employee *head, Function *functions);
 void save_employees_to_file(Employee *head);
 Employee* load_employees_from_file(Employee *head);
 void free_employee_list(Employee *head);
+void add_employee_to_store(Function *functions);
+void display_employee_store(Function *functions);
+void modify_employee_in_store(Function *functions);
+void delete_employee_from_store(void);
+void search_employee_in_store(Function *functions);
 
 // Function management functions
 Function* add_function_at_beginning(Function *head);
@@ -175,13 +1071,232 @@ void save_trips_to_file(Trip *head);
 Trip* load_trips_from_file(Trip *head);
 void free_trip_list(Trip *head);
 
+// City table functions
+int city_table_intern(CityTable *table, const char *name);
+int city_table_find(const CityTable *table, const char *name);
+void city_table_free(CityTable *table);
+
+// Trip archive functions
+int trip_archive_days(void);
+int trip_archive_retention_months(void);
+int trip_archive_cold_months(void);
+int trip_archive_open(void);
+void trip_archive_close(void);
+long trip_archive_rows(void);
+int trip_archive_append(Trip **trips, int count);
+int archive_old_trips(Trip **list);
+int run_archive_maintenance(FILE *out);
+long trip_archive_scan(const ArchiveQuery *query, int (*visit)(const Trip *trip, void *context), void *context);
+void archive_query_all(ArchiveQuery *query);
+const ArchiveBusTotals* trip_archive_totals(int license_plate);
+
+// Fleet report functions
+int compute_fleet_utilization(Bus *buses, Trip *trips, TripTemplate *templates, long period_start, long period_end, BusUtilization **out);
+void fleet_utilization_report(Bus *buses, Trip *trips, TripTemplate *templates);
+
+// Fleet valuation functions
+int build_fleet_assets(Bus *buses, PurchaseDate valuation_date, FleetAssets *assets);
+void free_fleet_assets(FleetAssets *assets);
+int value_fleet(const FleetAssets *assets, const DepreciationSchedule *schedules, int schedule_count,
+                FleetValuation *valuation);
+void free_fleet_valuation(FleetValuation *valuation);
+int export_fleet_valuation(const char *filename, const FleetAssets *assets, const DepreciationSchedule *schedules,
+                           const FleetValuation *valuation);
+void fleet_valuation_report(Bus *buses);
+
+// Fleet optimizer functions
+int optimize_fleet_assignment(Bus *buses, Trip *trips, TripTemplate *templates, Departure *departures,
+                              long day_start, long day_end, int turnaround_minutes, FleetPlan *plan);
+int apply_fleet_plan(const FleetPlan *plan);
+void free_fleet_plan(FleetPlan *plan);
+void fleet_assignment_optimizer(Bus *buses, Trip *trips, TripTemplate *templates, Departure *departures);
+
+// Journey planner functions
+int build_timetable(Trip *trips, TripTemplate *templates, long from_time, long to_time, Timetable *timetable);
+int plan_journey(const Timetable *timetable, int from_city, int to_city, long earliest_departure,
+                 long latest_arrival, int min_transfer, int *legs, int max_legs);
+void free_timetable(Timetable *timetable);
+void journey_planner(Trip *trips, TripTemplate *templates);
+
+// Recurring trip template functions
+int day_of_week(long day);
+int template_runs_on(const TripTemplate *tmpl, long day);
+int next_template_occurrences(TripTemplate *templates, const char *city, long from_time, Trip *out, int max_rows);
+int expand_template_occurrences(TripTemplate *templates, long from_time, long to_time, Trip *rest, Trip **occurrences);
+Trip* materialize_occurrence(Trip *head, TripTemplate *tmpl, long day, int client_id);
+TripTemplate* add_template_at_end(TripTemplate *head, Bus *buses);
+void display_templates(TripTemplate *head);
+void display_template_occurrences(TripTemplate *head);
+Trip* book_template_occurrence(Trip *trips, TripTemplate *templates, Client *clients);
+void cancel_template_occurrence(TripTemplate *templates);
+TripTemplate* delete_template(TripTemplate *head);
+void save_templates_to_file(TripTemplate *head);
+TripTemplate* load_templates_from_file(TripTemplate *head);
+void free_template_list(TripTemplate *head);
+
+// Seat inventory functions
+int seat_is_free(const Departure *departure, int seat_number);
+int seats_left(const Departure *departure);
+int reserve_seat(Departure *departure, int seat_number);
+void release_seat(Departure *departure, int seat_number);
+int allocate_first_fit_seat(Departure *departure);
+int allocate_contiguous_seats(Departure *departure, int count);
+Departure* add_departure_at_end(Departure *head, Bus *buses);
+void display_departures(Departure *head);
+void display_seat_map(Departure *departures, Booking *bookings);
+Booking* book_seats(Booking *head, Departure *departures, Client *clients);
+Booking* cancel_booking(Booking *head, Departure *departures);
+Departure* delete_departure(Departure *head, Booking **bookings);
+Departure* convert_trips_to_departures(Departure *head, Booking **bookings, Trip **trips, Bus *buses);
+int departure_lookup_build(Departure *head, DepartureLookup *lookup);
+Departure* departure_lookup_find(const DepartureLookup *lookup, int license_plate, long departure);
+void departure_lookup_free(DepartureLookup *lookup);
+void save_departures_to_file(Departure *head);
+Departure* load_departures_from_file(Departure *head);
+void free_departure_list(Departure *head);
+void save_bookings_to_file(Booking *head);
+Booking* load_bookings_from_file(Booking *head, Departure *departures);
+void free_booking_list(Booking *head);
+
+// Crew rostering functions
+void crew_index_rebuild(CrewAssignment *head);
+void crew_index_clear(void);
+int crew_shift_conflict(int employee_id, long start, long end, int rest_minutes);
+CrewAssignment* assign_crew_to_trip(CrewAssignment *head, Employee *employees, Function *functions, Trip *trips);
+void display_crew_roster(CrewAssignment *head, Employee *employees);
+CrewAssignment* remove_crew_assignment(CrewAssignment *head);
+int solve_crew_roster(CrewAssignment **head, Employee *employees, int function_id, Trip *trips,
+                      long from_time, long to_time, int rest_minutes, int *stale_removed);
+void crew_roster_solver(CrewAssignment **head, Employee *employees, Function *functions, Trip *trips);
+void save_crew_to_file(CrewAssignment *head);
+CrewAssignment* load_crew_from_file(CrewAssignment *head);
+void free_crew_list(CrewAssignment *head);
+
+// Fleet simulator functions
+int build_sim_schedule(Trip *trips, TripTemplate *templates, long from_time, long to_time, SimSchedule *schedule);
+void free_sim_schedule(SimSchedule *schedule);
+int run_fleet_simulation(const SimSchedule *schedule, const SimParams *params, SimStats *stats);
+void free_sim_stats(SimStats *stats);
+void fleet_delay_simulator(Trip *trips, TripTemplate *templates);
+
+// Maintenance planner functions
+void bus_usage_add(const Trip *trip);
+void bus_usage_remove(const Trip *trip);
+void bus_usage_add_sorted(const TripIndexUpdate *updates, int count);
+void bus_usage_clear(void);
+const BusUsage* bus_usage_find(int license_plate);
+int bus_in_maintenance(int license_plate, long start, long end);
+void maintenance_index_rebuild(MaintenanceBlock *head);
+void maintenance_index_clear(void);
+MaintenanceRule* add_maintenance_rule(MaintenanceRule *head);
+void display_maintenance_rules(MaintenanceRule *head);
+MaintenanceRule* delete_maintenance_rule(MaintenanceRule *head);
+void bus_usage_report(Bus *buses);
+int plan_maintenance(Bus *buses, MaintenanceRule *rules, long from_time, long to_time,
+                     MaintenanceBlock **schedule, int *conflicts);
+void maintenance_planner(Bus *buses, MaintenanceRule *rules, MaintenanceBlock **schedule);
+void display_maintenance_schedule(MaintenanceBlock *head);
+void save_maintenance_rules_to_file(MaintenanceRule *head);
+MaintenanceRule* load_maintenance_rules_from_file(MaintenanceRule *head);
+void free_maintenance_rule_list(MaintenanceRule *head);
+void save_maintenance_schedule_to_file(MaintenanceBlock *head);
+MaintenanceBlock* load_maintenance_schedule_from_file(MaintenanceBlock *head);
+void free_maintenance_schedule(MaintenanceBlock *head);
+
+// Slotted record storage functions
+int slot_storage_enabled(void);
+void slot_storage_attach(void);
+void slot_storage_convert(Bus *buses, Client *clients, Employee *employees);
+
+// Storage engine functions
+int store_open(RecordStore *store, const char *engine, const char *path, size_t record_size);
+int store_get(RecordStore *store, int key, void *record);
+int store_put(RecordStore *store, int key, const void *record);
+int store_remove(RecordStore *store, int key);
+int store_scan(RecordStore *store, int (*visit)(int key, const void *record, void *context), void *context);
+void store_describe(RecordStore *store, FILE *out);
+void store_close(RecordStore *store);
+int lsm_storage_enabled(void);
+int lsm_storage_attached(void);
+int lsm_storage_take_errors(void);
+void lsm_storage_attach(void);
+void lsm_storage_convert(Client **clients, Employee **employees);
+void lsm_storage_detach(void);
+
+// Autosave functions
+long save_all_data(const SaveSet *set);
+void autosave_init(void);
+int autosave_interval_seconds(void);
+int autosave_due(void);
+int autosave_start(const SaveSet *set);
+int autosave_poll(void);
+int autosave_wait(void);
+SaveSet save_set_for(unsigned int files);
+int record_foreground_save(const SaveSet *set);
+void display_save_stats(FILE *out);
+
+// Snapshot (MVCC) functions
+void snapshot_registry_init(SnapshotRegistry *registry);
+void snapshot_registry_destroy(SnapshotRegistry *registry);
+int snapshot_begin(SnapshotRegistry *registry, unsigned long *epoch);
+void snapshot_end(SnapshotRegistry *registry, int slot);
+unsigned long snapshot_oldest(SnapshotRegistry *registry);
+int trip_visible(const Trip *trip, unsigned long epoch);
+void trip_versions_collect(BatchSession *session);
+
+// Batch command functions
+void* id_set_get(const IdSet *set, int key);
+int id_set_add(IdSet *set, int key, void *value);
+void id_set_remove(IdSet *set, int key);
+void id_set_free(IdSet *set);
+int batch_session_open(BatchSession *session, FILE *out);
+int batch_execute_line(BatchSession *session, char *line);
+int batch_session_close(BatchSession *session);
+int run_batch_script(FILE *in, FILE *out);
+int import_csv(BatchSession *session, int entity, const char *path);
+ExportWriter* export_begin(FILE *out, int format);
+void export_flush(ExportWriter *writer);
+long export_entity(BatchSession *session, ExportWriter *writer, int entity, int joined);
+
+// Reload functions
+Bus* reload_buses_from_file(Bus *head, ReloadReport *report);
+Client* reload_clients_from_file(Client *head, ReloadReport *report);
+Employee* reload_employees_from_file(Employee *head, ReloadReport *report);
+Function* reload_functions_from_file(Function *head, ReloadReport *report);
+Trip* reload_trips_from_file(Trip *head, ReloadReport *report);
+void display_reload_report(const char *entity, const ReloadReport *report);
+
+// Server mode functions (Linux only; elsewhere they report that and fail)
+int run_server(const char *socket_path);
+int run_client(const char *socket_path, FILE *in, FILE *out);
+
+// Trip index maintenance (called by every path that changes the trip list)
+void trip_indexes_add(Trip *trip);
+void trip_indexes_add_batch(Trip **trips, int count);
+void trip_indexes_remove(Trip *trip);
+Trip* trip_indexes_find(int license_plate, int client_id, long departure);
+int client_trip_count(int client_id);
+void trip_indexes_rebuild(Trip *head);
+void trip_indexes_clear(void);
+
+// Departure board functions
+int departure_board_query(const char *city, long from_time, DepartureEntry *rows, int max_rows);
+void departure_board(Trip *trips, TripTemplate *templates, Departure *departures);
+
 // Menu functions
-void main_menu(Bus **buses, Client **clients, Employee **employees, Function **functions, Trip **trips);
+void main_menu(Bus **buses, Client **clients, Employee **employees, Function **functions, Trip **trips, TripTemplate **templates,
+               Departure **departures, Booking **bookings, CrewAssignment **crew,
+               MaintenanceRule **maintenance_rules, MaintenanceBlock **maintenance);
 void bus_menu(Bus **buses, Client *clients, Employee *employees, Function *functions, Trip *trips);
 void client_menu(Bus *buses, Client **clients, Employee *employees, Function *functions, Trip *trips);
 void employee_menu(Bus *buses, Client *clients, Employee **employees, Function *functions, Trip *trips);
 void function_menu(Bus *buses, Client *clients, Employee *employees, Function **functions, Trip *trips);
 void trip_menu(Bus *buses, Client *clients, Employee *employees, Function *functions, Trip **trips);
+void report_menu(Bus *buses, Trip **trips, TripTemplate *templates, Departure *departures);
+void template_menu(Bus *buses, Client *clients, Trip **trips, TripTemplate **templates);
+void booking_menu(Bus *buses, Client *clients, Trip **trips, Departure **departures, Booking **bookings);
+void crew_menu(Employee *employees, Function *functions, Trip *trips, CrewAssignment **crew);
+void maintenance_menu(Bus *buses, MaintenanceRule **rules, MaintenanceBlock **schedule);
 void bus_choice_menu(Bus **buses, Client *clients, Employee *employees, Function *functions, Trip *trips);
 void client_choice_menu(Bus *buses, Client **clients, Employee *employees, Function *functions, Trip *trips);
 void employee_choice_menu(Bus *buses, Client *clients, Employee **employees, Function *functions, Trip *trips);
@@ -1,7 +1,63 @@
 #include "../include/bus_management_system.h"
 
+// Screen rendering functions
+// stdout is fully buffered while the menus run, so a screen (including the
+// clear sequence that starts it) leaves in a single write when the program
+// next waits for input. Colours and clearing are skipped when stdout is not
+// a terminal.
+static char screen_buffer[SCREEN_BUFFER_SIZE];
+static int ui_color_enabled = 1;
+static int ui_ansi = 1;
+
+void ui_init(void) {
+#ifdef _WIN32
+    HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+    DWORD mode;
+    ui_color_enabled = GetConsoleMode(console, &mode) != 0;
+    // 0x0004 = ENABLE_VIRTUAL_TERMINAL_PROCESSING (Windows 10 and later)
+    ui_ansi = ui_color_enabled && SetConsoleMode(console, mode | 0x0004);
+#else
+    ui_color_enabled = isatty(STDOUT_FILENO);
+    ui_ansi = ui_color_enabled;
+#endif
+    setvbuf(stdout, screen_buffer, _IOFBF, sizeof(screen_buffer));
+}
+
+int ui_scanf(const char *format, ...) {
+    fflush(stdout);
+    va_list args;
+    va_start(args, format);
+    int result = vscanf(format, args);
+    va_end(args);
+    return result;
+}
+
+void clear_screen(void) {
+    if (ui_ansi) {
+        fputs("\033[H\033[2J\033[3J", stdout);
+        return;
+    }
+#ifdef _WIN32
+    if (ui_color_enabled) {
+        // Console without escape sequence support: clear through the console API
+        HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        COORD origin = {0, 0};
+        DWORD written;
+        fflush(stdout);
+        if (GetConsoleScreenBufferInfo(console, &info)) {
+            DWORD cells = (DWORD)info.dwSize.X * info.dwSize.Y;
+            FillConsoleOutputCharacter(console, ' ', cells, origin, &written);
+            FillConsoleOutputAttribute(console, info.wAttributes, cells, origin, &written);
+            SetConsoleCursorPosition(console, origin);
+        }
+    }
+#endif
+}
+
 // Utility functions
 void safe_string_input(char *buffer, size_t buffer_size) {
+    fflush(stdout);
     if (fgets(buffer, buffer_size, stdin) != NULL) {
         // Remove newline character if present
         size_t len = strlen(buffer);
@@ -13,7 +69,7 @@ void safe_string_input(char *buffer, size_t buffer_size) {
 
 int safe_int_input(void) {
     int value;
-    while (scanf("%d", &value) != 1) {
+    while (ui_scanf("%d", &value) != 1) {
         printf("Invalid input. Please enter a number: ");
         clear_input_buffer();
     }
@@ -23,7 +79,7 @@ int safe_int_input(void) {
 
 float safe_float_input(void) {
     float value;
-    while (scanf("%f", &value) != 1) {
+    while (ui_scanf("%f", &value) != 1) {
         printf("Invalid input. Please enter a number: ");
         clear_input_buffer();
     }
@@ -36,14 +92,17 @@ void clear_input_buffer(void) {
     while ((c = getchar()) != '\n' && c != EOF);
 }
 
-#ifdef _WIN32
 void set_console_color(int color) {
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    SetConsoleTextAttribute(hConsole, color);
-}
-#else
-void set_console_color(int color) {
-    // For non-Windows systems, use ANSI colors
+    if (!ui_color_enabled) return;
+#ifdef _WIN32
+    if (!ui_ansi) {
+        // Console attributes apply immediately, so the text before them goes out first
+        fflush(stdout);
+        SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), color);
+        return;
+    }
+#endif
+    // ANSI colors
     switch(color) {
         case 2: printf("\033[0;32m"); break; // Green
         case 3: printf("\033[0;33m"); break; // Yellow
@@ -52,7 +111,6 @@ void set_console_color(int color) {
         default: printf("\033[0m"); break;   // Reset
     }
 }
-#endif
 
 void print_header(const char* title) {
     set_console_color(3);
@@ -65,15 +123,246 @@ void print_header(const char* title) {
 
 void pause_screen(void) {
     printf("\nPress any key to continue...");
+    fflush(stdout);
     #ifdef _WIN32
         getch();
-        system("cls");
     #else
         getchar();
-        system("clear");
     #endif
+    clear_screen();
+}
+
+// Table rendering functions
+// Each listing declares its columns once as an X-macro list of
+// (title, width, kind, expression). DEFINE_TABLE expands that list into the
+// header layout and a row function with the widths and cell formatters
+// inlined, so display and search screens share one definition and no format
+// string is parsed per row.
+static TableWriter table_writer;
+
+static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Writes the decimal digits of value to dst and returns how many were written
+static int format_unsigned(char *dst, unsigned long long value) {
+    char digits[20];
+    int pos = 20;
+    while (value >= 100) {
+        unsigned int pair = (unsigned int)(value % 100) * 2;
+        value /= 100;
+        digits[--pos] = digit_pairs[pair + 1];
+        digits[--pos] = digit_pairs[pair];
+    }
+    if (value >= 10) {
+        digits[--pos] = digit_pairs[value * 2 + 1];
+        digits[--pos] = digit_pairs[value * 2];
+    } else {
+        digits[--pos] = (char)('0' + value);
+    }
+    memcpy(dst, digits + pos, (size_t)(20 - pos));
+    return 20 - pos;
+}
+
+static int format_signed(char *dst, long long value) {
+    if (value < 0) {
+        dst[0] = '-';
+        return 1 + format_unsigned(dst + 1, 0ULL - (unsigned long long)value);
+    }
+    return format_unsigned(dst, (unsigned long long)value);
+}
+
+// Two-digit zero-padded field (day, month, hour, minute)
+static char *format_pair(char *dst, int value) {
+    if (value < 0 || value > 99) return dst + format_signed(dst, value);
+    dst[0] = digit_pairs[value * 2];
+    dst[1] = digit_pairs[value * 2 + 1];
+    return dst + 2;
+}
+
+TableWriter* table_begin(FILE *out) {
+    table_writer.out = out;
+    table_writer.length = 0;
+    return &table_writer;
+}
+
+void table_flush(TableWriter *writer) {
+    if (writer->length > 0) {
+        fwrite(writer->buffer, 1, writer->length, writer->out);
+        writer->length = 0;
+    }
+}
+
+// Pads the cell that started at start to width and adds the column gap
+static void table_pad(TableWriter *writer, size_t start, int width) {
+    size_t used = writer->length - start;
+    while (used < (size_t)width) {
+        writer->buffer[writer->length++] = ' ';
+        used++;
+    }
+    writer->buffer[writer->length++] = ' ';
+}
+
+static void table_put_int(TableWriter *writer, long long value, int width) {
+    size_t start = writer->length;
+    writer->length += format_signed(writer->buffer + writer->length, value);
+    table_pad(writer, start, width);
+}
+
+// Two decimals, rounded half away from zero. Returns the end of the text.
+// NaN, infinities and amounts too large for exact cents go through
+// snprintf instead, in exponent form if the digits would not fit.
+static char *format_money(char *dst, double value) {
+    if (!(value > -MONEY_EXACT_LIMIT && value < MONEY_EXACT_LIMIT)) {
+        int length = snprintf(dst, MONEY_TEXT_MAX, "%.2f", value);
+        if (length >= MONEY_TEXT_MAX) length = snprintf(dst, MONEY_TEXT_MAX, "%.6e", value);
+        return dst + length;
+    }
+    if (value < 0) {
+        *dst++ = '-';
+        value = -value;
+    }
+    unsigned long long cents = (unsigned long long)(value * 100.0 + 0.5);
+    dst += format_unsigned(dst, cents / 100);
+    *dst++ = '.';
+    return format_pair(dst, (int)(cents % 100));
+}
+
+static void table_put_money(TableWriter *writer, double value, int width) {
+    size_t start = writer->length;
+    writer->length = (size_t)(format_money(writer->buffer + writer->length, value) - writer->buffer);
+    table_pad(writer, start, width);
+}
+
+static void table_put_text(TableWriter *writer, const char *text, int width) {
+    size_t start = writer->length;
+    size_t length = strlen(text);
+    if (length > MAX_STRING_LENGTH) length = MAX_STRING_LENGTH;
+    memcpy(writer->buffer + writer->length, text, length);
+    writer->length += length;
+    table_pad(writer, start, width);
+}
+
+static void table_put_date(TableWriter *writer, PurchaseDate date, int width) {
+    size_t start = writer->length;
+    char *p = writer->buffer + writer->length;
+    p = format_pair(p, date.day);
+    *p++ = '/';
+    p = format_pair(p, date.month);
+    *p++ = '/';
+    p += format_signed(p, date.year);
+    writer->length = (size_t)(p - writer->buffer);
+    table_pad(writer, start, width);
+}
+
+static void table_put_datetime(TableWriter *writer, DateTime time, int width) {
+    size_t start = writer->length;
+    char *p = writer->buffer + writer->length;
+    p = format_pair(p, time.day);
+    *p++ = '/';
+    p = format_pair(p, time.month);
+    *p++ = '/';
+    p += format_signed(p, time.year);
+    *p++ = ' ';
+    p = format_pair(p, time.hour);
+    *p++ = ':';
+    p = format_pair(p, time.minute);
+    writer->length = (size_t)(p - writer->buffer);
+    table_pad(writer, start, width);
+}
+
+// Drops the trailing padding, ends the line and flushes when the next row
+// might not fit
+static void table_end_row(TableWriter *writer) {
+    while (writer->length > 0 && writer->buffer[writer->length - 1] == ' ') {
+        writer->length--;
+    }
+    writer->buffer[writer->length++] = '\n';
+    if (writer->length + TABLE_ROW_RESERVE > TABLE_BUFFER_SIZE) {
+        table_flush(writer);
+    }
+}
+
+// Column titles underlined with '=', then flushed so the caller can switch
+// colours around it
+void table_header(TableWriter *writer, const TableColumn *columns, int count) {
+    for (int i = 0; i < count; i++) {
+        table_put_text(writer, columns[i].title, columns[i].width);
+    }
+    table_end_row(writer);
+    for (int i = 0; i < count; i++) {
+        size_t start = writer->length;
+        size_t length = strlen(columns[i].title);
+        memset(writer->buffer + writer->length, '=', length);
+        writer->length += length;
+        table_pad(writer, start, columns[i].width);
+    }
+    table_end_row(writer);
+    table_flush(writer);
+}
+
+#define TABLE_COLUMN_SPEC(title, width, kind, expr) { title, width },
+#define TABLE_COLUMN_CELL(title, width, kind, expr) table_put_##kind(writer, (expr), width);
+#define TABLE_COLUMN_COUNT(name) ((int)(sizeof(name##_columns) / sizeof(name##_columns[0])))
+#define TABLE_HEADER(writer, name) table_header(writer, name##_columns, TABLE_COLUMN_COUNT(name))
+
+#define DEFINE_TABLE(name, row_type, context_type, COLUMNS)                          \
+    static const TableColumn name##_columns[] = { COLUMNS(TABLE_COLUMN_SPEC) };      \
+    static void name##_row(TableWriter *writer, const row_type *row, context_type context) { \
+        (void)context;                                                               \
+        COLUMNS(TABLE_COLUMN_CELL)                                                   \
+        table_end_row(writer);                                                       \
+    }
+
+static const char *employee_function_name(const Employee *employee, const Function *functions) {
+    for (const Function *func = functions; func != NULL; func = func->next) {
+        if (func->function_id == employee->function_id) return func->function_name;
+    }
+    return "Unknown";
 }
 
+#define BUS_TABLE_COLUMNS(COL)                                      \
+    COL("License Plate", 15, int, row->license_plate)               \
+    COL("Price ($)", 15, money, row->price)                         \
+    COL("Purchase Date", 15, date, row->purchase_date)              \
+    COL("Seats", 15, int, row->seat_count)
+
+#define CLIENT_TABLE_COLUMNS(COL)                                   \
+    COL("ID", 10, int, row->client_id)                              \
+    COL("First Name", 15, text, row->first_name)                    \
+    COL("Last Name", 15, text, row->last_name)                      \
+    COL("Phone", 15, text, row->phone)                              \
+    COL("City", 15, text, row->city)                                \
+    COL("Province", 30, text, row->province)                        \
+    COL("Postal Code", 10, int, row->postal_code)
+
+#define EMPLOYEE_TABLE_COLUMNS(COL)                                 \
+    COL("ID", 10, int, row->employee_id)                            \
+    COL("First Name", 15, text, row->first_name)                    \
+    COL("Last Name", 15, text, row->last_name)                      \
+    COL("Phone", 15, text, row->phone)                              \
+    COL("Function", 15, text, employee_function_name(row, context))
+
+#define FUNCTION_TABLE_COLUMNS(COL)                                 \
+    COL("ID", 10, int, row->function_id)                            \
+    COL("Function Name", 20, text, row->function_name)              \
+    COL("Salary ($)", 15, money, row->salary)
+
+#define TRIP_TABLE_COLUMNS(COL)                                     \
+    COL("Bus", 10, int, row->license_plate)                         \
+    COL("Client", 10, int, row->client_id)                          \
+    COL("Departure", 15, text, row->departure_city)                 \
+    COL("Arrival", 15, text, row->arrival_city)                     \
+    COL("Departure Time", 20, datetime, row->departure_time)        \
+    COL("Arrival Time", 20, datetime, row->arrival_time)
+
+DEFINE_TABLE(bus_table, Bus, const void *, BUS_TABLE_COLUMNS)
+DEFINE_TABLE(client_table, Client, const void *, CLIENT_TABLE_COLUMNS)
+DEFINE_TABLE(employee_table, Employee, const Function *, EMPLOYEE_TABLE_COLUMNS)
+DEFINE_TABLE(function_table, Function, const void *, FUNCTION_TABLE_COLUMNS)
+DEFINE_TABLE(trip_table, Trip, const void *, TRIP_TABLE_COLUMNS)
+
 // Date validation functions
 int is_leap_year(int year) {
     return (year % 4 == 0 && year % 100 != 0) || (year % 400 == 0);
@@ -164,53 +453,427 @@ void secure_encrypt_password(char *password, char *encrypted_password) {
     strcpy(encrypted_password, hex_output);
 }
 
+static unsigned long long mix64(unsigned long long x) {
+    x ^= x >> 30;
+    x *= 0xBF58476D1CE4E5B9ULL;
+    x ^= x >> 27;
+    x *= 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static unsigned long long fnv1a64(const char *text) {
+    unsigned long long hash = 0xCBF29CE484222325ULL;
+    while (*text) {
+        hash ^= (unsigned char)*text++;
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+// SHA-256 (FIPS 180-4), used only through PBKDF2 below
+typedef struct Sha256 {
+    unsigned int state[8];
+    unsigned char block[64];
+    size_t block_length;
+    unsigned long long total_length;
+} Sha256;
+
+static const unsigned int sha256_k[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define SHA256_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_compress(unsigned int state[8], const unsigned char *block) {
+    unsigned int w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (unsigned int)block[i * 4] << 24 | (unsigned int)block[i * 4 + 1] << 16 |
+               (unsigned int)block[i * 4 + 2] << 8 | (unsigned int)block[i * 4 + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        unsigned int s0 = SHA256_ROTR(w[i - 15], 7) ^ SHA256_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        unsigned int s1 = SHA256_ROTR(w[i - 2], 17) ^ SHA256_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    unsigned int a = state[0], b = state[1], c = state[2], d = state[3];
+    unsigned int e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        unsigned int t1 = h + (SHA256_ROTR(e, 6) ^ SHA256_ROTR(e, 11) ^ SHA256_ROTR(e, 25)) +
+                          ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        unsigned int t2 = (SHA256_ROTR(a, 2) ^ SHA256_ROTR(a, 13) ^ SHA256_ROTR(a, 22)) +
+                          ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+static void sha256_init(Sha256 *ctx) {
+    static const unsigned int initial[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->block_length = 0;
+    ctx->total_length = 0;
+}
+
+static void sha256_update(Sha256 *ctx, const unsigned char *data, size_t length) {
+    ctx->total_length += length;
+    while (length > 0) {
+        size_t take = 64 - ctx->block_length;
+        if (take > length) take = length;
+        memcpy(ctx->block + ctx->block_length, data, take);
+        ctx->block_length += take;
+        data += take;
+        length -= take;
+        if (ctx->block_length == 64) {
+            sha256_compress(ctx->state, ctx->block);
+            ctx->block_length = 0;
+        }
+    }
+}
+
+static void sha256_final(Sha256 *ctx, unsigned char digest[32]) {
+    unsigned long long bits = ctx->total_length * 8;
+    unsigned char pad = 0x80;
+    sha256_update(ctx, &pad, 1);
+    pad = 0;
+    while (ctx->block_length != 56) sha256_update(ctx, &pad, 1);
+    unsigned char length[8];
+    for (int i = 0; i < 8; i++) length[i] = (unsigned char)(bits >> (56 - 8 * i));
+    sha256_update(ctx, length, 8);
+    for (int i = 0; i < 8; i++) {
+        digest[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+        digest[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+        digest[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+        digest[i * 4 + 3] = (unsigned char)ctx->state[i];
+    }
+}
+
+// HMAC-SHA256 with the padded key blocks hashed once, so every PBKDF2
+// iteration costs two compressions
+typedef struct HmacSha256 {
+    Sha256 inner;
+    Sha256 outer;
+} HmacSha256;
+
+static void hmac_sha256_init(HmacSha256 *mac, const unsigned char *key, size_t key_length) {
+    unsigned char hashed_key[32], pad[64];
+    if (key_length > 64) {
+        Sha256 ctx;
+        sha256_init(&ctx);
+        sha256_update(&ctx, key, key_length);
+        sha256_final(&ctx, hashed_key);
+        key = hashed_key;
+        key_length = 32;
+    }
+    memset(pad, 0x36, sizeof(pad));
+    for (size_t i = 0; i < key_length; i++) pad[i] ^= key[i];
+    sha256_init(&mac->inner);
+    sha256_update(&mac->inner, pad, sizeof(pad));
+    memset(pad, 0x5c, sizeof(pad));
+    for (size_t i = 0; i < key_length; i++) pad[i] ^= key[i];
+    sha256_init(&mac->outer);
+    sha256_update(&mac->outer, pad, sizeof(pad));
+}
+
+static void hmac_sha256(const HmacSha256 *mac, const unsigned char *message, size_t length, unsigned char out[32]) {
+    Sha256 ctx = mac->inner;
+    sha256_update(&ctx, message, length);
+    sha256_final(&ctx, out);
+    ctx = mac->outer;
+    sha256_update(&ctx, out, 32);
+    sha256_final(&ctx, out);
+}
+
+// PBKDF2-HMAC-SHA256 (RFC 8018) with a single 32-byte output block
+static void pbkdf2_sha256(const char *password, const char *salt, unsigned long iterations, unsigned char out[32]) {
+    HmacSha256 mac;
+    hmac_sha256_init(&mac, (const unsigned char*)password, strlen(password));
+
+    unsigned char first[MAX_STRING_LENGTH + 4], u[32];
+    size_t salt_length = strlen(salt);
+    if (salt_length > MAX_STRING_LENGTH) salt_length = MAX_STRING_LENGTH;
+    memcpy(first, salt, salt_length);
+    first[salt_length] = 0;
+    first[salt_length + 1] = 0;
+    first[salt_length + 2] = 0;
+    first[salt_length + 3] = 1;
+    hmac_sha256(&mac, first, salt_length + 4, u);
+    memcpy(out, u, 32);
+    for (unsigned long i = 1; i < iterations; i++) {
+        hmac_sha256(&mac, u, 32, u);
+        for (int k = 0; k < 32; k++) out[k] ^= u[k];
+    }
+}
+
+// Compares without returning early, so the time taken does not tell how
+// many leading characters matched
+static int constant_time_equals(const char *a, const char *b) {
+    size_t length_a = strlen(a), length_b = strlen(b);
+    unsigned char difference = length_a != length_b;
+    size_t length = length_a < length_b ? length_a : length_b;
+    for (size_t i = 0; i < length; i++) difference |= (unsigned char)(a[i] ^ b[i]);
+    return difference == 0;
+}
+
+// Stored as $pbkdf2-sha256$<iterations>$<salt>$<hash>, iterations = 2^cost.
+// Two older formats are still accepted at login and replaced by this one:
+// $s1$<cost>$<salt>$<hash> (a 64-bit mixer) and the original unprefixed
+// secure_encrypt_password text.
+static void legacy_stretch_password(const char *password, const char *salt, int cost, char *digest) {
+    unsigned long long key = fnv1a64(password);
+    unsigned long long a = fnv1a64(salt) ^ key;
+    unsigned long long b = mix64(a ^ 0x9E3779B97F4A7C15ULL);
+    unsigned long long rounds = 1ULL << cost;
+    for (unsigned long long i = 0; i < rounds; i++) {
+        a = mix64(a + key + i);
+        b = mix64(b ^ a);
+    }
+    sprintf(digest, "%016llx%016llx", a, b);
+}
+
+static void make_salt(char *salt) {
+    static unsigned long long counter = 0;
+    unsigned long long value[2] = {0, 0};
+    FILE *random = fopen("/dev/urandom", "rb");
+    if (random != NULL) {
+        if (fread(value, sizeof(value), 1, random) != 1) value[0] = value[1] = 0;
+        fclose(random);
+    }
+    // Without /dev/urandom (Windows) fall back to time and a counter
+    value[0] ^= mix64((unsigned long long)time(NULL) ^ ((unsigned long long)clock() << 32) ^ ++counter);
+    value[1] ^= mix64(value[0] ^ ++counter);
+    sprintf(salt, "%016llx%016llx", value[0], value[1]);
+}
+
+int password_hash_cost(void) {
+    const char *setting = getenv("BUSFLOW_HASH_COST");
+    int cost = setting != NULL ? atoi(setting) : DEFAULT_PASSWORD_COST;
+    if (cost < MIN_PASSWORD_COST) cost = MIN_PASSWORD_COST;
+    if (cost > MAX_PASSWORD_COST) cost = MAX_PASSWORD_COST;
+    return cost;
+}
+
+void make_password_hash(const char *password, int cost, char *hash) {
+    char salt[33];
+    unsigned char derived[32];
+    make_salt(salt);
+    unsigned long iterations = 1UL << cost;
+    pbkdf2_sha256(password, salt, iterations, derived);
+    int length = sprintf(hash, "%s%lu$%s$", PASSWORD_HASH_PREFIX, iterations, salt);
+    for (int i = 0; i < 32; i++) length += sprintf(hash + length, "%02x", derived[i]);
+}
+
+// Reads the iteration count of a current-format hash, 0 for anything else
+static unsigned long password_hash_iterations(const char *stored_hash) {
+    size_t prefix_length = strlen(PASSWORD_HASH_PREFIX);
+    unsigned long iterations;
+    if (strncmp(stored_hash, PASSWORD_HASH_PREFIX, prefix_length) != 0 ||
+        sscanf(stored_hash + prefix_length, "%lu$", &iterations) != 1 ||
+        iterations < 1UL << MIN_PASSWORD_COST || iterations > 1UL << MAX_PASSWORD_COST) {
+        return 0;
+    }
+    return iterations;
+}
+
+int password_matches(const char *password, const char *stored_hash) {
+    char computed[MAX_STRING_LENGTH * 2];
+    unsigned long iterations = password_hash_iterations(stored_hash);
+    if (iterations > 0) {
+        char salt[33], digest[65];
+        if (sscanf(stored_hash + strlen(PASSWORD_HASH_PREFIX), "%*u$%32[0-9a-f]$%64[0-9a-f]", salt, digest) != 2 ||
+            strlen(digest) != 64) {
+            return 0;
+        }
+        unsigned char derived[32];
+        pbkdf2_sha256(password, salt, iterations, derived);
+        for (int i = 0; i < 32; i++) sprintf(computed + i * 2, "%02x", derived[i]);
+        return constant_time_equals(digest, computed);
+    }
+
+    size_t prefix_length = strlen(LEGACY_HASH_PREFIX);
+    if (strncmp(stored_hash, LEGACY_HASH_PREFIX, prefix_length) != 0) {
+        char plain[MAX_STRING_LENGTH];
+        snprintf(plain, sizeof(plain), "%s", password);
+        secure_encrypt_password(plain, computed);
+        return constant_time_equals(stored_hash, computed);
+    }
+
+    int cost;
+    char salt[17], digest[33];
+    if (sscanf(stored_hash + prefix_length, "%d$%16[0-9a-f]$%32[0-9a-f]", &cost, salt, digest) != 3 ||
+        cost < LEGACY_MIN_COST || cost > MAX_PASSWORD_COST) {
+        return 0;
+    }
+    legacy_stretch_password(password, salt, cost, computed);
+    return constant_time_equals(digest, computed);
+}
+
+// Older formats and hashes cheaper than the current cost are redone at login
+int password_needs_rehash(const char *stored_hash) {
+    return password_hash_iterations(stored_hash) < 1UL << password_hash_cost();
+}
+
+// User store functions
+void user_store_init(UserStore *store) {
+    memset(store, 0, sizeof(UserStore));
+}
+
+void user_store_free(UserStore *store) {
+    free(store->users);
+    free(store->slots);
+    memset(store, 0, sizeof(UserStore));
+}
+
+static unsigned int user_slot(const char *username, unsigned int mask) {
+    return (unsigned int)fnv1a64(username) & mask;
+}
+
+User* user_store_find(const UserStore *store, const char *username) {
+    if (store->slot_capacity == 0) return NULL;
+    unsigned int mask = store->slot_capacity - 1;
+    for (unsigned int i = user_slot(username, mask); store->slots[i] >= 0; i = (i + 1) & mask) {
+        User *user = &store->users[store->slots[i]];
+        if (strcmp(user->username, username) == 0) return user;
+    }
+    return NULL;
+}
+
+static int user_store_grow_index(UserStore *store) {
+    unsigned int new_capacity = store->slot_capacity ? store->slot_capacity * 2 : 256;
+    int *slots = (int*)malloc(new_capacity * sizeof(int));
+    if (slots == NULL) return -1;
+    for (unsigned int i = 0; i < new_capacity; i++) slots[i] = -1;
+    unsigned int mask = new_capacity - 1;
+    for (int index = 0; index < store->count; index++) {
+        unsigned int i = user_slot(store->users[index].username, mask);
+        while (slots[i] >= 0) i = (i + 1) & mask;
+        slots[i] = index;
+    }
+    free(store->slots);
+    store->slots = slots;
+    store->slot_capacity = new_capacity;
+    return 0;
+}
+
+// Returns 1 if added, 0 if the username is taken, -1 on allocation failure
+int user_store_add(UserStore *store, const char *username, const char *password_hash) {
+    if (user_store_find(store, username) != NULL) return 0;
+    if (store->count == store->capacity) {
+        int new_capacity = store->capacity ? store->capacity * 2 : 64;
+        User *grown = (User*)realloc(store->users, new_capacity * sizeof(User));
+        if (grown == NULL) return -1;
+        store->users = grown;
+        store->capacity = new_capacity;
+    }
+    if ((unsigned int)(store->count + 1) * 4 > store->slot_capacity * 3 && user_store_grow_index(store) != 0) {
+        return -1;
+    }
+
+    User *user = &store->users[store->count];
+    snprintf(user->username, sizeof(user->username), "%s", username);
+    snprintf(user->password, sizeof(user->password), "%s", password_hash);
+    unsigned int mask = store->slot_capacity - 1;
+    unsigned int i = user_slot(user->username, mask);
+    while (store->slots[i] >= 0) i = (i + 1) & mask;
+    store->slots[i] = store->count++;
+    return 1;
+}
+
 // User authentication functions
-void write_users_to_file(User users[], int num_users) {
+void write_users_to_file(const UserStore *store) {
     FILE *fp = fopen(FILENAME, "w");
     if (fp == NULL) {
          return;
     }
 
-    for (int i = 0; i < num_users; i++) {
+    for (int i = 0; i < store->count; i++) {
         // Users array already contains encrypted passwords, write them directly
-        fprintf(fp, "%s %s\n", users[i].username, users[i].password);
+        fprintf(fp, "%s %s\n", store->users[i].username, store->users[i].password);
     }
 
     fclose(fp);
 }
 
-int read_users_from_file(User users[]) {
-    FILE *fp = fopen(FILENAME, "r");
-    if (fp == NULL) {
-        return 0;
-    }
+#ifndef _WIN32
+// Appends and the rehash rewrite hold an exclusive flock on <users file>.lock,
+// which outlives the renames, so a rewrite cannot drop an account another
+// process appends meanwhile. Returns the descriptor to close, or -1.
+static int users_file_lock(void) {
+    char path[MAX_STRING_LENGTH];
+    snprintf(path, sizeof(path), "%s.lock", FILENAME);
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+#endif
 
-    fseek(fp, 0L, SEEK_END);
-    if (ftell(fp) == 0) {
-        fclose(fp);
-        return 0;
-    }
-    rewind(fp);
+// New accounts are appended, so registering never rewrites the file
+int append_user_to_file(const User *user) {
+#ifndef _WIN32
+    int lock = users_file_lock();
+    if (lock < 0) return -1;
+#endif
+    FILE *fp = fopen(FILENAME, "a");
+    int written = -1;
+    if (fp != NULL) {
+        written = fprintf(fp, "%s %s\n", user->username, user->password);
+        if (fclose(fp) != 0) written = -1;
+    }
+#ifndef _WIN32
+    close(lock);
+#endif
+    return written < 0 ? -1 : 0;
+}
 
-    int num_users = 0;
-    char username[MAX_STRING_LENGTH], encrypted_password[MAX_STRING_LENGTH * 2];
-    while (fscanf(fp, "%99s %199s", username, encrypted_password) == 2 && num_users < MAX_USERS) {
-        strncpy(users[num_users].username, username, MAX_STRING_LENGTH - 1);
-        users[num_users].username[MAX_STRING_LENGTH - 1] = '\0';
-        
-        // Store the encrypted password hash directly (no decryption needed)
-        strncpy(users[num_users].password, encrypted_password, MAX_STRING_LENGTH * 2 - 1);
-        users[num_users].password[MAX_STRING_LENGTH * 2 - 1] = '\0';
-        
-        num_users++;
+// One "username hash" per line; for a repeated username the first line wins
+static int read_users_from_stream(UserStore *store, FILE *fp) {
+    char line[MAX_STRING_LENGTH * 4];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        char *username = strtok(line, " \t\r\n");
+        char *password_hash = strtok(NULL, " \t\r\n");
+        if (username == NULL || password_hash == NULL) continue;
+        if (user_store_add(store, username, password_hash) < 0) break;
     }
+    return store->count;
+}
 
+int read_users_from_file(UserStore *store) {
+    FILE *fp = fopen(FILENAME, "r");
+    if (fp == NULL) {
+        return 0;
+    }
+    read_users_from_stream(store, fp);
     fclose(fp);
-    return num_users;
+    return store->count;
 }
 
-int authenticate_user(User users[], int num_users) {
-    if (num_users == 0) {
+int authenticate_user(UserStore *store) {
+    if (store->count == 0) {
         printf("No users registered yet. Please register first.\n");
         return 0;
     }
@@ -218,48 +881,87 @@ int authenticate_user(User users[], int num_users) {
     char username[MAX_STRING_LENGTH], password[MAX_STRING_LENGTH];
     
     printf("Enter username: ");
-    scanf("%99s", username);
+    ui_scanf("%99s", username);
     printf("Enter password: ");
-    scanf("%99s", password);
+    ui_scanf("%99s", password);
 
-    for (int i = 0; i < num_users; i++) {
-        if (strcmp(users[i].username, username) == 0) {
-            // Verify password using the secure verification method
-            char computed_hash[MAX_STRING_LENGTH * 2];
-            secure_encrypt_password(password, computed_hash);
-            
-            if (strcmp(users[i].password, computed_hash) == 0) {
-                return 1; // Authentication successful
-            }
-            break; // Username found but password doesn't match
+    return check_credentials(store, username, password);
+}
+
+// Replaces the first line of user's name through a temporary file and a
+// rename. Callers hold the users file lock, so accounts other processes
+// appended since this one read the file are kept.
+static int replace_user_line(const User *user) {
+    FILE *in = fopen(FILENAME, "r");
+    if (in == NULL) return -1;
+    char temp_path[MAX_STRING_LENGTH];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", FILENAME);
+    FILE *out = fopen(temp_path, "w");
+    if (out == NULL) {
+        fclose(in);
+        return -1;
+    }
+
+    char line[MAX_STRING_LENGTH * 4], username[MAX_STRING_LENGTH];
+    int replaced = 0;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        // The first line of a username is the one that counts
+        if (!replaced && sscanf(line, "%99s", username) == 1 && strcmp(username, user->username) == 0) {
+            fprintf(out, "%s %s\n", user->username, user->password);
+            replaced = 1;
+        } else {
+            fputs(line, out);
         }
     }
-    return 0; // Authentication failed
+    fclose(in);
+    int failed = ferror(out) || !replaced;
+    if (fclose(out) != 0) failed = 1;
+    if (failed || rename(temp_path, FILENAME) != 0) {
+        remove(temp_path);
+        return -1;
+    }
+    return 0;
 }
 
-void register_user(User users[], int *num_users) {
-    if (*num_users >= MAX_USERS) {
-        printf("Maximum number of users reached (%d).\n", MAX_USERS);
-        return;
+int update_user_in_file(const User *user) {
+#ifdef _WIN32
+    return replace_user_line(user);
+#else
+    int lock = users_file_lock();
+    if (lock < 0) return -1;
+    int result = replace_user_line(user);
+    close(lock);
+    return result;
+#endif
+}
+
+// A successful login with an older hash format stores a new hash while the
+// plain password is at hand
+int check_credentials(UserStore *store, const char *username, const char *password) {
+    User *user = user_store_find(store, username);
+    if (user == NULL || !password_matches(password, user->password)) return 0;
+    if (password_needs_rehash(user->password)) {
+        User upgraded = *user;
+        make_password_hash(password, password_hash_cost(), upgraded.password);
+        if (update_user_in_file(&upgraded) == 0) {
+            *user = upgraded;
+        } else {
+            fprintf(stderr, "Warning: could not update %s; the password keeps its old hash.\n", FILENAME);
+        }
     }
+    return 1;
+}
 
+void register_user(UserStore *store) {
     print_header("REGISTER NEW ACCOUNT - ADVANCED ENCRYPTION");
     
     char new_username[MAX_STRING_LENGTH], new_password[MAX_STRING_LENGTH];
     
     while (1) {
         printf("Enter username: ");
-        scanf("%99s", new_username);
-        
-        int username_exists = 0;
-        for (int i = 0; i < *num_users; i++) {
-            if (strcmp(users[i].username, new_username) == 0) {
-                username_exists = 1;
-                break;
-            }
-        }
+        ui_scanf("%99s", new_username);
         
-        if (username_exists) {
+        if (user_store_find(store, new_username) != NULL) {
             printf("Username '%s' already exists. Please choose a different username.\n", new_username);
         } else {
             break;
@@ -267,649 +969,1386 @@ void register_user(User users[], int *num_users) {
     }
 
     printf("Enter password: ");
-    scanf("%99s", new_password);
+    ui_scanf("%99s", new_password);
 
-    // Store username
-    strncpy(users[*num_users].username, new_username, MAX_STRING_LENGTH - 1);
-    users[*num_users].username[MAX_STRING_LENGTH - 1] = '\0';
-    
-    // Encrypt password and store the encrypted version in memory
-    char encrypted_password[MAX_STRING_LENGTH * 2];
-    secure_encrypt_password(new_password, encrypted_password);
-    strncpy(users[*num_users].password, encrypted_password, MAX_STRING_LENGTH * 2 - 1);
-    users[*num_users].password[MAX_STRING_LENGTH * 2 - 1] = '\0';
-    
-    (*num_users)++;
-    write_users_to_file(users, *num_users);
+    char password_hash[MAX_STRING_LENGTH * 2];
+    make_password_hash(new_password, password_hash_cost(), password_hash);
+    if (user_store_add(store, new_username, password_hash) != 1) {
+        printf("Memory allocation error. Cannot register user.\n");
+        return;
+    }
+    if (append_user_to_file(&store->users[store->count - 1]) != 0) {
+        printf("Warning: could not write %s; the account only lasts for this session.\n", FILENAME);
+    }
     printf("User '%s' registered successfully!\n", new_username);
     printf("You can now login with your credentials.\n");
 }
 
-// Bus management functions
-Bus* add_bus_at_beginning(Bus *head) {
-    Bus *new_bus = (Bus*)malloc(sizeof(Bus));
-    if (new_bus == NULL) {
-        printf("Memory allocation error.\n");
-        return head;
+// Slotted record storage functions
+// With BUSFLOW_STORAGE=slotted, buses, clients and employees live in
+// fixed-width slot files instead of the text files. The interactive menus
+// attach to them: every add, modify or delete writes the one slot it
+// touches with pwrite and frees or reuses slots through the free-slot list,
+// so an edit costs the same whatever the size of the table. Batch and
+// server sessions do not attach; their saves rewrite the file in list order.
+static int storage_mode_setting = -1;
+static SlotFile bus_slot_file = {BUS_SLOT_FILENAME, offsetof(Bus, next), 0, -1, 0, NULL, 0, 0, {0}};
+static SlotFile client_slot_file = {CLIENT_SLOT_FILENAME, offsetof(Client, next), 0, -1, 0, NULL, 0, 0, {0}};
+static SlotFile employee_slot_file = {EMPLOYEE_SLOT_FILENAME, offsetof(Employee, next), 0, -1, 0, NULL, 0, 0, {0}};
+
+static long data_file_size(const char *filename) {
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) return 0;
+    fseek(file, 0L, SEEK_END);
+    long size = ftell(file);
+    fclose(file);
+    return size > 0 ? size : 0;
+}
+
+// BUSFLOW_STORAGE selects "slotted" or "lsm"; anything else keeps the text files
+static int storage_mode(void) {
+#ifdef _WIN32
+    return STORAGE_TEXT;
+#else
+    if (storage_mode_setting < 0) {
+        const char *mode = getenv("BUSFLOW_STORAGE");
+        storage_mode_setting = STORAGE_TEXT;
+        if (mode != NULL && strcmp(mode, "slotted") == 0) storage_mode_setting = STORAGE_SLOTTED;
+        if (mode != NULL && strcmp(mode, "lsm") == 0) storage_mode_setting = STORAGE_LSM;
     }
+    return storage_mode_setting;
+#endif
+}
 
-    PurchaseDate date;
-    int license_exists;
+int slot_storage_enabled(void) {
+    return storage_mode() == STORAGE_SLOTTED;
+}
 
-    // Input and validate license plate
-    do {
-        license_exists = 0;
-        printf("Enter bus license plate number: ");
-        new_bus->license_plate = safe_int_input();
-        
-        Bus *temp = head;
-        while (temp != NULL) {
-            if (new_bus->license_plate == temp->license_plate) {
-                printf("License plate already exists. Please enter a different one.\n");
-                license_exists = 1;
-                break;
-            }
-            temp = temp->next;
-        }
-    } while (license_exists);
+// Size of whichever file currently holds an entity
+static long stored_data_size(const char *filename, const char *slot_filename) {
+    long size = slot_filename != NULL && slot_storage_enabled() ? data_file_size(slot_filename) : 0;
+    return size > 0 ? size : data_file_size(filename);
+}
 
-    printf("Enter bus purchase price: $");
-    new_bus->price = safe_float_input();
+// Called by the interactive session before it loads the lists
+void slot_storage_attach(void) {
+    if (!slot_storage_enabled()) return;
+    bus_slot_file.attached = 1;
+    client_slot_file.attached = 1;
+    employee_slot_file.attached = 1;
+}
 
-    // Input and validate purchase date
-    printf("Enter purchase date:\n");
-    do {
-        printf("Year (1900-2100): ");
-        date.year = safe_int_input();
-        printf("Month (1-12): ");
-        date.month = safe_int_input();
-        printf("Day: ");
-        date.day = safe_int_input();
-        
-        if (!is_valid_date(date.day, date.month, date.year)) {
-            printf("Invalid date. Please enter a valid date.\n");
-        }
-    } while (!is_valid_date(date.day, date.month, date.year));
+static size_t slot_size(const SlotFile *file) {
+    return sizeof(int) + file->record_size;
+}
 
-    new_bus->purchase_date = date;
+#ifndef _WIN32
+static void slot_file_detach(SlotFile *file) {
+    if (file->fd >= 0) close(file->fd);
+    file->fd = -1;
+    file->slot_count = 0;
+    file->free_count = 0;
+    id_set_free(&file->slots);
+}
 
-    printf("Enter number of seats: ");
-    new_bus->seat_count = safe_int_input();
+static void slot_file_index(SlotFile *file, int id, int slot) {
+    if (!file->attached) return;
+    if (id_set_add(&file->slots, id, (void*)(size_t)(slot + 1)) < 0) slot_file_detach(file);
+}
 
-    new_bus->next = head;
-    printf("Bus added successfully.\n");
-    return new_bus;
+static void slot_file_free_slot(SlotFile *file, int slot) {
+    if (file->free_count == file->free_capacity) {
+        int new_capacity = file->free_capacity ? file->free_capacity * 2 : 64;
+        int *grown = (int*)realloc(file->free_slots, new_capacity * sizeof(int));
+        if (grown == NULL) return; // the slot is simply not reused
+        file->free_slots = grown;
+        file->free_capacity = new_capacity;
+    }
+    file->free_slots[file->free_count++] = slot;
 }
 
-Bus* add_bus_at_end(Bus *head) {
-    Bus *new_bus = (Bus*)malloc(sizeof(Bus));
-    if (new_bus == NULL) {
-        printf("Memory allocation error. Cannot add bus.\n");
-        return head;
+// Opens the file for a sequential read and checks its header. Returns
+// NULL if it is missing or was written with another record layout.
+static FILE* slot_file_open_read(SlotFile *file) {
+    FILE *in = fopen(file->path, "rb");
+    if (in == NULL) return NULL;
+    unsigned int header[SLOT_HEADER_SIZE / sizeof(unsigned int)];
+    if (fread(header, 1, SLOT_HEADER_SIZE, in) != SLOT_HEADER_SIZE || header[0] != SLOT_FILE_MAGIC ||
+        header[1] != SLOT_FILE_VERSION || header[2] != slot_size(file)) {
+        fclose(in);
+        return NULL;
+    }
+    slot_file_detach(file);
+    return in;
+}
+
+// Reads up to the next used slot. Returns 1 with its number and record
+// image, or 0 at the end of the file.
+static int slot_file_next(SlotFile *file, FILE *in, int *slot, void *image) {
+    int status;
+    while (fread(&status, sizeof(int), 1, in) == 1 && fread(image, file->record_size, 1, in) == 1) {
+        int current = file->slot_count++;
+        if (status == SLOT_USED) {
+            *slot = current;
+            return 1;
+        }
+        if (file->attached) slot_file_free_slot(file, current);
     }
+    return 0;
+}
 
-    print_header("ADD NEW BUS");
-    
-    PurchaseDate date;
-    int license_exists;
+static void slot_file_finish_read(SlotFile *file, FILE *in) {
+    fclose(in);
+    if (file->attached) {
+        file->fd = open(file->path, O_RDWR);
+        if (file->fd < 0) slot_file_detach(file);
+    }
+}
 
-    // Input and validate license plate
-    do {
-        license_exists = 0;
-        printf("Enter bus license plate number: ");
-        new_bus->license_plate = safe_int_input();
-        
-        Bus *temp = head;
-        while (temp != NULL) {
-            if (new_bus->license_plate == temp->license_plate) {
-                printf("License plate %d already exists. Please enter a different one.\n", new_bus->license_plate);
-                license_exists = 1;
-                break;
-            }
-            temp = temp->next;
-        }
-    } while (license_exists);
-
-    printf("Enter bus purchase price: $");
-    new_bus->price = safe_float_input();
+// Full rewrite in list order through a temporary file and a rename
+static FILE* slot_file_begin_write(SlotFile *file, char *temp_path, size_t temp_size) {
+    snprintf(temp_path, temp_size, "%s.tmp", file->path);
+    FILE *out = fopen(temp_path, "wb");
+    if (out == NULL) return NULL;
+    unsigned int header[SLOT_HEADER_SIZE / sizeof(unsigned int)] = {SLOT_FILE_MAGIC, SLOT_FILE_VERSION, 0, 0};
+    header[2] = (unsigned int)slot_size(file);
+    fwrite(header, 1, SLOT_HEADER_SIZE, out);
+    return out;
+}
 
-    // Input and validate purchase date
-    printf("\nEnter purchase date:\n");
-    do {
-        printf("Year (1900-2100): ");
-        date.year = safe_int_input();
-        printf("Month (1-12): ");
-        date.month = safe_int_input();
-        printf("Day: ");
-        date.day = safe_int_input();
-        
-        if (!is_valid_date(date.day, date.month, date.year)) {
-            printf("Invalid date. Please enter a valid date.\n");
-        }
-    } while (!is_valid_date(date.day, date.month, date.year));
+static void slot_file_write(SlotFile *file, FILE *out, const void *record) {
+    int status = SLOT_USED;
+    fwrite(&status, sizeof(int), 1, out);
+    fwrite(record, file->record_size, 1, out);
+}
 
-    new_bus->purchase_date = date;
+// Returns 0 once the new file has replaced the old one
+static int slot_file_commit(SlotFile *file, FILE *out, const char *temp_path) {
+    int failed = ferror(out);
+    if (fclose(out) != 0) failed = 1;
+    if (failed || rename(temp_path, file->path) != 0) {
+        remove(temp_path);
+        return -1;
+    }
+    slot_file_detach(file);
+    if (file->attached) {
+        file->fd = open(file->path, O_RDWR);
+        if (file->fd < 0) return -1;
+    }
+    return 0;
+}
 
-    printf("Enter number of seats: ");
-    new_bus->seat_count = safe_int_input();
+static void slot_file_write_failed(SlotFile *file) {
+    printf("Warning: could not update %s; it will be rewritten on the next save.\n", file->path);
+    slot_file_detach(file);
+}
 
-    new_bus->next = NULL;
-    
-    if (head == NULL) {
-        printf("Bus added successfully! This is your first bus.\n");
-        return new_bus;
-    } else {
-        Bus *temp = head;
-        while (temp->next != NULL) {
-            temp = temp->next;
-        }
-        temp->next = new_bus;
-        printf("Bus added successfully!\n");
-        return head;
+// Writes one record into its slot, or into a free or new slot if it has
+// none yet: a single pwrite of status word and record image
+static void slot_file_put(SlotFile *file, int id, const void *record) {
+    if (!file->attached || file->fd < 0) return;
+    int slot = (int)(size_t)id_set_get(&file->slots, id) - 1;
+    int is_new = slot < 0;
+    if (is_new) slot = file->free_count > 0 ? file->free_slots[--file->free_count] : file->slot_count;
+
+    char buffer[sizeof(int) + sizeof(union { Bus bus; Client client; Employee employee; })];
+    int status = SLOT_USED;
+    memcpy(buffer, &status, sizeof(int));
+    memcpy(buffer + sizeof(int), record, file->record_size);
+    off_t offset = SLOT_HEADER_SIZE + (off_t)slot * (off_t)slot_size(file);
+    if (pwrite(file->fd, buffer, slot_size(file), offset) != (ssize_t)slot_size(file)) {
+        slot_file_write_failed(file);
+        return;
     }
+    if (slot == file->slot_count) file->slot_count++;
+    if (is_new) slot_file_index(file, id, slot);
 }
 
-void display_buses(Bus *head) {
-    if (head == NULL) {
-        printf("  No buses found in the system.\n");
-        printf("You need to add buses first to view them.\n");
-        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
+// Frees a record's slot: a single pwrite of its status word
+static void slot_file_remove(SlotFile *file, int id) {
+    if (!file->attached || file->fd < 0) return;
+    int slot = (int)(size_t)id_set_get(&file->slots, id) - 1;
+    if (slot < 0) return;
+
+    int status = SLOT_FREE;
+    off_t offset = SLOT_HEADER_SIZE + (off_t)slot * (off_t)slot_size(file);
+    if (pwrite(file->fd, &status, sizeof(int), offset) != (ssize_t)sizeof(int)) {
+        slot_file_write_failed(file);
         return;
     }
+    id_set_remove(&file->slots, id);
+    slot_file_free_slot(file, slot);
+}
+#endif
 
-    print_header("BUS FLEET OVERVIEW");
-    
-    // Count buses
-    int bus_count = 0;
-    Bus *temp = head;
-    while (temp != NULL) {
-        bus_count++;
-        temp = temp->next;
+// Expands to the typed load / save / put / remove wrappers for one entity
+#ifndef _WIN32
+#define DEFINE_SLOT_STORAGE(name, type, file, id_field)                          \
+    static type* name##_slots_load(int *found) {                                 \
+        FILE *in = slot_file_open_read(&file);                                   \
+        *found = in != NULL;                                                     \
+        if (in == NULL) return NULL;                                             \
+        type *head = NULL, *tail = NULL, image;                                  \
+        int slot;                                                                \
+        while (slot_file_next(&file, in, &slot, &image)) {                       \
+            type *record = (type*)malloc(sizeof(type));                          \
+            if (record == NULL) break;                                           \
+            *record = image;                                                     \
+            record->next = NULL;                                                 \
+            if (tail == NULL) head = record;                                     \
+            else tail->next = record;                                            \
+            tail = record;                                                       \
+            slot_file_index(&file, record->id_field, slot);                      \
+        }                                                                        \
+        slot_file_finish_read(&file, in);                                        \
+        return head;                                                             \
+    }                                                                            \
+    static void name##_slots_save(const type *head) {                            \
+        char temp_path[MAX_STRING_LENGTH];                                       \
+        FILE *out = slot_file_begin_write(&file, temp_path, sizeof(temp_path));  \
+        if (out == NULL) return;                                                 \
+        for (const type *record = head; record != NULL; record = record->next) { \
+            slot_file_write(&file, out, record);                                 \
+        }                                                                        \
+        if (slot_file_commit(&file, out, temp_path) != 0 || !file.attached) return; \
+        for (const type *record = head; record != NULL; record = record->next) { \
+            slot_file_index(&file, record->id_field, file.slot_count++);         \
+        }                                                                        \
+    }                                                                            \
+    static void name##_slot_put(const type *record) {                            \
+        slot_file_put(&file, record->id_field, record);                          \
+    }                                                                            \
+    static void name##_slot_remove(int id) {                                     \
+        slot_file_remove(&file, id);                                             \
     }
-    
-    printf("Total buses in fleet: %d\n\n", bus_count);
-    
-    set_console_color(2);
-    printf("%-15s %-15s %-15s %-15s\n", "License Plate", "Price ($)", "Purchase Date", "Seats");
-    printf("%-15s %-15s %-15s %-15s\n", "=============", "=========", "=============", "=====");
-    set_console_color(7);
+#else
+#define DEFINE_SLOT_STORAGE(name, type, file, id_field)                          \
+    static type* name##_slots_load(int *found) { *found = 0; return NULL; }     \
+    static void name##_slots_save(const type *head) { (void)head; }              \
+    static void name##_slot_put(const type *record) { (void)record; }            \
+    static void name##_slot_remove(int id) { (void)id; }
+#endif
 
-    temp = head;
-    while (temp != NULL) {
-        printf("%-15d %-15.2f %02d/%02d/%-8d  %-15d\n",
-               temp->license_plate,
-               temp->price,
-               temp->purchase_date.day,
-               temp->purchase_date.month,
-               temp->purchase_date.year,
-               temp->seat_count);
-        temp = temp->next;
-    }
+DEFINE_SLOT_STORAGE(bus, Bus, bus_slot_file, license_plate)
+DEFINE_SLOT_STORAGE(client, Client, client_slot_file, client_id)
+DEFINE_SLOT_STORAGE(employee, Employee, employee_slot_file, employee_id)
+
+// After the attached session has loaded its lists: writes the slot files
+// that did not exist yet (first run in slotted mode, from the text files)
+void slot_storage_convert(Bus *buses, Client *clients, Employee *employees) {
+    if (!slot_storage_enabled()) return;
+    if (bus_slot_file.fd < 0) bus_slots_save(buses);
+    if (client_slot_file.fd < 0) client_slots_save(clients);
+    if (employee_slot_file.fd < 0) employee_slots_save(employees);
 }
 
-Bus* modify_bus(Bus *head) {
-    if (head == NULL) {
-        printf("  No buses found in the system.\n");
-        printf("You need to add buses first before modifying them.\n");
-        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
-        return head;
-    }
+// Storage engine functions
+// With BUSFLOW_STORAGE=lsm, clients and employees are kept in record stores
+// instead of lists. The interactive session opens the stores at login and
+// the client and employee menus read and write them directly, so memory
+// use does not grow with those tables. The trip, template, booking and crew
+// menus look clients and employees up by id through find_client and
+// find_employee, which try the store before the (then empty) list. Batch
+// and server sessions load the stores into lists and write back only what
+// changed when they save.
+static RecordStore client_store;
+static RecordStore employee_store;
+// Store loads and saves that failed since lsm_storage_take_errors last ran
+static int lsm_storage_errors = 0;
+
+#ifndef _WIN32
+static void lsm_file_path(const LsmTree *tree, const char *suffix, char *path, size_t size) {
+    snprintf(path, size, "%s%s", tree->path, suffix);
+}
 
-    print_header("MODIFY BUS");
-    
-    int license_plate;
-    printf("Enter license plate of the bus to modify: ");
-    license_plate = safe_int_input();
+static void lsm_run_path(const LsmTree *tree, int sequence, char *path, size_t size) {
+    snprintf(path, size, "%s-%06d.run", tree->path, sequence);
+}
 
-    Bus *temp = head;
-    while (temp != NULL && temp->license_plate != license_plate) {
-        temp = temp->next;
+static unsigned long long lsm_key_hash(int key) {
+    return mix64((unsigned long long)(unsigned int)key + 0x9E3779B97F4A7C15ULL);
+}
+
+// Double hashing: probe i is hash + i * step
+static void lsm_bloom_add(unsigned long long *bloom, unsigned int bits, int key) {
+    unsigned long long hash = lsm_key_hash(key);
+    unsigned long long step = (hash >> 32) | 1;
+    for (int i = 0; i < LSM_BLOOM_HASHES; i++, hash += step) {
+        unsigned int bit = (unsigned int)(hash % bits);
+        bloom[bit / 64] |= 1ULL << (bit % 64);
     }
+}
 
-    if (temp == NULL) {
-        printf("Bus with license plate %d not found.\n", license_plate);
-        printf("Tip: Check the license plate number and try again.\n");
-        return head;
+static int lsm_bloom_test(const LsmRun *run, int key) {
+    unsigned long long hash = lsm_key_hash(key);
+    unsigned long long step = (hash >> 32) | 1;
+    for (int i = 0; i < LSM_BLOOM_HASHES; i++, hash += step) {
+        unsigned int bit = (unsigned int)(hash % run->bloom_bits);
+        if (!(run->bloom[bit / 64] & (1ULL << (bit % 64)))) return 0;
     }
+    return 1;
+}
 
-    // Show current bus details
-    printf("\nCurrent bus details:\n");
-    printf("License Plate: %d\n", temp->license_plate);
-    printf("Price: $%.2f\n", temp->price);
-    printf("Purchase Date: %02d/%02d/%d\n", temp->purchase_date.day, temp->purchase_date.month, temp->purchase_date.year);
-    printf("Seats: %d\n", temp->seat_count);
-    
-    printf("\nEnter new details:\n");
-    printf("Enter new price: $");
-    temp->price = safe_float_input();
+static void lsm_run_free(LsmRun *run) {
+    if (run == NULL) return;
+    if (run->fd >= 0) close(run->fd);
+    free(run->block_keys);
+    free(run->bloom);
+    free(run);
+}
 
-    printf("\nEnter new purchase date:\n");
-    PurchaseDate date;
-    do {
-        printf("Year (1900-2100): ");
-        date.year = safe_int_input();
-        printf("Month (1-12): ");
-        date.month = safe_int_input();
-        printf("Day: ");
-        date.day = safe_int_input();
-        
-        if (!is_valid_date(date.day, date.month, date.year)) {
-            printf("Invalid date. Please enter a valid date.\n");
-        }
-    } while (!is_valid_date(date.day, date.month, date.year));
+// Opens a run and reads its block index and bloom filter into memory
+static LsmRun* lsm_run_open(const LsmTree *tree, int sequence) {
+    char path[MAX_STRING_LENGTH + 16];
+    lsm_run_path(tree, sequence, path, sizeof(path));
+    LsmRun *run = (LsmRun*)calloc(1, sizeof(LsmRun));
+    if (run == NULL) return NULL;
+    run->sequence = sequence;
+    run->fd = open(path, O_RDONLY);
+
+    unsigned int header[LSM_RUN_HEADER_SIZE / sizeof(unsigned int)];
+    if (run->fd < 0 || pread(run->fd, header, sizeof(header), 0) != (ssize_t)sizeof(header) ||
+        header[0] != LSM_RUN_MAGIC || header[1] != LSM_VERSION || header[2] != tree->record_size ||
+        header[5] == 0 || header[5] % 64 != 0) {
+        lsm_run_free(run);
+        return NULL;
+    }
+    run->count = (int)header[3];
+    run->block_count = (int)header[4];
+    run->bloom_bits = header[5];
+
+    size_t keys_size = run->block_count * sizeof(int);
+    size_t bloom_size = run->bloom_bits / 64 * sizeof(unsigned long long);
+    off_t offset = LSM_RUN_HEADER_SIZE + (off_t)run->count * (off_t)tree->entry_size;
+    run->block_keys = (int*)malloc(keys_size + sizeof(int));
+    run->bloom = (unsigned long long*)malloc(bloom_size);
+    if (run->block_keys == NULL || run->bloom == NULL ||
+        pread(run->fd, run->block_keys, keys_size, offset) != (ssize_t)keys_size ||
+        pread(run->fd, run->bloom, bloom_size, offset + (off_t)keys_size) != (ssize_t)bloom_size) {
+        lsm_run_free(run);
+        return NULL;
+    }
+    return run;
+}
 
-    temp->purchase_date = date;
+// Starts a run for at most expected entries, which arrive in key order
+static int lsm_writer_begin(const LsmTree *tree, LsmRunWriter *writer, int sequence, int expected) {
+    char path[MAX_STRING_LENGTH + 16];
+    memset(writer, 0, sizeof(LsmRunWriter));
+    writer->sequence = sequence;
+    writer->bloom_bits = ((unsigned int)(expected > 0 ? expected : 1) * LSM_BLOOM_BITS_PER_KEY + 63) / 64 * 64;
+    writer->bloom = (unsigned long long*)calloc(writer->bloom_bits / 64, sizeof(unsigned long long));
+    writer->block_keys = (int*)malloc((expected / LSM_BLOCK_ENTRIES + 1) * sizeof(int));
+    lsm_run_path(tree, sequence, path, sizeof(path));
+    if (writer->bloom != NULL && writer->block_keys != NULL) writer->out = fopen(path, "wb");
+    if (writer->out == NULL) {
+        free(writer->bloom);
+        free(writer->block_keys);
+        return -1;
+    }
+
+    // The header is written last, once the counts are known
+    char header[LSM_RUN_HEADER_SIZE] = {0};
+    fwrite(header, 1, sizeof(header), writer->out);
+    return 0;
+}
 
-    printf("Enter new number of seats: ");
-    temp->seat_count = safe_int_input();
+static void lsm_writer_add(const LsmTree *tree, LsmRunWriter *writer, const LsmEntry *entry) {
+    if (writer->count % LSM_BLOCK_ENTRIES == 0) writer->block_keys[writer->count / LSM_BLOCK_ENTRIES] = entry->key;
+    lsm_bloom_add(writer->bloom, writer->bloom_bits, entry->key);
+    fwrite(entry, tree->entry_size, 1, writer->out);
+    writer->count++;
+}
 
-    printf("Bus information updated successfully!\n");
-    return head;
+static void lsm_writer_abort(const LsmTree *tree, LsmRunWriter *writer) {
+    char path[MAX_STRING_LENGTH + 16];
+    fclose(writer->out);
+    free(writer->bloom);
+    free(writer->block_keys);
+    lsm_run_path(tree, writer->sequence, path, sizeof(path));
+    remove(path);
 }
 
-Bus* delete_bus(Bus *head) {
-    if (head == NULL) {
-        printf("  No buses found in the system.\n");
-        printf("You need to add buses first before deleting them.\n");
-        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
-        return head;
+// Writes the block index, bloom filter and header, then reopens the run
+// for reading. Returns NULL (and removes the file) on failure.
+static LsmRun* lsm_writer_finish(const LsmTree *tree, LsmRunWriter *writer) {
+    int block_count = (writer->count + LSM_BLOCK_ENTRIES - 1) / LSM_BLOCK_ENTRIES;
+    unsigned int header[LSM_RUN_HEADER_SIZE / sizeof(unsigned int)] = {
+        LSM_RUN_MAGIC, LSM_VERSION, (unsigned int)tree->record_size, (unsigned int)writer->count,
+        (unsigned int)block_count, writer->bloom_bits, 0, 0
+    };
+    fwrite(writer->block_keys, sizeof(int), block_count, writer->out);
+    fwrite(writer->bloom, sizeof(unsigned long long), writer->bloom_bits / 64, writer->out);
+    int failed = fseek(writer->out, 0L, SEEK_SET) != 0 || fwrite(header, sizeof(header), 1, writer->out) != 1 ||
+                 ferror(writer->out);
+    if (failed) {
+        lsm_writer_abort(tree, writer);
+        return NULL;
+    }
+
+    char path[MAX_STRING_LENGTH + 16];
+    lsm_run_path(tree, writer->sequence, path, sizeof(path));
+    failed = fclose(writer->out) != 0;
+    free(writer->bloom);
+    free(writer->block_keys);
+    LsmRun *run = failed ? NULL : lsm_run_open(tree, writer->sequence);
+    if (run == NULL) remove(path);
+    return run;
+}
+
+// Replaces the manifest through a temporary file, so it always names a
+// complete set of runs
+static int lsm_write_manifest(const LsmTree *tree) {
+    char path[MAX_STRING_LENGTH + 16], temp_path[MAX_STRING_LENGTH + 16];
+    lsm_file_path(tree, ".lsm", path, sizeof(path));
+    lsm_file_path(tree, ".lsm.tmp", temp_path, sizeof(temp_path));
+    FILE *file = fopen(temp_path, "w");
+    if (file == NULL) return -1;
+    fprintf(file, "LSM %d %u\n%d\n%d\n", LSM_VERSION, (unsigned int)tree->record_size, tree->next_sequence,
+            tree->run_count);
+    for (int i = 0; i < tree->run_count; i++) {
+        fprintf(file, "%d\n", tree->runs[i]->sequence);
+    }
+    int failed = ferror(file);
+    if (fclose(file) != 0) failed = 1;
+    if (failed || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return -1;
     }
+    return 0;
+}
 
-    print_header("DELETE BUS");
-    
-    int license_plate;
-    printf("Enter license plate of the bus to delete: ");
-    license_plate = safe_int_input();
+static LsmEntry* lsm_memtable_put(LsmTree *tree, int key, int deleted, const void *record) {
+    LsmEntry *entry = (LsmEntry*)id_set_get(&tree->memtable, key);
+    if (entry == NULL) {
+        entry = (LsmEntry*)malloc(tree->entry_size);
+        if (entry == NULL) return NULL;
+        if (id_set_add(&tree->memtable, key, entry) < 0) {
+            free(entry);
+            return NULL;
+        }
+        tree->memtable_count++;
+    }
+    entry->key = key;
+    entry->deleted = deleted;
+    if (record != NULL) memcpy(entry->record, record, tree->record_size);
+    else memset(entry->record, 0, tree->record_size);
+    return entry;
+}
 
-    Bus *prev = NULL;
-    Bus *temp = head;
-    while (temp != NULL && temp->license_plate != license_plate) {
-        prev = temp;
-        temp = temp->next;
+static void lsm_memtable_clear(LsmTree *tree) {
+    for (int i = 0; i < tree->memtable.capacity; i++) {
+        if (tree->memtable.states[i] == 1) free(tree->memtable.values[i]);
     }
+    id_set_free(&tree->memtable);
+    tree->memtable_count = 0;
+}
 
-    if (temp == NULL) {
-        printf("Bus with license plate %d not found.\n", license_plate);
-        printf("Tip: Check the license plate number and try again.\n");
-        return head;
+static int compare_lsm_entries(const void *a, const void *b) {
+    int left = (*(LsmEntry* const*)a)->key;
+    int right = (*(LsmEntry* const*)b)->key;
+    return (left > right) - (left < right);
+}
+
+static LsmEntry** lsm_memtable_sorted(const LsmTree *tree) {
+    LsmEntry **entries = (LsmEntry**)malloc((tree->memtable_count + 1) * sizeof(LsmEntry*));
+    if (entries == NULL) return NULL;
+    int count = 0;
+    for (int i = 0; i < tree->memtable.capacity; i++) {
+        if (tree->memtable.states[i] == 1) entries[count++] = (LsmEntry*)tree->memtable.values[i];
     }
+    qsort(entries, count, sizeof(LsmEntry*), compare_lsm_entries);
+    return entries;
+}
 
-    // Show bus details before deletion
-    printf("\nBus to be deleted:\n");
-    printf("License Plate: %d\n", temp->license_plate);
-    printf("Price: $%.2f\n", temp->price);
-    printf("Purchase Date: %02d/%02d/%d\n", temp->purchase_date.day, temp->purchase_date.month, temp->purchase_date.year);
-    printf("Seats: %d\n", temp->seat_count);
-    
-    // Confirm deletion
-    char confirm;
-    printf("\nAre you sure you want to delete this bus? (y/N): ");
-    scanf(" %c", &confirm);
-    
-    if (confirm == 'y' || confirm == 'Y') {
-        if (prev == NULL) {
-            head = temp->next;
-        } else {
-            prev->next = temp->next;
+// Writes the memtable out as the newest run and empties the log. Called
+// with the lock held.
+static int lsm_flush_memtable(LsmTree *tree) {
+    // While compaction catches up the memtable keeps growing and the log keeps every change
+    if (tree->memtable_count == 0 || tree->run_count == LSM_MAX_RUNS) return 0;
+
+    LsmEntry **entries = lsm_memtable_sorted(tree);
+    LsmRunWriter writer;
+    LsmRun *run = NULL;
+    if (entries != NULL && lsm_writer_begin(tree, &writer, tree->next_sequence++, tree->memtable_count) == 0) {
+        for (int i = 0; i < tree->memtable_count; i++) {
+            lsm_writer_add(tree, &writer, entries[i]);
         }
-        free(temp);
-        printf("Bus deleted successfully!\n");
-    } else {
-        printf("Deletion cancelled.\n");
-    }
-    
-    return head;
+        run = lsm_writer_finish(tree, &writer);
+    }
+    free(entries);
+    if (run == NULL) return -1;
+
+    tree->runs[tree->run_count++] = run;
+    if (lsm_write_manifest(tree) != 0) {
+        char path[MAX_STRING_LENGTH + 16];
+        lsm_run_path(tree, run->sequence, path, sizeof(path));
+        tree->run_count--;
+        lsm_run_free(run);
+        remove(path);
+        return -1;
+    }
+
+    // Every change in the log is in the run now
+    char log_path[MAX_STRING_LENGTH + 16];
+    lsm_file_path(tree, ".log", log_path, sizeof(log_path));
+    if (tree->log != NULL) fclose(tree->log);
+    tree->log = fopen(log_path, "wb");
+    lsm_memtable_clear(tree);
+    if (tree->run_count >= LSM_COMPACTION_TRIGGER) pthread_cond_signal(&tree->wake);
+    return 0;
 }
 
-void search_bus(Bus *head) {
-    if (head == NULL) {
-        printf("  No buses found in the system.\n");
-        printf("You need to add buses first before searching for them.\n");
-        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
-        return;
+static int lsm_cursor_open(const LsmTree *tree, LsmCursor *cursor, const LsmRun *run) {
+    memset(cursor, 0, sizeof(LsmCursor));
+    cursor->run = run;
+    cursor->count = run->count;
+    cursor->block = (char*)malloc(LSM_BLOCK_ENTRIES * tree->entry_size);
+    return cursor->block != NULL ? 0 : -1;
+}
+
+// Entry under the cursor, or NULL at the end or after a read error
+static const LsmEntry* lsm_cursor_current(const LsmTree *tree, LsmCursor *cursor) {
+    if (cursor->position >= cursor->count) return NULL;
+    if (cursor->run == NULL) return cursor->entries[cursor->position];
+
+    int offset = cursor->position - cursor->block_start;
+    if (offset < 0 || offset >= cursor->block_length) {
+        int length = cursor->count - cursor->position;
+        if (length > LSM_BLOCK_ENTRIES) length = LSM_BLOCK_ENTRIES;
+        size_t bytes = length * tree->entry_size;
+        off_t position = LSM_RUN_HEADER_SIZE + (off_t)cursor->position * (off_t)tree->entry_size;
+        if (pread(cursor->run->fd, cursor->block, bytes, position) != (ssize_t)bytes) {
+            cursor->failed = 1;
+            cursor->position = cursor->count;
+            return NULL;
+        }
+        cursor->block_start = cursor->position;
+        cursor->block_length = length;
+        offset = 0;
     }
+    return (const LsmEntry*)(cursor->block + offset * tree->entry_size);
+}
 
-    print_header("SEARCH BUS");
-    
-    int license_plate;
-    printf("Enter license plate number to search: ");
-    license_plate = safe_int_input();
+// Returns the entry for the smallest key under any cursor, taking it from
+// the newest source (cursors run oldest to newest), and moves every cursor
+// past that key. NULL once all of them are exhausted.
+static const LsmEntry* lsm_merge_next(const LsmTree *tree, LsmCursor *cursors, int count) {
+    const LsmEntry *newest = NULL;
+    for (int i = 0; i < count; i++) {
+        const LsmEntry *entry = lsm_cursor_current(tree, &cursors[i]);
+        if (entry != NULL && (newest == NULL || entry->key <= newest->key)) newest = entry;
+    }
+    if (newest == NULL) return NULL;
 
-    Bus *temp = head;
-    while (temp != NULL && temp->license_plate != license_plate) {
-        temp = temp->next;
+    int key = newest->key;
+    for (int i = 0; i < count; i++) {
+        const LsmEntry *entry = lsm_cursor_current(tree, &cursors[i]);
+        if (entry != NULL && entry->key == key) cursors[i].position++;
     }
+    return newest;
+}
 
-    if (temp == NULL) {
-        printf("Bus with license plate %d not found.\n", license_plate);
-        printf("Tip: Check the license plate number and try again.\n");
-    } else {
-        printf("\nBus found!\n\n");
-        set_console_color(2);
-        printf("%-15s %-15s %-15s %-15s\n", "License Plate", "Price ($)", "Purchase Date", "Seats");
-        printf("%-15s %-15s %-15s %-15s\n", "=============", "=========", "=============", "=====");
-        set_console_color(7);
-        printf("%-15d %-15.2f %02d/%02d/%-8d %-15d\n",
-               temp->license_plate,
-               temp->price,
-               temp->purchase_date.day,
-               temp->purchase_date.month,
-               temp->purchase_date.year,
-               temp->seat_count);
+// Merges adjacent runs into one. When the inputs include the oldest run,
+// deleted entries have nothing left to hide and are dropped; otherwise
+// they are kept to hide the older runs.
+static LsmRun* lsm_merge_runs(const LsmTree *tree, LsmRun **inputs, int count, int sequence, int drop_deleted) {
+    LsmCursor *cursors = (LsmCursor*)calloc(count, sizeof(LsmCursor));
+    int expected = 0;
+    for (int i = 0; i < count; i++) expected += inputs[i]->count;
+
+    LsmRunWriter writer;
+    LsmRun *merged = NULL;
+    if (cursors != NULL && lsm_writer_begin(tree, &writer, sequence, expected) == 0) {
+        int failed = 0;
+        for (int i = 0; i < count; i++) {
+            if (lsm_cursor_open(tree, &cursors[i], inputs[i]) != 0) failed = 1;
+        }
+        const LsmEntry *entry;
+        while (!failed && (entry = lsm_merge_next(tree, cursors, count)) != NULL) {
+            if (!entry->deleted || !drop_deleted) lsm_writer_add(tree, &writer, entry);
+        }
+        for (int i = 0; i < count; i++) {
+            if (cursors[i].failed) failed = 1;
+        }
+        if (failed) lsm_writer_abort(tree, &writer);
+        else merged = lsm_writer_finish(tree, &writer);
     }
+    for (int i = 0; cursors != NULL && i < count; i++) free(cursors[i].block);
+    free(cursors);
+    return merged;
 }
 
-void save_buses_to_file(Bus *head) {
-    FILE *file = fopen(BUS_FILENAME, "w");
-    if (file == NULL) {
-        return;
+// Size-tiered compaction: picks the newest window of at least
+// LSM_COMPACTION_TRIGGER adjacent runs whose sizes are within
+// LSM_TIER_RATIO of each other, so a large run is rewritten only once
+// enough runs of its own size have built up. Returns the window length
+// and sets *first, or 0 if no tier is full. Runs must stay adjacent for
+// newer entries to keep hiding older ones.
+static int lsm_pick_tier(const LsmTree *tree, int *first) {
+    for (int end = tree->run_count - 1; end >= LSM_COMPACTION_TRIGGER - 1; end--) {
+        int smallest = tree->runs[end]->count, largest = smallest;
+        int start = end;
+        while (start > 0) {
+            int count = tree->runs[start - 1]->count;
+            int low = count < smallest ? count : smallest;
+            int high = count > largest ? count : largest;
+            if ((long)high > (long)LSM_TIER_RATIO * (low > 0 ? low : 1)) break;
+            smallest = low;
+            largest = high;
+            start--;
+        }
+        if (end - start + 1 >= LSM_COMPACTION_TRIGGER) {
+            *first = start;
+            return end - start + 1;
+        }
+    }
+    // Out of run slots with no full tier: merge the newest runs
+    if (tree->run_count >= LSM_MAX_RUNS) {
+        *first = tree->run_count - LSM_COMPACTION_TRIGGER;
+        return LSM_COMPACTION_TRIGGER;
     }
+    return 0;
+}
 
-    Bus *temp = head;
-    while (temp != NULL) {
-        fprintf(file, "%d\n%.2f\n%d/%d/%d\n%d\n",
-                temp->license_plate,
-                temp->price,
-                temp->purchase_date.day,
-                temp->purchase_date.month,
-                temp->purchase_date.year,
-                temp->seat_count);
-        temp = temp->next;
+// Background compaction: merges one tier at a time while any is full.
+// The merge reads immutable runs without the lock; only swapping the
+// merged run into the tree takes it.
+static void* lsm_compactor_run(void *argument) {
+    LsmTree *tree = (LsmTree*)argument;
+    pthread_mutex_lock(&tree->lock);
+    while (!tree->stopping) {
+        int first = 0;
+        int count = lsm_pick_tier(tree, &first);
+        if (count == 0) {
+            pthread_cond_wait(&tree->wake, &tree->lock);
+            continue;
+        }
+        LsmRun *inputs[LSM_MAX_RUNS];
+        memcpy(inputs, &tree->runs[first], count * sizeof(LsmRun*));
+        int sequence = tree->next_sequence++;
+        tree->compacting = 1;
+        pthread_mutex_unlock(&tree->lock);
+
+        LsmRun *merged = lsm_merge_runs(tree, inputs, count, sequence, first == 0);
+
+        pthread_mutex_lock(&tree->lock);
+        tree->compacting = 0;
+        if (merged == NULL) {
+            // Try again after the next flush
+            if (!tree->stopping) pthread_cond_wait(&tree->wake, &tree->lock);
+            continue;
+        }
+        // Runs flushed during the merge are newer and stay after it
+        int newer = tree->run_count - first - count;
+        tree->runs[first] = merged;
+        memmove(&tree->runs[first + 1], &tree->runs[first + count], newer * sizeof(LsmRun*));
+        tree->run_count -= count - 1;
+        char path[MAX_STRING_LENGTH + 16];
+        if (lsm_write_manifest(tree) != 0) {
+            memmove(&tree->runs[first + count], &tree->runs[first + 1], newer * sizeof(LsmRun*));
+            memcpy(&tree->runs[first], inputs, count * sizeof(LsmRun*));
+            tree->run_count += count - 1;
+            lsm_run_path(tree, merged->sequence, path, sizeof(path));
+            lsm_run_free(merged);
+            remove(path);
+            if (!tree->stopping) pthread_cond_wait(&tree->wake, &tree->lock);
+            continue;
+        }
+        for (int i = 0; i < count; i++) {
+            lsm_run_path(tree, inputs[i]->sequence, path, sizeof(path));
+            lsm_run_free(inputs[i]);
+            remove(path);
+        }
+        tree->compactions++;
     }
+    pthread_mutex_unlock(&tree->lock);
+    return NULL;
+}
 
-    fclose(file);
+static void lsm_free(LsmTree *tree) {
+    for (int i = 0; i < tree->run_count; i++) lsm_run_free(tree->runs[i]);
+    lsm_memtable_clear(tree);
+    if (tree->log != NULL) fclose(tree->log);
+    if (tree->lock_fd >= 0) close(tree->lock_fd);
+    pthread_mutex_destroy(&tree->lock);
+    pthread_cond_destroy(&tree->wake);
+    free(tree->block);
+    free(tree);
 }
 
-Bus* load_buses_from_file(Bus *head) {
-    FILE *file = fopen(BUS_FILENAME, "r");
-    if (file == NULL) {
-        return head;
-    }
+// Applies the changes that had not reached a run yet. A torn last record
+// is ignored. Returns the number of records replayed.
+static int lsm_replay_log(LsmTree *tree, const char *path) {
+    FILE *log = fopen(path, "rb");
+    if (log == NULL) return 0;
+    LsmEntry *entry = (LsmEntry*)malloc(tree->entry_size);
+    int replayed = 0;
+    while (entry != NULL && fread(entry, tree->entry_size, 1, log) == 1) {
+        if (lsm_memtable_put(tree, entry->key, entry->deleted, entry->record) == NULL) break;
+        replayed++;
+    }
+    free(entry);
+    fclose(log);
+    return replayed;
+}
 
-    // Check if file is empty
-    fseek(file, 0L, SEEK_END);
-    if (ftell(file) == 0) {
-        fclose(file);
-        return head;
+static void* lsm_open(const char *path, size_t record_size, int *created) {
+    LsmTree *tree = (LsmTree*)calloc(1, sizeof(LsmTree));
+    if (tree == NULL) return NULL;
+    snprintf(tree->path, sizeof(tree->path), "%s", path);
+    tree->record_size = record_size;
+    tree->entry_size = sizeof(LsmEntry) + record_size;
+    tree->next_sequence = 1;
+    tree->block = (char*)malloc(LSM_BLOCK_ENTRIES * tree->entry_size);
+    pthread_mutex_init(&tree->lock, NULL);
+    pthread_cond_init(&tree->wake, NULL);
+
+    // Another process with the store open would replay and compact the same files
+    char lock_path[MAX_STRING_LENGTH + 16];
+    lsm_file_path(tree, ".lock", lock_path, sizeof(lock_path));
+    tree->lock_fd = open(lock_path, O_RDWR | O_CREAT, 0644);
+    if (tree->lock_fd >= 0 && flock(tree->lock_fd, LOCK_EX | LOCK_NB) != 0) {
+        printf("Warning: the store at %s is in use by another process.\n", path);
+        lsm_free(tree);
+        return NULL;
+    }
+
+    char manifest_path[MAX_STRING_LENGTH + 16], log_path[MAX_STRING_LENGTH + 16];
+    lsm_file_path(tree, ".lsm", manifest_path, sizeof(manifest_path));
+    lsm_file_path(tree, ".log", log_path, sizeof(log_path));
+    int failed = tree->block == NULL || tree->lock_fd < 0;
+    FILE *manifest = fopen(manifest_path, "r");
+    if (manifest != NULL) {
+        int version, run_count;
+        unsigned int size;
+        if (fscanf(manifest, "LSM %d %u\n%d\n%d\n", &version, &size, &tree->next_sequence, &run_count) != 4 ||
+            version != LSM_VERSION || size != record_size || run_count < 0 || run_count > LSM_MAX_RUNS) {
+            failed = 1;
+        }
+        for (int i = 0; !failed && i < run_count; i++) {
+            int sequence;
+            if (fscanf(manifest, "%d\n", &sequence) != 1 ||
+                (tree->runs[tree->run_count] = lsm_run_open(tree, sequence)) == NULL) {
+                failed = 1;
+            } else {
+                tree->run_count++;
+            }
+        }
+        fclose(manifest);
     }
-    rewind(file);
+    int replayed = failed ? 0 : lsm_replay_log(tree, log_path);
+    *created = manifest == NULL && replayed == 0;
 
-    // Free existing list first
-    free_bus_list(head);
-    head = NULL;
+    if (!failed) tree->log = fopen(log_path, "ab");
+    if (failed || tree->log == NULL || pthread_create(&tree->compactor, NULL, lsm_compactor_run, tree) != 0) {
+        printf("Warning: could not open the store at %s.\n", path);
+        lsm_free(tree);
+        return NULL;
+    }
+    return tree;
+}
 
-    Bus *new_bus;
-    int license_plate, seat_count;
-    float price;
-    int day, month, year;
-    
-    while (fscanf(file, "%d\n%f\n%d/%d/%d\n%d\n", 
-                  &license_plate, &price, &day, &month, &year, &seat_count) == 6) {
-        new_bus = (Bus*)malloc(sizeof(Bus));
-        if (new_bus == NULL) {
-            fclose(file);
-            return head;
+static int lsm_get(void *state, int key, void *record) {
+    LsmTree *tree = (LsmTree*)state;
+    pthread_mutex_lock(&tree->lock);
+    const LsmEntry *entry = (const LsmEntry*)id_set_get(&tree->memtable, key);
+
+    // Newest run first; each costs a bloom probe and at most one block read
+    for (int i = tree->run_count - 1; entry == NULL && i >= 0; i--) {
+        const LsmRun *run = tree->runs[i];
+        if (run->count == 0 || key < run->block_keys[0] || !lsm_bloom_test(run, key)) continue;
+
+        int low = 0, high = run->block_count - 1;
+        while (low < high) {
+            int middle = (low + high + 1) / 2;
+            if (run->block_keys[middle] <= key) low = middle;
+            else high = middle - 1;
+        }
+        int first = low * LSM_BLOCK_ENTRIES;
+        int length = run->count - first < LSM_BLOCK_ENTRIES ? run->count - first : LSM_BLOCK_ENTRIES;
+        size_t bytes = length * tree->entry_size;
+        off_t offset = LSM_RUN_HEADER_SIZE + (off_t)first * (off_t)tree->entry_size;
+        if (pread(run->fd, tree->block, bytes, offset) != (ssize_t)bytes) continue;
+
+        low = 0;
+        high = length - 1;
+        while (low <= high) {
+            int middle = (low + high) / 2;
+            const LsmEntry *candidate = (const LsmEntry*)(tree->block + middle * tree->entry_size);
+            if (candidate->key == key) {
+                entry = candidate;
+                break;
+            }
+            if (candidate->key < key) low = middle + 1;
+            else high = middle - 1;
         }
+    }
 
-        new_bus->license_plate = license_plate;
-        new_bus->price = price;
-        new_bus->purchase_date.day = day;
-        new_bus->purchase_date.month = month;
-        new_bus->purchase_date.year = year;
-        new_bus->seat_count = seat_count;
-        new_bus->next = NULL;
+    int found = entry != NULL && !entry->deleted;
+    if (found) memcpy(record, entry->record, tree->record_size);
+    pthread_mutex_unlock(&tree->lock);
+    return found;
+}
 
-        if (head == NULL) {
-            head = new_bus;
-        } else {
-            Bus *temp = head;
-            while (temp->next != NULL) {
-                temp = temp->next;
-            }
-            temp->next = new_bus;
+// Logs one change, applies it to the memtable and flushes a full memtable
+static int lsm_write(LsmTree *tree, int key, int deleted, const void *record) {
+    pthread_mutex_lock(&tree->lock);
+    LsmEntry *entry = lsm_memtable_put(tree, key, deleted, record);
+    int result = entry != NULL ? 0 : -1;
+    if (entry != NULL && (tree->log == NULL || fwrite(entry, tree->entry_size, 1, tree->log) != 1 ||
+                          fflush(tree->log) != 0)) {
+        printf("Warning: could not write the log of %s; the change is kept in memory.\n", tree->path);
+        result = -1;
+    }
+    if (tree->memtable_count >= LSM_MEMTABLE_LIMIT && lsm_flush_memtable(tree) != 0) {
+        printf("Warning: could not write a run for %s; changes stay in the log.\n", tree->path);
+    }
+    pthread_mutex_unlock(&tree->lock);
+    return result;
+}
+
+static int lsm_put(void *state, int key, const void *record) {
+    return lsm_write((LsmTree*)state, key, 0, record);
+}
+
+static int lsm_remove(void *state, int key) {
+    return lsm_write((LsmTree*)state, key, 1, NULL);
+}
+
+static int lsm_scan(void *state, int (*visit)(int key, const void *record, void *context), void *context) {
+    LsmTree *tree = (LsmTree*)state;
+    pthread_mutex_lock(&tree->lock);
+    int count = tree->run_count + 1;
+    LsmCursor *cursors = (LsmCursor*)calloc(count, sizeof(LsmCursor));
+    LsmEntry **entries = lsm_memtable_sorted(tree);
+    int failed = cursors == NULL || entries == NULL;
+    for (int i = 0; !failed && i < tree->run_count; i++) {
+        if (lsm_cursor_open(tree, &cursors[i], tree->runs[i]) != 0) failed = 1;
+    }
+    if (!failed) {
+        // The memtable is the newest source
+        cursors[tree->run_count].entries = entries;
+        cursors[tree->run_count].count = tree->memtable_count;
+        const LsmEntry *entry;
+        while ((entry = lsm_merge_next(tree, cursors, count)) != NULL) {
+            if (!entry->deleted && visit(entry->key, entry->record, context)) break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (cursors[i].failed) failed = 1;
         }
     }
+    for (int i = 0; cursors != NULL && i < count; i++) free(cursors[i].block);
+    free(cursors);
+    free(entries);
+    pthread_mutex_unlock(&tree->lock);
+    return failed ? -1 : 0;
+}
 
-    fclose(file);
-    return head;
+static void lsm_describe(void *state, FILE *out) {
+    LsmTree *tree = (LsmTree*)state;
+    pthread_mutex_lock(&tree->lock);
+    int entries = 0;
+    for (int i = 0; i < tree->run_count; i++) entries += tree->runs[i]->count;
+    fprintf(out, "%d runs on disk (%d entries), %d recent changes in memory, %d compactions%s\n",
+            tree->run_count, entries, tree->memtable_count, tree->compactions,
+            tree->compacting ? ", compacting" : "");
+    pthread_mutex_unlock(&tree->lock);
 }
 
-void free_bus_list(Bus *head) {
-    Bus *temp;
-    while (head != NULL) {
-        temp = head;
-        head = head->next;
-        free(temp);
+// Stops compaction, then writes what is left in the memtable to a run
+static void lsm_close(void *state) {
+    LsmTree *tree = (LsmTree*)state;
+    pthread_mutex_lock(&tree->lock);
+    tree->stopping = 1;
+    pthread_cond_signal(&tree->wake);
+    pthread_mutex_unlock(&tree->lock);
+    pthread_join(tree->compactor, NULL);
+    lsm_flush_memtable(tree);
+    lsm_free(tree);
+}
+
+static const StorageEngine lsm_engine = {
+    "lsm", lsm_open, lsm_get, lsm_put, lsm_remove, lsm_scan, lsm_describe, lsm_close
+};
+#endif
+
+static const StorageEngine *storage_engines[] = {
+#ifndef _WIN32
+    &lsm_engine,
+#endif
+    NULL
+};
+
+int store_open(RecordStore *store, const char *engine, const char *path, size_t record_size) {
+    memset(store, 0, sizeof(RecordStore));
+    for (int i = 0; storage_engines[i] != NULL; i++) {
+        if (strcmp(storage_engines[i]->name, engine) != 0) continue;
+        store->state = storage_engines[i]->open(path, record_size, &store->created);
+        if (store->state == NULL) return -1;
+        store->engine = storage_engines[i];
+        return 0;
     }
+    return -1;
 }
 
-// Client management functions (similar pattern to bus functions)
-Client* add_client_at_beginning(Client *head) {
-    Client *new_client = (Client*)malloc(sizeof(Client));
-    if (new_client == NULL) {
+int store_get(RecordStore *store, int key, void *record) {
+    return store->engine->get(store->state, key, record);
+}
+
+int store_put(RecordStore *store, int key, const void *record) {
+    return store->engine->put(store->state, key, record);
+}
+
+int store_remove(RecordStore *store, int key) {
+    return store->engine->remove(store->state, key);
+}
+
+int store_scan(RecordStore *store, int (*visit)(int key, const void *record, void *context), void *context) {
+    return store->engine->scan(store->state, visit, context);
+}
+
+static int store_any_visit(int key, const void *record, void *context) {
+    (void)key;
+    (void)record;
+    *(int*)context = 1;
+    return 1; // the first record is enough
+}
+
+// 1 if the store is open and holds at least one record
+static int store_has_records(RecordStore *store) {
+    int found = 0;
+    if (store->engine != NULL) store_scan(store, store_any_visit, &found);
+    return found;
+}
+
+void store_describe(RecordStore *store, FILE *out) {
+    store->engine->describe(store->state, out);
+}
+
+void store_close(RecordStore *store) {
+    if (store->engine != NULL) store->engine->close(store->state);
+    memset(store, 0, sizeof(RecordStore));
+}
+
+static int compare_record_ids(const void *a, const void *b) {
+    int left = **(const int* const*)a;
+    int right = **(const int* const*)b;
+    return (left > right) - (left < right);
+}
+
+static int store_sync_visit(int key, const void *record, void *context) {
+    StoreSync *sync = (StoreSync*)context;
+    while (sync->position < sync->count && *(const int*)sync->records[sync->position] < key) sync->position++;
+    if (sync->position < sync->count && *(const int*)sync->records[sync->position] == key) {
+        sync->unchanged[sync->position] = memcmp(sync->records[sync->position], record, sync->record_size) == 0;
+        sync->position++;
+        return 0;
+    }
+    if (sync->removed_count == sync->removed_capacity) {
+        int new_capacity = sync->removed_capacity ? sync->removed_capacity * 2 : 256;
+        int *grown = (int*)realloc(sync->removed, new_capacity * sizeof(int));
+        if (grown == NULL) return 1;
+        sync->removed = grown;
+        sync->removed_capacity = new_capacity;
+    }
+    sync->removed[sync->removed_count++] = key;
+    return 0;
+}
+
+// Makes the store hold exactly the given records, writing only the
+// records that differ from what it already has
+static int store_sync(RecordStore *store, void **records, int count, size_t record_size) {
+    StoreSync sync;
+    memset(&sync, 0, sizeof(StoreSync));
+    sync.records = records;
+    sync.count = count;
+    sync.record_size = record_size;
+    sync.unchanged = (unsigned char*)calloc(count + 1, 1);
+    if (sync.unchanged == NULL) return -1;
+    qsort(records, count, sizeof(void*), compare_record_ids);
+
+    int result = store_scan(store, store_sync_visit, &sync);
+    for (int i = 0; result == 0 && i < sync.removed_count; i++) {
+        if (store_remove(store, sync.removed[i]) != 0) result = -1;
+    }
+    for (int i = 0; result == 0 && i < count; i++) {
+        if (!sync.unchanged[i] && store_put(store, *(const int*)records[i], records[i]) != 0) result = -1;
+    }
+    free(sync.unchanged);
+    free(sync.removed);
+    return result;
+}
+
+int lsm_storage_enabled(void) {
+    return storage_mode() == STORAGE_LSM;
+}
+
+int lsm_storage_attached(void) {
+    return client_store.engine != NULL;
+}
+
+// Returns how many store loads and saves failed since the last call. A
+// batch session that could not read a store must not go on with the text
+// files, and a save that could not write one has not saved.
+int lsm_storage_take_errors(void) {
+    int errors = lsm_storage_errors;
+    lsm_storage_errors = 0;
+    return errors;
+}
+
+// Called by the interactive session before it loads the lists; the stores
+// stay open until the program exits
+void lsm_storage_attach(void) {
+    if (!lsm_storage_enabled() || lsm_storage_attached()) return;
+    if (store_open(&client_store, "lsm", CLIENT_STORE_PATH, offsetof(Client, next)) != 0 ||
+        store_open(&employee_store, "lsm", EMPLOYEE_STORE_PATH, offsetof(Employee, next)) != 0) {
+        printf("Warning: could not open the LSM stores; using the text files.\n");
+        store_close(&client_store);
+        store_close(&employee_store);
+        storage_mode_setting = STORAGE_TEXT;
+    }
+}
+
+void lsm_storage_detach(void) {
+    store_close(&client_store);
+    store_close(&employee_store);
+}
+
+// Expands to the list <-> store conversions for one entity. The id must be
+// the first field of the record.
+#define DEFINE_RECORD_STORE(name, type, store, path)                                \
+    static int name##_store_append(int key, const void *record, void *context) {    \
+        type ***tail = (type***)context;                                            \
+        type *copy = (type*)malloc(sizeof(type));                                   \
+        (void)key;                                                                  \
+        if (copy == NULL) return 1;                                                 \
+        memcpy(copy, record, offsetof(type, next));                                 \
+        copy->next = NULL;                                                          \
+        **tail = copy;                                                              \
+        *tail = &copy->next;                                                        \
+        return 0;                                                                   \
+    }                                                                               \
+    static type* name##_store_read(RecordStore *source) {                           \
+        type *head = NULL, **tail = &head;                                          \
+        store_scan(source, name##_store_append, &tail);                             \
+        return head;                                                                \
+    }                                                                               \
+    /* Batch side: 1 with the list read from the store, 0 if there is none and */   \
+    /* -1 if it exists but cannot be opened (another process holds it) */           \
+    static int name##_store_load(type **head) {                                     \
+        RecordStore source;                                                         \
+        if (data_file_size(path ".lsm") == 0 && data_file_size(path ".log") == 0) return 0; \
+        if (store_open(&source, "lsm", path, offsetof(type, next)) != 0) {          \
+            lsm_storage_errors++;                                                   \
+            return -1;                                                              \
+        }                                                                           \
+        type *loaded = name##_store_read(&source);                                  \
+        store_close(&source);                                                       \
+        free_##name##_list(*head);                                                  \
+        *head = loaded;                                                             \
+        return 1;                                                                   \
+    }                                                                               \
+    static void name##_store_save(type *head) {                                     \
+        RecordStore target;                                                         \
+        int count = 0;                                                              \
+        for (type *record = head; record != NULL; record = record->next) count++;   \
+        void **records = (void**)malloc((count + 1) * sizeof(void*));               \
+        if (records == NULL || store_open(&target, "lsm", path, offsetof(type, next)) != 0) { \
+            printf("Warning: could not save to the store at %s.\n", path);          \
+            lsm_storage_errors++;                                                   \
+            free(records);                                                          \
+            return;                                                                 \
+        }                                                                           \
+        count = 0;                                                                  \
+        for (type *record = head; record != NULL; record = record->next) records[count++] = record; \
+        if (store_sync(&target, records, count, offsetof(type, next)) != 0) {       \
+            printf("Warning: could not save to the store at %s.\n", path);          \
+            lsm_storage_errors++;                                                   \
+        }                                                                           \
+        store_close(&target);                                                       \
+        free(records);                                                              \
+    }                                                                               \
+    /* First attached login: moves the list read from the text file into the store */ \
+    static void name##_store_convert(type **head) {                                 \
+        if (store.created) {                                                        \
+            for (type *record = *head; record != NULL; record = record->next) {     \
+                store_put(&store, *(const int*)record, record);                     \
+            }                                                                       \
+            store.created = 0;                                                      \
+        }                                                                           \
+        free_##name##_list(*head);                                                  \
+        *head = NULL;                                                               \
+    }
+
+DEFINE_RECORD_STORE(client, Client, client_store, CLIENT_STORE_PATH)
+DEFINE_RECORD_STORE(employee, Employee, employee_store, EMPLOYEE_STORE_PATH)
+
+// After the attached session has loaded its lists: fills stores that were
+// just created from the text files, then drops the lists
+void lsm_storage_convert(Client **clients, Employee **employees) {
+    if (!lsm_storage_attached()) return;
+    client_store_convert(clients);
+    employee_store_convert(employees);
+}
+
+// Bus management functions
+Bus* add_bus_at_beginning(Bus *head) {
+    Bus *new_bus = (Bus*)malloc(sizeof(Bus));
+    if (new_bus == NULL) {
         printf("Memory allocation error.\n");
         return head;
     }
 
-    int client_exists;
+    PurchaseDate date;
+    int license_exists;
+
+    // Input and validate license plate
     do {
-        client_exists = 0;
-        printf("Enter client ID: ");
-        new_client->client_id = safe_int_input();
+        license_exists = 0;
+        printf("Enter bus license plate number: ");
+        new_bus->license_plate = safe_int_input();
         
-        Client *temp = head;
+        Bus *temp = head;
         while (temp != NULL) {
-            if (new_client->client_id == temp->client_id) {
-                printf("Client ID already exists. Please enter a different one.\n");
-                client_exists = 1;
+            if (new_bus->license_plate == temp->license_plate) {
+                printf("License plate already exists. Please enter a different one.\n");
+                license_exists = 1;
                 break;
             }
             temp = temp->next;
         }
-    } while (client_exists);
+    } while (license_exists);
 
-    printf("Enter first name: ");
-    scanf("%99s", new_client->first_name);
-    printf("Enter last name: ");
-    scanf("%99s", new_client->last_name);
-    printf("Enter phone number: ");
-    scanf("%14s", new_client->phone);
-    printf("Enter city: ");
-    scanf("%99s", new_client->city);
-    printf("Enter province: ");
-    scanf("%99s", new_client->province);
-    printf("Enter postal code: ");
-    new_client->postal_code = safe_int_input();
+    printf("Enter bus purchase price: $");
+    new_bus->price = safe_float_input();
 
-    new_client->next = head;
-    printf("Client added successfully.\n");
-    return new_client;
+    // Input and validate purchase date
+    printf("Enter purchase date:\n");
+    do {
+        printf("Year (1900-2100): ");
+        date.year = safe_int_input();
+        printf("Month (1-12): ");
+        date.month = safe_int_input();
+        printf("Day: ");
+        date.day = safe_int_input();
+        
+        if (!is_valid_date(date.day, date.month, date.year)) {
+            printf("Invalid date. Please enter a valid date.\n");
+        }
+    } while (!is_valid_date(date.day, date.month, date.year));
+
+    new_bus->purchase_date = date;
+
+    printf("Enter number of seats: ");
+    new_bus->seat_count = safe_int_input();
+
+    new_bus->next = head;
+    printf("Bus added successfully.\n");
+    return new_bus;
 }
 
-Client* add_client_at_end(Client *head) {
-    Client *new_client = (Client*)malloc(sizeof(Client));
-    if (new_client == NULL) {
-        printf("Memory allocation error. Cannot add client.\n");
+Bus* add_bus_at_end(Bus *head) {
+    Bus *new_bus = (Bus*)malloc(sizeof(Bus));
+    if (new_bus == NULL) {
+        printf("Memory allocation error. Cannot add bus.\n");
         return head;
     }
 
-    print_header("ADD NEW CLIENT");
+    print_header("ADD NEW BUS");
+    
+    PurchaseDate date;
+    int license_exists;
 
-    int client_exists;
+    // Input and validate license plate
     do {
-        client_exists = 0;
-        printf("Enter client ID: ");
-        new_client->client_id = safe_int_input();
+        license_exists = 0;
+        printf("Enter bus license plate number: ");
+        new_bus->license_plate = safe_int_input();
         
-        Client *temp = head;
+        Bus *temp = head;
         while (temp != NULL) {
-            if (new_client->client_id == temp->client_id) {
-                printf("Client ID %d already exists. Please enter a different one.\n", new_client->client_id);
-                client_exists = 1;
+            if (new_bus->license_plate == temp->license_plate) {
+                printf("License plate %d already exists. Please enter a different one.\n", new_bus->license_plate);
+                license_exists = 1;
                 break;
             }
             temp = temp->next;
         }
-    } while (client_exists);
+    } while (license_exists);
 
-    printf("Enter first name: ");
-    scanf("%99s", new_client->first_name);
-    printf("Enter last name: ");
-    scanf("%99s", new_client->last_name);
-    printf("Enter phone number: ");
-    scanf("%14s", new_client->phone);
-    printf("Enter city: ");
-    scanf("%99s", new_client->city);
-    printf("Enter province: ");
-    scanf("%99s", new_client->province);
-    printf("Enter postal code: ");
-    new_client->postal_code = safe_int_input();
+    printf("Enter bus purchase price: $");
+    new_bus->price = safe_float_input();
 
-    new_client->next = NULL;
+    // Input and validate purchase date
+    printf("\nEnter purchase date:\n");
+    do {
+        printf("Year (1900-2100): ");
+        date.year = safe_int_input();
+        printf("Month (1-12): ");
+        date.month = safe_int_input();
+        printf("Day: ");
+        date.day = safe_int_input();
+        
+        if (!is_valid_date(date.day, date.month, date.year)) {
+            printf("Invalid date. Please enter a valid date.\n");
+        }
+    } while (!is_valid_date(date.day, date.month, date.year));
+
+    new_bus->purchase_date = date;
+
+    printf("Enter number of seats: ");
+    new_bus->seat_count = safe_int_input();
+
+    new_bus->next = NULL;
+    bus_slot_put(new_bus);
     
     if (head == NULL) {
-        printf("Client added successfully! This is your first client.\n");
-        return new_client;
+        printf("Bus added successfully! This is your first bus.\n");
+        return new_bus;
     } else {
-        Client *temp = head;
+        Bus *temp = head;
         while (temp->next != NULL) {
             temp = temp->next;
         }
-        temp->next = new_client;
-        printf("Client added successfully!\n");
+        temp->next = new_bus;
+        printf("Bus added successfully!\n");
         return head;
     }
 }
 
-void display_clients(Client *head) {
+void display_buses(Bus *head) {
     if (head == NULL) {
-        printf("  No clients found in the system.\n");
-        printf("You need to add clients first to view them.\n");
-        printf("Please go to 'Client Management' -> 'Add New Client' to create your first client.\n");
+        printf("  No buses found in the system.\n");
+        printf("You need to add buses first to view them.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
         return;
     }
 
-    print_header("CLIENT DATABASE");
+    print_header("BUS FLEET OVERVIEW");
     
-    // Count clients
-    int client_count = 0;
-    Client *temp = head;
+    // Count buses
+    int bus_count = 0;
+    Bus *temp = head;
     while (temp != NULL) {
-        client_count++;
+        bus_count++;
         temp = temp->next;
     }
     
-    printf("Total clients in database: %d\n\n", client_count);
+    printf("Total buses in fleet: %d\n\n", bus_count);
     
+    TableWriter *writer = table_begin(stdout);
     set_console_color(2);
-    printf("%-10s %-15s %-15s %-15s %-15s %-30s %-10s\n", 
-           "ID", "First Name", "Last Name", "Phone", "City", "Province", "Postal Code");
-    printf("%-10s %-15s %-15s %-15s %-15s %-30s %-10s\n", 
-           "==", "==========", "=========", "=====", "====", "========", "===========");
+    TABLE_HEADER(writer, bus_table);
     set_console_color(7);
 
     temp = head;
     while (temp != NULL) {
-        printf("%-10d %-15s %-15s %-15s %-15s %-30s %-10d\n",
-               temp->client_id,
-               temp->first_name,
-               temp->last_name,
-               temp->phone,
-               temp->city,
-               temp->province,
-               temp->postal_code);
+        bus_table_row(writer, temp, NULL);
         temp = temp->next;
     }
+    table_flush(writer);
 }
 
-Client* modify_client(Client *head) {
+Bus* modify_bus(Bus *head) {
     if (head == NULL) {
-        printf("  No clients found in the system.\n");
-        printf("You need to add clients first before modifying them.\n");
-        printf("Please go to 'Client Management' -> 'Add New Client' to create your first client.\n");
+        printf("  No buses found in the system.\n");
+        printf("You need to add buses first before modifying them.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
         return head;
     }
 
-    print_header("MODIFY CLIENT");
+    print_header("MODIFY BUS");
     
-    int client_id;
-    printf("Enter client ID to modify: ");
-    client_id = safe_int_input();
+    int license_plate;
+    printf("Enter license plate of the bus to modify: ");
+    license_plate = safe_int_input();
 
-    Client *temp = head;
-    while (temp != NULL && temp->client_id != client_id) {
+    Bus *temp = head;
+    while (temp != NULL && temp->license_plate != license_plate) {
         temp = temp->next;
     }
 
     if (temp == NULL) {
-        printf("Client with ID %d not found.\n", client_id);
-        printf("Tip: Check the client ID and try again.\n");
+        printf("Bus with license plate %d not found.\n", license_plate);
+        printf("Tip: Check the license plate number and try again.\n");
         return head;
     }
 
-    // Show current client details
-    printf("\nCurrent client details:\n");
-    printf("ID: %d\n", temp->client_id);
-    printf("Name: %s %s\n", temp->first_name, temp->last_name);
-    printf("Phone: %s\n", temp->phone);
-    printf("Location: %s, %s %d\n", temp->city, temp->province, temp->postal_code);
+    // Show current bus details
+    printf("\nCurrent bus details:\n");
+    printf("License Plate: %d\n", temp->license_plate);
+    printf("Price: $%.2f\n", temp->price);
+    printf("Purchase Date: %02d/%02d/%d\n", temp->purchase_date.day, temp->purchase_date.month, temp->purchase_date.year);
+    printf("Seats: %d\n", temp->seat_count);
     
     printf("\nEnter new details:\n");
-    printf("Enter new first name: ");
-    scanf("%99s", temp->first_name);
-    printf("Enter new last name: ");
-    scanf("%99s", temp->last_name);
-    printf("Enter new phone number: ");
-    scanf("%14s", temp->phone);
-    printf("Enter new city: ");
-    scanf("%99s", temp->city);
-    printf("Enter new province: ");
-    scanf("%99s", temp->province);
-    printf("Enter new postal code: ");
-    temp->postal_code = safe_int_input();
+    printf("Enter new price: $");
+    temp->price = safe_float_input();
 
-    printf("Client information updated successfully!\n");
+    printf("\nEnter new purchase date:\n");
+    PurchaseDate date;
+    do {
+        printf("Year (1900-2100): ");
+        date.year = safe_int_input();
+        printf("Month (1-12): ");
+        date.month = safe_int_input();
+        printf("Day: ");
+        date.day = safe_int_input();
+        
+        if (!is_valid_date(date.day, date.month, date.year)) {
+            printf("Invalid date. Please enter a valid date.\n");
+        }
+    } while (!is_valid_date(date.day, date.month, date.year));
+
+    temp->purchase_date = date;
+
+    printf("Enter new number of seats: ");
+    temp->seat_count = safe_int_input();
+
+    bus_slot_put(temp);
+    printf("Bus information updated successfully!\n");
     return head;
 }
 
-Client* delete_client(Client *head) {
+Bus* delete_bus(Bus *head) {
     if (head == NULL) {
-        printf("  No clients found in the system.\n");
-        printf("You need to add clients first before deleting them.\n");
-        printf("Please go to 'Client Management' -> 'Add New Client' to create your first client.\n");
+        printf("  No buses found in the system.\n");
+        printf("You need to add buses first before deleting them.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
         return head;
     }
 
-    print_header("DELETE CLIENT");
+    print_header("DELETE BUS");
     
-    int client_id;
-    printf("Enter client ID to delete: ");
-    client_id = safe_int_input();
+    int license_plate;
+    printf("Enter license plate of the bus to delete: ");
+    license_plate = safe_int_input();
 
-    Client *prev = NULL;
-    Client *temp = head;
-    while (temp != NULL && temp->client_id != client_id) {
+    Bus *prev = NULL;
+    Bus *temp = head;
+    while (temp != NULL && temp->license_plate != license_plate) {
         prev = temp;
         temp = temp->next;
     }
 
     if (temp == NULL) {
-        printf("Client with ID %d not found.\n", client_id);
-        printf("Tip: Check the client ID and try again.\n");
+        printf("Bus with license plate %d not found.\n", license_plate);
+        printf("Tip: Check the license plate number and try again.\n");
         return head;
     }
 
-    // Show client details before deletion
-    printf("\nClient to be deleted:\n");
-    printf("ID: %d\n", temp->client_id);
-    printf("Name: %s %s\n", temp->first_name, temp->last_name);
-    printf("Phone: %s\n", temp->phone);
-    printf("Location: %s, %s %d\n", temp->city, temp->province, temp->postal_code);
+    // Show bus details before deletion
+    printf("\nBus to be deleted:\n");
+    printf("License Plate: %d\n", temp->license_plate);
+    printf("Price: $%.2f\n", temp->price);
+    printf("Purchase Date: %02d/%02d/%d\n", temp->purchase_date.day, temp->purchase_date.month, temp->purchase_date.year);
+    printf("Seats: %d\n", temp->seat_count);
     
     // Confirm deletion
     char confirm;
-    printf("\nAre you sure you want to delete this client? (y/N): ");
-    scanf(" %c", &confirm);
+    printf("\nAre you sure you want to delete this bus? (y/N): ");
+    ui_scanf(" %c", &confirm);
     
     if (confirm == 'y' || confirm == 'Y') {
         if (prev == NULL) {
@@ -917,8 +2356,9 @@ Client* delete_client(Client *head) {
         } else {
             prev->next = temp->next;
         }
+        bus_slot_remove(temp->license_plate);
         free(temp);
-        printf("Client deleted successfully!\n");
+        printf("Bus deleted successfully!\n");
     } else {
         printf("Deletion cancelled.\n");
     }
@@ -926,71 +2366,77 @@ Client* delete_client(Client *head) {
     return head;
 }
 
-void search_client(Client *head) {
+void search_bus(Bus *head) {
     if (head == NULL) {
-        printf("  No clients found in the system.\n");
-        printf("You need to add clients first before searching for them.\n");
-        printf("Please go to 'Client Management' -> 'Add New Client' to create your first client.\n");
+        printf("  No buses found in the system.\n");
+        printf("You need to add buses first before searching for them.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
         return;
     }
 
-    print_header("SEARCH CLIENT");
+    print_header("SEARCH BUS");
     
-    int client_id;
-    printf("Enter client ID to search: ");
-    client_id = safe_int_input();
+    int license_plate;
+    printf("Enter license plate number to search: ");
+    license_plate = safe_int_input();
 
-    Client *temp = head;
-    while (temp != NULL && temp->client_id != client_id) {
+    Bus *temp = head;
+    while (temp != NULL && temp->license_plate != license_plate) {
         temp = temp->next;
     }
 
     if (temp == NULL) {
-        printf("Client with ID %d not found.\n", client_id);
-        printf("Tip: Check the client ID and try again.\n");
+        printf("Bus with license plate %d not found.\n", license_plate);
+        printf("Tip: Check the license plate number and try again.\n");
     } else {
-        printf("\nClient found!\n\n");
+        printf("\nBus found!\n\n");
+        TableWriter *writer = table_begin(stdout);
         set_console_color(2);
-        printf("%-10s %-15s %-15s %-15s %-15s %-15s %-10s\n", 
-               "ID", "First Name", "Last Name", "Phone", "City", "Province", "Postal Code");
-        printf("%-10s %-15s %-15s %-15s %-15s %-15s %-10s\n", 
-               "==", "==========", "=========", "=====", "====", "========", "===========");
+        TABLE_HEADER(writer, bus_table);
         set_console_color(7);
-        printf("%-10d %-15s %-15s %-15s %-15s %-15s %-10d\n",
-               temp->client_id,
-               temp->first_name,
-               temp->last_name,
-               temp->phone,
-               temp->city,
-               temp->province,
-               temp->postal_code);
+        bus_table_row(writer, temp, NULL);
+        table_flush(writer);
     }
 }
 
-void save_clients_to_file(Client *head) {
-    FILE *file = fopen(CLIENT_FILENAME, "w");
+void save_buses_to_file(Bus *head) {
+    if (slot_storage_enabled()) {
+        // An attached slot file is already current
+        if (!bus_slot_file.attached || bus_slot_file.fd < 0) bus_slots_save(head);
+        return;
+    }
+
+    FILE *file = fopen(BUS_FILENAME, "w");
     if (file == NULL) {
         return;
     }
 
-    Client *temp = head;
+    Bus *temp = head;
     while (temp != NULL) {
-        fprintf(file, "%d\n%s\n%s\n%s\n%s\n%s\n%d\n",
-                temp->client_id,
-                temp->first_name,
-                temp->last_name,
-                temp->phone,
-                temp->city,
-                temp->province,
-                temp->postal_code);
+        fprintf(file, "%d\n%.2f\n%d/%d/%d\n%d\n",
+                temp->license_plate,
+                temp->price,
+                temp->purchase_date.day,
+                temp->purchase_date.month,
+                temp->purchase_date.year,
+                temp->seat_count);
         temp = temp->next;
     }
 
     fclose(file);
 }
 
-Client* load_clients_from_file(Client *head) {
-    FILE *file = fopen(CLIENT_FILENAME, "r");
+Bus* load_buses_from_file(Bus *head) {
+    if (slot_storage_enabled()) {
+        int found;
+        Bus *loaded = bus_slots_load(&found);
+        if (found) {
+            free_bus_list(head);
+            return loaded;
+        }
+    }
+
+    FILE *file = fopen(BUS_FILENAME, "r");
     if (file == NULL) {
         return head;
     }
@@ -1004,76 +2450,45 @@ Client* load_clients_from_file(Client *head) {
     rewind(file);
 
     // Free existing list first
-    free_client_list(head);
+    free_bus_list(head);
     head = NULL;
+    Bus *tail = NULL;
 
-    Client *new_client;
-    int client_id, postal_code;
-    char first_name[MAX_STRING_LENGTH], last_name[MAX_STRING_LENGTH];
-    char phone[MAX_PHONE_LENGTH], city[MAX_STRING_LENGTH], province[MAX_STRING_LENGTH];
-    char buffer[MAX_STRING_LENGTH];
+    Bus *new_bus;
+    int license_plate, seat_count;
+    float price;
+    int day, month, year;
     
-    while (fscanf(file, "%d\n", &client_id) == 1) {
-        // Read first name
-        if (fgets(first_name, MAX_STRING_LENGTH, file) == NULL) break;
-        first_name[strcspn(first_name, "\n")] = '\0'; // Remove newline
-        
-        // Read last name
-        if (fgets(last_name, MAX_STRING_LENGTH, file) == NULL) break;
-        last_name[strcspn(last_name, "\n")] = '\0'; // Remove newline
-        
-        // Read phone
-        if (fgets(phone, MAX_PHONE_LENGTH, file) == NULL) break;
-        phone[strcspn(phone, "\n")] = '\0'; // Remove newline
-        
-        // Read city
-        if (fgets(city, MAX_STRING_LENGTH, file) == NULL) break;
-        city[strcspn(city, "\n")] = '\0'; // Remove newline
-        
-        // Read province
-        if (fgets(province, MAX_STRING_LENGTH, file) == NULL) break;
-        province[strcspn(province, "\n")] = '\0'; // Remove newline
-        
-        // Read postal code
-        if (fscanf(file, "%d\n", &postal_code) != 1) break;
-        
-        new_client = (Client*)malloc(sizeof(Client));
-        if (new_client == NULL) {
+    while (fscanf(file, "%d\n%f\n%d/%d/%d\n%d\n", 
+                  &license_plate, &price, &day, &month, &year, &seat_count) == 6) {
+        new_bus = (Bus*)malloc(sizeof(Bus));
+        if (new_bus == NULL) {
             fclose(file);
             return head;
         }
 
-        new_client->client_id = client_id;
-        strncpy(new_client->first_name, first_name, MAX_STRING_LENGTH - 1);
-        new_client->first_name[MAX_STRING_LENGTH - 1] = '\0';
-        strncpy(new_client->last_name, last_name, MAX_STRING_LENGTH - 1);
-        new_client->last_name[MAX_STRING_LENGTH - 1] = '\0';
-        strncpy(new_client->phone, phone, MAX_PHONE_LENGTH - 1);
-        new_client->phone[MAX_PHONE_LENGTH - 1] = '\0';
-        strncpy(new_client->city, city, MAX_STRING_LENGTH - 1);
-        new_client->city[MAX_STRING_LENGTH - 1] = '\0';
-        strncpy(new_client->province, province, MAX_STRING_LENGTH - 1);
-        new_client->province[MAX_STRING_LENGTH - 1] = '\0';
-        new_client->postal_code = postal_code;
-        new_client->next = NULL;
+        new_bus->license_plate = license_plate;
+        new_bus->price = price;
+        new_bus->purchase_date.day = day;
+        new_bus->purchase_date.month = month;
+        new_bus->purchase_date.year = year;
+        new_bus->seat_count = seat_count;
+        new_bus->next = NULL;
 
-        if (head == NULL) {
-            head = new_client;
+        if (tail == NULL) {
+            head = new_bus;
         } else {
-            Client *temp = head;
-            while (temp->next != NULL) {
-                temp = temp->next;
-            }
-            temp->next = new_client;
+            tail->next = new_bus;
         }
+        tail = new_bus;
     }
 
     fclose(file);
     return head;
 }
 
-void free_client_list(Client *head) {
-    Client *temp;
+void free_bus_list(Bus *head) {
+    Bus *temp;
     while (head != NULL) {
         temp = head;
         head = head->next;
@@ -1081,243 +2496,242 @@ void free_client_list(Client *head) {
     }
 }
 
-// Employee management functions
-Employee* add_employee_at_end(Employee *head, Function *functions) {
-    // Check prerequisites first
-    if (!has_functions(functions)) {
-        printf("  No job functions available in the system.\n");
-        printf("You need to create job functions first before adding employees.\n");
-        printf("Please go to 'Function Management' -> 'Add New Function' to add job functions.\n");
-        return head;
-    }
+// Client management functions (similar pattern to bus functions)
 
-    Employee *new_employee = (Employee*)malloc(sizeof(Employee));
-    if (new_employee == NULL) {
-        printf("Memory allocation error. Cannot add employee.\n");
-        return head;
+// The prompts below are shared by the list and the store versions of the
+// client actions. A client is looked up in the list or, in lsm mode, in
+// the client store; found, it is copied to *client and 1 is returned.
+static int find_client(const Client *head, int client_id, Client *client) {
+    if (client_store.engine != NULL && store_get(&client_store, client_id, client)) {
+        client->next = NULL;
+        return 1;
+    }
+    for (const Client *temp = head; temp != NULL; temp = temp->next) {
+        if (temp->client_id == client_id) {
+            *client = *temp;
+            return 1;
+        }
     }
+    return 0;
+}
 
-    print_header("ADD NEW EMPLOYEE");
+static int client_id_taken(const Client *head, int client_id) {
+    Client existing;
+    return find_client(head, client_id, &existing);
+}
 
-    int employee_exists;
+static void read_client_details(Client *client, const char *prefix) {
+    printf("Enter %sfirst name: ", prefix);
+    ui_scanf("%99s", client->first_name);
+    printf("Enter %slast name: ", prefix);
+    ui_scanf("%99s", client->last_name);
+    printf("Enter %sphone number: ", prefix);
+    ui_scanf("%14s", client->phone);
+    printf("Enter %scity: ", prefix);
+    ui_scanf("%99s", client->city);
+    printf("Enter %sprovince: ", prefix);
+    ui_scanf("%99s", client->province);
+    printf("Enter %spostal code: ", prefix);
+    client->postal_code = safe_int_input();
+}
+
+static void read_new_client(Client *client, const Client *head) {
+    print_header("ADD NEW CLIENT");
+    int client_exists;
     do {
-        employee_exists = 0;
-        printf("Enter employee ID: ");
-        new_employee->employee_id = safe_int_input();
-        
-        Employee *temp = head;
-        while (temp != NULL) {
-            if (new_employee->employee_id == temp->employee_id) {
-                printf("Employee ID %d already exists. Please enter a different one.\n", new_employee->employee_id);
-                employee_exists = 1;
-                break;
-            }
-            temp = temp->next;
+        printf("Enter client ID: ");
+        client->client_id = safe_int_input();
+        client_exists = client_id_taken(head, client->client_id);
+        if (client_exists) {
+            printf("Client ID %d already exists. Please enter a different one.\n", client->client_id);
         }
-    } while (employee_exists);
-
-    printf("Enter first name: ");
-    scanf("%99s", new_employee->first_name);
-    printf("Enter last name: ");
-    scanf("%99s", new_employee->last_name);
-    printf("Enter phone number: ");
-    scanf("%14s", new_employee->phone);
-    
-    // Display available functions
-    display_functions(functions);
-    printf("Enter function ID: ");
-    new_employee->function_id = safe_int_input();
+    } while (client_exists);
+    read_client_details(client, "");
+    client->next = NULL;
+}
 
-    new_employee->next = NULL;
-    
-    if (head == NULL) {
-        printf("Employee added successfully! This is your first employee.\n");
-        return new_employee;
-    } else {
-        Employee *temp = head;
-        while (temp->next != NULL) {
-            temp = temp->next;
-        }
-        temp->next = new_employee;
-        printf("Employee added successfully!\n");
-        return head;
-    }
+static void show_client_details(const char *title, const Client *client) {
+    printf("\n%s:\n", title);
+    printf("ID: %d\n", client->client_id);
+    printf("Name: %s %s\n", client->first_name, client->last_name);
+    printf("Phone: %s\n", client->phone);
+    printf("Location: %s, %s %d\n", client->city, client->province, client->postal_code);
 }
 
-Employee* add_employee_at_beginning(Employee *head, Function *functions) {
-    // Check prerequisites first
-    if (!has_functions(functions)) {
-        printf("  No job functions available in the system.\n");
-        printf("You need to create job functions first before adding employees.\n");
-        printf("Please go to 'Function Management' -> 'Add New Function' to add job functions.\n");
-        return head;
-    }
+static void edit_client(Client *client) {
+    show_client_details("Current client details", client);
+    printf("\nEnter new details:\n");
+    read_client_details(client, "new ");
+}
 
-    Employee *new_employee = (Employee*)malloc(sizeof(Employee));
-    if (new_employee == NULL) {
+Client* add_client_at_beginning(Client *head) {
+    Client *new_client = (Client*)malloc(sizeof(Client));
+    if (new_client == NULL) {
         printf("Memory allocation error.\n");
         return head;
     }
 
-    int employee_exists;
+    int client_exists;
     do {
-        employee_exists = 0;
-        printf("Enter employee ID: ");
-        new_employee->employee_id = safe_int_input();
+        client_exists = 0;
+        printf("Enter client ID: ");
+        new_client->client_id = safe_int_input();
         
-        Employee *temp = head;
+        Client *temp = head;
         while (temp != NULL) {
-            if (new_employee->employee_id == temp->employee_id) {
-                printf("Employee ID already exists. Please enter a different one.\n");
-                employee_exists = 1;
+            if (new_client->client_id == temp->client_id) {
+                printf("Client ID already exists. Please enter a different one.\n");
+                client_exists = 1;
                 break;
             }
             temp = temp->next;
         }
-    } while (employee_exists);
+    } while (client_exists);
 
     printf("Enter first name: ");
-    scanf("%99s", new_employee->first_name);
+    ui_scanf("%99s", new_client->first_name);
     printf("Enter last name: ");
-    scanf("%99s", new_employee->last_name);
+    ui_scanf("%99s", new_client->last_name);
     printf("Enter phone number: ");
-    scanf("%14s", new_employee->phone);
-    
-    display_functions(functions);
-    printf("Enter function ID: ");
-    new_employee->function_id = safe_int_input();
+    ui_scanf("%14s", new_client->phone);
+    printf("Enter city: ");
+    ui_scanf("%99s", new_client->city);
+    printf("Enter province: ");
+    ui_scanf("%99s", new_client->province);
+    printf("Enter postal code: ");
+    new_client->postal_code = safe_int_input();
 
-    new_employee->next = head;
-    printf("Employee added successfully.\n");
-    return new_employee;
+    new_client->next = head;
+    printf("Client added successfully.\n");
+    return new_client;
 }
 
-void display_employees(Employee *head, Function *functions) {
+Client* add_client_at_end(Client *head) {
+    Client *new_client = (Client*)malloc(sizeof(Client));
+    if (new_client == NULL) {
+        printf("Memory allocation error. Cannot add client.\n");
+        return head;
+    }
+
+    read_new_client(new_client, head);
+    client_slot_put(new_client);
+    
     if (head == NULL) {
-        printf("  No employees found in the system.\n");
-        printf("You need to add employees first to view them.\n");
-        printf("Please go to 'Employee Management' -> 'Add New Employee' to create your first employee.\n");
+        printf("Client added successfully! This is your first client.\n");
+        return new_client;
+    } else {
+        Client *temp = head;
+        while (temp->next != NULL) {
+            temp = temp->next;
+        }
+        temp->next = new_client;
+        printf("Client added successfully!\n");
+        return head;
+    }
+}
+
+void display_clients(Client *head) {
+    // Attached to the store, menus outside client management pass no list
+    if (head == NULL && lsm_storage_attached()) {
+        display_client_store();
+        return;
+    }
+    if (head == NULL) {
+        printf("  No clients found in the system.\n");
+        printf("You need to add clients first to view them.\n");
+        printf("Please go to 'Client Management' -> 'Add New Client' to create your first client.\n");
         return;
     }
 
-    print_header("EMPLOYEE DATABASE");
+    print_header("CLIENT DATABASE");
     
-    int employee_count = 0;
-    Employee *temp = head;
+    // Count clients
+    int client_count = 0;
+    Client *temp = head;
     while (temp != NULL) {
-        employee_count++;
+        client_count++;
         temp = temp->next;
     }
     
-    printf("Total employees in database: %d\n\n", employee_count);
+    printf("Total clients in database: %d\n\n", client_count);
     
+    TableWriter *writer = table_begin(stdout);
     set_console_color(2);
-    printf("%-10s %-15s %-15s %-15s %-15s\n", 
-           "ID", "First Name", "Last Name", "Phone", "Function");
-    printf("%-10s %-15s %-15s %-15s %-15s\n", 
-           "==", "==========", "=========", "=====", "========");
+    TABLE_HEADER(writer, client_table);
     set_console_color(7);
 
     temp = head;
     while (temp != NULL) {
-        // Find function name
-        char function_name[MAX_STRING_LENGTH] = "Unknown";
-        Function *func = functions;
-        while (func != NULL) {
-            if (func->function_id == temp->function_id) {
-                strncpy(function_name, func->function_name, MAX_STRING_LENGTH - 1);
-                function_name[MAX_STRING_LENGTH - 1] = '\0';
-                break;
-            }
-            func = func->next;
-        }
-        
-        printf("%-10d %-15s %-15s %-15s %-15s\n",
-               temp->employee_id,
-               temp->first_name,
-               temp->last_name,
-               temp->phone,
-               function_name);
+        client_table_row(writer, temp, NULL);
         temp = temp->next;
     }
+    table_flush(writer);
 }
 
-Employee* modify_employee(Employee *head, Function *functions) {
+Client* modify_client(Client *head) {
     if (head == NULL) {
-        printf("No employees found in the system.\n");
+        printf("  No clients found in the system.\n");
+        printf("You need to add clients first before modifying them.\n");
+        printf("Please go to 'Client Management' -> 'Add New Client' to create your first client.\n");
         return head;
     }
 
-    print_header("MODIFY EMPLOYEE");
+    print_header("MODIFY CLIENT");
     
-    int employee_id;
-    printf("Enter employee ID to modify: ");
-    employee_id = safe_int_input();
+    int client_id;
+    printf("Enter client ID to modify: ");
+    client_id = safe_int_input();
 
-    Employee *temp = head;
-    while (temp != NULL && temp->employee_id != employee_id) {
+    Client *temp = head;
+    while (temp != NULL && temp->client_id != client_id) {
         temp = temp->next;
     }
 
     if (temp == NULL) {
-        printf("Employee with ID %d not found.\n", employee_id);
+        printf("Client with ID %d not found.\n", client_id);
+        printf("Tip: Check the client ID and try again.\n");
         return head;
     }
 
-    printf("\nCurrent employee details:\n");
-    printf("ID: %d\n", temp->employee_id);
-    printf("Name: %s %s\n", temp->first_name, temp->last_name);
-    printf("Phone: %s\n", temp->phone);
-    printf("Function ID: %d\n", temp->function_id);
-    
-    printf("\nEnter new details:\n");
-    printf("Enter new first name: ");
-    scanf("%99s", temp->first_name);
-    printf("Enter new last name: ");
-    scanf("%99s", temp->last_name);
-    printf("Enter new phone number: ");
-    scanf("%14s", temp->phone);
-    
-    display_functions(functions);
-    printf("Enter new function ID: ");
-    temp->function_id = safe_int_input();
-
-    printf("Employee information updated successfully!\n");
+    edit_client(temp);
+    client_slot_put(temp);
+    printf("Client information updated successfully!\n");
     return head;
 }
 
-Employee* delete_employee(Employee *head) {
+Client* delete_client(Client *head) {
     if (head == NULL) {
-        printf("No employees found in the system.\n");
+        printf("  No clients found in the system.\n");
+        printf("You need to add clients first before deleting them.\n");
+        printf("Please go to 'Client Management' -> 'Add New Client' to create your first client.\n");
         return head;
     }
 
-    print_header("DELETE EMPLOYEE");
+    print_header("DELETE CLIENT");
     
-    int employee_id;
-    printf("Enter employee ID to delete: ");
-    employee_id = safe_int_input();
+    int client_id;
+    printf("Enter client ID to delete: ");
+    client_id = safe_int_input();
 
-    Employee *prev = NULL;
-    Employee *temp = head;
-    while (temp != NULL && temp->employee_id != employee_id) {
+    Client *prev = NULL;
+    Client *temp = head;
+    while (temp != NULL && temp->client_id != client_id) {
         prev = temp;
         temp = temp->next;
     }
 
     if (temp == NULL) {
-        printf("Employee with ID %d not found.\n", employee_id);
+        printf("Client with ID %d not found.\n", client_id);
+        printf("Tip: Check the client ID and try again.\n");
         return head;
     }
 
-    printf("\nEmployee to be deleted:\n");
-    printf("ID: %d\n", temp->employee_id);
-    printf("Name: %s %s\n", temp->first_name, temp->last_name);
-    printf("Phone: %s\n", temp->phone);
+    show_client_details("Client to be deleted", temp);
     
+    // Confirm deletion
     char confirm;
-    printf("\nAre you sure you want to delete this employee? (y/N): ");
-    scanf(" %c", &confirm);
+    printf("\nAre you sure you want to delete this client? (y/N): ");
+    ui_scanf(" %c", &confirm);
     
     if (confirm == 'y' || confirm == 'Y') {
         if (prev == NULL) {
@@ -1325,8 +2739,9 @@ Employee* delete_employee(Employee *head) {
         } else {
             prev->next = temp->next;
         }
+        client_slot_remove(temp->client_id);
         free(temp);
-        printf("Employee deleted successfully!\n");
+        printf("Client deleted successfully!\n");
     } else {
         printf("Deletion cancelled.\n");
     }
@@ -1334,127 +2749,289 @@ Employee* delete_employee(Employee *head) {
     return head;
 }
 
-void search_employee(Employee *head, Function *functions) {
+void search_client(Client *head) {
     if (head == NULL) {
-        printf("No employees found in the system.\n");
+        printf("  No clients found in the system.\n");
+        printf("You need to add clients first before searching for them.\n");
+        printf("Please go to 'Client Management' -> 'Add New Client' to create your first client.\n");
         return;
     }
 
-    print_header("SEARCH EMPLOYEE");
+    print_header("SEARCH CLIENT");
     
-    int employee_id;
-    printf("Enter employee ID to search: ");
-    employee_id = safe_int_input();
+    int client_id;
+    printf("Enter client ID to search: ");
+    client_id = safe_int_input();
 
-    Employee *temp = head;
-    while (temp != NULL && temp->employee_id != employee_id) {
+    Client *temp = head;
+    while (temp != NULL && temp->client_id != client_id) {
         temp = temp->next;
     }
 
     if (temp == NULL) {
-        printf("Employee with ID %d not found.\n", employee_id);
+        printf("Client with ID %d not found.\n", client_id);
+        printf("Tip: Check the client ID and try again.\n");
     } else {
-        printf("\nEmployee found!\n\n");
+        printf("\nClient found!\n\n");
+        TableWriter *writer = table_begin(stdout);
         set_console_color(2);
-        printf("%-10s %-15s %-15s %-15s %-15s\n", 
-               "ID", "First Name", "Last Name", "Phone", "Function");
-        printf("%-10s %-15s %-15s %-15s %-15s\n", 
-               "==", "==========", "=========", "=====", "========");
+        TABLE_HEADER(writer, client_table);
         set_console_color(7);
-        
-        char function_name[MAX_STRING_LENGTH] = "Unknown";
-        Function *func = functions;
-        while (func != NULL) {
-            if (func->function_id == temp->function_id) {
-                strncpy(function_name, func->function_name, MAX_STRING_LENGTH - 1);
-                function_name[MAX_STRING_LENGTH - 1] = '\0';
-                break;
-            }
-            func = func->next;
-        }
-        
-        printf("%-10d %-15s %-15s %-15s %-15s\n",
-               temp->employee_id,
-               temp->first_name,
-               temp->last_name,
-               temp->phone,
-               function_name);
+        client_table_row(writer, temp, NULL);
+        table_flush(writer);
     }
 }
 
-void save_employees_to_file(Employee *head) {
-    FILE *file = fopen(EMPLOYEE_FILENAME, "w");
-    if (file == NULL) {
-        return;
-    }
+// Client menu actions against the client store (BUSFLOW_STORAGE=lsm)
+void add_client_to_store(void) {
+    Client client;
+    memset(&client, 0, sizeof(Client));
+    read_new_client(&client, NULL);
 
-    Employee *temp = head;
-    while (temp != NULL) {
-        fprintf(file, "%d\n%s\n%s\n%s\n%d\n",
-                temp->employee_id,
-                temp->first_name,
-                temp->last_name,
-                temp->phone,
-                temp->function_id);
-        temp = temp->next;
+    if (store_put(&client_store, client.client_id, &client) != 0) {
+        printf("Could not store the client.\n");
+        return;
     }
+    printf("Client added successfully!\n");
+}
 
-    fclose(file);
+static int client_store_row(int key, const void *record, void *context) {
+    StoreView *view = (StoreView*)context;
+    Client client;
+    (void)key;
+    memcpy(&client, record, offsetof(Client, next));
+    client.next = NULL;
+    client_table_row(view->writer, &client, NULL);
+    view->count++;
+    return 0;
 }
 
-Employee* load_employees_from_file(Employee *head) {
-    FILE *file = fopen(EMPLOYEE_FILENAME, "r");
-    if (file == NULL) {
-        return head;
-    }
+void display_client_store(void) {
+    print_header("CLIENT DATABASE");
 
-    fseek(file, 0L, SEEK_END);
-    if (ftell(file) == 0) {
-        fclose(file);
-        return head;
+    StoreView view = { table_begin(stdout), NULL, 0 };
+    set_console_color(2);
+    TABLE_HEADER(view.writer, client_table);
+    set_console_color(7);
+    store_scan(&client_store, client_store_row, &view);
+    table_flush(view.writer);
+
+    if (view.count == 0) {
+        printf("  No clients found in the system.\n");
+        printf("Please go to 'Client Management' -> 'Add New Client' to create your first client.\n");
+    } else {
+        printf("\nTotal clients in database: %d\n", view.count);
     }
-    rewind(file);
+}
 
-    free_employee_list(head);
-    head = NULL;
+void modify_client_in_store(void) {
+    print_header("MODIFY CLIENT");
 
-    Employee *new_employee;
-    int employee_id, function_id;
+    Client client;
+    int client_id;
+    printf("Enter client ID to modify: ");
+    client_id = safe_int_input();
+    if (!store_get(&client_store, client_id, &client)) {
+        printf("Client with ID %d not found.\n", client_id);
+        printf("Tip: Check the client ID and try again.\n");
+        return;
+    }
+
+    edit_client(&client);
+
+    if (store_put(&client_store, client.client_id, &client) != 0) {
+        printf("Could not store the client.\n");
+        return;
+    }
+    printf("Client information updated successfully!\n");
+}
+
+void delete_client_from_store(void) {
+    print_header("DELETE CLIENT");
+
+    Client client;
+    int client_id;
+    printf("Enter client ID to delete: ");
+    client_id = safe_int_input();
+    if (!store_get(&client_store, client_id, &client)) {
+        printf("Client with ID %d not found.\n", client_id);
+        printf("Tip: Check the client ID and try again.\n");
+        return;
+    }
+
+    show_client_details("Client to be deleted", &client);
+
+    char confirm;
+    printf("\nAre you sure you want to delete this client? (y/N): ");
+    ui_scanf(" %c", &confirm);
+
+    if (confirm == 'y' || confirm == 'Y') {
+        if (store_remove(&client_store, client_id) != 0) {
+            printf("Could not delete the client.\n");
+            return;
+        }
+        printf("Client deleted successfully!\n");
+    } else {
+        printf("Deletion cancelled.\n");
+    }
+}
+
+void search_client_in_store(void) {
+    print_header("SEARCH CLIENT");
+
+    Client client;
+    int client_id;
+    printf("Enter client ID to search: ");
+    client_id = safe_int_input();
+    if (!store_get(&client_store, client_id, &client)) {
+        printf("Client with ID %d not found.\n", client_id);
+        printf("Tip: Check the client ID and try again.\n");
+        return;
+    }
+
+    client.next = NULL;
+    printf("\nClient found!\n\n");
+    TableWriter *writer = table_begin(stdout);
+    set_console_color(2);
+    TABLE_HEADER(writer, client_table);
+    set_console_color(7);
+    client_table_row(writer, &client, NULL);
+    table_flush(writer);
+}
+
+void save_clients_to_file(Client *head) {
+    if (lsm_storage_enabled()) {
+        // An attached store is always current
+        if (!lsm_storage_attached()) client_store_save(head);
+        return;
+    }
+    if (slot_storage_enabled()) {
+        // An attached slot file is already current
+        if (!client_slot_file.attached || client_slot_file.fd < 0) client_slots_save(head);
+        return;
+    }
+
+    FILE *file = fopen(CLIENT_FILENAME, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    Client *temp = head;
+    while (temp != NULL) {
+        fprintf(file, "%d\n%s\n%s\n%s\n%s\n%s\n%d\n",
+                temp->client_id,
+                temp->first_name,
+                temp->last_name,
+                temp->phone,
+                temp->city,
+                temp->province,
+                temp->postal_code);
+        temp = temp->next;
+    }
+
+    fclose(file);
+}
+
+Client* load_clients_from_file(Client *head) {
+    if (lsm_storage_enabled()) {
+        // Attached, the menus read the store itself; a new store is filled from the text file
+        if (lsm_storage_attached()) {
+            if (!client_store.created) return head;
+        } else if (client_store_load(&head) != 0) {
+            return head; // loaded, or the session refuses to start
+        }
+    }
+    if (slot_storage_enabled()) {
+        int found;
+        Client *loaded = client_slots_load(&found);
+        if (found) {
+            free_client_list(head);
+            return loaded;
+        }
+    }
+
+    FILE *file = fopen(CLIENT_FILENAME, "r");
+    if (file == NULL) {
+        return head;
+    }
+
+    // Check if file is empty
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
+        return head;
+    }
+    rewind(file);
+
+    // Free existing list first
+    free_client_list(head);
+    head = NULL;
+    Client *tail = NULL;
+
+    Client *new_client;
+    int client_id, postal_code;
     char first_name[MAX_STRING_LENGTH], last_name[MAX_STRING_LENGTH];
-    char phone[MAX_PHONE_LENGTH];
+    char phone[MAX_PHONE_LENGTH], city[MAX_STRING_LENGTH], province[MAX_STRING_LENGTH];
+    char buffer[MAX_STRING_LENGTH];
     
-    while (fscanf(file, "%d\n%99s\n%99s\n%14s\n%d\n", 
-                  &employee_id, first_name, last_name, phone, &function_id) == 5) {
-        new_employee = (Employee*)malloc(sizeof(Employee));
-        if (new_employee == NULL) {
+    while (fscanf(file, "%d\n", &client_id) == 1) {
+        // Read first name
+        if (fgets(first_name, MAX_STRING_LENGTH, file) == NULL) break;
+        first_name[strcspn(first_name, "\n")] = '\0'; // Remove newline
+        
+        // Read last name
+        if (fgets(last_name, MAX_STRING_LENGTH, file) == NULL) break;
+        last_name[strcspn(last_name, "\n")] = '\0'; // Remove newline
+        
+        // Read phone
+        if (fgets(phone, MAX_PHONE_LENGTH, file) == NULL) break;
+        phone[strcspn(phone, "\n")] = '\0'; // Remove newline
+        
+        // Read city
+        if (fgets(city, MAX_STRING_LENGTH, file) == NULL) break;
+        city[strcspn(city, "\n")] = '\0'; // Remove newline
+        
+        // Read province
+        if (fgets(province, MAX_STRING_LENGTH, file) == NULL) break;
+        province[strcspn(province, "\n")] = '\0'; // Remove newline
+        
+        // Read postal code
+        if (fscanf(file, "%d\n", &postal_code) != 1) break;
+        
+        new_client = (Client*)malloc(sizeof(Client));
+        if (new_client == NULL) {
             fclose(file);
             return head;
         }
 
-        new_employee->employee_id = employee_id;
-        strncpy(new_employee->first_name, first_name, MAX_STRING_LENGTH - 1);
-        strncpy(new_employee->last_name, last_name, MAX_STRING_LENGTH - 1);
-        strncpy(new_employee->phone, phone, MAX_PHONE_LENGTH - 1);
-        new_employee->function_id = function_id;
-        new_employee->next = NULL;
+        new_client->client_id = client_id;
+        strncpy(new_client->first_name, first_name, MAX_STRING_LENGTH - 1);
+        new_client->first_name[MAX_STRING_LENGTH - 1] = '\0';
+        strncpy(new_client->last_name, last_name, MAX_STRING_LENGTH - 1);
+        new_client->last_name[MAX_STRING_LENGTH - 1] = '\0';
+        strncpy(new_client->phone, phone, MAX_PHONE_LENGTH - 1);
+        new_client->phone[MAX_PHONE_LENGTH - 1] = '\0';
+        strncpy(new_client->city, city, MAX_STRING_LENGTH - 1);
+        new_client->city[MAX_STRING_LENGTH - 1] = '\0';
+        strncpy(new_client->province, province, MAX_STRING_LENGTH - 1);
+        new_client->province[MAX_STRING_LENGTH - 1] = '\0';
+        new_client->postal_code = postal_code;
+        new_client->next = NULL;
 
-        if (head == NULL) {
-            head = new_employee;
+        if (tail == NULL) {
+            head = new_client;
         } else {
-            Employee *temp = head;
-            while (temp->next != NULL) {
-                temp = temp->next;
-            }
-            temp->next = new_employee;
+            tail->next = new_client;
         }
+        tail = new_client;
     }
 
     fclose(file);
     return head;
 }
 
-void free_employee_list(Employee *head) {
-    Employee *temp;
+void free_client_list(Client *head) {
+    Client *temp;
     while (head != NULL) {
         temp = head;
         head = head->next;
@@ -1462,201 +3039,241 @@ void free_employee_list(Employee *head) {
     }
 }
 
-// Function management functions
-Function* add_function_at_beginning(Function *head) {
-    Function *new_function = (Function*)malloc(sizeof(Function));
-    if (new_function == NULL) {
-        printf("Memory allocation error.\n");
-        return head;
+// Employee management functions
+
+// Prompts shared by the list and the store versions of the employee
+// actions. Lookups go to the list or, in lsm mode, the employee store.
+static int find_employee(const Employee *head, int employee_id, Employee *employee) {
+    if (employee_store.engine != NULL && store_get(&employee_store, employee_id, employee)) {
+        employee->next = NULL;
+        return 1;
+    }
+    for (const Employee *temp = head; temp != NULL; temp = temp->next) {
+        if (temp->employee_id == employee_id) {
+            *employee = *temp;
+            return 1;
+        }
     }
+    return 0;
+}
 
-    int function_exists;
+static int employee_id_taken(const Employee *head, int employee_id) {
+    Employee existing;
+    return find_employee(head, employee_id, &existing);
+}
+
+static void read_employee_details(Employee *employee, Function *functions, const char *prefix) {
+    printf("Enter %sfirst name: ", prefix);
+    ui_scanf("%99s", employee->first_name);
+    printf("Enter %slast name: ", prefix);
+    ui_scanf("%99s", employee->last_name);
+    printf("Enter %sphone number: ", prefix);
+    ui_scanf("%14s", employee->phone);
+
+    // Display available functions
+    display_functions(functions);
+    printf("Enter %sfunction ID: ", prefix);
+    employee->function_id = safe_int_input();
+}
+
+static void read_new_employee(Employee *employee, const Employee *head, Function *functions) {
+    print_header("ADD NEW EMPLOYEE");
+    int employee_exists;
     do {
-        function_exists = 0;
-        printf("Enter function ID: ");
-        new_function->function_id = safe_int_input();
-        
-        Function *temp = head;
-        while (temp != NULL) {
-            if (new_function->function_id == temp->function_id) {
-                printf("Function ID already exists. Please enter a different one.\n");
-                function_exists = 1;
-                break;
-            }
-            temp = temp->next;
+        printf("Enter employee ID: ");
+        employee->employee_id = safe_int_input();
+        employee_exists = employee_id_taken(head, employee->employee_id);
+        if (employee_exists) {
+            printf("Employee ID %d already exists. Please enter a different one.\n", employee->employee_id);
         }
-    } while (function_exists);
+    } while (employee_exists);
+    read_employee_details(employee, functions, "");
+    employee->next = NULL;
+}
 
-    printf("Enter function name: ");
-    scanf("%99s", new_function->function_name);
-    printf("Enter salary: $");
-    new_function->salary = safe_float_input();
+static void edit_employee(Employee *employee, Function *functions) {
+    printf("\nCurrent employee details:\n");
+    printf("ID: %d\n", employee->employee_id);
+    printf("Name: %s %s\n", employee->first_name, employee->last_name);
+    printf("Phone: %s\n", employee->phone);
+    printf("Function ID: %d\n", employee->function_id);
 
-    new_function->next = head;
-    printf("Function added successfully.\n");
-    return new_function;
+    printf("\nEnter new details:\n");
+    read_employee_details(employee, functions, "new ");
 }
 
-Function* add_function_at_end(Function *head) {
-    Function *new_function = (Function*)malloc(sizeof(Function));
-    if (new_function == NULL) {
-        printf("Memory allocation error. Cannot add function.\n");
+Employee* add_employee_at_end(Employee *head, Function *functions) {
+    // Check prerequisites first
+    if (!has_functions(functions)) {
+        printf("  No job functions available in the system.\n");
+        printf("You need to create job functions first before adding employees.\n");
+        printf("Please go to 'Function Management' -> 'Add New Function' to add job functions.\n");
         return head;
     }
 
-    print_header("ADD NEW FUNCTION");
-
-    int function_exists;
-    do {
-        function_exists = 0;
-        printf("Enter function ID: ");
-        new_function->function_id = safe_int_input();
-        
-        Function *temp = head;
-        while (temp != NULL) {
-            if (new_function->function_id == temp->function_id) {
-                printf("Function ID %d already exists. Please enter a different one.\n", new_function->function_id);
-                function_exists = 1;
-                break;
-            }
-            temp = temp->next;
-        }
-    } while (function_exists);
-
-    printf("Enter function name: ");
-    scanf("%99s", new_function->function_name);
-    printf("Enter salary: $");
-    new_function->salary = safe_float_input();
+    Employee *new_employee = (Employee*)malloc(sizeof(Employee));
+    if (new_employee == NULL) {
+        printf("Memory allocation error. Cannot add employee.\n");
+        return head;
+    }
 
-    new_function->next = NULL;
+    read_new_employee(new_employee, head, functions);
+    employee_slot_put(new_employee);
     
     if (head == NULL) {
-        printf("Function added successfully! This is your first function.\n");
-        return new_function;
+        printf("Employee added successfully! This is your first employee.\n");
+        return new_employee;
     } else {
-        Function *temp = head;
+        Employee *temp = head;
         while (temp->next != NULL) {
             temp = temp->next;
         }
-        temp->next = new_function;
-        printf("Function added successfully!\n");
+        temp->next = new_employee;
+        printf("Employee added successfully!\n");
         return head;
     }
 }
 
-void display_functions(Function *head) {
+Employee* add_employee_at_beginning(Employee *head, Function *functions) {
+    // Check prerequisites first
+    if (!has_functions(functions)) {
+        printf("  No job functions available in the system.\n");
+        printf("You need to create job functions first before adding employees.\n");
+        printf("Please go to 'Function Management' -> 'Add New Function' to add job functions.\n");
+        return head;
+    }
+
+    Employee *new_employee = (Employee*)malloc(sizeof(Employee));
+    if (new_employee == NULL) {
+        printf("Memory allocation error.\n");
+        return head;
+    }
+
+    int employee_exists;
+    do {
+        employee_exists = 0;
+        printf("Enter employee ID: ");
+        new_employee->employee_id = safe_int_input();
+        
+        Employee *temp = head;
+        while (temp != NULL) {
+            if (new_employee->employee_id == temp->employee_id) {
+                printf("Employee ID already exists. Please enter a different one.\n");
+                employee_exists = 1;
+                break;
+            }
+            temp = temp->next;
+        }
+    } while (employee_exists);
+
+    printf("Enter first name: ");
+    ui_scanf("%99s", new_employee->first_name);
+    printf("Enter last name: ");
+    ui_scanf("%99s", new_employee->last_name);
+    printf("Enter phone number: ");
+    ui_scanf("%14s", new_employee->phone);
+    
+    display_functions(functions);
+    printf("Enter function ID: ");
+    new_employee->function_id = safe_int_input();
+
+    new_employee->next = head;
+    printf("Employee added successfully.\n");
+    return new_employee;
+}
+
+void display_employees(Employee *head, Function *functions) {
     if (head == NULL) {
-        printf("  No functions found in the system.\n");
-        printf("You need to add job functions first to view them.\n");
-        printf("Please go to 'Function Management' -> 'Add New Function' to create your first function.\n");
+        printf("  No employees found in the system.\n");
+        printf("You need to add employees first to view them.\n");
+        printf("Please go to 'Employee Management' -> 'Add New Employee' to create your first employee.\n");
         return;
     }
 
-    print_header("FUNCTION DATABASE");
+    print_header("EMPLOYEE DATABASE");
     
-    // Count functions
-    int function_count = 0;
-    Function *temp = head;
+    int employee_count = 0;
+    Employee *temp = head;
     while (temp != NULL) {
-        function_count++;
+        employee_count++;
         temp = temp->next;
     }
     
-    printf("Total functions in database: %d\n\n", function_count);
+    printf("Total employees in database: %d\n\n", employee_count);
     
+    TableWriter *writer = table_begin(stdout);
     set_console_color(2);
-    printf("%-10s %-20s %-15s\n", "ID", "Function Name", "Salary ($)");
-    printf("%-10s %-20s %-15s\n", "==", "=============", "==========");
+    TABLE_HEADER(writer, employee_table);
     set_console_color(7);
 
     temp = head;
     while (temp != NULL) {
-        printf("%-10d %-20s %-15.2f\n",
-               temp->function_id,
-               temp->function_name,
-               temp->salary);
+        employee_table_row(writer, temp, functions);
         temp = temp->next;
     }
+    table_flush(writer);
 }
 
-Function* modify_function(Function *head) {
+Employee* modify_employee(Employee *head, Function *functions) {
     if (head == NULL) {
-        printf("  No functions found in the system.\n");
-        printf("You need to add job functions first before modifying them.\n");
-        printf("Please go to 'Function Management' -> 'Add New Function' to create your first function.\n");
+        printf("No employees found in the system.\n");
         return head;
     }
 
-    print_header("MODIFY FUNCTION");
+    print_header("MODIFY EMPLOYEE");
     
-    int function_id;
-    printf("Enter function ID to modify: ");
-    function_id = safe_int_input();
+    int employee_id;
+    printf("Enter employee ID to modify: ");
+    employee_id = safe_int_input();
 
-    Function *temp = head;
-    while (temp != NULL && temp->function_id != function_id) {
+    Employee *temp = head;
+    while (temp != NULL && temp->employee_id != employee_id) {
         temp = temp->next;
     }
 
     if (temp == NULL) {
-        printf("Function with ID %d not found.\n", function_id);
-        printf("Tip: Check the function ID and try again.\n");
+        printf("Employee with ID %d not found.\n", employee_id);
         return head;
     }
 
-    // Show current function details
-    printf("\nCurrent function details:\n");
-    printf("ID: %d\n", temp->function_id);
-    printf("Name: %s\n", temp->function_name);
-    printf("Salary: $%.2f\n", temp->salary);
-    
-    printf("\nEnter new details:\n");
-    printf("Enter new function name: ");
-    scanf("%99s", temp->function_name);
-    printf("Enter new salary: $");
-    temp->salary = safe_float_input();
-
-    printf("Function information updated successfully!\n");
+    edit_employee(temp, functions);
+    employee_slot_put(temp);
+    printf("Employee information updated successfully!\n");
     return head;
 }
 
-Function* delete_function(Function *head) {
+Employee* delete_employee(Employee *head) {
     if (head == NULL) {
-        printf("  No functions found in the system.\n");
-        printf("You need to add job functions first before deleting them.\n");
-        printf("Please go to 'Function Management' -> 'Add New Function' to create your first function.\n");
+        printf("No employees found in the system.\n");
         return head;
     }
 
-    print_header("DELETE FUNCTION");
+    print_header("DELETE EMPLOYEE");
     
-    int function_id;
-    printf("Enter function ID to delete: ");
-    function_id = safe_int_input();
+    int employee_id;
+    printf("Enter employee ID to delete: ");
+    employee_id = safe_int_input();
 
-    Function *prev = NULL;
-    Function *temp = head;
-    while (temp != NULL && temp->function_id != function_id) {
+    Employee *prev = NULL;
+    Employee *temp = head;
+    while (temp != NULL && temp->employee_id != employee_id) {
         prev = temp;
         temp = temp->next;
     }
 
     if (temp == NULL) {
-        printf("Function with ID %d not found.\n", function_id);
-        printf("Tip: Check the function ID and try again.\n");
+        printf("Employee with ID %d not found.\n", employee_id);
         return head;
     }
 
-    // Show function details before deletion
-    printf("\nFunction to be deleted:\n");
-    printf("ID: %d\n", temp->function_id);
-    printf("Name: %s\n", temp->function_name);
-    printf("Salary: $%.2f\n", temp->salary);
+    printf("\nEmployee to be deleted:\n");
+    printf("ID: %d\n", temp->employee_id);
+    printf("Name: %s %s\n", temp->first_name, temp->last_name);
+    printf("Phone: %s\n", temp->phone);
     
-    // Confirm deletion
     char confirm;
-    printf("\nAre you sure you want to delete this function? (y/N): ");
-    scanf(" %c", &confirm);
+    printf("\nAre you sure you want to delete this employee? (y/N): ");
+    ui_scanf(" %c", &confirm);
     
     if (confirm == 'y' || confirm == 'Y') {
         if (prev == NULL) {
@@ -1664,8 +3281,9 @@ Function* delete_function(Function *head) {
         } else {
             prev->next = temp->next;
         }
+        employee_slot_remove(temp->employee_id);
         free(temp);
-        printf("Function deleted successfully!\n");
+        printf("Employee deleted successfully!\n");
     } else {
         printf("Deletion cancelled.\n");
     }
@@ -1673,772 +3291,10751 @@ Function* delete_function(Function *head) {
     return head;
 }
 
-void search_function(Function *head) {
+void search_employee(Employee *head, Function *functions) {
     if (head == NULL) {
-        printf("  No functions found in the system.\n");
-        printf("You need to add job functions first before searching for them.\n");
-        printf("Please go to 'Function Management' -> 'Add New Function' to create your first function.\n");
+        printf("No employees found in the system.\n");
         return;
     }
 
-    print_header("SEARCH FUNCTION");
+    print_header("SEARCH EMPLOYEE");
     
-    int function_id;
-    printf("Enter function ID to search: ");
-    function_id = safe_int_input();
+    int employee_id;
+    printf("Enter employee ID to search: ");
+    employee_id = safe_int_input();
 
-    Function *temp = head;
-    while (temp != NULL && temp->function_id != function_id) {
+    Employee *temp = head;
+    while (temp != NULL && temp->employee_id != employee_id) {
         temp = temp->next;
     }
 
     if (temp == NULL) {
-        printf("Function with ID %d not found.\n", function_id);
-        printf("Tip: Check the function ID and try again.\n");
+        printf("Employee with ID %d not found.\n", employee_id);
     } else {
-        printf("\nFunction found!\n\n");
+        printf("\nEmployee found!\n\n");
+        TableWriter *writer = table_begin(stdout);
         set_console_color(2);
-        printf("%-10s %-20s %-15s\n", "ID", "Function Name", "Salary ($)");
-        printf("%-10s %-20s %-15s\n", "==", "=============", "==========");
+        TABLE_HEADER(writer, employee_table);
         set_console_color(7);
-        printf("%-10d %-20s %-15.2f\n",
-               temp->function_id,
-               temp->function_name,
-               temp->salary);
+        employee_table_row(writer, temp, functions);
+        table_flush(writer);
     }
 }
 
-void save_functions_to_file(Function *head) {
-    FILE *file = fopen(FUNCTION_FILENAME, "w");
-    if (file == NULL) {
+// Employee menu actions against the employee store (BUSFLOW_STORAGE=lsm)
+void add_employee_to_store(Function *functions) {
+    if (!has_functions(functions)) {
+        printf("  No job functions available in the system.\n");
+        printf("You need to create job functions first before adding employees.\n");
+        printf("Please go to 'Function Management' -> 'Add New Function' to add job functions.\n");
         return;
     }
 
-    Function *temp = head;
-    while (temp != NULL) {
-        fprintf(file, "%d\n%s\n%.2f\n",
-                temp->function_id,
-                temp->function_name,
-                temp->salary);
-        temp = temp->next;
+    Employee employee;
+    memset(&employee, 0, sizeof(Employee));
+    read_new_employee(&employee, NULL, functions);
+
+    if (store_put(&employee_store, employee.employee_id, &employee) != 0) {
+        printf("Could not store the employee.\n");
+        return;
     }
+    printf("Employee added successfully!\n");
+}
 
-    fclose(file);
+static int employee_store_row(int key, const void *record, void *context) {
+    StoreView *view = (StoreView*)context;
+    Employee employee;
+    (void)key;
+    memcpy(&employee, record, offsetof(Employee, next));
+    employee.next = NULL;
+    employee_table_row(view->writer, &employee, (const Function*)view->context);
+    view->count++;
+    return 0;
 }
 
-Function* load_functions_from_file(Function *head) {
-    FILE *file = fopen(FUNCTION_FILENAME, "r");
-    if (file == NULL) {
-        return head;
-    }
+void display_employee_store(Function *functions) {
+    print_header("EMPLOYEE DATABASE");
 
-    // Check if file is empty
-    fseek(file, 0L, SEEK_END);
-    if (ftell(file) == 0) {
-        fclose(file);
-        return head;
+    StoreView view = { table_begin(stdout), functions, 0 };
+    set_console_color(2);
+    TABLE_HEADER(view.writer, employee_table);
+    set_console_color(7);
+    store_scan(&employee_store, employee_store_row, &view);
+    table_flush(view.writer);
+
+    if (view.count == 0) {
+        printf("  No employees found in the system.\n");
+        printf("Please go to 'Employee Management' -> 'Add New Employee' to create your first employee.\n");
+    } else {
+        printf("\nTotal employees in database: %d\n", view.count);
     }
-    rewind(file);
+}
 
-    // Free existing list first
-    free_function_list(head);
-    head = NULL;
+void modify_employee_in_store(Function *functions) {
+    print_header("MODIFY EMPLOYEE");
 
-    Function *new_function;
-    int function_id;
-    char function_name[MAX_STRING_LENGTH];
-    float salary;
-    
-    while (fscanf(file, "%d\n%99s\n%f\n", &function_id, function_name, &salary) == 3) {
-        new_function = (Function*)malloc(sizeof(Function));
-        if (new_function == NULL) {
-            fclose(file);
-            return head;
-        }
+    Employee employee;
+    int employee_id;
+    printf("Enter employee ID to modify: ");
+    employee_id = safe_int_input();
+    if (!store_get(&employee_store, employee_id, &employee)) {
+        printf("Employee with ID %d not found.\n", employee_id);
+        return;
+    }
 
-        new_function->function_id = function_id;
-        strncpy(new_function->function_name, function_name, MAX_STRING_LENGTH - 1);
-        new_function->function_name[MAX_STRING_LENGTH - 1] = '\0';
-        new_function->salary = salary;
-        new_function->next = NULL;
+    edit_employee(&employee, functions);
 
-        if (head == NULL) {
-            head = new_function;
-        } else {
-            Function *temp = head;
-            while (temp->next != NULL) {
-                temp = temp->next;
-            }
-            temp->next = new_function;
-        }
+    if (store_put(&employee_store, employee.employee_id, &employee) != 0) {
+        printf("Could not store the employee.\n");
+        return;
     }
-
-    fclose(file);
-    return head;
+    printf("Employee information updated successfully!\n");
 }
 
-void free_function_list(Function *head) {
-    Function *temp;
-    while (head != NULL) {
-        temp = head;
-        head = head->next;
-        free(temp);
+void delete_employee_from_store(void) {
+    print_header("DELETE EMPLOYEE");
+
+    Employee employee;
+    int employee_id;
+    printf("Enter employee ID to delete: ");
+    employee_id = safe_int_input();
+    if (!store_get(&employee_store, employee_id, &employee)) {
+        printf("Employee with ID %d not found.\n", employee_id);
+        return;
     }
-}
 
-// DateTime validation functions
-int is_valid_time(int hour, int minute) {
-    if (hour < 0 || hour > 23) return 0;
-    if (minute < 0 || minute > 59) return 0;
-    return 1;
-}
+    printf("\nEmployee to be deleted:\n");
+    printf("ID: %d\n", employee.employee_id);
+    printf("Name: %s %s\n", employee.first_name, employee.last_name);
+    printf("Phone: %s\n", employee.phone);
 
-int is_valid_datetime(int day, int month, int year, int hour, int minute) {
-    if (!is_valid_date(day, month, year)) return 0;
-    if (!is_valid_time(hour, minute)) return 0;
-    return 1;
+    char confirm;
+    printf("\nAre you sure you want to delete this employee? (y/N): ");
+    ui_scanf(" %c", &confirm);
+
+    if (confirm == 'y' || confirm == 'Y') {
+        if (store_remove(&employee_store, employee_id) != 0) {
+            printf("Could not delete the employee.\n");
+            return;
+        }
+        printf("Employee deleted successfully!\n");
+    } else {
+        printf("Deletion cancelled.\n");
+    }
 }
 
-// Trip management functions
-Trip* add_trip_at_beginning(Trip *head, Bus *buses, Client *clients) {
-    // Check prerequisites first
-    if (!has_buses(buses)) {
-        printf("  No buses available in the system.\n");
-        printf("You need to add buses first before creating trips.\n");
-        printf("Please go to 'Bus Management' -> 'Add New Bus' to add your first bus.\n");
-        return head;
+void search_employee_in_store(Function *functions) {
+    print_header("SEARCH EMPLOYEE");
+
+    Employee employee;
+    int employee_id;
+    printf("Enter employee ID to search: ");
+    employee_id = safe_int_input();
+    if (!store_get(&employee_store, employee_id, &employee)) {
+        printf("Employee with ID %d not found.\n", employee_id);
+        return;
     }
-    
-    if (!has_clients(clients)) {
-        printf("  No clients available in the system.\n");
-        printf("You need to add clients first before creating trips.\n");
-        printf("Please go to 'Client Management' -> 'Add New Client' to add your first client.\n");
-        return head;
+
+    employee.next = NULL;
+    printf("\nEmployee found!\n\n");
+    TableWriter *writer = table_begin(stdout);
+    set_console_color(2);
+    TABLE_HEADER(writer, employee_table);
+    set_console_color(7);
+    employee_table_row(writer, &employee, functions);
+    table_flush(writer);
+}
+
+void save_employees_to_file(Employee *head) {
+    if (lsm_storage_enabled()) {
+        // An attached store is always current
+        if (!lsm_storage_attached()) employee_store_save(head);
+        return;
+    }
+    if (slot_storage_enabled()) {
+        // An attached slot file is already current
+        if (!employee_slot_file.attached || employee_slot_file.fd < 0) employee_slots_save(head);
+        return;
     }
 
-    Trip *new_trip = (Trip*)malloc(sizeof(Trip));
-    if (new_trip == NULL) {
-        printf("Memory allocation error.\n");
-        return head;
+    FILE *file = fopen(EMPLOYEE_FILENAME, "w");
+    if (file == NULL) {
+        return;
     }
 
-    // Display available buses
-    printf("Available buses:\n");
-    display_buses(buses);
-    printf("Enter bus license plate: ");
-    new_trip->license_plate = safe_int_input();
-    
-    // Verify bus exists
-    Bus *bus_temp = buses;
-    int bus_found = 0;
-    while (bus_temp != NULL) {
-        if (bus_temp->license_plate == new_trip->license_plate) {
-            bus_found = 1;
-            break;
+    Employee *temp = head;
+    while (temp != NULL) {
+        fprintf(file, "%d\n%s\n%s\n%s\n%d\n",
+                temp->employee_id,
+                temp->first_name,
+                temp->last_name,
+                temp->phone,
+                temp->function_id);
+        temp = temp->next;
+    }
+
+    fclose(file);
+}
+
+Employee* load_employees_from_file(Employee *head) {
+    if (lsm_storage_enabled()) {
+        // Attached, the menus read the store itself; a new store is filled from the text file
+        if (lsm_storage_attached()) {
+            if (!employee_store.created) return head;
+        } else if (employee_store_load(&head) != 0) {
+            return head; // loaded, or the session refuses to start
         }
-        bus_temp = bus_temp->next;
     }
-    
-    if (!bus_found) {
-        printf("Bus with license plate %d not found.\n", new_trip->license_plate);
-        free(new_trip);
-        return head;
+    if (slot_storage_enabled()) {
+        int found;
+        Employee *loaded = employee_slots_load(&found);
+        if (found) {
+            free_employee_list(head);
+            return loaded;
+        }
     }
 
-    // Display available clients
-    printf("\nAvailable clients:\n");
-    display_clients(clients);
-    printf("Enter client ID: ");
-    new_trip->client_id = safe_int_input();
-    
-    // Verify client exists
-    Client *client_temp = clients;
-    int client_found = 0;
-    while (client_temp != NULL) {
-        if (client_temp->client_id == new_trip->client_id) {
-            client_found = 1;
-            break;
-        }
-        client_temp = client_temp->next;
+    FILE *file = fopen(EMPLOYEE_FILENAME, "r");
+    if (file == NULL) {
+        return head;
     }
-    
-    if (!client_found) {
-        printf("Client with ID %d not found.\n", new_trip->client_id);
-        free(new_trip);
+
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
         return head;
     }
+    rewind(file);
 
-    // Input departure details
-    printf("\nEnter departure details:\n");
-    printf("Departure city: ");
-    scanf("%99s", new_trip->departure_city);
+    free_employee_list(head);
+    head = NULL;
+    Employee *tail = NULL;
+
+    Employee *new_employee;
+    int employee_id, function_id;
+    char first_name[MAX_STRING_LENGTH], last_name[MAX_STRING_LENGTH];
+    char phone[MAX_PHONE_LENGTH];
     
-    DateTime departure;
-    do {
-        printf("Departure date and time:\n");
-        printf("Year (1900-2100): ");
-        departure.year = safe_int_input();
-        printf("Month (1-12): ");
-        departure.month = safe_int_input();
-        printf("Day: ");
-        departure.day = safe_int_input();
-        printf("Hour (0-23): ");
-        departure.hour = safe_int_input();
-        printf("Minute (0-59): ");
-        departure.minute = safe_int_input();
-        
-        if (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute)) {
-            printf("Invalid date/time. Please enter valid values.\n");
+    while (fscanf(file, "%d\n%99s\n%99s\n%14s\n%d\n", 
+                  &employee_id, first_name, last_name, phone, &function_id) == 5) {
+        new_employee = (Employee*)malloc(sizeof(Employee));
+        if (new_employee == NULL) {
+            fclose(file);
+            return head;
         }
-    } while (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute));
 
-    new_trip->departure_time = departure;
+        new_employee->employee_id = employee_id;
+        strncpy(new_employee->first_name, first_name, MAX_STRING_LENGTH - 1);
+        strncpy(new_employee->last_name, last_name, MAX_STRING_LENGTH - 1);
+        strncpy(new_employee->phone, phone, MAX_PHONE_LENGTH - 1);
+        new_employee->function_id = function_id;
+        new_employee->next = NULL;
 
-    // Input arrival details
-    printf("\nEnter arrival details:\n");
-    printf("Arrival city: ");
-    scanf("%99s", new_trip->arrival_city);
-    
-    DateTime arrival;
-    do {
-        printf("Arrival date and time:\n");
-        printf("Year (1900-2100): ");
-        arrival.year = safe_int_input();
-        printf("Month (1-12): ");
-        arrival.month = safe_int_input();
-        printf("Day: ");
-        arrival.day = safe_int_input();
-        printf("Hour (0-23): ");
-        arrival.hour = safe_int_input();
-        printf("Minute (0-59): ");
-        arrival.minute = safe_int_input();
-        
-        if (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute)) {
-            printf("Invalid date/time. Please enter valid values.\n");
+        if (tail == NULL) {
+            head = new_employee;
+        } else {
+            tail->next = new_employee;
         }
-    } while (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute));
-
-    new_trip->arrival_time = arrival;
+        tail = new_employee;
+    }
 
-    new_trip->next = head;
-    printf("Trip added successfully.\n");
-    return new_trip;
+    fclose(file);
+    return head;
 }
 
-Trip* add_trip_at_end(Trip *head, Bus *buses, Client *clients) {
-    // Check prerequisites first
-    if (!has_buses(buses)) {
-        printf("  No buses available in the system.\n");
-        printf("You need to add buses first before creating trips.\n");
-        printf("Please go to 'Bus Management' -> 'Add New Bus' to add your first bus.\n");
-        return head;
+void free_employee_list(Employee *head) {
+    Employee *temp;
+    while (head != NULL) {
+        temp = head;
+        head = head->next;
+        free(temp);
     }
-    
-    if (!has_clients(clients)) {
-        printf("  No clients available in the system.\n");
-        printf("You need to add clients first before creating trips.\n");
-        printf("Please go to 'Client Management' -> 'Add New Client' to add your first client.\n");
+}
+
+// Function management functions
+Function* add_function_at_beginning(Function *head) {
+    Function *new_function = (Function*)malloc(sizeof(Function));
+    if (new_function == NULL) {
+        printf("Memory allocation error.\n");
         return head;
     }
 
-    Trip *new_trip = (Trip*)malloc(sizeof(Trip));
-    if (new_trip == NULL) {
-        printf("Memory allocation error. Cannot add trip.\n");
+    int function_exists;
+    do {
+        function_exists = 0;
+        printf("Enter function ID: ");
+        new_function->function_id = safe_int_input();
+        
+        Function *temp = head;
+        while (temp != NULL) {
+            if (new_function->function_id == temp->function_id) {
+                printf("Function ID already exists. Please enter a different one.\n");
+                function_exists = 1;
+                break;
+            }
+            temp = temp->next;
+        }
+    } while (function_exists);
+
+    printf("Enter function name: ");
+    ui_scanf("%99s", new_function->function_name);
+    printf("Enter salary: $");
+    new_function->salary = safe_float_input();
+
+    new_function->next = head;
+    printf("Function added successfully.\n");
+    return new_function;
+}
+
+Function* add_function_at_end(Function *head) {
+    Function *new_function = (Function*)malloc(sizeof(Function));
+    if (new_function == NULL) {
+        printf("Memory allocation error. Cannot add function.\n");
         return head;
     }
 
-    print_header("ADD NEW TRIP");
+    print_header("ADD NEW FUNCTION");
 
-    // Display available buses
-    printf("Available buses:\n");
-    display_buses(buses);
-    printf("Enter bus license plate: ");
-    new_trip->license_plate = safe_int_input();
-    
-    // Verify bus exists
-    Bus *bus_temp = buses;
-    int bus_found = 0;
-    while (bus_temp != NULL) {
-        if (bus_temp->license_plate == new_trip->license_plate) {
-            bus_found = 1;
-            break;
+    int function_exists;
+    do {
+        function_exists = 0;
+        printf("Enter function ID: ");
+        new_function->function_id = safe_int_input();
+        
+        Function *temp = head;
+        while (temp != NULL) {
+            if (new_function->function_id == temp->function_id) {
+                printf("Function ID %d already exists. Please enter a different one.\n", new_function->function_id);
+                function_exists = 1;
+                break;
+            }
+            temp = temp->next;
+        }
+    } while (function_exists);
+
+    printf("Enter function name: ");
+    ui_scanf("%99s", new_function->function_name);
+    printf("Enter salary: $");
+    new_function->salary = safe_float_input();
+
+    new_function->next = NULL;
+    
+    if (head == NULL) {
+        printf("Function added successfully! This is your first function.\n");
+        return new_function;
+    } else {
+        Function *temp = head;
+        while (temp->next != NULL) {
+            temp = temp->next;
+        }
+        temp->next = new_function;
+        printf("Function added successfully!\n");
+        return head;
+    }
+}
+
+void display_functions(Function *head) {
+    if (head == NULL) {
+        printf("  No functions found in the system.\n");
+        printf("You need to add job functions first to view them.\n");
+        printf("Please go to 'Function Management' -> 'Add New Function' to create your first function.\n");
+        return;
+    }
+
+    print_header("FUNCTION DATABASE");
+    
+    // Count functions
+    int function_count = 0;
+    Function *temp = head;
+    while (temp != NULL) {
+        function_count++;
+        temp = temp->next;
+    }
+    
+    printf("Total functions in database: %d\n\n", function_count);
+    
+    TableWriter *writer = table_begin(stdout);
+    set_console_color(2);
+    TABLE_HEADER(writer, function_table);
+    set_console_color(7);
+
+    temp = head;
+    while (temp != NULL) {
+        function_table_row(writer, temp, NULL);
+        temp = temp->next;
+    }
+    table_flush(writer);
+}
+
+Function* modify_function(Function *head) {
+    if (head == NULL) {
+        printf("  No functions found in the system.\n");
+        printf("You need to add job functions first before modifying them.\n");
+        printf("Please go to 'Function Management' -> 'Add New Function' to create your first function.\n");
+        return head;
+    }
+
+    print_header("MODIFY FUNCTION");
+    
+    int function_id;
+    printf("Enter function ID to modify: ");
+    function_id = safe_int_input();
+
+    Function *temp = head;
+    while (temp != NULL && temp->function_id != function_id) {
+        temp = temp->next;
+    }
+
+    if (temp == NULL) {
+        printf("Function with ID %d not found.\n", function_id);
+        printf("Tip: Check the function ID and try again.\n");
+        return head;
+    }
+
+    // Show current function details
+    printf("\nCurrent function details:\n");
+    printf("ID: %d\n", temp->function_id);
+    printf("Name: %s\n", temp->function_name);
+    printf("Salary: $%.2f\n", temp->salary);
+    
+    printf("\nEnter new details:\n");
+    printf("Enter new function name: ");
+    ui_scanf("%99s", temp->function_name);
+    printf("Enter new salary: $");
+    temp->salary = safe_float_input();
+
+    printf("Function information updated successfully!\n");
+    return head;
+}
+
+Function* delete_function(Function *head) {
+    if (head == NULL) {
+        printf("  No functions found in the system.\n");
+        printf("You need to add job functions first before deleting them.\n");
+        printf("Please go to 'Function Management' -> 'Add New Function' to create your first function.\n");
+        return head;
+    }
+
+    print_header("DELETE FUNCTION");
+    
+    int function_id;
+    printf("Enter function ID to delete: ");
+    function_id = safe_int_input();
+
+    Function *prev = NULL;
+    Function *temp = head;
+    while (temp != NULL && temp->function_id != function_id) {
+        prev = temp;
+        temp = temp->next;
+    }
+
+    if (temp == NULL) {
+        printf("Function with ID %d not found.\n", function_id);
+        printf("Tip: Check the function ID and try again.\n");
+        return head;
+    }
+
+    // Show function details before deletion
+    printf("\nFunction to be deleted:\n");
+    printf("ID: %d\n", temp->function_id);
+    printf("Name: %s\n", temp->function_name);
+    printf("Salary: $%.2f\n", temp->salary);
+    
+    // Confirm deletion
+    char confirm;
+    printf("\nAre you sure you want to delete this function? (y/N): ");
+    ui_scanf(" %c", &confirm);
+    
+    if (confirm == 'y' || confirm == 'Y') {
+        if (prev == NULL) {
+            head = temp->next;
+        } else {
+            prev->next = temp->next;
+        }
+        free(temp);
+        printf("Function deleted successfully!\n");
+    } else {
+        printf("Deletion cancelled.\n");
+    }
+    
+    return head;
+}
+
+void search_function(Function *head) {
+    if (head == NULL) {
+        printf("  No functions found in the system.\n");
+        printf("You need to add job functions first before searching for them.\n");
+        printf("Please go to 'Function Management' -> 'Add New Function' to create your first function.\n");
+        return;
+    }
+
+    print_header("SEARCH FUNCTION");
+    
+    int function_id;
+    printf("Enter function ID to search: ");
+    function_id = safe_int_input();
+
+    Function *temp = head;
+    while (temp != NULL && temp->function_id != function_id) {
+        temp = temp->next;
+    }
+
+    if (temp == NULL) {
+        printf("Function with ID %d not found.\n", function_id);
+        printf("Tip: Check the function ID and try again.\n");
+    } else {
+        printf("\nFunction found!\n\n");
+        TableWriter *writer = table_begin(stdout);
+        set_console_color(2);
+        TABLE_HEADER(writer, function_table);
+        set_console_color(7);
+        function_table_row(writer, temp, NULL);
+        table_flush(writer);
+    }
+}
+
+void save_functions_to_file(Function *head) {
+    FILE *file = fopen(FUNCTION_FILENAME, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    Function *temp = head;
+    while (temp != NULL) {
+        fprintf(file, "%d\n%s\n%.2f\n",
+                temp->function_id,
+                temp->function_name,
+                temp->salary);
+        temp = temp->next;
+    }
+
+    fclose(file);
+}
+
+Function* load_functions_from_file(Function *head) {
+    FILE *file = fopen(FUNCTION_FILENAME, "r");
+    if (file == NULL) {
+        return head;
+    }
+
+    // Check if file is empty
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
+        return head;
+    }
+    rewind(file);
+
+    // Free existing list first
+    free_function_list(head);
+    head = NULL;
+    Function *tail = NULL;
+
+    Function *new_function;
+    int function_id;
+    char function_name[MAX_STRING_LENGTH];
+    float salary;
+    
+    while (fscanf(file, "%d\n%99s\n%f\n", &function_id, function_name, &salary) == 3) {
+        new_function = (Function*)malloc(sizeof(Function));
+        if (new_function == NULL) {
+            fclose(file);
+            return head;
+        }
+
+        new_function->function_id = function_id;
+        strncpy(new_function->function_name, function_name, MAX_STRING_LENGTH - 1);
+        new_function->function_name[MAX_STRING_LENGTH - 1] = '\0';
+        new_function->salary = salary;
+        new_function->next = NULL;
+
+        if (tail == NULL) {
+            head = new_function;
+        } else {
+            tail->next = new_function;
+        }
+        tail = new_function;
+    }
+
+    fclose(file);
+    return head;
+}
+
+void free_function_list(Function *head) {
+    Function *temp;
+    while (head != NULL) {
+        temp = head;
+        head = head->next;
+        free(temp);
+    }
+}
+
+// DateTime validation functions
+int is_valid_time(int hour, int minute) {
+    if (hour < 0 || hour > 23) return 0;
+    if (minute < 0 || minute > 59) return 0;
+    return 1;
+}
+
+int is_valid_datetime(int day, int month, int year, int hour, int minute) {
+    if (!is_valid_date(day, month, year)) return 0;
+    if (!is_valid_time(hour, minute)) return 0;
+    return 1;
+}
+
+// Time conversion functions
+long days_from_civil(int day, int month, int year) {
+    // Days since 01/01/1970 using the proleptic Gregorian calendar
+    long y = year - (month <= 2);
+    long era = (y >= 0 ? y : y - 399) / 400;
+    long yoe = y - era * 400;
+    long doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+long datetime_to_minutes(DateTime dt) {
+    return days_from_civil(dt.day, dt.month, dt.year) * 1440L + dt.hour * 60L + dt.minute;
+}
+
+static long current_time_in_minutes(void) {
+    time_t now = time(NULL);
+    struct tm *local = localtime(&now);
+    DateTime dt;
+    dt.day = local->tm_mday;
+    dt.month = local->tm_mon + 1;
+    dt.year = local->tm_year + 1900;
+    dt.hour = local->tm_hour;
+    dt.minute = local->tm_min;
+    return datetime_to_minutes(dt);
+}
+
+DateTime minutes_to_datetime(long minutes) {
+    DateTime dt;
+    long days = minutes / 1440;
+    long rest = minutes % 1440;
+    if (rest < 0) {
+        rest += 1440;
+        days--;
+    }
+    dt.hour = (int)(rest / 60);
+    dt.minute = (int)(rest % 60);
+
+    // Inverse of days_from_civil
+    long z = days + 719468;
+    long era = (z >= 0 ? z : z - 146096) / 146097;
+    long doe = z - era * 146097;
+    long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    long mp = (5 * doy + 2) / 153;
+    dt.day = (int)(doy - (153 * mp + 2) / 5 + 1);
+    dt.month = (int)(mp < 10 ? mp + 3 : mp - 9);
+    dt.year = (int)(yoe + era * 400 + (dt.month <= 2));
+    return dt;
+}
+
+void input_date(const char *label, PurchaseDate *date) {
+    printf("%s\n", label);
+    do {
+        printf("Year (1900-2100): ");
+        date->year = safe_int_input();
+        printf("Month (1-12): ");
+        date->month = safe_int_input();
+        printf("Day: ");
+        date->day = safe_int_input();
+        
+        if (!is_valid_date(date->day, date->month, date->year)) {
+            printf("Invalid date. Please enter a valid date.\n");
+        }
+    } while (!is_valid_date(date->day, date->month, date->year));
+}
+
+// Trip management functions
+Trip* add_trip_at_beginning(Trip *head, Bus *buses, Client *clients) {
+    // Check prerequisites first
+    if (!has_buses(buses)) {
+        printf("  No buses available in the system.\n");
+        printf("You need to add buses first before creating trips.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to add your first bus.\n");
+        return head;
+    }
+    
+    if (!has_clients(clients)) {
+        printf("  No clients available in the system.\n");
+        printf("You need to add clients first before creating trips.\n");
+        printf("Please go to 'Client Management' -> 'Add New Client' to add your first client.\n");
+        return head;
+    }
+
+    Trip *new_trip = (Trip*)malloc(sizeof(Trip));
+    if (new_trip == NULL) {
+        printf("Memory allocation error.\n");
+        return head;
+    }
+
+    // Display available buses
+    printf("Available buses:\n");
+    display_buses(buses);
+    printf("Enter bus license plate: ");
+    new_trip->license_plate = safe_int_input();
+    
+    // Verify bus exists
+    Bus *bus_temp = buses;
+    int bus_found = 0;
+    while (bus_temp != NULL) {
+        if (bus_temp->license_plate == new_trip->license_plate) {
+            bus_found = 1;
+            break;
+        }
+        bus_temp = bus_temp->next;
+    }
+    
+    if (!bus_found) {
+        printf("Bus with license plate %d not found.\n", new_trip->license_plate);
+        free(new_trip);
+        return head;
+    }
+
+    // Display available clients
+    printf("\nAvailable clients:\n");
+    display_clients(clients);
+    printf("Enter client ID: ");
+    new_trip->client_id = safe_int_input();
+    
+    // Verify client exists
+    Client client;
+    if (!find_client(clients, new_trip->client_id, &client)) {
+        printf("Client with ID %d not found.\n", new_trip->client_id);
+        free(new_trip);
+        return head;
+    }
+
+    // Input departure details
+    printf("\nEnter departure details:\n");
+    printf("Departure city: ");
+    ui_scanf("%99s", new_trip->departure_city);
+    
+    DateTime departure;
+    do {
+        printf("Departure date and time:\n");
+        printf("Year (1900-2100): ");
+        departure.year = safe_int_input();
+        printf("Month (1-12): ");
+        departure.month = safe_int_input();
+        printf("Day: ");
+        departure.day = safe_int_input();
+        printf("Hour (0-23): ");
+        departure.hour = safe_int_input();
+        printf("Minute (0-59): ");
+        departure.minute = safe_int_input();
+        
+        if (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute)) {
+            printf("Invalid date/time. Please enter valid values.\n");
+        }
+    } while (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute));
+
+    new_trip->departure_time = departure;
+
+    // Input arrival details
+    printf("\nEnter arrival details:\n");
+    printf("Arrival city: ");
+    ui_scanf("%99s", new_trip->arrival_city);
+    
+    DateTime arrival;
+    do {
+        printf("Arrival date and time:\n");
+        printf("Year (1900-2100): ");
+        arrival.year = safe_int_input();
+        printf("Month (1-12): ");
+        arrival.month = safe_int_input();
+        printf("Day: ");
+        arrival.day = safe_int_input();
+        printf("Hour (0-23): ");
+        arrival.hour = safe_int_input();
+        printf("Minute (0-59): ");
+        arrival.minute = safe_int_input();
+        
+        if (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute)) {
+            printf("Invalid date/time. Please enter valid values.\n");
+        }
+    } while (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute));
+
+    new_trip->arrival_time = arrival;
+
+    if (bus_in_maintenance(new_trip->license_plate, datetime_to_minutes(departure), datetime_to_minutes(arrival))) {
+        printf("Bus %d is blocked for maintenance during this trip.\n", new_trip->license_plate);
+        free(new_trip);
+        return head;
+    }
+
+    new_trip->created_epoch = 0;
+    new_trip->deleted_epoch = 0;
+    new_trip->next = head;
+    trip_indexes_add(new_trip);
+    printf("Trip added successfully.\n");
+    return new_trip;
+}
+
+Trip* add_trip_at_end(Trip *head, Bus *buses, Client *clients) {
+    // Check prerequisites first
+    if (!has_buses(buses)) {
+        printf("  No buses available in the system.\n");
+        printf("You need to add buses first before creating trips.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to add your first bus.\n");
+        return head;
+    }
+    
+    if (!has_clients(clients)) {
+        printf("  No clients available in the system.\n");
+        printf("You need to add clients first before creating trips.\n");
+        printf("Please go to 'Client Management' -> 'Add New Client' to add your first client.\n");
+        return head;
+    }
+
+    Trip *new_trip = (Trip*)malloc(sizeof(Trip));
+    if (new_trip == NULL) {
+        printf("Memory allocation error. Cannot add trip.\n");
+        return head;
+    }
+
+    print_header("ADD NEW TRIP");
+
+    // Display available buses
+    printf("Available buses:\n");
+    display_buses(buses);
+    printf("Enter bus license plate: ");
+    new_trip->license_plate = safe_int_input();
+    
+    // Verify bus exists
+    Bus *bus_temp = buses;
+    int bus_found = 0;
+    while (bus_temp != NULL) {
+        if (bus_temp->license_plate == new_trip->license_plate) {
+            bus_found = 1;
+            break;
+        }
+        bus_temp = bus_temp->next;
+    }
+    
+    if (!bus_found) {
+        printf("Bus with license plate %d not found.\n", new_trip->license_plate);
+        free(new_trip);
+        return head;
+    }
+
+    // Display available clients
+    printf("\nAvailable clients:\n");
+    display_clients(clients);
+    printf("Enter client ID: ");
+    new_trip->client_id = safe_int_input();
+    
+    // Verify client exists
+    Client client;
+    if (!find_client(clients, new_trip->client_id, &client)) {
+        printf("Client with ID %d not found.\n", new_trip->client_id);
+        free(new_trip);
+        return head;
+    }
+
+    // Input departure details
+    printf("\nEnter departure details:\n");
+    printf("Departure city: ");
+    ui_scanf("%99s", new_trip->departure_city);
+    
+    DateTime departure;
+    do {
+        printf("Departure date and time:\n");
+        printf("Year (1900-2100): ");
+        departure.year = safe_int_input();
+        printf("Month (1-12): ");
+        departure.month = safe_int_input();
+        printf("Day: ");
+        departure.day = safe_int_input();
+        printf("Hour (0-23): ");
+        departure.hour = safe_int_input();
+        printf("Minute (0-59): ");
+        departure.minute = safe_int_input();
+        
+        if (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute)) {
+            printf("Invalid date/time. Please enter valid values.\n");
+        }
+    } while (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute));
+
+    new_trip->departure_time = departure;
+
+    // Input arrival details
+    printf("\nEnter arrival details:\n");
+    printf("Arrival city: ");
+    ui_scanf("%99s", new_trip->arrival_city);
+    
+    DateTime arrival;
+    do {
+        printf("Arrival date and time:\n");
+        printf("Year (1900-2100): ");
+        arrival.year = safe_int_input();
+        printf("Month (1-12): ");
+        arrival.month = safe_int_input();
+        printf("Day: ");
+        arrival.day = safe_int_input();
+        printf("Hour (0-23): ");
+        arrival.hour = safe_int_input();
+        printf("Minute (0-59): ");
+        arrival.minute = safe_int_input();
+        
+        if (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute)) {
+            printf("Invalid date/time. Please enter valid values.\n");
+        }
+    } while (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute));
+
+    new_trip->arrival_time = arrival;
+
+    if (bus_in_maintenance(new_trip->license_plate, datetime_to_minutes(departure), datetime_to_minutes(arrival))) {
+        printf("Bus %d is blocked for maintenance during this trip.\n", new_trip->license_plate);
+        free(new_trip);
+        return head;
+    }
+
+    new_trip->created_epoch = 0;
+    new_trip->deleted_epoch = 0;
+    new_trip->next = NULL;
+    trip_indexes_add(new_trip);
+    
+    if (head == NULL) {
+        printf("Trip added successfully! This is your first trip.\n");
+        return new_trip;
+    } else {
+        Trip *temp = head;
+        while (temp->next != NULL) {
+            temp = temp->next;
+        }
+        temp->next = new_trip;
+        printf("Trip added successfully!\n");
+        return head;
+    }
+}
+
+static int archived_trip_found(const Trip *trip, void *context) {
+    (void)trip;
+    (void)context;
+    return 1;
+}
+
+static int archived_trip_table_row(const Trip *trip, void *context) {
+    trip_table_row((TableWriter*)context, trip, NULL);
+    return 0;
+}
+
+void display_trips(Trip *head, Bus *buses, Client *clients) {
+    long archived = trip_archive_rows();
+    if (head == NULL && archived == 0) {
+        printf("  No trips found in the system.\n");
+        printf("You need to add trips first to view them.\n");
+        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
+        return;
+    }
+
+    print_header("TRIP DATABASE");
+    
+    // Count trips
+    int trip_count = 0;
+    Trip *temp = head;
+    while (temp != NULL) {
+        trip_count++;
+        temp = temp->next;
+    }
+    
+    printf("Total trips in database: %ld (%ld archived)\n\n", trip_count + archived, archived);
+    
+    TableWriter *writer = table_begin(stdout);
+    set_console_color(2);
+    TABLE_HEADER(writer, trip_table);
+    set_console_color(7);
+
+    temp = head;
+    while (temp != NULL) {
+        trip_table_row(writer, temp, NULL);
+        temp = temp->next;
+    }
+    if (archived > 0) {
+        ArchiveQuery query;
+        archive_query_all(&query);
+        trip_archive_scan(&query, archived_trip_table_row, writer);
+    }
+    table_flush(writer);
+}
+
+Trip* modify_trip(Trip *head, Bus *buses, Client *clients) {
+    if (head == NULL) {
+        printf("  No trips found in the system.\n");
+        printf("You need to add trips first before modifying them.\n");
+        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
+        return head;
+    }
+
+    // Check prerequisites
+    if (!has_buses(buses)) {
+        printf("  No buses available in the system.\n");
+        printf("You need buses available to modify trips.\n");
+        return head;
+    }
+    
+    if (!has_clients(clients)) {
+        printf("  No clients available in the system.\n");
+        printf("You need clients available to modify trips.\n");
+        return head;
+    }
+
+    print_header("MODIFY TRIP");
+    
+    printf("Enter bus license plate of the trip to modify: ");
+    int license_plate = safe_int_input();
+    printf("Enter client ID of the trip to modify: ");
+    int client_id = safe_int_input();
+
+    Trip *temp = head;
+    while (temp != NULL && (temp->license_plate != license_plate || temp->client_id != client_id)) {
+        temp = temp->next;
+    }
+
+    if (temp == NULL) {
+        printf("Trip not found.\n");
+        return head;
+    }
+
+    printf("\nCurrent trip details:\n");
+    printf("Bus: %d, Client: %d\n", temp->license_plate, temp->client_id);
+    printf("Route: %s to %s\n", temp->departure_city, temp->arrival_city);
+    printf("Departure: %02d/%02d/%d %02d:%02d\n", 
+           temp->departure_time.day, temp->departure_time.month, temp->departure_time.year,
+           temp->departure_time.hour, temp->departure_time.minute);
+    printf("Arrival: %02d/%02d/%d %02d:%02d\n", 
+           temp->arrival_time.day, temp->arrival_time.month, temp->arrival_time.year,
+           temp->arrival_time.hour, temp->arrival_time.minute);
+
+    // Re-indexed once the new city and times are known
+    trip_indexes_remove(temp);
+
+    printf("\nEnter new details:\n");
+    printf("New departure city: ");
+    ui_scanf("%99s", temp->departure_city);
+    printf("New arrival city: ");
+    ui_scanf("%99s", temp->arrival_city);
+
+    // Update departure time
+    DateTime departure;
+    do {
+        printf("New departure date and time:\n");
+        printf("Year (1900-2100): ");
+        departure.year = safe_int_input();
+        printf("Month (1-12): ");
+        departure.month = safe_int_input();
+        printf("Day: ");
+        departure.day = safe_int_input();
+        printf("Hour (0-23): ");
+        departure.hour = safe_int_input();
+        printf("Minute (0-59): ");
+        departure.minute = safe_int_input();
+        
+        if (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute)) {
+            printf("Invalid date/time. Please enter valid values.\n");
+        }
+    } while (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute));
+
+    temp->departure_time = departure;
+
+    // Update arrival time
+    DateTime arrival;
+    do {
+        printf("New arrival date and time:\n");
+        printf("Year (1900-2100): ");
+        arrival.year = safe_int_input();
+        printf("Month (1-12): ");
+        arrival.month = safe_int_input();
+        printf("Day: ");
+        arrival.day = safe_int_input();
+        printf("Hour (0-23): ");
+        arrival.hour = safe_int_input();
+        printf("Minute (0-59): ");
+        arrival.minute = safe_int_input();
+        
+        if (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute)) {
+            printf("Invalid date/time. Please enter valid values.\n");
+        }
+    } while (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute));
+
+    temp->arrival_time = arrival;
+
+    if (bus_in_maintenance(temp->license_plate, datetime_to_minutes(departure), datetime_to_minutes(arrival))) {
+        set_console_color(4);
+        printf("Warning: bus %d is blocked for maintenance during this trip.\n", temp->license_plate);
+        set_console_color(7);
+    }
+
+    trip_indexes_add(temp);
+    printf("Trip information updated successfully!\n");
+    return head;
+}
+
+Trip* delete_trip(Trip *head) {
+    if (head == NULL) {
+        printf("  No trips found in the system.\n");
+        printf("You need to add trips first before deleting them.\n");
+        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
+        return head;
+    }
+
+    print_header("DELETE TRIP");
+    
+    printf("Enter bus license plate of the trip to delete: ");
+    int license_plate = safe_int_input();
+    printf("Enter client ID of the trip to delete: ");
+    int client_id = safe_int_input();
+
+    Trip *prev = NULL;
+    Trip *temp = head;
+    while (temp != NULL && (temp->license_plate != license_plate || temp->client_id != client_id)) {
+        prev = temp;
+        temp = temp->next;
+    }
+
+    if (temp == NULL) {
+        printf("Trip not found.\n");
+        return head;
+    }
+
+   
+
+    // Show trip details before deletion
+    printf("\nTrip to be deleted:\n");
+    printf("Bus: %d, Client: %d\n", temp->license_plate, temp->client_id);
+    printf("Route: %s to %s\n", temp->departure_city, temp->arrival_city);
+    printf("Departure: %02d/%02d/%d %02d:%02d\n", 
+           temp->departure_time.day, temp->departure_time.month, temp->departure_time.year,
+           temp->departure_time.hour, temp->departure_time.minute);
+    printf("Arrival: %02d/%02d/%d %02d:%02d\n", 
+           temp->arrival_time.day, temp->arrival_time.month, temp->arrival_time.year,
+           temp->arrival_time.hour, temp->arrival_time.minute);
+    
+    // Confirm deletion
+    char confirm;
+    printf("\nAre you sure you want to delete this trip? (y/N): ");
+    ui_scanf(" %c", &confirm);
+    
+    if (confirm == 'y' || confirm == 'Y') {
+        if (prev == NULL) {
+            head = temp->next;
+        } else {
+            prev->next = temp->next;
+        }
+        trip_indexes_remove(temp);
+        free(temp);
+        printf("Trip deleted successfully!\n");
+    } else {
+        printf("Deletion cancelled.\n");
+    }
+    
+    return head;
+}
+
+void search_trip(Trip *head, Bus *buses, Client *clients) {
+    if (head == NULL && trip_archive_rows() == 0) {
+        printf("  No trips found in the system.\n");
+        printf("You need to add trips first before searching for them.\n");
+        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
+        return;
+    }
+
+    print_header("SEARCH TRIP");
+    
+    printf("Enter bus license plate to search: ");
+    int license_plate = safe_int_input();
+    printf("Enter client ID to search: ");
+    int client_id = safe_int_input();
+
+    Trip *temp = head;
+    while (temp != NULL && (temp->license_plate != license_plate || temp->client_id != client_id)) {
+        temp = temp->next;
+    }
+
+    // Archived trips of the pair are listed after the current one
+    ArchiveQuery query;
+    archive_query_all(&query);
+    query.license_plate = license_plate;
+    query.client_id = client_id;
+    int archived = trip_archive_scan(&query, archived_trip_found, NULL) > 0;
+
+    if (temp == NULL && !archived) {
+        printf("Trip not found.\n");
+    } else {
+        printf(temp != NULL ? "\nTrip found!\n\n" : "\nTrip found in the archive!\n\n");
+        TableWriter *writer = table_begin(stdout);
+        set_console_color(2);
+        TABLE_HEADER(writer, trip_table);
+        set_console_color(7);
+        if (temp != NULL) trip_table_row(writer, temp, NULL);
+        if (archived) trip_archive_scan(&query, archived_trip_table_row, writer);
+        table_flush(writer);
+    }
+}
+
+void save_trips_to_file(Trip *head) {
+    FILE *file = fopen(TRIP_FILENAME, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    Trip *temp = head;
+    while (temp != NULL) {
+        // Deleted in the server but still linked for an older snapshot
+        if (temp->deleted_epoch != 0) {
+            temp = temp->next;
+            continue;
+        }
+        fprintf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n%s\n%s\n",
+                temp->license_plate,
+                temp->client_id,
+                temp->departure_time.day,
+                temp->departure_time.month,
+                temp->departure_time.year,
+                temp->departure_time.hour,
+                temp->departure_time.minute,
+                temp->arrival_time.day,
+                temp->arrival_time.month,
+                temp->arrival_time.year,
+                temp->arrival_time.hour,
+                temp->arrival_time.minute,
+                temp->departure_city,
+                temp->arrival_city);
+        temp = temp->next;
+    }
+
+    fclose(file);
+}
+
+// Parses trips.txt records into a new list without touching the indexes
+static Trip* read_trip_records(FILE *file) {
+    Trip *head = NULL;
+    Trip *tail = NULL;
+    Trip *new_trip;
+    int license_plate, client_id;
+    int dep_day, dep_month, dep_year, dep_hour, dep_minute;
+    int arr_day, arr_month, arr_year, arr_hour, arr_minute;
+    char departure_city[MAX_STRING_LENGTH], arrival_city[MAX_STRING_LENGTH];
+    
+    while (fscanf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n%99s\n%99s\n",
+                  &license_plate, &client_id,
+                  &dep_day, &dep_month, &dep_year, &dep_hour, &dep_minute,
+                  &arr_day, &arr_month, &arr_year, &arr_hour, &arr_minute,
+                  departure_city, arrival_city) == 14) {
+        new_trip = (Trip*)malloc(sizeof(Trip));
+        if (new_trip == NULL) {
+            return head;
+        }
+
+        new_trip->license_plate = license_plate;
+        new_trip->client_id = client_id;
+        new_trip->departure_time.day = dep_day;
+        new_trip->departure_time.month = dep_month;
+        new_trip->departure_time.year = dep_year;
+        new_trip->departure_time.hour = dep_hour;
+        new_trip->departure_time.minute = dep_minute;
+        new_trip->arrival_time.day = arr_day;
+        new_trip->arrival_time.month = arr_month;
+        new_trip->arrival_time.year = arr_year;
+        new_trip->arrival_time.hour = arr_hour;
+        new_trip->arrival_time.minute = arr_minute;
+        strncpy(new_trip->departure_city, departure_city, MAX_STRING_LENGTH - 1);
+        strncpy(new_trip->arrival_city, arrival_city, MAX_STRING_LENGTH - 1);
+        new_trip->departure_city[MAX_STRING_LENGTH - 1] = '\0';
+        new_trip->arrival_city[MAX_STRING_LENGTH - 1] = '\0';
+        new_trip->created_epoch = 0;
+        new_trip->deleted_epoch = 0;
+        new_trip->next = NULL;
+
+        if (tail == NULL) {
+            head = new_trip;
+        } else {
+            tail->next = new_trip;
+        }
+        tail = new_trip;
+    }
+    return head;
+}
+
+// Trips in trips.txt that the archive already holds, because an archive
+// run was interrupted before it rewrote the file or a session saved its
+// copy afterwards, are left out of the list. The next archive run takes
+// them out of the file.
+static Trip* drop_archived_copies(Trip *head) {
+    if (trip_archive_rows() == 0) return head;
+    Trip *prev = NULL;
+    Trip *trip = head;
+    while (trip != NULL) {
+        Trip *next = trip->next;
+        ArchiveQuery query;
+        archive_query_all(&query);
+        query.license_plate = trip->license_plate;
+        query.client_id = trip->client_id;
+        query.departure_from = query.departure_to = datetime_to_minutes(trip->departure_time);
+        query.arrival_from = query.arrival_to = datetime_to_minutes(trip->arrival_time);
+        if (trip_archive_scan(&query, archived_trip_found, NULL) > 0) {
+            if (prev == NULL) {
+                head = next;
+            } else {
+                prev->next = next;
+            }
+            free(trip);
+        } else {
+            prev = trip;
+        }
+        trip = next;
+    }
+    return head;
+}
+
+// Reading trips never writes: moving old trips into the archive is left to
+// busflow archive (run_archive_maintenance)
+Trip* load_trips_from_file(Trip *head) {
+    FILE *file = fopen(TRIP_FILENAME, "r");
+    if (file == NULL) {
+        return head;
+    }
+
+    // Check if file is empty
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
+        return head;
+    }
+    rewind(file);
+
+    // Free existing list first
+    free_trip_list(head);
+    head = read_trip_records(file);
+    fclose(file);
+    head = drop_archived_copies(head);
+    trip_indexes_rebuild(head);
+    return head;
+}
+
+void free_trip_list(Trip *head) {
+    trip_indexes_clear();
+    Trip *temp;
+    while (head != NULL) {
+        temp = head;
+        head = head->next;
+        free(temp);
+    }
+}
+
+// City table functions
+static unsigned long hash_string(const char *str) {
+    // FNV-1a
+    unsigned long hash = 2166136261UL;
+    while (*str) {
+        hash ^= (unsigned char)*str++;
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+static int city_table_grow(CityTable *table) {
+    int new_slot_count = table->slot_count ? table->slot_count * 2 : 64;
+    int *new_slots = (int*)calloc(new_slot_count, sizeof(int));
+    if (new_slots == NULL) return 0;
+
+    // Slots hold id + 1 so that zero marks an empty slot
+    for (int id = 0; id < table->count; id++) {
+        unsigned long h = hash_string(table->names[id]) & (new_slot_count - 1);
+        while (new_slots[h] != 0) h = (h + 1) & (new_slot_count - 1);
+        new_slots[h] = id + 1;
+    }
+    free(table->slots);
+    table->slots = new_slots;
+    table->slot_count = new_slot_count;
+    return 1;
+}
+
+int city_table_find(const CityTable *table, const char *name) {
+    if (table->slot_count == 0) return -1;
+    unsigned long h = hash_string(name) & (table->slot_count - 1);
+    while (table->slots[h] != 0) {
+        if (strcmp(table->names[table->slots[h] - 1], name) == 0) {
+            return table->slots[h] - 1;
+        }
+        h = (h + 1) & (table->slot_count - 1);
+    }
+    return -1;
+}
+
+int city_table_intern(CityTable *table, const char *name) {
+    int id = city_table_find(table, name);
+    if (id >= 0) return id;
+
+    if ((table->count + 1) * 2 > table->slot_count && !city_table_grow(table)) return -1;
+    if (table->count == table->capacity) {
+        int new_capacity = table->capacity ? table->capacity * 2 : 32;
+        char **grown = (char**)realloc(table->names, new_capacity * sizeof(char*));
+        if (grown == NULL) return -1;
+        table->names = grown;
+        table->capacity = new_capacity;
+    }
+
+    size_t len = strlen(name);
+    char *copy = (char*)malloc(len + 1);
+    if (copy == NULL) return -1;
+    memcpy(copy, name, len + 1);
+
+    id = table->count++;
+    table->names[id] = copy;
+    unsigned long h = hash_string(name) & (table->slot_count - 1);
+    while (table->slots[h] != 0) h = (h + 1) & (table->slot_count - 1);
+    table->slots[h] = id + 1;
+    return id;
+}
+
+void city_table_free(CityTable *table) {
+    for (int i = 0; i < table->count; i++) {
+        free(table->names[i]);
+    }
+    free(table->names);
+    free(table->slots);
+    memset(table, 0, sizeof(CityTable));
+}
+
+// Trip archive functions
+// Trips that departed more than trip_archive_days() ago leave trips.txt for
+// a columnar archive partitioned by departure month. A partition is one
+// flat file of 32-bit values per column, memory-mapped read-only, plus a
+// block index holding the value range of every column per
+// ARCHIVE_BLOCK_ROWS rows. Startup only reads the manifest: the partitions
+// with their row counts and key ranges, the shared city dictionary and
+// per-bus usage totals. A partition is mapped the first time a query
+// overlapping its ranges runs; the query then skips blocks whose ranges
+// miss it and only builds a Trip for rows that match.
+//
+// Appends write the column files past the committed rows and then replace
+// the manifest, which is what commits them. Partitions whose month ended
+// before the archive cutoff are sealed: their files are made read-only and
+// trips for that month turning up later stay in trips.txt. Sealed
+// partitions older than the retention period are dropped whole.
+//
+// Sealed partitions older than trip_archive_cold_months() move to the cold
+// tier: one file of delta-coded blocks (see ColdBlockEntry) whose
+// directory carries the block ranges. A query decodes only the blocks its
+// ranges overlap, into a scratch buffer of its own.
+static TripArchive trip_archive;
+static int archive_days_setting = -1;
+static int retention_months_setting = -1;
+static int cold_months_setting = -1;
+static int archive_converting = 0;
+#ifndef _WIN32
+static pthread_mutex_t archive_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static const char *const archive_column_names[ARCHIVE_COLUMNS] = {
+    "plate", "client", "departure", "arrival", "from", "to"
+};
+
+int trip_archive_days(void) {
+#ifdef _WIN32
+    return 0;
+#else
+    if (archive_days_setting < 0) {
+        const char *setting = getenv("BUSFLOW_ARCHIVE_DAYS");
+        archive_days_setting = setting != NULL ? atoi(setting) : DEFAULT_ARCHIVE_DAYS;
+        if (archive_days_setting < 0) archive_days_setting = 0;
+    }
+    return archive_days_setting;
+#endif
+}
+
+int trip_archive_retention_months(void) {
+    if (retention_months_setting < 0) {
+        const char *setting = getenv("BUSFLOW_RETENTION_MONTHS");
+        retention_months_setting = setting != NULL ? atoi(setting) : DEFAULT_RETENTION_MONTHS;
+        if (retention_months_setting < 0) retention_months_setting = 0;
+    }
+    return retention_months_setting;
+}
+
+int trip_archive_cold_months(void) {
+    if (cold_months_setting < 0) {
+        const char *setting = getenv("BUSFLOW_COLD_MONTHS");
+        cold_months_setting = setting != NULL ? atoi(setting) : DEFAULT_COLD_MONTHS;
+        if (cold_months_setting < 0) cold_months_setting = 0;
+    }
+    return cold_months_setting;
+}
+
+long trip_archive_rows(void) {
+    return trip_archive_open() == 0 ? trip_archive.rows : 0;
+}
+
+static int month_of_minutes(long minutes) {
+    DateTime dt = minutes_to_datetime(minutes);
+    return dt.year * 12 + dt.month - 1;
+}
+
+static long month_start_minutes(int month) {
+    return days_from_civil(1, month % 12 + 1, month / 12) * 1440L;
+}
+
+static ArchiveBusTotals* archive_totals_for(ArchiveTotals *totals, int license_plate, int create) {
+    int lo = 0, hi = totals->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (totals->buses[mid].license_plate < license_plate) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < totals->count && totals->buses[lo].license_plate == license_plate) return &totals->buses[lo];
+    if (!create) return NULL;
+
+    if (totals->count == totals->capacity) {
+        int new_capacity = totals->capacity ? totals->capacity * 2 : 16;
+        ArchiveBusTotals *grown = (ArchiveBusTotals*)realloc(totals->buses, new_capacity * sizeof(ArchiveBusTotals));
+        if (grown == NULL) return NULL;
+        totals->buses = grown;
+        totals->capacity = new_capacity;
+    }
+    memmove(&totals->buses[lo + 1], &totals->buses[lo], (totals->count - lo) * sizeof(ArchiveBusTotals));
+    memset(&totals->buses[lo], 0, sizeof(ArchiveBusTotals));
+    totals->buses[lo].license_plate = license_plate;
+    totals->count++;
+    return &totals->buses[lo];
+}
+
+const ArchiveBusTotals* trip_archive_totals(int license_plate) {
+    if (trip_archive_open() != 0) return NULL;
+    return archive_totals_for(&trip_archive.totals, license_plate, 0);
+}
+
+static ArchivePartition* archive_partition_for(int month, int create) {
+    TripArchive *archive = &trip_archive;
+    int lo = 0, hi = archive->partition_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (archive->partitions[mid].month < month) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < archive->partition_count && archive->partitions[lo].month == month) return &archive->partitions[lo];
+    if (!create) return NULL;
+
+    if (archive->partition_count == archive->partition_capacity) {
+        int new_capacity = archive->partition_capacity ? archive->partition_capacity * 2 : 16;
+        ArchivePartition *grown = (ArchivePartition*)realloc(archive->partitions, new_capacity * sizeof(ArchivePartition));
+        if (grown == NULL) return NULL;
+        archive->partitions = grown;
+        archive->partition_capacity = new_capacity;
+    }
+    memmove(&archive->partitions[lo + 1], &archive->partitions[lo],
+            (archive->partition_count - lo) * sizeof(ArchivePartition));
+    memset(&archive->partitions[lo], 0, sizeof(ArchivePartition));
+    archive->partitions[lo].month = month;
+    archive->partition_count++;
+    return &archive->partitions[lo];
+}
+
+static void archive_partition_path(int month, const char *suffix, char *path, size_t size) {
+    snprintf(path, size, "%s/%04d-%02d.%s", TRIP_ARCHIVE_PATH, month / 12, month % 12 + 1, suffix);
+}
+
+// Builds the Trip stored in row of a block's columns. Returns -1 if a city
+// code is not in the dictionary, which only a damaged file can hold.
+static int trip_archive_row(const int *const *columns, int row, Trip *trip) {
+    const CityTable *cities = &trip_archive.cities;
+    int from = columns[ARCHIVE_FROM][row], to = columns[ARCHIVE_TO][row];
+    if (from < 0 || from >= cities->count || to < 0 || to >= cities->count) return -1;
+    trip->license_plate = columns[ARCHIVE_PLATE][row];
+    trip->client_id = columns[ARCHIVE_CLIENT][row];
+    trip->departure_time = minutes_to_datetime(columns[ARCHIVE_DEPARTURE][row]);
+    trip->arrival_time = minutes_to_datetime(columns[ARCHIVE_ARRIVAL][row]);
+    strncpy(trip->departure_city, cities->names[from], MAX_STRING_LENGTH - 1);
+    strncpy(trip->arrival_city, cities->names[to], MAX_STRING_LENGTH - 1);
+    trip->departure_city[MAX_STRING_LENGTH - 1] = '\0';
+    trip->arrival_city[MAX_STRING_LENGTH - 1] = '\0';
+    trip->created_epoch = 0;
+    trip->deleted_epoch = 0;
+    trip->next = NULL;
+    return 0;
+}
+
+void archive_query_all(ArchiveQuery *query) {
+    query->license_plate = -1;
+    query->client_id = -1;
+    query->departure_from = LONG_MIN;
+    query->departure_to = LONG_MAX;
+    query->arrival_from = LONG_MIN;
+    query->arrival_to = LONG_MAX;
+}
+
+// Inclusive bounds on each key column
+static void archive_query_bounds(const ArchiveQuery *query, long *lo, long *hi) {
+    lo[ARCHIVE_PLATE] = query->license_plate >= 0 ? query->license_plate : LONG_MIN;
+    hi[ARCHIVE_PLATE] = query->license_plate >= 0 ? query->license_plate : LONG_MAX;
+    lo[ARCHIVE_CLIENT] = query->client_id >= 0 ? query->client_id : LONG_MIN;
+    hi[ARCHIVE_CLIENT] = query->client_id >= 0 ? query->client_id : LONG_MAX;
+    lo[ARCHIVE_DEPARTURE] = query->departure_from;
+    hi[ARCHIVE_DEPARTURE] = query->departure_to;
+    lo[ARCHIVE_ARRIVAL] = query->arrival_from;
+    hi[ARCHIVE_ARRIVAL] = query->arrival_to;
+}
+
+static int archive_ranges_overlap(const int *min, const int *max, const long *lo, const long *hi) {
+    for (int column = 0; column < ARCHIVE_KEY_COLUMNS; column++) {
+        if (max[column] < lo[column] || min[column] > hi[column]) return 0;
+    }
+    return 1;
+}
+
+// Decodes rows of a cold block into scratch, one ARCHIVE_BLOCK_ROWS
+// stretch per column. Returns 0, or -1 if the block is malformed.
+static int cold_decode_block(const unsigned char *data, size_t length, int rows, int *scratch) {
+    const unsigned char *p = data;
+    const unsigned char *end = data + length;
+    long long previous[ARCHIVE_COLUMNS] = {0};
+    for (int row = 0; row < rows; row++) {
+        if (p == end) return -1;
+        unsigned int changed = *p++;
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            if (changed & (1u << column)) {
+                unsigned long long zigzag = 0;
+                int shift = 0;
+                do {
+                    if (p == end || shift > 63) return -1;
+                    zigzag |= (unsigned long long)(*p & 0x7F) << shift;
+                    shift += 7;
+                } while (*p++ & 0x80);
+                previous[column] += (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+            }
+            scratch[column * ARCHIVE_BLOCK_ROWS + row] = (int)previous[column];
+        }
+        // The arrival column carries the duration
+        scratch[ARCHIVE_ARRIVAL * ARCHIVE_BLOCK_ROWS + row] += scratch[ARCHIVE_DEPARTURE * ARCHIVE_BLOCK_ROWS + row];
+    }
+    return 0;
+}
+
+// Points columns at the values of block b: straight into the column
+// mappings, or into scratch once a cold block is decoded. Returns the
+// number of rows, or -1 if the block cannot be decoded.
+static int archive_partition_block(const ArchivePartition *partition, int b, int *scratch, const int **columns) {
+    if (partition->state == ARCHIVE_COLD) {
+        const ColdBlockEntry *entry = (const ColdBlockEntry*)(partition->cold + COLD_HEADER_SIZE) + b;
+        if (cold_decode_block(partition->cold + entry->offset, entry->length, (int)entry->rows, scratch) != 0) {
+            return -1;
+        }
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            columns[column] = scratch + column * ARCHIVE_BLOCK_ROWS;
+        }
+        return (int)entry->rows;
+    }
+
+    long start = (long)b * ARCHIVE_BLOCK_ROWS;
+    long end = start + ARCHIVE_BLOCK_ROWS < partition->rows ? start + ARCHIVE_BLOCK_ROWS : partition->rows;
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        columns[column] = partition->columns[column] + start;
+    }
+    return (int)(end - start);
+}
+
+// Warns once per partition about blocks a scan had to skip, like a
+// partition that cannot be mapped
+static void archive_partition_report_damaged(ArchivePartition *partition, int blocks) {
+#ifndef _WIN32
+    pthread_mutex_lock(&archive_lock);
+#endif
+    if (!partition->damaged_reported) {
+        partition->damaged_reported = 1;
+        printf("Warning: skipped %d damaged block%s of archived trips for %02d/%04d.\n", blocks, blocks == 1 ? "" : "s",
+               partition->month % 12 + 1, partition->month / 12);
+    }
+#ifndef _WIN32
+    pthread_mutex_unlock(&archive_lock);
+#endif
+}
+
+// Visits the matching rows of a loaded partition. Returns the number
+// visited and sets *stopped when visit asked to stop. Blocks that cannot
+// be decoded or hold unknown city codes are skipped and reported.
+static long archive_partition_scan(ArchivePartition *partition, const long *lo, const long *hi,
+                                   int (*visit)(const Trip *trip, void *context), void *context, int *stopped) {
+    int *scratch = NULL;
+    if (partition->state == ARCHIVE_COLD) {
+        scratch = (int*)malloc(ARCHIVE_COLUMNS * ARCHIVE_BLOCK_ROWS * sizeof(int));
+        if (scratch == NULL) return 0;
+    }
+
+    long visited = 0;
+    int damaged = 0;
+    Trip trip;
+    const int *columns[ARCHIVE_COLUMNS];
+    for (int b = 0; b < partition->block_count && !*stopped; b++) {
+        if (!archive_ranges_overlap(partition->blocks[b].min, partition->blocks[b].max, lo, hi)) continue;
+
+        int rows = archive_partition_block(partition, b, scratch, columns);
+        if (rows < 0) {
+            damaged++;
+            continue;
+        }
+        int damaged_block = 0;
+        for (int row = 0; row < rows; row++) {
+            int column;
+            for (column = 0; column < ARCHIVE_KEY_COLUMNS; column++) {
+                long value = columns[column][row];
+                if (value < lo[column] || value > hi[column]) break;
+            }
+            if (column < ARCHIVE_KEY_COLUMNS) continue;
+            if (trip_archive_row(columns, row, &trip) != 0) {
+                damaged_block = 1;
+                continue;
+            }
+            visited++;
+            if (visit(&trip, context)) {
+                *stopped = 1;
+                break;
+            }
+        }
+        damaged += damaged_block;
+    }
+    free(scratch);
+    if (damaged > 0) archive_partition_report_damaged(partition, damaged);
+    return visited;
+}
+
+#ifndef _WIN32
+static void archive_partition_unmap(ArchivePartition *partition) {
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        if (partition->columns[column] != NULL) {
+            munmap((void*)partition->columns[column], partition->mapped_size);
+        }
+        partition->columns[column] = NULL;
+    }
+    partition->mapped_size = 0;
+    if (partition->cold != NULL) munmap((void*)partition->cold, partition->cold_size);
+    partition->cold = NULL;
+    partition->cold_size = 0;
+}
+
+// Maps the committed rows of every column; longer files keep the tail of
+// an append that never committed, which is ignored
+static int archive_partition_map(ArchivePartition *partition) {
+    size_t size = (size_t)partition->rows * sizeof(int);
+    if (size == 0) return 0;
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        char path[MAX_STRING_LENGTH + 16];
+        archive_partition_path(partition->month, archive_column_names[column], path, sizeof(path));
+        int fd = open(path, O_RDONLY);
+        struct stat info;
+        void *mapped = MAP_FAILED;
+        if (fd >= 0 && fstat(fd, &info) == 0 && (size_t)info.st_size >= size) {
+            mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        if (fd >= 0) close(fd);
+        if (mapped == MAP_FAILED) {
+            partition->mapped_size = size;
+            archive_partition_unmap(partition);
+            return -1;
+        }
+        partition->columns[column] = (const int*)mapped;
+    }
+    partition->mapped_size = size;
+    return 0;
+}
+
+// Maps a cold partition's file and takes the block ranges from its
+// directory, after checking that every block lies inside the file
+static int archive_partition_map_cold(ArchivePartition *partition) {
+    char path[MAX_STRING_LENGTH + 16];
+    archive_partition_path(partition->month, "cold", path, sizeof(path));
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    void *mapped = MAP_FAILED;
+    if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size >= COLD_HEADER_SIZE) {
+        mapped = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    if (fd >= 0) close(fd);
+    if (mapped == MAP_FAILED) return -1;
+    partition->cold = (const unsigned char*)mapped;
+    partition->cold_size = (size_t)info.st_size;
+
+    const unsigned int *header = (const unsigned int*)partition->cold;
+    int count = (int)((partition->rows + ARCHIVE_BLOCK_ROWS - 1) / ARCHIVE_BLOCK_ROWS);
+    size_t data_start = COLD_HEADER_SIZE + (size_t)count * sizeof(ColdBlockEntry);
+    int valid = header[0] == COLD_FILE_MAGIC && header[1] == COLD_FILE_VERSION &&
+                header[2] == (unsigned int)partition->rows && header[3] == (unsigned int)count &&
+                data_start <= partition->cold_size;
+    const ColdBlockEntry *directory = (const ColdBlockEntry*)(partition->cold + COLD_HEADER_SIZE);
+    long rows = 0;
+    for (int b = 0; valid && b < count; b++) {
+        valid = directory[b].offset >= data_start && directory[b].offset <= partition->cold_size &&
+                directory[b].length <= partition->cold_size - directory[b].offset &&
+                directory[b].rows > 0 && directory[b].rows <= ARCHIVE_BLOCK_ROWS;
+        rows += directory[b].rows;
+    }
+    if (!valid || rows != partition->rows) {
+        archive_partition_unmap(partition);
+        return -1;
+    }
+
+    if (count > partition->block_capacity) {
+        ArchiveBlock *grown = (ArchiveBlock*)realloc(partition->blocks, count * sizeof(ArchiveBlock));
+        if (grown == NULL) {
+            archive_partition_unmap(partition);
+            return -1;
+        }
+        partition->blocks = grown;
+        partition->block_capacity = count;
+    }
+    for (int b = 0; b < count; b++) partition->blocks[b] = directory[b].ranges;
+    partition->block_count = count;
+    return 0;
+}
+
+// Recomputes the column ranges of every block from first_block on, and the
+// partition's key ranges from those
+static int archive_partition_index_blocks(ArchivePartition *partition, int first_block) {
+    int count = (int)((partition->rows + ARCHIVE_BLOCK_ROWS - 1) / ARCHIVE_BLOCK_ROWS);
+    if (count > partition->block_capacity) {
+        ArchiveBlock *grown = (ArchiveBlock*)realloc(partition->blocks, count * sizeof(ArchiveBlock));
+        if (grown == NULL) return -1;
+        partition->blocks = grown;
+        partition->block_capacity = count;
+    }
+
+    for (int b = first_block; b < count; b++) {
+        long start = (long)b * ARCHIVE_BLOCK_ROWS;
+        long end = start + ARCHIVE_BLOCK_ROWS < partition->rows ? start + ARCHIVE_BLOCK_ROWS : partition->rows;
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            const int *values = partition->columns[column];
+            int min = values[start], max = values[start];
+            for (long row = start + 1; row < end; row++) {
+                if (values[row] < min) min = values[row];
+                if (values[row] > max) max = values[row];
+            }
+            partition->blocks[b].min[column] = min;
+            partition->blocks[b].max[column] = max;
+        }
+    }
+    partition->block_count = count;
+
+    for (int column = 0; column < ARCHIVE_KEY_COLUMNS && count > 0; column++) {
+        partition->min[column] = partition->blocks[0].min[column];
+        partition->max[column] = partition->blocks[0].max[column];
+        for (int b = 1; b < count; b++) {
+            if (partition->blocks[b].min[column] < partition->min[column]) partition->min[column] = partition->blocks[b].min[column];
+            if (partition->blocks[b].max[column] > partition->max[column]) partition->max[column] = partition->blocks[b].max[column];
+        }
+    }
+    return 0;
+}
+
+// Reads the block index; fails when it was written for a different row
+// count, so an index left behind by an uncommitted append is rebuilt
+static int archive_partition_read_blocks(ArchivePartition *partition, FILE *file) {
+    long rows;
+    int count;
+    if (fscanf(file, "BLOCKS %ld %d", &rows, &count) != 2 || rows != partition->rows ||
+        count != (rows + ARCHIVE_BLOCK_ROWS - 1) / ARCHIVE_BLOCK_ROWS) {
+        return -1;
+    }
+    if (count > partition->block_capacity) {
+        ArchiveBlock *grown = (ArchiveBlock*)realloc(partition->blocks, count * sizeof(ArchiveBlock));
+        if (grown == NULL) return -1;
+        partition->blocks = grown;
+        partition->block_capacity = count;
+    }
+    for (int b = 0; b < count; b++) {
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            if (fscanf(file, "%d %d", &partition->blocks[b].min[column], &partition->blocks[b].max[column]) != 2) {
+                return -1;
+            }
+        }
+    }
+    partition->block_count = count;
+    return 0;
+}
+
+static int archive_partition_write_blocks(const ArchivePartition *partition) {
+    char path[MAX_STRING_LENGTH + 16], temp_path[MAX_STRING_LENGTH + 16];
+    archive_partition_path(partition->month, "blocks", path, sizeof(path));
+    archive_partition_path(partition->month, "blocks.tmp", temp_path, sizeof(temp_path));
+    FILE *file = fopen(temp_path, "w");
+    if (file == NULL) return -1;
+    fprintf(file, "BLOCKS %ld %d\n", partition->rows, partition->block_count);
+    for (int b = 0; b < partition->block_count; b++) {
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            fprintf(file, column == 0 ? "%d %d" : " %d %d", partition->blocks[b].min[column], partition->blocks[b].max[column]);
+        }
+        fputc('\n', file);
+    }
+    int failed = ferror(file);
+    if (fclose(file) != 0) failed = 1;
+    if (failed || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return -1;
+    }
+    return 0;
+}
+
+static void archive_partition_release(ArchivePartition *partition) {
+    archive_partition_unmap(partition);
+    free(partition->blocks);
+    partition->blocks = NULL;
+    partition->block_count = 0;
+    partition->block_capacity = 0;
+    partition->loaded = 0;
+}
+
+// Maps a partition and reads its block index, once
+static int archive_partition_load(ArchivePartition *partition) {
+    if (partition->loaded != 0) return partition->loaded > 0 ? 0 : -1;
+    int cold = partition->state == ARCHIVE_COLD;
+    if ((cold ? archive_partition_map_cold(partition) : archive_partition_map(partition)) != 0) {
+        partition->loaded = -1;
+        printf("Warning: could not map archived trips for %02d/%04d.\n", partition->month % 12 + 1, partition->month / 12);
+        return -1;
+    }
+    if (cold) {
+        partition->loaded = 1;
+        return 0;
+    }
+
+    char path[MAX_STRING_LENGTH + 16];
+    archive_partition_path(partition->month, "blocks", path, sizeof(path));
+    FILE *file = fopen(path, "r");
+    int current = file != NULL && archive_partition_read_blocks(partition, file) == 0;
+    if (file != NULL) fclose(file);
+    if (!current) {
+        if (archive_partition_index_blocks(partition, 0) != 0) {
+            archive_partition_release(partition);
+            partition->loaded = -1;
+            return -1;
+        }
+        if (partition->state == ARCHIVE_OPEN) archive_partition_write_blocks(partition);
+    }
+    partition->loaded = 1;
+    return 0;
+}
+
+// Removes the column files and block index of a month
+static void archive_partition_remove_columns(int month) {
+    char path[MAX_STRING_LENGTH + 16];
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        archive_partition_path(month, archive_column_names[column], path, sizeof(path));
+        remove(path);
+    }
+    archive_partition_path(month, "blocks", path, sizeof(path));
+    remove(path);
+}
+
+static void archive_partition_remove_files(int month) {
+    char path[MAX_STRING_LENGTH + 16];
+    archive_partition_remove_columns(month);
+    archive_partition_path(month, "cold", path, sizeof(path));
+    remove(path);
+}
+
+static void archive_partition_seal_files(int month) {
+    char path[MAX_STRING_LENGTH + 16];
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+        archive_partition_path(month, archive_column_names[column], path, sizeof(path));
+        chmod(path, 0444);
+    }
+    archive_partition_path(month, "blocks", path, sizeof(path));
+    chmod(path, 0444);
+}
+
+static int trip_archive_read_manifest(FILE *file) {
+    TripArchive *archive = &trip_archive;
+    int version, partition_count, city_count, bus_count;
+    if (fscanf(file, "ARCHIVE %d %d %d %d", &version, &partition_count, &city_count, &bus_count) != 4 ||
+        version != ARCHIVE_VERSION || partition_count < 0 || city_count < 0 || bus_count < 0) {
+        return -1;
+    }
+
+    char name[MAX_STRING_LENGTH];
+    for (int i = 0; i < city_count; i++) {
+        if (fscanf(file, "%99s", name) != 1 || city_table_intern(&archive->cities, name) != i) return -1;
+    }
+
+    for (int i = 0; i < partition_count; i++) {
+        int year, month;
+        ArchivePartition read;
+        memset(&read, 0, sizeof(ArchivePartition));
+        if (fscanf(file, "%d-%d %ld %d", &year, &month, &read.rows, &read.state) != 4 ||
+            month < 1 || month > 12 || read.rows <= 0 || read.state < ARCHIVE_OPEN || read.state > ARCHIVE_COLD) {
+            return -1;
+        }
+        for (int column = 0; column < ARCHIVE_KEY_COLUMNS; column++) {
+            if (fscanf(file, "%d %d", &read.min[column], &read.max[column]) != 2) return -1;
+        }
+        read.month = year * 12 + month - 1;
+        ArchivePartition *partition = archive_partition_for(read.month, 1);
+        if (partition == NULL || partition->rows != 0) return -1;
+        *partition = read;
+        archive->rows += read.rows;
+    }
+
+    for (int i = 0; i < bus_count; i++) {
+        ArchiveBusTotals read;
+        if (fscanf(file, "%d %d %d %ld", &read.license_plate, &read.trip_count, &read.run_count,
+                   &read.service_minutes) != 4) {
+            return -1;
+        }
+        ArchiveBusTotals *totals = archive_totals_for(&archive->totals, read.license_plate, 1);
+        if (totals == NULL) return -1;
+        *totals = read;
+    }
+    return 0;
+}
+
+// Replaces the manifest through a temporary file; the rename is what
+// commits appended rows
+static int trip_archive_write_manifest(void) {
+    const TripArchive *archive = &trip_archive;
+    char path[MAX_STRING_LENGTH + 16], temp_path[MAX_STRING_LENGTH + 16];
+    snprintf(path, sizeof(path), "%s/manifest", TRIP_ARCHIVE_PATH);
+    snprintf(temp_path, sizeof(temp_path), "%s/manifest.tmp", TRIP_ARCHIVE_PATH);
+    FILE *file = fopen(temp_path, "w");
+    if (file == NULL) return -1;
+
+    int partition_count = 0;
+    for (int i = 0; i < archive->partition_count; i++) {
+        if (archive->partitions[i].rows > 0) partition_count++;
+    }
+    fprintf(file, "ARCHIVE %d %d %d %d\n", ARCHIVE_VERSION, partition_count, archive->cities.count,
+            archive->totals.count);
+    for (int i = 0; i < archive->cities.count; i++) {
+        fprintf(file, "%s\n", archive->cities.names[i]);
+    }
+    for (int i = 0; i < archive->partition_count; i++) {
+        const ArchivePartition *partition = &archive->partitions[i];
+        if (partition->rows == 0) continue;
+        fprintf(file, "%04d-%02d %ld %d", partition->month / 12, partition->month % 12 + 1, partition->rows,
+                partition->state);
+        for (int column = 0; column < ARCHIVE_KEY_COLUMNS; column++) {
+            fprintf(file, " %d %d", partition->min[column], partition->max[column]);
+        }
+        fputc('\n', file);
+    }
+    for (int i = 0; i < archive->totals.count; i++) {
+        const ArchiveBusTotals *totals = &archive->totals.buses[i];
+        fprintf(file, "%d %d %d %ld\n", totals->license_plate, totals->trip_count, totals->run_count,
+                totals->service_minutes);
+    }
+
+    int failed = ferror(file);
+    if (fclose(file) != 0) failed = 1;
+    if (failed || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+// Partitions are loaded under a lock, since snapshot readers of a shared
+// session can scan concurrently
+static int archive_partition_acquire(ArchivePartition *partition) {
+#ifdef _WIN32
+    (void)partition;
+    return -1;
+#else
+    pthread_mutex_lock(&archive_lock);
+    int result = archive_partition_load(partition);
+    pthread_mutex_unlock(&archive_lock);
+    return result;
+#endif
+}
+
+// Calls visit for every archived trip matching query, month by month, until
+// it returns non-zero. Only partitions whose ranges overlap the query are
+// loaded. Returns the number of trips visited.
+long trip_archive_scan(const ArchiveQuery *query, int (*visit)(const Trip *trip, void *context), void *context) {
+    if (trip_archive_open() != 0) return 0;
+    long lo[ARCHIVE_KEY_COLUMNS], hi[ARCHIVE_KEY_COLUMNS];
+    archive_query_bounds(query, lo, hi);
+
+    long visited = 0;
+    int stopped = 0;
+    for (int i = 0; i < trip_archive.partition_count && !stopped; i++) {
+        ArchivePartition *partition = &trip_archive.partitions[i];
+        if (partition->rows == 0 || !archive_ranges_overlap(partition->min, partition->max, lo, hi)) continue;
+        if (archive_partition_acquire(partition) != 0) continue;
+        visited += archive_partition_scan(partition, lo, hi, visit, context, &stopped);
+    }
+    return visited;
+}
+
+void trip_archive_close(void) {
+#ifndef _WIN32
+    for (int i = 0; i < trip_archive.partition_count; i++) {
+        archive_partition_release(&trip_archive.partitions[i]);
+    }
+#endif
+    free(trip_archive.partitions);
+    free(trip_archive.totals.buses);
+    city_table_free(&trip_archive.cities);
+    memset(&trip_archive, 0, sizeof(TripArchive));
+}
+
+#ifndef _WIN32
+// Moves an archive in the earlier single-file layout (<path>.meta with one
+// file per column beside the directory) into month partitions
+static void trip_archive_convert_legacy(void) {
+    char path[MAX_STRING_LENGTH + 16];
+    snprintf(path, sizeof(path), "%s.meta", TRIP_ARCHIVE_PATH);
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return;
+
+    CityTable cities;
+    memset(&cities, 0, sizeof(CityTable));
+    int version, block_rows, city_count;
+    long rows;
+    int ok = fscanf(file, "ARCHIVE %d %ld %d %d", &version, &rows, &block_rows, &city_count) == 4 &&
+             version == 1 && rows >= 0 && city_count >= 0;
+    char name[MAX_STRING_LENGTH];
+    for (int i = 0; ok && i < city_count; i++) {
+        ok = fscanf(file, "%99s", name) == 1 && city_table_intern(&cities, name) == i;
+    }
+    fclose(file);
+
+    int *columns[ARCHIVE_COLUMNS] = {NULL};
+    for (int column = 0; ok && column < ARCHIVE_COLUMNS; column++) {
+        char column_path[MAX_STRING_LENGTH + 16];
+        snprintf(column_path, sizeof(column_path), "%s.%s", TRIP_ARCHIVE_PATH, archive_column_names[column]);
+        FILE *in = fopen(column_path, "rb");
+        columns[column] = (int*)malloc((size_t)rows * sizeof(int) + sizeof(int));
+        ok = in != NULL && columns[column] != NULL && fread(columns[column], sizeof(int), rows, in) == (size_t)rows;
+        if (in != NULL) fclose(in);
+    }
+
+    Trip *chunk = (Trip*)malloc(ARCHIVE_BLOCK_ROWS * sizeof(Trip));
+    Trip **pointers = (Trip**)malloc(ARCHIVE_BLOCK_ROWS * sizeof(Trip*));
+    ok = ok && chunk != NULL && pointers != NULL;
+    archive_converting = 1;
+    for (long start = 0; ok && start < rows; start += ARCHIVE_BLOCK_ROWS) {
+        int count = rows - start < ARCHIVE_BLOCK_ROWS ? (int)(rows - start) : ARCHIVE_BLOCK_ROWS;
+        for (int i = 0; ok && i < count; i++) {
+            long row = start + i;
+            int from = columns[ARCHIVE_FROM][row], to = columns[ARCHIVE_TO][row];
+            if (from < 0 || from >= cities.count || to < 0 || to >= cities.count) {
+                ok = 0;
+                break;
+            }
+            Trip *trip = &chunk[i];
+            trip->license_plate = columns[ARCHIVE_PLATE][row];
+            trip->client_id = columns[ARCHIVE_CLIENT][row];
+            trip->departure_time = minutes_to_datetime(columns[ARCHIVE_DEPARTURE][row]);
+            trip->arrival_time = minutes_to_datetime(columns[ARCHIVE_ARRIVAL][row]);
+            strncpy(trip->departure_city, cities.names[from], MAX_STRING_LENGTH - 1);
+            strncpy(trip->arrival_city, cities.names[to], MAX_STRING_LENGTH - 1);
+            trip->departure_city[MAX_STRING_LENGTH - 1] = '\0';
+            trip->arrival_city[MAX_STRING_LENGTH - 1] = '\0';
+            pointers[i] = trip;
+        }
+        ok = ok && trip_archive_append(pointers, count) == 0;
+    }
+    archive_converting = 0;
+
+    if (ok) {
+        remove(path);
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            char column_path[MAX_STRING_LENGTH + 16];
+            snprintf(column_path, sizeof(column_path), "%s.%s", TRIP_ARCHIVE_PATH, archive_column_names[column]);
+            remove(column_path);
+        }
+    } else {
+        printf("Warning: could not convert the trip archive at %s; it is left in place.\n", path);
+    }
+    free(chunk);
+    free(pointers);
+    for (int column = 0; column < ARCHIVE_COLUMNS; column++) free(columns[column]);
+    city_table_free(&cities);
+}
+#endif
+
+// Opens the archive on first use by reading its manifest. A missing archive
+// opens empty; an unreadable one is reported once and left alone. Returns
+// 0 or -1.
+int trip_archive_open(void) {
+    if (trip_archive.loaded != 0) return trip_archive.loaded > 0 ? 0 : -1;
+#ifdef _WIN32
+    trip_archive.loaded = -1;
+    return -1;
+#else
+    char path[MAX_STRING_LENGTH + 16];
+    snprintf(path, sizeof(path), "%s/manifest", TRIP_ARCHIVE_PATH);
+    FILE *file = fopen(path, "r");
+    int failed = 0;
+    if (file != NULL) {
+        failed = trip_archive_read_manifest(file) != 0;
+        fclose(file);
+    }
+    if (failed) {
+        trip_archive_close();
+        trip_archive.loaded = -1;
+        printf("Warning: could not open the trip archive at %s; archived trips are unavailable.\n", path);
+        return -1;
+    }
+    trip_archive.loaded = 1;
+    // Conversion is repeated until it completes; appends skip trips already moved
+    if (!archive_converting) trip_archive_convert_legacy();
+    return 0;
+#endif
+}
+
+static int compare_archive_trips(const void *a, const void *b) {
+    const Trip *x = *(Trip* const*)a;
+    const Trip *y = *(Trip* const*)b;
+    long dx = datetime_to_minutes(x->departure_time);
+    long dy = datetime_to_minutes(y->departure_time);
+    if (dx != dy) return dx < dy ? -1 : 1;
+    return (x->license_plate > y->license_plate) - (x->license_plate < y->license_plate);
+}
+
+#ifndef _WIN32
+// Appends one month of trips, sorted by departure, to its partition and
+// updates the usage totals. Trips the partition already holds (left in
+// trips.txt by an interrupted archive run) are skipped. Runs never span months,
+// so whether a trip starts a new run is decided within the partition.
+static int archive_partition_append(int month, Trip **trips, int count) {
+    TripArchive *archive = &trip_archive;
+    ArchivePartition *partition = archive_partition_for(month, 1);
+    if (partition == NULL || partition->state != ARCHIVE_OPEN) return -1;
+    if (partition->rows > 0 && archive_partition_load(partition) != 0) return -1;
+
+    int *values = (int*)malloc((size_t)count * ARCHIVE_COLUMNS * sizeof(int));
+    if (values == NULL) return -1;
+
+    long newest = partition->rows > 0 ? partition->max[ARCHIVE_DEPARTURE] : LONG_MIN;
+    long previous_departure = LONG_MIN;
+    int previous_plate = -1;
+    int failed = 0, added = 0;
+    for (int i = 0; i < count; i++) {
+        const Trip *trip = trips[i];
+        long departure = datetime_to_minutes(trip->departure_time);
+        long arrival = datetime_to_minutes(trip->arrival_time);
+        int new_run = departure != previous_departure || trip->license_plate != previous_plate;
+        if (departure <= newest) {
+            ArchiveQuery query;
+            long lo[ARCHIVE_KEY_COLUMNS], hi[ARCHIVE_KEY_COLUMNS];
+            int stopped = 0;
+            archive_query_all(&query);
+            query.license_plate = trip->license_plate;
+            query.departure_from = query.departure_to = departure;
+            archive_query_bounds(&query, lo, hi);
+            if (new_run && archive_partition_scan(partition, lo, hi, archived_trip_found, NULL, &stopped) > 0) {
+                new_run = 0;
+            }
+            query.client_id = trip->client_id;
+            query.arrival_from = query.arrival_to = arrival;
+            archive_query_bounds(&query, lo, hi);
+            if (archive_partition_scan(partition, lo, hi, archived_trip_found, NULL, &stopped) > 0) continue;
+        }
+        previous_departure = departure;
+        previous_plate = trip->license_plate;
+
+        int from = city_table_intern(&archive->cities, trip->departure_city);
+        int to = city_table_intern(&archive->cities, trip->arrival_city);
+        ArchiveBusTotals *totals = archive_totals_for(&archive->totals, trip->license_plate, 1);
+        if (from < 0 || to < 0 || totals == NULL) {
+            failed = 1;
+            break;
+        }
+        totals->trip_count++;
+        if (new_run) {
+            totals->run_count++;
+            if (arrival > departure) totals->service_minutes += arrival - departure;
+        }
+        values[ARCHIVE_PLATE * count + added] = trip->license_plate;
+        values[ARCHIVE_CLIENT * count + added] = trip->client_id;
+        values[ARCHIVE_DEPARTURE * count + added] = (int)departure;
+        values[ARCHIVE_ARRIVAL * count + added] = (int)arrival;
+        values[ARCHIVE_FROM * count + added] = from;
+        values[ARCHIVE_TO * count + added] = to;
+        added++;
+    }
+
+    if (!failed && added > 0) {
+        int first_block = (int)(partition->rows / ARCHIVE_BLOCK_ROWS);
+        off_t offset = (off_t)partition->rows * (off_t)sizeof(int);
+        size_t bytes = (size_t)added * sizeof(int);
+        archive_partition_unmap(partition);
+        for (int column = 0; column < ARCHIVE_COLUMNS && !failed; column++) {
+            char path[MAX_STRING_LENGTH + 16];
+            archive_partition_path(month, archive_column_names[column], path, sizeof(path));
+            int fd = open(path, O_WRONLY | O_CREAT, 0644);
+            if (fd < 0 || ftruncate(fd, offset) != 0 ||
+                pwrite(fd, values + (size_t)column * count, bytes, offset) != (ssize_t)bytes) {
+                failed = 1;
+            }
+            if (fd >= 0) close(fd);
+        }
+        if (!failed) {
+            partition->rows += added;
+            archive->rows += added;
+            failed = archive_partition_map(partition) != 0 ||
+                     archive_partition_index_blocks(partition, first_block) != 0 ||
+                     archive_partition_write_blocks(partition) != 0;
+            partition->loaded = failed ? -1 : 1;
+        }
+    }
+    free(values);
+    return failed ? -1 : 0;
+}
+#endif
+
+// Appends trips to the archive, one partition per departure month. Column
+// files are cut back to the committed row count before writing, and the
+// manifest is replaced once at the end. Returns 0 or -1; on failure the
+// archive is reopened as it was on disk.
+int trip_archive_append(Trip **trips, int count) {
+#ifdef _WIN32
+    (void)trips;
+    (void)count;
+    return -1;
+#else
+    if (count == 0) return 0;
+    if (trip_archive_open() != 0) return -1;
+    qsort(trips, count, sizeof(Trip*), compare_archive_trips);
+    mkdir(TRIP_ARCHIVE_PATH, 0755);
+
+    int failed = 0;
+    int start = 0;
+    while (start < count && !failed) {
+        int month = month_of_minutes(datetime_to_minutes(trips[start]->departure_time));
+        int end = start + 1;
+        while (end < count && month_of_minutes(datetime_to_minutes(trips[end]->departure_time)) == month) end++;
+        failed = archive_partition_append(month, trips + start, end - start) != 0;
+        start = end;
+    }
+    if (!failed) failed = trip_archive_write_manifest() != 0;
+
+    if (failed) {
+        trip_archive_close();
+        trip_archive_open();
+        return -1;
+    }
+    return 0;
+#endif
+}
+
+static int archive_month_sealed(int month) {
+    const ArchivePartition *partition = archive_partition_for(month, 0);
+    return partition != NULL && partition->state != ARCHIVE_OPEN;
+}
+
+#ifndef _WIN32
+typedef struct ArchiveRunKey {
+    int license_plate;
+    int departure;
+    int arrival;
+} ArchiveRunKey;
+
+static int compare_archive_run_keys(const void *a, const void *b) {
+    const ArchiveRunKey *x = (const ArchiveRunKey*)a;
+    const ArchiveRunKey *y = (const ArchiveRunKey*)b;
+    if (x->license_plate != y->license_plate) return x->license_plate < y->license_plate ? -1 : 1;
+    return (x->departure > y->departure) - (x->departure < y->departure);
+}
+
+// Takes a partition's trips out of the usage totals, counting its runs
+// the same way appends did
+static int archive_partition_subtract_totals(ArchivePartition *partition) {
+    if (archive_partition_load(partition) != 0) return -1;
+    ArchiveRunKey *keys = (ArchiveRunKey*)malloc((size_t)partition->rows * sizeof(ArchiveRunKey));
+    int *scratch = NULL;
+    if (partition->state == ARCHIVE_COLD) scratch = (int*)malloc(ARCHIVE_COLUMNS * ARCHIVE_BLOCK_ROWS * sizeof(int));
+    if (keys == NULL || (partition->state == ARCHIVE_COLD && scratch == NULL)) {
+        free(keys);
+        free(scratch);
+        return -1;
+    }
+    long row = 0;
+    const int *columns[ARCHIVE_COLUMNS];
+    for (int b = 0; b < partition->block_count; b++) {
+        int rows = archive_partition_block(partition, b, scratch, columns);
+        if (rows < 0) {
+            free(keys);
+            free(scratch);
+            return -1;
+        }
+        for (int i = 0; i < rows; i++, row++) {
+            keys[row].license_plate = columns[ARCHIVE_PLATE][i];
+            keys[row].departure = columns[ARCHIVE_DEPARTURE][i];
+            keys[row].arrival = columns[ARCHIVE_ARRIVAL][i];
+        }
+    }
+    free(scratch);
+    qsort(keys, partition->rows, sizeof(ArchiveRunKey), compare_archive_run_keys);
+
+    for (row = 0; row < partition->rows; row++) {
+        ArchiveBusTotals *totals = archive_totals_for(&trip_archive.totals, keys[row].license_plate, 0);
+        if (totals == NULL) continue;
+        totals->trip_count--;
+        if (row == 0 || keys[row].license_plate != keys[row - 1].license_plate ||
+            keys[row].departure != keys[row - 1].departure) {
+            totals->run_count--;
+            if (keys[row].arrival > keys[row].departure) {
+                totals->service_minutes -= keys[row].arrival - keys[row].departure;
+            }
+        }
+        if (totals->trip_count <= 0) {
+            int index = (int)(totals - trip_archive.totals.buses);
+            memmove(totals, totals + 1, (trip_archive.totals.count - index - 1) * sizeof(ArchiveBusTotals));
+            trip_archive.totals.count--;
+        }
+    }
+    free(keys);
+    return 0;
+}
+
+typedef struct ArchiveRow {
+    int values[ARCHIVE_COLUMNS];
+} ArchiveRow;
+
+// Orders rows so that the passengers of one run sit next to each other
+static int compare_archive_rows(const void *a, const void *b) {
+    const int *x = ((const ArchiveRow*)a)->values;
+    const int *y = ((const ArchiveRow*)b)->values;
+    if (x[ARCHIVE_DEPARTURE] != y[ARCHIVE_DEPARTURE]) return x[ARCHIVE_DEPARTURE] < y[ARCHIVE_DEPARTURE] ? -1 : 1;
+    if (x[ARCHIVE_PLATE] != y[ARCHIVE_PLATE]) return x[ARCHIVE_PLATE] < y[ARCHIVE_PLATE] ? -1 : 1;
+    return (x[ARCHIVE_CLIENT] > y[ARCHIVE_CLIENT]) - (x[ARCHIVE_CLIENT] < y[ARCHIVE_CLIENT]);
+}
+
+static unsigned char* cold_put_varint(unsigned char *p, long long delta) {
+    unsigned long long zigzag = ((unsigned long long)delta << 1) ^ (delta < 0 ? ~0ULL : 0ULL);
+    while (zigzag >= 0x80) {
+        *p++ = (unsigned char)(zigzag | 0x80);
+        zigzag >>= 7;
+    }
+    *p++ = (unsigned char)zigzag;
+    return p;
+}
+
+// Writes a sealed partition's rows to <yyyy-mm>.cold. The column files are
+// left alone; they go once the manifest records the partition as cold.
+static int archive_partition_compress(ArchivePartition *partition) {
+    if (archive_partition_load(partition) != 0) return -1;
+    long rows = partition->rows;
+    int block_count = (int)((rows + ARCHIVE_BLOCK_ROWS - 1) / ARCHIVE_BLOCK_ROWS);
+    ArchiveRow *sorted = (ArchiveRow*)malloc((size_t)rows * sizeof(ArchiveRow));
+    ColdBlockEntry *directory = (ColdBlockEntry*)calloc(block_count, sizeof(ColdBlockEntry));
+    // A row takes a mask byte and at most ten bytes per column
+    unsigned char *buffer = (unsigned char*)malloc((size_t)ARCHIVE_BLOCK_ROWS * (1 + ARCHIVE_COLUMNS * 10));
+    char path[MAX_STRING_LENGTH + 16], temp_path[MAX_STRING_LENGTH + 16];
+    archive_partition_path(partition->month, "cold", path, sizeof(path));
+    archive_partition_path(partition->month, "cold.tmp", temp_path, sizeof(temp_path));
+    FILE *file = NULL;
+    if (sorted != NULL && directory != NULL && buffer != NULL) file = fopen(temp_path, "wb");
+    if (file == NULL) {
+        free(sorted);
+        free(directory);
+        free(buffer);
+        return -1;
+    }
+
+    for (long row = 0; row < rows; row++) {
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            sorted[row].values[column] = partition->columns[column][row];
+        }
+    }
+    qsort(sorted, rows, sizeof(ArchiveRow), compare_archive_rows);
+
+    unsigned int header[COLD_HEADER_SIZE / sizeof(unsigned int)] = {
+        COLD_FILE_MAGIC, COLD_FILE_VERSION, (unsigned int)rows, (unsigned int)block_count
+    };
+    fwrite(header, sizeof(header), 1, file);
+    fwrite(directory, sizeof(ColdBlockEntry), block_count, file); // rewritten below
+    unsigned long long offset = COLD_HEADER_SIZE + (unsigned long long)block_count * sizeof(ColdBlockEntry);
+    for (int b = 0; b < block_count; b++) {
+        long start = (long)b * ARCHIVE_BLOCK_ROWS;
+        long end = start + ARCHIVE_BLOCK_ROWS < rows ? start + ARCHIVE_BLOCK_ROWS : rows;
+        ColdBlockEntry *entry = &directory[b];
+        long long previous[ARCHIVE_COLUMNS] = {0};
+        unsigned char *p = buffer;
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            entry->ranges.min[column] = entry->ranges.max[column] = sorted[start].values[column];
+        }
+        for (long row = start; row < end; row++) {
+            const int *values = sorted[row].values;
+            unsigned char *changed = p++;
+            *changed = 0;
+            for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+                if (values[column] < entry->ranges.min[column]) entry->ranges.min[column] = values[column];
+                if (values[column] > entry->ranges.max[column]) entry->ranges.max[column] = values[column];
+                long long value = values[column];
+                if (column == ARCHIVE_ARRIVAL) value -= values[ARCHIVE_DEPARTURE];
+                if (value == previous[column]) continue;
+                *changed |= (unsigned char)(1u << column);
+                p = cold_put_varint(p, value - previous[column]);
+                previous[column] = value;
+            }
+        }
+        entry->offset = offset;
+        entry->length = (unsigned int)(p - buffer);
+        entry->rows = (unsigned int)(end - start);
+        fwrite(buffer, 1, entry->length, file);
+        offset += entry->length;
+    }
+    if (fseek(file, COLD_HEADER_SIZE, SEEK_SET) == 0) fwrite(directory, sizeof(ColdBlockEntry), block_count, file);
+
+    int failed = ferror(file);
+    if (fclose(file) != 0) failed = 1;
+    free(sorted);
+    free(directory);
+    free(buffer);
+    if (failed || rename(temp_path, path) != 0) {
+        remove(temp_path);
+        return -1;
+    }
+    chmod(path, 0444);
+    return 0;
+}
+#endif
+
+// Seals the partitions whose month ended by cutoff, drops sealed ones that
+// fell out of the retention period and compresses those past the cold
+// age. Dropped and compressed partitions reach the manifest before the
+// files they no longer need are removed.
+static void trip_archive_maintain(long cutoff) {
+#ifdef _WIN32
+    (void)cutoff;
+#else
+    TripArchive *archive = &trip_archive;
+    int changed = 0;
+    for (int i = 0; i < archive->partition_count; i++) {
+        ArchivePartition *partition = &archive->partitions[i];
+        if (partition->state != ARCHIVE_OPEN || partition->rows == 0 ||
+            month_start_minutes(partition->month + 1) > cutoff) {
+            continue;
+        }
+        archive_partition_seal_files(partition->month);
+        partition->state = ARCHIVE_SEALED;
+        changed = 1;
+    }
+
+    int retention = trip_archive_retention_months();
+    int *dropped = NULL;
+    int dropped_count = 0;
+    if (retention > 0) {
+        int oldest = month_of_minutes(current_time_in_minutes()) - retention;
+        dropped = (int*)malloc((archive->partition_count + 1) * sizeof(int));
+        for (int i = 0; dropped != NULL && i < archive->partition_count; i++) {
+            ArchivePartition *partition = &archive->partitions[i];
+            if (partition->state == ARCHIVE_OPEN || partition->month >= oldest) continue;
+            if (archive_partition_subtract_totals(partition) != 0) break;
+            dropped[dropped_count++] = partition->month;
+            archive->rows -= partition->rows;
+            archive_partition_release(partition);
+            memmove(partition, partition + 1, (archive->partition_count - i - 1) * sizeof(ArchivePartition));
+            archive->partition_count--;
+            i--;
+            changed = 1;
+        }
+    }
+
+    int cold_months = trip_archive_cold_months();
+    int *compressed = NULL;
+    int compressed_count = 0;
+    if (cold_months > 0) {
+        int coldest = month_of_minutes(current_time_in_minutes()) - cold_months;
+        compressed = (int*)malloc((archive->partition_count + 1) * sizeof(int));
+        for (int i = 0; compressed != NULL && i < archive->partition_count; i++) {
+            ArchivePartition *partition = &archive->partitions[i];
+            if (partition->state != ARCHIVE_SEALED || partition->month >= coldest) continue;
+            if (archive_partition_compress(partition) != 0) {
+                printf("Warning: could not compress archived trips for %02d/%04d.\n",
+                       partition->month % 12 + 1, partition->month / 12);
+                continue;
+            }
+            archive_partition_release(partition);
+            partition->state = ARCHIVE_COLD;
+            compressed[compressed_count++] = partition->month;
+            changed = 1;
+        }
+    }
+
+    if (changed && trip_archive_write_manifest() != 0) {
+        printf("Warning: could not update the trip archive manifest.\n");
+        for (int i = 0; i < compressed_count; i++) {
+            char path[MAX_STRING_LENGTH + 16];
+            archive_partition_path(compressed[i], "cold", path, sizeof(path));
+            remove(path);
+        }
+        trip_archive_close();
+        trip_archive_open();
+    } else {
+        for (int i = 0; i < dropped_count; i++) archive_partition_remove_files(dropped[i]);
+        for (int i = 0; i < compressed_count; i++) archive_partition_remove_columns(compressed[i]);
+    }
+    free(dropped);
+    free(compressed);
+#endif
+}
+
+// Moves the trips that departed before the archive cutoff out of *head
+// and rewrites trips.txt without them, then seals and drops partitions.
+// The archive commits first, so an interruption leaves trips in both
+// places; loads skip the copies and the next run removes them. Returns
+// the number of trips moved, or -1 if the archive could not be written.
+int archive_old_trips(Trip **list) {
+    Trip *head = *list;
+    int days = trip_archive_days();
+    if (days <= 0 || trip_archive_open() != 0) return -1;
+    long cutoff = current_time_in_minutes() - days * 1440L;
+
+    int count = 0, capacity = 0;
+    Trip **old = NULL;
+    for (Trip *trip = head; trip != NULL; trip = trip->next) {
+        long departure = datetime_to_minutes(trip->departure_time);
+        if (departure >= cutoff || archive_month_sealed(month_of_minutes(departure))) continue;
+        if (count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 256;
+            Trip **grown = (Trip**)realloc(old, new_capacity * sizeof(Trip*));
+            if (grown == NULL) {
+                free(old);
+                return -1;
+            }
+            old = grown;
+            capacity = new_capacity;
+        }
+        old[count++] = trip;
+    }
+    if (count > 0 && trip_archive_append(old, count) != 0) {
+        free(old);
+        return -1;
+    }
+    free(old);
+
+    if (count > 0) {
+        Trip *prev = NULL;
+        Trip *trip = head;
+        while (trip != NULL) {
+            Trip *next = trip->next;
+            long departure = datetime_to_minutes(trip->departure_time);
+            if (departure < cutoff && !archive_month_sealed(month_of_minutes(departure))) {
+                if (prev == NULL) {
+                    head = next;
+                } else {
+                    prev->next = next;
+                }
+                free(trip);
+            } else {
+                prev = trip;
+            }
+            trip = next;
+        }
+        autosave_wait();
+        save_trips_to_file(head);
+    }
+    *list = head;
+    trip_archive_maintain(cutoff);
+    return count;
+}
+
+// busflow archive: the one step that writes the archive. Reads trips.txt as
+// it is, moves the old trips, maintains the partitions and finally takes
+// out copies of archived trips, which archiving skips once their month is
+// sealed. Returns the process exit status.
+int run_archive_maintenance(FILE *out) {
+    if (trip_archive_days() <= 0) {
+        fprintf(out, "Archiving is off (BUSFLOW_ARCHIVE_DAYS=0, or not available on this platform).\n");
+        return 0;
+    }
+    Trip *trips = NULL;
+    FILE *file = fopen(TRIP_FILENAME, "r");
+    if (file != NULL) {
+        trips = read_trip_records(file);
+        fclose(file);
+    }
+    int archived = archive_old_trips(&trips);
+    if (archived < 0) {
+        free_trip_list(trips);
+        fprintf(out, "Could not write the trip archive; trips.txt is unchanged.\n");
+        return 1;
+    }
+    int count = 0, left = 0;
+    for (Trip *trip = trips; trip != NULL; trip = trip->next) count++;
+    trips = drop_archived_copies(trips);
+    for (Trip *trip = trips; trip != NULL; trip = trip->next) left++;
+    if (left < count) save_trips_to_file(trips);
+    free_trip_list(trips);
+    fprintf(out, "%d trips archived, %d copies removed, %d left in trips.txt, %ld in the archive\n",
+            archived, count - left, left, trip_archive_rows());
+    return 0;
+}
+
+// Fleet report functions
+typedef struct ServiceInterval {
+    int license_plate;
+    long departure;     // before clipping; one bus run per (plate, departure)
+    long start;
+    long end;
+} ServiceInterval;
+
+typedef struct ServiceIntervalList {
+    ServiceInterval *items;
+    size_t count;
+    size_t capacity;
+    long period_start;
+    long period_end;
+    int failed;
+} ServiceIntervalList;
+
+// Clips a trip to the period and records it. Also used as an archive scan
+// visitor, which stops on allocation failure.
+static int collect_service_interval(const Trip *trip, void *context) {
+    ServiceIntervalList *list = (ServiceIntervalList*)context;
+    long departure = datetime_to_minutes(trip->departure_time);
+    long start = departure;
+    long end = datetime_to_minutes(trip->arrival_time);
+    if (start < list->period_start) start = list->period_start;
+    if (end > list->period_end) end = list->period_end;
+    if (end <= start) return 0;
+
+    if (list->count == list->capacity) {
+        size_t new_capacity = list->capacity ? list->capacity * 2 : 256;
+        ServiceInterval *grown = (ServiceInterval*)realloc(list->items, new_capacity * sizeof(ServiceInterval));
+        if (grown == NULL) {
+            list->failed = 1;
+            return 1;
+        }
+        list->items = grown;
+        list->capacity = new_capacity;
+    }
+    list->items[list->count].license_plate = trip->license_plate;
+    list->items[list->count].departure = departure;
+    list->items[list->count].start = start;
+    list->items[list->count].end = end;
+    list->count++;
+    return 0;
+}
+
+static int compare_service_intervals(const void *a, const void *b) {
+    const ServiceInterval *x = (const ServiceInterval*)a;
+    const ServiceInterval *y = (const ServiceInterval*)b;
+    if (x->license_plate != y->license_plate) return x->license_plate < y->license_plate ? -1 : 1;
+    if (x->start != y->start) return x->start < y->start ? -1 : 1;
+    if (x->departure != y->departure) return x->departure < y->departure ? -1 : 1;
+    return 0;
+}
+
+static int compare_utilization_by_plate(const void *a, const void *b) {
+    const BusUtilization *x = (const BusUtilization*)a;
+    const BusUtilization *y = (const BusUtilization*)b;
+    return (x->license_plate > y->license_plate) - (x->license_plate < y->license_plate);
+}
+
+static int compare_utilization_by_service(const void *a, const void *b) {
+    const BusUtilization *x = (const BusUtilization*)a;
+    const BusUtilization *y = (const BusUtilization*)b;
+    if (x->service_minutes != y->service_minutes) return x->service_minutes < y->service_minutes ? -1 : 1;
+    return (x->license_plate > y->license_plate) - (x->license_plate < y->license_plate);
+}
+
+// Computes service and idle minutes per bus over [period_start, period_end).
+// Trips, including recurring occurrences, are clipped to the period, sorted
+// by (bus, departure) and swept once per bus, merging overlapping trips so
+// shared departures are not double counted. Passenger rows of the same
+// departure count as one trip, as the optimizer groups them into one run.
+// Returns the number of buses written to *out (caller frees), or -1 on error.
+int compute_fleet_utilization(Bus *buses, Trip *trips, TripTemplate *templates, long period_start, long period_end,
+                              BusUtilization **out) {
+    *out = NULL;
+    if (period_end <= period_start) return -1;
+
+    int bus_count = 0;
+    for (Bus *bus = buses; bus != NULL; bus = bus->next) bus_count++;
+    if (bus_count == 0) return 0;
+
+    BusUtilization *stats = (BusUtilization*)malloc(bus_count * sizeof(BusUtilization));
+    if (stats == NULL) return -1;
+
+    int i = 0;
+    for (Bus *bus = buses; bus != NULL; bus = bus->next, i++) {
+        stats[i].license_plate = bus->license_plate;
+        stats[i].price = bus->price;
+        stats[i].purchase_date = bus->purchase_date;
+        stats[i].seat_count = bus->seat_count;
+        stats[i].trip_count = 0;
+        stats[i].service_minutes = 0;
+        stats[i].idle_minutes = period_end - period_start;
+    }
+    qsort(stats, bus_count, sizeof(BusUtilization), compare_utilization_by_plate);
+
+    // Occurrences that left before the period can still be on the road in it
+    long longest = 0;
+    for (TripTemplate *tmpl = templates; tmpl != NULL; tmpl = tmpl->next) {
+        if (tmpl->duration_minutes > longest) longest = tmpl->duration_minutes;
+    }
+    Trip *occurrences;
+    if (expand_template_occurrences(templates, period_start - longest, period_end, trips, &occurrences) < 0) {
+        free(stats);
+        return -1;
+    }
+    if (occurrences != NULL) trips = occurrences;
+
+    // Collect the trips overlapping the period, archived ones included
+    ServiceIntervalList list;
+    memset(&list, 0, sizeof(ServiceIntervalList));
+    list.period_start = period_start;
+    list.period_end = period_end;
+    for (Trip *trip = trips; trip != NULL && !list.failed; trip = trip->next) {
+        collect_service_interval(trip, &list);
+    }
+    free(occurrences);
+    ArchiveQuery query;
+    archive_query_all(&query);
+    query.departure_to = period_end - 1;
+    query.arrival_from = period_start + 1;
+    if (!list.failed) trip_archive_scan(&query, collect_service_interval, &list);
+    if (list.failed) {
+        free(list.items);
+        free(stats);
+        return -1;
+    }
+    ServiceInterval *intervals = list.items;
+    size_t interval_count = list.count;
+    qsort(intervals, interval_count, sizeof(ServiceInterval), compare_service_intervals);
+
+    // Sweep: both arrays are sorted by license plate, so walk them together
+    size_t k = 0;
+    for (i = 0; i < bus_count; i++) {
+        while (k < interval_count && intervals[k].license_plate < stats[i].license_plate) k++;
+
+        long busy = 0, run_start = 0, run_end = 0;
+        int in_run = 0;
+        while (k < interval_count && intervals[k].license_plate == stats[i].license_plate) {
+            if (!in_run || intervals[k].departure != intervals[k - 1].departure) stats[i].trip_count++;
+            if (in_run && intervals[k].start <= run_end) {
+                if (intervals[k].end > run_end) run_end = intervals[k].end;
+            } else {
+                if (in_run) busy += run_end - run_start;
+                run_start = intervals[k].start;
+                run_end = intervals[k].end;
+                in_run = 1;
+            }
+            k++;
+        }
+        if (in_run) busy += run_end - run_start;
+
+        stats[i].service_minutes = busy;
+        stats[i].idle_minutes = (period_end - period_start) - busy;
+    }
+
+    free(intervals);
+    *out = stats;
+    return bus_count;
+}
+
+void fleet_utilization_report(Bus *buses, Trip *trips, TripTemplate *templates) {
+    if (buses == NULL) {
+        printf("  No buses found in the system.\n");
+        printf("You need to add buses first to build a utilization report.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
+        return;
+    }
+
+    print_header("FLEET UTILIZATION REPORT");
+
+    PurchaseDate from, to;
+    input_date("Enter period start date:", &from);
+    do {
+        input_date("\nEnter period end date (inclusive):", &to);
+        if (days_from_civil(to.day, to.month, to.year) < days_from_civil(from.day, from.month, from.year)) {
+            printf("End date must not be before the start date.\n");
+        }
+    } while (days_from_civil(to.day, to.month, to.year) < days_from_civil(from.day, from.month, from.year));
+
+    long period_start = days_from_civil(from.day, from.month, from.year) * 1440L;
+    long period_end = (days_from_civil(to.day, to.month, to.year) + 1) * 1440L;
+    double period_hours = (period_end - period_start) / 60.0;
+
+    BusUtilization *stats;
+    int count = compute_fleet_utilization(buses, trips, templates, period_start, period_end, &stats);
+    if (count < 0) {
+        printf("Memory allocation error. Cannot build report.\n");
+        return;
+    }
+
+    printf("\nPeriod: %02d/%02d/%d - %02d/%02d/%d (%.0f hours)\n\n",
+           from.day, from.month, from.year, to.day, to.month, to.year, period_hours);
+
+    set_console_color(2);
+    printf("%-15s %-12s %-15s %-8s %-8s %-12s %-12s %-10s %-12s\n",
+           "License Plate", "Price ($)", "Purchase Date", "Seats", "Trips", "Service (h)", "Idle (h)", "Util (%)", "$/Service h");
+    printf("%-15s %-12s %-15s %-8s %-8s %-12s %-12s %-10s %-12s\n",
+           "=============", "=========", "=============", "=====", "=====", "===========", "========", "========", "===========");
+    set_console_color(7);
+
+    long fleet_service = 0;
+    int histogram[10] = {0};
+    for (int i = 0; i < count; i++) {
+        double service_hours = stats[i].service_minutes / 60.0;
+        double utilization = 100.0 * stats[i].service_minutes / (period_end - period_start);
+        int bucket = (int)(utilization / 10.0);
+        if (bucket > 9) bucket = 9;
+        histogram[bucket]++;
+        fleet_service += stats[i].service_minutes;
+
+        printf("%-15d %-12.2f %02d/%02d/%-9d %-8d %-8d %-12.1f %-12.1f %-10.1f ",
+               stats[i].license_plate,
+               stats[i].price,
+               stats[i].purchase_date.day,
+               stats[i].purchase_date.month,
+               stats[i].purchase_date.year,
+               stats[i].seat_count,
+               stats[i].trip_count,
+               service_hours,
+               stats[i].idle_minutes / 60.0,
+               utilization);
+        if (stats[i].service_minutes > 0) {
+            printf("%-12.2f\n", stats[i].price / service_hours);
+        } else {
+            printf("%-12s\n", "N/A");
+        }
+    }
+
+    printf("\nFleet utilization: %.1f%% (%.1f of %.1f bus-hours)\n",
+           100.0 * fleet_service / ((double)(period_end - period_start) * count),
+           fleet_service / 60.0, period_hours * count);
+
+    printf("\nUtilization histogram:\n");
+    for (int b = 0; b < 10; b++) {
+        printf("  %3d-%3d%% | ", b * 10, b * 10 + 10);
+        set_console_color(2);
+        for (int j = 0; j < histogram[b] && j < 50; j++) printf("#");
+        set_console_color(7);
+        printf(" %d\n", histogram[b]);
+    }
+
+    qsort(stats, count, sizeof(BusUtilization), compare_utilization_by_service);
+    int shown = count < 5 ? count : 5;
+    printf("\nLeast-used vehicles:\n");
+    for (int i = 0; i < shown; i++) {
+        printf("  %d. Bus %d - %.1f service hours over %d trips\n",
+               i + 1, stats[i].license_plate, stats[i].service_minutes / 60.0, stats[i].trip_count);
+    }
+
+    free(stats);
+}
+
+// Fleet valuation functions
+#define VALUATION_BLOCK 512
+
+// Copies the bus list into contiguous arrays with each bus's age in whole
+// months at valuation_date (buses bought later get age 0). Returns the
+// number of buses or -1 on allocation failure.
+int build_fleet_assets(Bus *buses, PurchaseDate valuation_date, FleetAssets *assets) {
+    memset(assets, 0, sizeof(FleetAssets));
+    int count = 0;
+    for (Bus *bus = buses; bus != NULL; bus = bus->next) count++;
+    if (count == 0) return 0;
+
+    assets->license_plates = (int*)malloc(count * sizeof(int));
+    assets->purchase_dates = (PurchaseDate*)malloc(count * sizeof(PurchaseDate));
+    assets->prices = (double*)malloc(count * sizeof(double));
+    assets->age_months = (int*)malloc(count * sizeof(int));
+    if (assets->license_plates == NULL || assets->purchase_dates == NULL ||
+        assets->prices == NULL || assets->age_months == NULL) {
+        free_fleet_assets(assets);
+        return -1;
+    }
+
+    for (Bus *bus = buses; bus != NULL; bus = bus->next) {
+        int i = assets->count++;
+        assets->license_plates[i] = bus->license_plate;
+        assets->purchase_dates[i] = bus->purchase_date;
+        assets->prices[i] = bus->price;
+        int age = (valuation_date.year - bus->purchase_date.year) * 12 +
+                  (valuation_date.month - bus->purchase_date.month);
+        if (valuation_date.day < bus->purchase_date.day) age--;
+        assets->age_months[i] = age > 0 ? age : 0;
+    }
+    return assets->count;
+}
+
+void free_fleet_assets(FleetAssets *assets) {
+    free(assets->license_plates);
+    free(assets->purchase_dates);
+    free(assets->prices);
+    free(assets->age_months);
+    memset(assets, 0, sizeof(FleetAssets));
+}
+
+// Straight-line: the price minus the salvage is written off evenly over
+// life_months. Declining balance: annual_rate / 12 comes off the remaining
+// value every month, never below the salvage floor; the monthly factors are
+// tabulated once per schedule so each bus is a single lookup and multiply.
+// All schedules are evaluated in one pass over the buses, a cache-sized
+// block at a time, with branch-free inner loops the compiler can vectorize.
+// Returns 0 or -1 on allocation failure.
+int value_fleet(const FleetAssets *assets, const DepreciationSchedule *schedules, int schedule_count,
+                FleetValuation *valuation) {
+    memset(valuation, 0, sizeof(FleetValuation));
+    if (schedule_count > MAX_DEPRECIATION_SCHEDULES) schedule_count = MAX_DEPRECIATION_SCHEDULES;
+    valuation->schedule_count = schedule_count;
+    valuation->bus_count = assets->count;
+    if (assets->count == 0 || schedule_count == 0) return 0;
+
+    valuation->book_values = (double*)malloc((size_t)schedule_count * assets->count * sizeof(double));
+    if (valuation->book_values == NULL) return -1;
+
+    int max_age = 0;
+    for (int i = 0; i < assets->count; i++) {
+        if (assets->age_months[i] > max_age) max_age = assets->age_months[i];
+    }
+    double *factors = (double*)malloc((size_t)schedule_count * (max_age + 1) * sizeof(double));
+    if (factors == NULL) {
+        free_fleet_valuation(valuation);
+        return -1;
+    }
+    for (int s = 0; s < schedule_count; s++) {
+        double *table = factors + (size_t)s * (max_age + 1);
+        double monthly = 1.0 - schedules[s].annual_rate / 12.0;
+        if (monthly < 0.0) monthly = 0.0;
+        table[0] = 1.0;
+        for (int m = 1; m <= max_age; m++) {
+            table[m] = table[m - 1] * monthly;
+        }
+    }
+
+    for (int start = 0; start < assets->count; start += VALUATION_BLOCK) {
+        int end = start + VALUATION_BLOCK < assets->count ? start + VALUATION_BLOCK : assets->count;
+        const double *prices = assets->prices;
+        const int *ages = assets->age_months;
+
+        for (int s = 0; s < schedule_count; s++) {
+            const DepreciationSchedule *schedule = &schedules[s];
+            double *values = valuation->book_values + (size_t)s * assets->count;
+            double salvage = schedule->salvage_percent / 100.0;
+
+            if (schedule->method == DEPRECIATION_STRAIGHT_LINE) {
+                int life = schedule->life_months > 0 ? schedule->life_months : 1;
+                double written_off_per_month = (1.0 - salvage) / life;
+                for (int i = start; i < end; i++) {
+                    int used = ages[i] < life ? ages[i] : life;
+                    values[i] = prices[i] * (1.0 - written_off_per_month * used);
+                }
+            } else {
+                const double *table = factors + (size_t)s * (max_age + 1);
+                for (int i = start; i < end; i++) {
+                    double factor = table[ages[i]];
+                    values[i] = prices[i] * (factor > salvage ? factor : salvage);
+                }
+            }
+
+            // Summed separately: a floating-point reduction would keep the loops above scalar
+            double total = 0.0;
+            for (int i = start; i < end; i++) {
+                total += values[i];
+            }
+            valuation->totals[s] += total;
+        }
+    }
+
+    free(factors);
+    return 0;
+}
+
+void free_fleet_valuation(FleetValuation *valuation) {
+    free(valuation->book_values);
+    valuation->book_values = NULL;
+}
+
+// One row per bus with a book value column per schedule, then a fleet
+// total row. Returns 0 or -1 if the file cannot be written.
+int export_fleet_valuation(const char *filename, const FleetAssets *assets, const DepreciationSchedule *schedules,
+                           const FleetValuation *valuation) {
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        return -1;
+    }
+
+    fprintf(file, "license_plate,purchase_date,price,age_months");
+    for (int s = 0; s < valuation->schedule_count; s++) {
+        fprintf(file, ",%s", schedules[s].name);
+    }
+    fprintf(file, "\n");
+
+    double price_total = 0.0;
+    for (int i = 0; i < assets->count; i++) {
+        fprintf(file, "%d,%02d/%02d/%d,%.2f,%d",
+                assets->license_plates[i],
+                assets->purchase_dates[i].day, assets->purchase_dates[i].month, assets->purchase_dates[i].year,
+                assets->prices[i], assets->age_months[i]);
+        for (int s = 0; s < valuation->schedule_count; s++) {
+            fprintf(file, ",%.2f", valuation->book_values[(size_t)s * assets->count + i]);
+        }
+        fprintf(file, "\n");
+        price_total += assets->prices[i];
+    }
+
+    fprintf(file, "TOTAL,,%.2f,", price_total);
+    for (int s = 0; s < valuation->schedule_count; s++) {
+        fprintf(file, ",%.2f", valuation->totals[s]);
+    }
+    fprintf(file, "\n");
+
+    fclose(file);
+    return 0;
+}
+
+static int input_depreciation_schedules(DepreciationSchedule *schedules) {
+    printf("\nDepreciation schedules:\n");
+    printf("1. Standard set (straight-line 5 and 8 years, declining balance 25%% and 40%%)\n");
+    printf("2. Define schedules\n");
+    printf("Enter your choice: ");
+    int choice = safe_int_input();
+
+    if (choice != 2) {
+        DepreciationSchedule defaults[4] = {
+            {"SL_5y", DEPRECIATION_STRAIGHT_LINE, 60, 0.0, 10.0},
+            {"SL_8y", DEPRECIATION_STRAIGHT_LINE, 96, 0.0, 10.0},
+            {"DB_25pct", DEPRECIATION_DECLINING_BALANCE, 0, 0.25, 10.0},
+            {"DB_40pct", DEPRECIATION_DECLINING_BALANCE, 0, 0.40, 10.0}
+        };
+        memcpy(schedules, defaults, sizeof(defaults));
+        return 4;
+    }
+
+    printf("Number of schedules (1-%d): ", MAX_DEPRECIATION_SCHEDULES);
+    int count = safe_int_input();
+    if (count < 1) count = 1;
+    if (count > MAX_DEPRECIATION_SCHEDULES) count = MAX_DEPRECIATION_SCHEDULES;
+
+    for (int s = 0; s < count; s++) {
+        DepreciationSchedule *schedule = &schedules[s];
+        memset(schedule, 0, sizeof(DepreciationSchedule));
+        printf("\nSchedule %d name (one word): ", s + 1);
+        ui_scanf("%99s", schedule->name);
+        printf("Method (1 = straight-line, 2 = declining balance): ");
+        schedule->method = safe_int_input() == 2 ? DEPRECIATION_DECLINING_BALANCE : DEPRECIATION_STRAIGHT_LINE;
+        if (schedule->method == DEPRECIATION_STRAIGHT_LINE) {
+            printf("Useful life (months): ");
+            schedule->life_months = safe_int_input();
+            if (schedule->life_months < 1) schedule->life_months = 1;
+        } else {
+            printf("Yearly rate (%%): ");
+            schedule->annual_rate = safe_float_input() / 100.0;
+            if (schedule->annual_rate < 0.0) schedule->annual_rate = 0.0;
+        }
+        printf("Salvage value (%% of price): ");
+        schedule->salvage_percent = safe_float_input();
+        if (schedule->salvage_percent < 0.0) schedule->salvage_percent = 0.0;
+        if (schedule->salvage_percent > 100.0) schedule->salvage_percent = 100.0;
+    }
+    return count;
+}
+
+void fleet_valuation_report(Bus *buses) {
+    if (buses == NULL) {
+        printf("  No buses found in the system.\n");
+        printf("You need to add buses first to value the fleet.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
+        return;
+    }
+
+    print_header("FLEET VALUATION");
+
+    PurchaseDate valuation_date;
+    input_date("Valuation date:", &valuation_date);
+    DepreciationSchedule schedules[MAX_DEPRECIATION_SCHEDULES];
+    int schedule_count = input_depreciation_schedules(schedules);
+
+    FleetAssets assets;
+    FleetValuation valuation;
+    if (build_fleet_assets(buses, valuation_date, &assets) < 0) {
+        printf("Memory allocation error. Cannot value the fleet.\n");
+        return;
+    }
+    clock_t started = clock();
+    if (value_fleet(&assets, schedules, schedule_count, &valuation) != 0) {
+        printf("Memory allocation error. Cannot value the fleet.\n");
+        free_fleet_assets(&assets);
+        return;
+    }
+    double elapsed_ms = 1000.0 * (clock() - started) / CLOCKS_PER_SEC;
+
+    printf("\nBook values at %02d/%02d/%d (%d buses, %d schedules, %.2f ms)\n\n",
+           valuation_date.day, valuation_date.month, valuation_date.year,
+           assets.count, schedule_count, elapsed_ms);
+
+    set_console_color(2);
+    printf("%-15s %-15s %-8s", "License Plate", "Price ($)", "Age (m)");
+    for (int s = 0; s < schedule_count; s++) printf(" %-14.14s", schedules[s].name);
+    printf("\n%-15s %-15s %-8s", "=============", "=========", "=======");
+    for (int s = 0; s < schedule_count; s++) printf(" %-14s", "==============");
+    printf("\n");
+    set_console_color(7);
+
+    double price_total = 0.0;
+    for (int i = 0; i < assets.count; i++) {
+        printf("%-15d %-15.2f %-8d", assets.license_plates[i], assets.prices[i], assets.age_months[i]);
+        for (int s = 0; s < schedule_count; s++) {
+            printf(" %-14.2f", valuation.book_values[(size_t)s * assets.count + i]);
+        }
+        printf("\n");
+        price_total += assets.prices[i];
+    }
+
+    set_console_color(2);
+    printf("%-15s %-15.2f %-8s", "Fleet total", price_total, "");
+    for (int s = 0; s < schedule_count; s++) printf(" %-14.2f", valuation.totals[s]);
+    printf("\n");
+    set_console_color(7);
+
+    char export_choice;
+    printf("\nExport to CSV? (y/n): ");
+    ui_scanf(" %c", &export_choice);
+    if (export_choice == 'y' || export_choice == 'Y') {
+        char filename[MAX_STRING_LENGTH + 16];
+        char name[MAX_STRING_LENGTH];
+        printf("File name (saved under ../data/): ");
+        ui_scanf("%99s", name);
+        snprintf(filename, sizeof(filename), "../data/%s", name);
+        if (export_fleet_valuation(filename, &assets, schedules, &valuation) == 0) {
+            printf("Valuation exported to %s\n", filename);
+        } else {
+            printf("Cannot write %s\n", filename);
+        }
+    }
+
+    free_fleet_valuation(&valuation);
+    free_fleet_assets(&assets);
+}
+
+// Fleet optimizer functions
+typedef struct RunKey {
+    long departure;
+    long arrival;
+    int departure_city;
+    int arrival_city;
+    int old_plate;
+    int pinned;
+    int trip_index;     // -1 for a recurring occurrence
+} RunKey;
+
+typedef struct FleetBus {
+    int license_plate;
+    int seat_count;
+    int city;
+    long ready;
+    int reserved;       // serves recurring occurrences only
+} FleetBus;
+
+static int compare_run_keys(const void *a, const void *b) {
+    const RunKey *x = (const RunKey*)a;
+    const RunKey *y = (const RunKey*)b;
+    if (x->departure != y->departure) return x->departure < y->departure ? -1 : 1;
+    if (x->arrival != y->arrival) return x->arrival < y->arrival ? -1 : 1;
+    if (x->departure_city != y->departure_city) return x->departure_city < y->departure_city ? -1 : 1;
+    if (x->arrival_city != y->arrival_city) return x->arrival_city < y->arrival_city ? -1 : 1;
+    if (x->old_plate != y->old_plate) return x->old_plate < y->old_plate ? -1 : 1;
+    if (x->pinned != y->pinned) return x->pinned - y->pinned;
+    return x->trip_index - y->trip_index;
+}
+
+static int same_run(const RunKey *x, const RunKey *y) {
+    return x->departure == y->departure && x->arrival == y->arrival &&
+           x->departure_city == y->departure_city && x->arrival_city == y->arrival_city &&
+           x->old_plate == y->old_plate && x->pinned == y->pinned;
+}
+
+static int compare_longs(const void *a, const void *b) {
+    long x = *(const long*)a;
+    long y = *(const long*)b;
+    return (x > y) - (x < y);
+}
+
+static int compare_fleet_bus_plates(const void *a, const void *b) {
+    const FleetBus *x = *(FleetBus* const*)a;
+    const FleetBus *y = *(FleetBus* const*)b;
+    return (x->license_plate > y->license_plate) - (x->license_plate < y->license_plate);
+}
+
+static FleetBus* fleet_bus_find(FleetBus **by_plate, int count, int license_plate) {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (by_plate[mid]->license_plate < license_plate) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo < count && by_plate[lo]->license_plate == license_plate ? by_plate[lo] : NULL;
+}
+
+static int compare_fleet_bus_seats(const void *a, const void *b) {
+    const FleetBus *x = *(FleetBus* const*)a;
+    const FleetBus *y = *(FleetBus* const*)b;
+    if (x->seat_count != y->seat_count) return x->seat_count < y->seat_count ? -1 : 1;
+    return (x->license_plate > y->license_plate) - (x->license_plate < y->license_plate);
+}
+
+// Min-heap of buses on the road, keyed on the time they are ready again
+static void busy_heap_push(FleetBus **heap, int *size, FleetBus *bus) {
+    int i = (*size)++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap[parent]->ready <= bus->ready) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = bus;
+}
+
+static FleetBus* busy_heap_pop(FleetBus **heap, int *size) {
+    FleetBus *top = heap[0];
+    FleetBus *last = heap[--(*size)];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= *size) break;
+        if (child + 1 < *size && heap[child + 1]->ready < heap[child]->ready) child++;
+        if (last->ready <= heap[child]->ready) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*size > 0) heap[i] = last;
+    return top;
+}
+
+// Pools are kept sorted by seat count so the best-fit bus is a binary search away
+static int pool_lower_bound(FleetBus **pool, int size, int seats) {
+    int lo = 0, hi = size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (pool[mid]->seat_count < seats) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static FleetBus* pool_take(FleetBus **pool, int *size, int seats, long start, long end) {
+    int pos = pool_lower_bound(pool, *size, seats);
+    // Skip buses blocked for maintenance during the run
+    while (pos < *size && bus_in_maintenance(pool[pos]->license_plate, start, end)) pos++;
+    if (pos == *size) return NULL;
+    FleetBus *bus = pool[pos];
+    memmove(&pool[pos], &pool[pos + 1], (*size - pos - 1) * sizeof(FleetBus*));
+    (*size)--;
+    return bus;
+}
+
+static void pool_insert(FleetBus **pool, int *size, FleetBus *bus) {
+    int pos = pool_lower_bound(pool, *size, bus->seat_count);
+    memmove(&pool[pos + 1], &pool[pos], (*size - pos) * sizeof(FleetBus*));
+    pool[pos] = bus;
+    (*size)++;
+}
+
+void free_fleet_plan(FleetPlan *plan) {
+    free(plan->runs);
+    free(plan->trips);
+    free(plan->trip_run);
+    city_table_free(&plan->cities);
+    memset(plan, 0, sizeof(FleetPlan));
+}
+
+// Greedy interval partitioning over the runs of [day_start, day_end).
+// Trips sharing route, times and bus form one run whose demand is the
+// passenger count. Runs are taken in departure order; a bus becomes free
+// again at its arrival city after the turnaround gap. Each run gets the
+// smallest idle bus at its departure city that seats everyone, and only
+// then a bus from the unused fleet, so the number of buses stays minimal.
+// Recurring occurrences are pinned runs: a plan cannot move them, so the
+// buses of those templates are kept for them and left out of the pools.
+// A converted run's demand is its booked seats.
+// Returns 0 on success, -1 on allocation failure.
+int optimize_fleet_assignment(Bus *buses, Trip *trips, TripTemplate *templates, Departure *departures,
+                              long day_start, long day_end, int turnaround_minutes, FleetPlan *plan) {
+    memset(plan, 0, sizeof(FleetPlan));
+
+    DepartureLookup seats;
+    if (departure_lookup_build(departures, &seats) != 0) return -1;
+    Trip *occurrences;
+    int occurrence_count = expand_template_occurrences(templates, day_start, day_end, NULL, &occurrences);
+    if (occurrence_count < 0) {
+        departure_lookup_free(&seats);
+        return -1;
+    }
+
+    int trip_count = 0, bus_count = 0;
+    for (Trip *trip = trips; trip != NULL; trip = trip->next) {
+        long departure = datetime_to_minutes(trip->departure_time);
+        if (departure >= day_start && departure < day_end) trip_count++;
+    }
+    for (Bus *bus = buses; bus != NULL; bus = bus->next) bus_count++;
+    int key_count = trip_count + occurrence_count;
+    if (key_count == 0) {
+        departure_lookup_free(&seats);
+        return 0;
+    }
+
+    RunKey *keys = (RunKey*)malloc(key_count * sizeof(RunKey));
+    plan->trips = (Trip**)malloc((trip_count + 1) * sizeof(Trip*));
+    plan->trip_run = (int*)malloc((trip_count + 1) * sizeof(int));
+    plan->runs = (ServiceRun*)malloc(key_count * sizeof(ServiceRun));
+    FleetBus *fleet = (FleetBus*)malloc((bus_count + 1) * sizeof(FleetBus));
+    FleetBus **unused = (FleetBus**)malloc((bus_count + 1) * sizeof(FleetBus*));
+    FleetBus **by_plate = (FleetBus**)malloc((bus_count + 1) * sizeof(FleetBus*));
+    FleetBus **busy = (FleetBus**)malloc((bus_count + 1) * sizeof(FleetBus*));
+    if (keys == NULL || plan->trips == NULL || plan->trip_run == NULL || plan->runs == NULL ||
+        fleet == NULL || unused == NULL || by_plate == NULL || busy == NULL) {
+        departure_lookup_free(&seats);
+        free(occurrences);
+        free(keys);
+        free(fleet);
+        free(unused);
+        free(by_plate);
+        free(busy);
+        free_fleet_plan(plan);
+        return -1;
+    }
+
+    int index = 0;
+    Trip *next_trip = trips;
+    for (int k = 0; k < key_count; k++) {
+        Trip *trip;
+        if (k < occurrence_count) {
+            trip = &occurrences[k];
+        } else {
+            while (datetime_to_minutes(next_trip->departure_time) < day_start ||
+                   datetime_to_minutes(next_trip->departure_time) >= day_end) {
+                next_trip = next_trip->next;
+            }
+            trip = next_trip;
+            next_trip = next_trip->next;
+        }
+        keys[k].departure = datetime_to_minutes(trip->departure_time);
+        keys[k].arrival = datetime_to_minutes(trip->arrival_time);
+        keys[k].departure_city = city_table_intern(&plan->cities, trip->departure_city);
+        keys[k].arrival_city = city_table_intern(&plan->cities, trip->arrival_city);
+        keys[k].old_plate = trip->license_plate;
+        keys[k].pinned = k < occurrence_count;
+        keys[k].trip_index = keys[k].pinned ? -1 : index;
+        if (!keys[k].pinned) plan->trips[index++] = trip;
+        if (keys[k].departure_city < 0 || keys[k].arrival_city < 0) {
+            departure_lookup_free(&seats);
+            free(occurrences);
+            free(keys);
+            free(fleet);
+            free(unused);
+            free(by_plate);
+            free(busy);
+            free_fleet_plan(plan);
+            return -1;
+        }
+    }
+    free(occurrences);
+    plan->trip_count = trip_count;
+    qsort(keys, key_count, sizeof(RunKey), compare_run_keys);
+
+    // Group identical keys into runs
+    for (int i = 0; i < key_count; i++) {
+        if (i == 0 || !same_run(&keys[i - 1], &keys[i])) {
+            ServiceRun *run = &plan->runs[plan->run_count++];
+            run->departure_city = keys[i].departure_city;
+            run->arrival_city = keys[i].arrival_city;
+            run->departure = keys[i].departure;
+            run->arrival = keys[i].arrival;
+            run->demand = 0;
+            run->old_plate = keys[i].old_plate;
+            run->new_plate = -1;
+            run->pinned = keys[i].pinned;
+            run->seats = run->pinned ? NULL : departure_lookup_find(&seats, run->old_plate, run->departure);
+        }
+        if (keys[i].pinned) continue;
+        plan->runs[plan->run_count - 1].demand++;
+        plan->trip_run[keys[i].trip_index] = plan->run_count - 1;
+    }
+    departure_lookup_free(&seats);
+    for (int r = 0; r < plan->run_count; r++) {
+        ServiceRun *run = &plan->runs[r];
+        if (run->seats != NULL && run->seats->seats_taken > run->demand) run->demand = run->seats->seats_taken;
+    }
+
+    int i = 0;
+    for (Bus *bus = buses; bus != NULL; bus = bus->next, i++) {
+        fleet[i].license_plate = bus->license_plate;
+        fleet[i].seat_count = bus->seat_count;
+        fleet[i].city = -1;
+        fleet[i].ready = 0;
+        fleet[i].reserved = 0;
+        by_plate[i] = &fleet[i];
+    }
+    qsort(by_plate, bus_count, sizeof(FleetBus*), compare_fleet_bus_plates);
+    for (int k = 0; k < key_count; k++) {
+        FleetBus *bus = keys[k].pinned ? fleet_bus_find(by_plate, bus_count, keys[k].old_plate) : NULL;
+        if (bus != NULL) bus->reserved = 1;
+    }
+    free(keys);
+    int unused_count = 0;
+    for (i = 0; i < bus_count; i++) {
+        if (!fleet[i].reserved) unused[unused_count++] = &fleet[i];
+    }
+    qsort(unused, unused_count, sizeof(FleetBus*), compare_fleet_bus_seats);
+
+    // One idle pool per city, each sorted by seat count
+    int city_count = plan->cities.count;
+    FleetBus ***pools = (FleetBus***)calloc(city_count, sizeof(FleetBus**));
+    int *pool_sizes = (int*)calloc(city_count, sizeof(int));
+    if (pools == NULL || pool_sizes == NULL) {
+        free(pools);
+        free(pool_sizes);
+        free(fleet);
+        free(unused);
+        free(by_plate);
+        free(busy);
+        free_fleet_plan(plan);
+        return -1;
+    }
+
+    int busy_count = 0;
+    int failed = 0;
+    for (int r = 0; r < plan->run_count && !failed; r++) {
+        ServiceRun *run = &plan->runs[r];
+
+        // Release every bus whose turnaround has finished by this departure
+        while (busy_count > 0 && busy[0]->ready <= run->departure) {
+            FleetBus *bus = busy_heap_pop(busy, &busy_count);
+            if (pools[bus->city] == NULL) {
+                pools[bus->city] = (FleetBus**)malloc((bus_count + 1) * sizeof(FleetBus*));
+                if (pools[bus->city] == NULL) {
+                    failed = 1;
+                    break;
+                }
+            }
+            pool_insert(pools[bus->city], &pool_sizes[bus->city], bus);
+        }
+        if (failed) break;
+
+        // A pinned run keeps its bus, which must be back from its last run
+        if (run->pinned) {
+            FleetBus *bus = fleet_bus_find(by_plate, bus_count, run->old_plate);
+            if (bus == NULL || bus->ready > run->departure) {
+                plan->unassigned_runs++;
+                continue;
+            }
+            if (bus->city < 0) plan->buses_used++;
+            run->new_plate = bus->license_plate;
+            bus->city = run->arrival_city;
+            bus->ready = run->arrival + turnaround_minutes;
+            continue;
+        }
+
+        FleetBus *bus = NULL;
+        if (pools[run->departure_city] != NULL) {
+            bus = pool_take(pools[run->departure_city], &pool_sizes[run->departure_city], run->demand,
+                             run->departure, run->arrival);
+        }
+        if (bus == NULL) {
+            bus = pool_take(unused, &unused_count, run->demand, run->departure, run->arrival);
+            if (bus != NULL) plan->buses_used++;
+        }
+        if (bus == NULL) {
+            plan->unassigned_runs++;
+            continue;
+        }
+
+        run->new_plate = bus->license_plate;
+        bus->city = run->arrival_city;
+        bus->ready = run->arrival + turnaround_minutes;
+        busy_heap_push(busy, &busy_count, bus);
+    }
+
+    // Lower bound: the peak number of runs on the road at once (with turnaround)
+    long *starts = NULL, *ends = NULL;
+    if (!failed) {
+        starts = (long*)malloc(plan->run_count * sizeof(long));
+        ends = (long*)malloc(plan->run_count * sizeof(long));
+        failed = starts == NULL || ends == NULL;
+    }
+    if (!failed) {
+        for (int r = 0; r < plan->run_count; r++) {
+            starts[r] = plan->runs[r].departure;
+            ends[r] = plan->runs[r].arrival + turnaround_minutes;
+        }
+        qsort(ends, plan->run_count, sizeof(long), compare_longs);
+        int active = 0, e = 0;
+        for (int r = 0; r < plan->run_count; r++) {
+            while (e < plan->run_count && ends[e] <= starts[r]) {
+                active--;
+                e++;
+            }
+            active++;
+            if (active > plan->lower_bound) plan->lower_bound = active;
+        }
+    }
+    free(starts);
+    free(ends);
+
+    for (int c = 0; c < city_count; c++) free(pools[c]);
+    free(pools);
+    free(pool_sizes);
+    free(fleet);
+    free(unused);
+    free(by_plate);
+    free(busy);
+    if (failed) {
+        free_fleet_plan(plan);
+        return -1;
+    }
+    return 0;
+}
+
+// Writes the plan back onto the trip list in one pass; a converted run's
+// departure moves with its trip rows. Runs that could not be covered keep
+// their current bus.
+int apply_fleet_plan(const FleetPlan *plan) {
+    int updated = 0;
+    for (int r = 0; r < plan->run_count; r++) {
+        const ServiceRun *run = &plan->runs[r];
+        if (run->seats != NULL && run->new_plate >= 0) run->seats->license_plate = run->new_plate;
+    }
+    for (int i = 0; i < plan->trip_count; i++) {
+        const ServiceRun *run = &plan->runs[plan->trip_run[i]];
+        if (run->new_plate >= 0 && plan->trips[i]->license_plate != run->new_plate) {
+            trip_indexes_remove(plan->trips[i]);
+            plan->trips[i]->license_plate = run->new_plate;
+            trip_indexes_add(plan->trips[i]);
+            updated++;
+        }
+    }
+    return updated;
+}
+
+void fleet_assignment_optimizer(Bus *buses, Trip *trips, TripTemplate *templates, Departure *departures) {
+    if (buses == NULL) {
+        printf("  No buses found in the system.\n");
+        printf("You need to add buses first before optimizing assignments.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
+        return;
+    }
+    if (trips == NULL && templates == NULL) {
+        printf("  No trips found in the system.\n");
+        printf("You need to add trips first before optimizing assignments.\n");
+        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
+        return;
+    }
+
+    print_header("MINIMUM FLEET OPTIMIZER");
+
+    PurchaseDate day;
+    input_date("Enter the service day:", &day);
+    printf("Minimum turnaround at arrival city (minutes): ");
+    int turnaround = safe_int_input();
+    if (turnaround < 0) turnaround = 0;
+
+    long day_start = days_from_civil(day.day, day.month, day.year) * 1440L;
+    FleetPlan plan;
+    clock_t started = clock();
+    if (optimize_fleet_assignment(buses, trips, templates, departures, day_start, day_start + 1440, turnaround, &plan) != 0) {
+        printf("Memory allocation error. Cannot optimize assignments.\n");
+        return;
+    }
+    double elapsed_ms = 1000.0 * (clock() - started) / CLOCKS_PER_SEC;
+
+    if (plan.run_count == 0) {
+        printf("\nNo trips depart on %02d/%02d/%d.\n", day.day, day.month, day.year);
+        free_fleet_plan(&plan);
+        return;
+    }
+
+    printf("\nTrips on %02d/%02d/%d: %d in %d runs\n", day.day, day.month, day.year, plan.trip_count, plan.run_count);
+    printf("Buses needed: %d (lower bound %d)\n", plan.buses_used, plan.lower_bound);
+    if (plan.unassigned_runs > 0) {
+        set_console_color(4);
+        printf("Runs without a suitable bus: %d\n", plan.unassigned_runs);
+        set_console_color(7);
+    }
+    printf("Computed in %.2f ms\n\n", elapsed_ms);
+
+    set_console_color(2);
+    printf("%-15s %-15s %-8s %-8s %-10s %-10s %-10s\n",
+           "Departure", "Arrival", "Leaves", "Arrives", "Passengers", "Old Bus", "New Bus");
+    printf("%-15s %-15s %-8s %-8s %-10s %-10s %-10s\n",
+           "=========", "=======", "======", "=======", "==========", "=======", "=======");
+    set_console_color(7);
+
+    int shown = plan.run_count < 50 ? plan.run_count : 50;
+    for (int r = 0; r < shown; r++) {
+        ServiceRun *run = &plan.runs[r];
+        DateTime leaves = minutes_to_datetime(run->departure);
+        DateTime arrives = minutes_to_datetime(run->arrival);
+        printf("%-15s %-15s %02d:%02d    %02d:%02d    ",
+               plan.cities.names[run->departure_city],
+               plan.cities.names[run->arrival_city],
+               leaves.hour, leaves.minute,
+               arrives.hour, arrives.minute);
+        if (run->pinned) {
+            printf("%-10s %-10d ", "Recurring", run->old_plate);
+        } else {
+            printf("%-10d %-10d ", run->demand, run->old_plate);
+        }
+        if (run->new_plate >= 0) {
+            printf("%-10d\n", run->new_plate);
+        } else {
+            printf("%-10s\n", "None");
+        }
+    }
+    if (plan.run_count > shown) {
+        printf("... %d more runs\n", plan.run_count - shown);
+    }
+
+    char confirm;
+    printf("\nApply this assignment to the trip list? Recurring runs keep their bus. (y/N): ");
+    ui_scanf(" %c", &confirm);
+    if (confirm == 'y' || confirm == 'Y') {
+        int updated = apply_fleet_plan(&plan);
+        printf("Assignment applied: %d trips moved to a different bus.\n", updated);
+    } else {
+        printf("Assignment discarded.\n");
+    }
+
+    free_fleet_plan(&plan);
+}
+
+// Journey planner functions
+static int compare_connections(const void *a, const void *b) {
+    const Connection *x = (const Connection*)a;
+    const Connection *y = (const Connection*)b;
+    if (x->departure != y->departure) return x->departure < y->departure ? -1 : 1;
+    if (x->arrival != y->arrival) return x->arrival < y->arrival ? -1 : 1;
+    if (x->license_plate != y->license_plate) return x->license_plate < y->license_plate ? -1 : 1;
+    if (x->departure_city != y->departure_city) return x->departure_city < y->departure_city ? -1 : 1;
+    return (x->arrival_city > y->arrival_city) - (x->arrival_city < y->arrival_city);
+}
+
+static int compare_ints(const void *a, const void *b) {
+    int x = *(const int*)a;
+    int y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+void free_timetable(Timetable *timetable) {
+    free(timetable->connections);
+    city_table_free(&timetable->cities);
+    memset(timetable, 0, sizeof(Timetable));
+}
+
+// Builds the connection array used by the planner: one connection per bus run
+// (passenger rows of the same run are collapsed), sorted by departure time.
+// Recurring occurrences departing in [from_time, to_time) are included.
+// Returns 0 on success, -1 on allocation failure.
+int build_timetable(Trip *trips, TripTemplate *templates, long from_time, long to_time, Timetable *timetable) {
+    memset(timetable, 0, sizeof(Timetable));
+    timetable->templates_from = from_time;
+    timetable->templates_to = to_time;
+
+    Trip *occurrences;
+    if (expand_template_occurrences(templates, from_time, to_time, trips, &occurrences) < 0) return -1;
+    if (occurrences != NULL) trips = occurrences;
+
+    int trip_count = 0;
+    for (Trip *trip = trips; trip != NULL; trip = trip->next) trip_count++;
+    if (trip_count == 0) return 0;
+
+    Connection *connections = (Connection*)malloc(trip_count * sizeof(Connection));
+    int *plates = (int*)malloc(trip_count * sizeof(int));
+    if (connections == NULL || plates == NULL) {
+        free(occurrences);
+        free(connections);
+        free(plates);
+        return -1;
+    }
+
+    int count = 0;
+    for (Trip *trip = trips; trip != NULL; trip = trip->next) {
+        Connection *c = &connections[count];
+        c->departure = datetime_to_minutes(trip->departure_time);
+        c->arrival = datetime_to_minutes(trip->arrival_time);
+        if (c->arrival < c->departure) continue;
+        c->departure_city = city_table_intern(&timetable->cities, trip->departure_city);
+        c->arrival_city = city_table_intern(&timetable->cities, trip->arrival_city);
+        c->license_plate = trip->license_plate;
+        plates[count] = trip->license_plate;
+        count++;
+    }
+    free(occurrences);
+    qsort(connections, count, sizeof(Connection), compare_connections);
+
+    // Dense bus indexes let the planner track "still seated on this bus" in an array
+    qsort(plates, count, sizeof(int), compare_ints);
+    int unique_plates = 0;
+    for (int i = 0; i < count; i++) {
+        if (i == 0 || plates[i] != plates[i - 1]) plates[unique_plates++] = plates[i];
+    }
+
+    int unique = 0;
+    for (int i = 0; i < count; i++) {
+        if (unique > 0 && compare_connections(&connections[unique - 1], &connections[i]) == 0) continue;
+        connections[unique] = connections[i];
+        int *found = (int*)bsearch(&connections[unique].license_plate, plates, unique_plates, sizeof(int), compare_ints);
+        connections[unique].bus_index = (int)(found - plates);
+        unique++;
+    }
+    free(plates);
+
+    timetable->connections = connections;
+    timetable->connection_count = unique;
+    timetable->bus_count = unique_plates;
+    return 0;
+}
+
+// Connection Scan: earliest arrival at to_city leaving from_city no earlier
+// than earliest_departure. Changing buses at an intermediate city requires
+// min_transfer minutes; staying on the same bus does not. The itinerary is
+// written to legs[] as connection indexes in travel order.
+// Returns the number of connections used, 0 when unreachable, -1 on error.
+int plan_journey(const Timetable *timetable, int from_city, int to_city, long earliest_departure,
+                 long latest_arrival, int min_transfer, int *legs, int max_legs) {
+    int city_count = timetable->cities.count;
+    int n = timetable->connection_count;
+    if (from_city < 0 || to_city < 0 || from_city >= city_count || to_city >= city_count) return 0;
+    if (from_city == to_city) return 0;
+
+    long *arrival = (long*)malloc(city_count * sizeof(long));
+    int *arrived_by = (int*)malloc(city_count * sizeof(int));
+    int *seated = (int*)malloc(timetable->bus_count * sizeof(int));
+    int *previous = (int*)malloc((n > 0 ? n : 1) * sizeof(int));
+    if (arrival == NULL || arrived_by == NULL || seated == NULL || previous == NULL) {
+        free(arrival);
+        free(arrived_by);
+        free(seated);
+        free(previous);
+        return -1;
+    }
+    for (int c = 0; c < city_count; c++) {
+        arrival[c] = LONG_MAX;
+        arrived_by[c] = -1;
+    }
+    for (int b = 0; b < timetable->bus_count; b++) seated[b] = -1;
+    arrival[from_city] = earliest_departure;
+
+    // Binary search for the first connection leaving at or after the start time
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (timetable->connections[mid].departure < earliest_departure) lo = mid + 1;
+        else hi = mid;
+    }
+
+    for (int i = lo; i < n; i++) {
+        const Connection *c = &timetable->connections[i];
+        if (c->departure >= arrival[to_city] || c->departure > latest_arrival) break;
+
+        int from_previous = -2;
+        int on_board = seated[c->bus_index];
+        if (on_board >= 0 && timetable->connections[on_board].arrival_city == c->departure_city &&
+            timetable->connections[on_board].arrival <= c->departure) {
+            from_previous = on_board;
+        } else if (arrival[c->departure_city] != LONG_MAX) {
+            long ready = arrival[c->departure_city];
+            if (c->departure_city != from_city) ready += min_transfer;
+            if (ready <= c->departure) {
+                from_previous = c->departure_city == from_city ? -1 : arrived_by[c->departure_city];
+            }
+        }
+        if (from_previous == -2) continue;
+
+        previous[i] = from_previous;
+        seated[c->bus_index] = i;
+        if (c->arrival < arrival[c->arrival_city] && c->arrival <= latest_arrival) {
+            arrival[c->arrival_city] = c->arrival;
+            arrived_by[c->arrival_city] = i;
+        }
+    }
+
+    int leg_count = 0;
+    if (arrived_by[to_city] >= 0) {
+        // Walk the journey pointers back to the origin, then reverse
+        for (int i = arrived_by[to_city]; i >= 0; i = previous[i]) {
+            if (leg_count == max_legs) {
+                leg_count = -1;
+                break;
+            }
+            legs[leg_count++] = i;
+        }
+        for (int a = 0, b = leg_count - 1; a < b; a++, b--) {
+            int tmp = legs[a];
+            legs[a] = legs[b];
+            legs[b] = tmp;
+        }
+    }
+
+    free(arrival);
+    free(arrived_by);
+    free(seated);
+    free(previous);
+    return leg_count;
+}
+
+void journey_planner(Trip *trips, TripTemplate *templates) {
+    if (trips == NULL && templates == NULL) {
+        printf("  No trips found in the system.\n");
+        printf("You need to add trips first before planning journeys.\n");
+        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
+        return;
+    }
+
+    print_header("JOURNEY PLANNER");
+
+    // Recurring service is expanded for PLANNER_TEMPLATE_DAYS from today;
+    // a query outside that window rebuilds the timetable around it
+    Timetable timetable;
+    long today = current_time_in_minutes() / 1440 * 1440;
+    clock_t started = clock();
+    if (build_timetable(trips, templates, today, today + PLANNER_TEMPLATE_DAYS * 1440L, &timetable) != 0) {
+        printf("Memory allocation error. Cannot build timetable.\n");
+        return;
+    }
+    printf("Timetable ready: %d connections between %d cities (%.1f ms)\n",
+           timetable.connection_count, timetable.cities.count,
+           1000.0 * (clock() - started) / CLOCKS_PER_SEC);
+
+    int legs[256];
+    char again;
+    do {
+        char from[MAX_STRING_LENGTH], to[MAX_STRING_LENGTH];
+        printf("\nFrom city: ");
+        ui_scanf("%99s", from);
+        printf("To city: ");
+        ui_scanf("%99s", to);
+
+        DateTime leave;
+        do {
+            printf("Leave after:\n");
+            printf("Year (1900-2100): ");
+            leave.year = safe_int_input();
+            printf("Month (1-12): ");
+            leave.month = safe_int_input();
+            printf("Day: ");
+            leave.day = safe_int_input();
+            printf("Hour (0-23): ");
+            leave.hour = safe_int_input();
+            printf("Minute (0-59): ");
+            leave.minute = safe_int_input();
+            
+            if (!is_valid_datetime(leave.day, leave.month, leave.year, leave.hour, leave.minute)) {
+                printf("Invalid date/time. Please enter valid values.\n");
+            }
+        } while (!is_valid_datetime(leave.day, leave.month, leave.year, leave.hour, leave.minute));
+
+        printf("Arrive within how many hours (0 = no limit): ");
+        int window_hours = safe_int_input();
+        printf("Minimum transfer time (minutes): ");
+        int min_transfer = safe_int_input();
+        if (min_transfer < 0) min_transfer = 0;
+
+        long earliest = datetime_to_minutes(leave);
+        long latest = window_hours > 0 ? earliest + window_hours * 60L : LONG_MAX;
+        long needed_to = window_hours > 0 ? latest : earliest + 7 * 1440L;
+        if (templates != NULL && (earliest < timetable.templates_from || needed_to > timetable.templates_to)) {
+            long first_day = earliest / 1440 * 1440;
+            long last_day = first_day + PLANNER_TEMPLATE_DAYS * 1440L;
+            if (last_day < needed_to) last_day = needed_to;
+            free_timetable(&timetable);
+            if (build_timetable(trips, templates, first_day, last_day, &timetable) != 0) {
+                printf("Memory allocation error. Cannot build timetable.\n");
+                return;
+            }
+        }
+        int from_city = city_table_find(&timetable.cities, from);
+        int to_city = city_table_find(&timetable.cities, to);
+
+        started = clock();
+        int count = plan_journey(&timetable, from_city, to_city, earliest, latest, min_transfer,
+                                 legs, (int)(sizeof(legs) / sizeof(legs[0])));
+        double elapsed_ms = 1000.0 * (clock() - started) / CLOCKS_PER_SEC;
+
+        if (from_city < 0 || to_city < 0) {
+            printf("\nNo trips serve %s.\n", from_city < 0 ? from : to);
+        } else if (count <= 0) {
+            printf("\nNo journey found from %s to %s in that window (%.2f ms).\n", from, to, elapsed_ms);
+        } else {
+            printf("\nItinerary from %s to %s (%.2f ms):\n\n", from, to, elapsed_ms);
+            set_console_color(2);
+            printf("%-10s %-15s %-18s %-15s %-18s\n", "Bus", "From", "Departure", "To", "Arrival");
+            printf("%-10s %-15s %-18s %-15s %-18s\n", "===", "====", "=========", "==", "=======");
+            set_console_color(7);
+
+            // Consecutive connections on the same bus are shown as one leg
+            for (int i = 0; i < count; i++) {
+                const Connection *first = &timetable.connections[legs[i]];
+                while (i + 1 < count && timetable.connections[legs[i + 1]].license_plate == first->license_plate) i++;
+                const Connection *last = &timetable.connections[legs[i]];
+                DateTime dep = minutes_to_datetime(first->departure);
+                DateTime arr = minutes_to_datetime(last->arrival);
+                printf("%-10d %-15s %02d/%02d/%d %02d:%02d   %-15s %02d/%02d/%d %02d:%02d\n",
+                       first->license_plate,
+                       timetable.cities.names[first->departure_city],
+                       dep.day, dep.month, dep.year, dep.hour, dep.minute,
+                       timetable.cities.names[last->arrival_city],
+                       arr.day, arr.month, arr.year, arr.hour, arr.minute);
+            }
+        }
+
+        printf("\nPlan another journey? (y/N): ");
+        ui_scanf(" %c", &again);
+    } while (again == 'y' || again == 'Y');
+
+    free_timetable(&timetable);
+}
+
+// Trip index maintenance
+// Each departure city has a treap of its trips ordered by departure time,
+// so adding or removing a trip costs O(log n) expected and a board query
+// costs a descent plus the entries it reads.
+static DepartureIndex departure_index;
+static unsigned int departure_priority_state = 2463534242u;
+// Live trips per client id; each value is a heap counter
+static IdSet client_trip_counts;
+
+static unsigned int departure_priority(void) {
+    unsigned int x = departure_priority_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    departure_priority_state = x;
+    return x;
+}
+
+static int compare_departure_entries(const void *a, const void *b) {
+    const DepartureEntry *x = (const DepartureEntry*)a;
+    const DepartureEntry *y = (const DepartureEntry*)b;
+    if (x->departure != y->departure) return x->departure < y->departure ? -1 : 1;
+    return ((size_t)x->trip > (size_t)y->trip) - ((size_t)x->trip < (size_t)y->trip);
+}
+
+static DepartureQueue* departure_queue_for(const char *city, int create) {
+    int id = create ? city_table_intern(&departure_index.cities, city)
+                    : city_table_find(&departure_index.cities, city);
+    if (id < 0) return NULL;
+
+    if (id >= departure_index.queue_capacity) {
+        int new_capacity = departure_index.queue_capacity ? departure_index.queue_capacity * 2 : 32;
+        while (new_capacity <= id) new_capacity *= 2;
+        DepartureQueue *grown = (DepartureQueue*)realloc(departure_index.queues, new_capacity * sizeof(DepartureQueue));
+        if (grown == NULL) return NULL;
+        memset(grown + departure_index.queue_capacity, 0,
+               (new_capacity - departure_index.queue_capacity) * sizeof(DepartureQueue));
+        departure_index.queues = grown;
+        departure_index.queue_capacity = new_capacity;
+    }
+    return &departure_index.queues[id];
+}
+
+// Splits a treap into the nodes ordered before key and the rest
+static void departure_tree_split(DepartureNode *node, const DepartureEntry *key,
+                                 DepartureNode **before, DepartureNode **rest) {
+    if (node == NULL) {
+        *before = NULL;
+        *rest = NULL;
+    } else if (compare_departure_entries(&node->entry, key) < 0) {
+        departure_tree_split(node->right, key, &node->right, rest);
+        *before = node;
+    } else {
+        departure_tree_split(node->left, key, before, &node->left);
+        *rest = node;
+    }
+}
+
+// Joins two treaps where every node of left is ordered before right
+static DepartureNode* departure_tree_merge(DepartureNode *left, DepartureNode *right) {
+    if (left == NULL) return right;
+    if (right == NULL) return left;
+    if (left->priority >= right->priority) {
+        left->right = departure_tree_merge(left->right, right);
+        return left;
+    }
+    right->left = departure_tree_merge(left, right->left);
+    return right;
+}
+
+static DepartureNode* departure_tree_insert(DepartureNode *node, DepartureNode *added) {
+    if (node == NULL) return added;
+    if (added->priority > node->priority) {
+        departure_tree_split(node, &added->entry, &added->left, &added->right);
+        return added;
+    }
+    if (compare_departure_entries(&added->entry, &node->entry) < 0) {
+        node->left = departure_tree_insert(node->left, added);
+    } else {
+        node->right = departure_tree_insert(node->right, added);
+    }
+    return node;
+}
+
+static DepartureNode* departure_tree_remove(DepartureNode *node, const DepartureEntry *key, DepartureNode **removed) {
+    if (node == NULL) return NULL;
+    int order = compare_departure_entries(key, &node->entry);
+    if (order == 0) {
+        *removed = node;
+        return departure_tree_merge(node->left, node->right);
+    }
+    if (order < 0) {
+        node->left = departure_tree_remove(node->left, key, removed);
+    } else {
+        node->right = departure_tree_remove(node->right, key, removed);
+    }
+    return node;
+}
+
+// Links nodes, already in order, into a balanced treap. A node's priority
+// is raised to its children's so the heap order holds.
+static DepartureNode* departure_tree_link(DepartureNode **nodes, int count) {
+    if (count == 0) return NULL;
+    int mid = count / 2;
+    DepartureNode *node = nodes[mid];
+    node->left = departure_tree_link(nodes, mid);
+    node->right = departure_tree_link(nodes + mid + 1, count - mid - 1);
+    node->priority = departure_priority();
+    if (node->left != NULL && node->left->priority > node->priority) node->priority = node->left->priority;
+    if (node->right != NULL && node->right->priority > node->priority) node->priority = node->right->priority;
+    return node;
+}
+
+// Writes the nodes of a treap to out in order; returns the number written
+static int departure_tree_flatten(DepartureNode *node, DepartureNode **out) {
+    int count = 0;
+    while (node != NULL) {
+        count += departure_tree_flatten(node->left, out + count);
+        out[count++] = node;
+        node = node->right;
+    }
+    return count;
+}
+
+static void departure_tree_free(DepartureNode *node) {
+    while (node != NULL) {
+        DepartureNode *right = node->right;
+        departure_tree_free(node->left);
+        free(node);
+        node = right;
+    }
+}
+
+static DepartureNode* departure_node_new(long departure, Trip *trip) {
+    DepartureNode *node = (DepartureNode*)malloc(sizeof(DepartureNode));
+    if (node == NULL) return NULL;
+    node->entry.departure = departure;
+    node->entry.trip = trip;
+    node->priority = departure_priority();
+    node->left = NULL;
+    node->right = NULL;
+    return node;
+}
+
+static void client_trips_adjust(int client_id, int delta) {
+    int *count = (int*)id_set_get(&client_trip_counts, client_id);
+    if (count == NULL) {
+        if (delta < 0 || (count = (int*)malloc(sizeof(int))) == NULL) return;
+        *count = 0;
+        if (id_set_add(&client_trip_counts, client_id, count) < 0) {
+            free(count);
+            return;
+        }
+    }
+    *count += delta;
+}
+
+// Number of live (not archived) trips booked by a client
+int client_trip_count(int client_id) {
+    const int *count = (const int*)id_set_get(&client_trip_counts, client_id);
+    return count != NULL ? *count : 0;
+}
+
+// Finds the live trip of a client on a bus departure in the departure
+// index. Trips with the same departure can sit on both sides of a node.
+static Trip* departure_tree_find(const DepartureNode *node, long departure, int license_plate, int client_id) {
+    while (node != NULL) {
+        if (node->entry.departure < departure) {
+            node = node->right;
+        } else if (node->entry.departure > departure) {
+            node = node->left;
+        } else {
+            Trip *trip = node->entry.trip;
+            if (trip->license_plate == license_plate && trip->client_id == client_id) return trip;
+            Trip *found = departure_tree_find(node->left, departure, license_plate, client_id);
+            if (found != NULL) return found;
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+// One descent per departure city instead of a walk of the trip list
+Trip* trip_indexes_find(int license_plate, int client_id, long departure) {
+    for (int i = 0; i < departure_index.queue_capacity; i++) {
+        Trip *trip = departure_tree_find(departure_index.queues[i].root, departure, license_plate, client_id);
+        if (trip != NULL) return trip;
+    }
+    return NULL;
+}
+
+void trip_indexes_add(Trip *trip) {
+    bus_usage_add(trip);
+    client_trips_adjust(trip->client_id, 1);
+
+    DepartureQueue *queue = departure_queue_for(trip->departure_city, 1);
+    if (queue == NULL) return;
+    DepartureNode *node = departure_node_new(datetime_to_minutes(trip->departure_time), trip);
+    if (node == NULL) return;
+    queue->root = departure_tree_insert(queue->root, node);
+    queue->count++;
+}
+
+// Must be called while the trip still holds the city and time it was indexed with
+void trip_indexes_remove(Trip *trip) {
+    bus_usage_remove(trip);
+    client_trips_adjust(trip->client_id, -1);
+
+    DepartureQueue *queue = departure_queue_for(trip->departure_city, 0);
+    if (queue == NULL) return;
+
+    DepartureEntry key;
+    DepartureNode *removed = NULL;
+    key.departure = datetime_to_minutes(trip->departure_time);
+    key.trip = trip;
+    queue->root = departure_tree_remove(queue->root, &key, &removed);
+    if (removed != NULL) {
+        free(removed);
+        queue->count--;
+    }
+}
+
+static int compare_index_updates(const void *a, const void *b) {
+    const TripIndexUpdate *x = (const TripIndexUpdate*)a;
+    const TripIndexUpdate *y = (const TripIndexUpdate*)b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    if (x->departure != y->departure) return x->departure < y->departure ? -1 : 1;
+    return ((size_t)x->trip > (size_t)y->trip) - ((size_t)x->trip < (size_t)y->trip);
+}
+
+// Adds the sorted updates [first, end) to a queue. A batch that is small
+// next to the queue is inserted node by node; otherwise the queue is
+// flattened, merged with the batch and relinked in one linear pass.
+static void departure_queue_add_sorted(DepartureQueue *queue, const TripIndexUpdate *updates, int first, int end) {
+    int added = end - first;
+    DepartureNode **nodes = NULL;
+    if (added >= queue->count / 16) {
+        nodes = (DepartureNode**)malloc((size_t)(queue->count + added) * sizeof(DepartureNode*));
+    }
+    if (nodes == NULL) {
+        for (int i = first; i < end; i++) {
+            DepartureNode *node = departure_node_new(updates[i].departure, updates[i].trip);
+            if (node == NULL) continue;
+            queue->root = departure_tree_insert(queue->root, node);
+            queue->count++;
+        }
+        return;
+    }
+
+    // Merge from the back so the existing nodes move at most once
+    int old = departure_tree_flatten(queue->root, nodes) - 1;
+    int next = end - 1;
+    int w = queue->count + added - 1;
+    while (next >= first) {
+        DepartureEntry candidate;
+        candidate.departure = updates[next].departure;
+        candidate.trip = updates[next].trip;
+        if (old >= 0 && compare_departure_entries(&nodes[old]->entry, &candidate) > 0) {
+            nodes[w--] = nodes[old--];
+            continue;
+        }
+        DepartureNode *node = departure_node_new(candidate.departure, candidate.trip);
+        if (node != NULL) {
+            nodes[w--] = node;
+        } else {
+            added--;
+        }
+        next--;
+    }
+    // Nodes that failed to allocate leave a gap at the front
+    int total = queue->count + added;
+    memmove(nodes + old + 1, nodes + w + 1, (size_t)(total - (old + 1)) * sizeof(DepartureNode*));
+    queue->root = departure_tree_link(nodes, total);
+    queue->count = total;
+    free(nodes);
+}
+
+// Indexes a batch of new trips with one sort and one merge per touched bus
+// and city, so bulk loads cost O(n log n) whatever order the trips come in
+void trip_indexes_add_batch(Trip **trips, int count) {
+    TripIndexUpdate *updates = (TripIndexUpdate*)malloc(count * sizeof(TripIndexUpdate));
+    if (updates == NULL) {
+        for (int i = 0; i < count; i++) trip_indexes_add(trips[i]);
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        client_trips_adjust(trips[i]->client_id, 1);
+        updates[i].departure = datetime_to_minutes(trips[i]->departure_time);
+        updates[i].arrival = datetime_to_minutes(trips[i]->arrival_time);
+        updates[i].key = trips[i]->license_plate;
+        updates[i].trip = trips[i];
+    }
+    qsort(updates, count, sizeof(TripIndexUpdate), compare_index_updates);
+    bus_usage_add_sorted(updates, count);
+
+    int indexed = 0;
+    for (int i = 0; i < count; i++) {
+        DepartureQueue *queue = departure_queue_for(updates[i].trip->departure_city, 1);
+        if (queue == NULL) continue;
+        updates[indexed] = updates[i];
+        updates[indexed++].key = (int)(queue - departure_index.queues);
+    }
+    qsort(updates, indexed, sizeof(TripIndexUpdate), compare_index_updates);
+
+    int i = 0;
+    while (i < indexed) {
+        int end = i + 1;
+        while (end < indexed && updates[end].key == updates[i].key) end++;
+        departure_queue_add_sorted(&departure_index.queues[updates[i].key], updates, i, end);
+        i = end;
+    }
+    free(updates);
+}
+
+void trip_indexes_rebuild(Trip *head) {
+    trip_indexes_clear();
+
+    int count = 0;
+    for (Trip *trip = head; trip != NULL; trip = trip->next) count++;
+    Trip **trips = (Trip**)malloc((count + 1) * sizeof(Trip*));
+    if (trips == NULL) {
+        for (Trip *trip = head; trip != NULL; trip = trip->next) trip_indexes_add(trip);
+        return;
+    }
+    count = 0;
+    for (Trip *trip = head; trip != NULL; trip = trip->next) trips[count++] = trip;
+    trip_indexes_add_batch(trips, count);
+    free(trips);
+}
+
+void trip_indexes_clear(void) {
+    bus_usage_clear();
+    for (int i = 0; i < client_trip_counts.capacity; i++) {
+        if (client_trip_counts.states[i] == 1) free(client_trip_counts.values[i]);
+    }
+    id_set_free(&client_trip_counts);
+    for (int i = 0; i < departure_index.queue_capacity; i++) {
+        departure_tree_free(departure_index.queues[i].root);
+    }
+    free(departure_index.queues);
+    city_table_free(&departure_index.cities);
+    memset(&departure_index, 0, sizeof(DepartureIndex));
+}
+
+// Departure board functions
+
+// Appends an entry to the board unless its run (same bus, time and
+// destination) already has a row
+static void departure_board_add(DepartureEntry *rows, int *count, const DepartureEntry *e) {
+    for (int r = *count - 1; r >= 0 && rows[r].departure == e->departure; r--) {
+        if (rows[r].trip->license_plate == e->trip->license_plate &&
+            strcmp(rows[r].trip->arrival_city, e->trip->arrival_city) == 0) {
+            return;
+        }
+    }
+    rows[(*count)++] = *e;
+}
+
+// In-order walk of the entries at or after from_time until the board is full
+static void departure_tree_collect(const DepartureNode *node, long from_time, DepartureEntry *rows,
+                                   int *count, int max_rows) {
+    while (node != NULL && *count < max_rows) {
+        if (node->entry.departure < from_time) {
+            node = node->right;
+            continue;
+        }
+        departure_tree_collect(node->left, from_time, rows, count, max_rows);
+        if (*count >= max_rows) return;
+        departure_board_add(rows, count, &node->entry);
+        node = node->right;
+    }
+}
+
+// Fills rows with the next departures from city at or after from_time,
+// one row per bus run (passengers of the same run share a row).
+// Costs a treap descent plus the entries read. Returns the row count.
+int departure_board_query(const char *city, long from_time, DepartureEntry *rows, int max_rows) {
+    DepartureQueue *queue = departure_queue_for(city, 0);
+    if (queue == NULL) return 0;
+
+    int count = 0;
+    departure_tree_collect(queue->root, from_time, rows, &count, max_rows);
+    return count;
+}
+
+// Decides whether the board is shown again. On a terminal the board
+// refreshes by itself every BOARD_REFRESH_SECONDS until Enter is pressed;
+// elsewhere (scripts, Windows consoles) the user is asked.
+static int departure_board_next(void) {
+#ifndef _WIN32
+    if (isatty(STDIN_FILENO)) {
+        printf("\nRefreshing every %d seconds. Press Enter to leave the board.", BOARD_REFRESH_SECONDS);
+        fflush(stdout);
+        struct pollfd input;
+        input.fd = STDIN_FILENO;
+        input.events = POLLIN;
+        if (poll(&input, 1, BOARD_REFRESH_SECONDS * 1000) == 0) return 1;
+        clear_input_buffer();
+        return 0;
+    }
+#endif
+    char refresh;
+    printf("\nRefresh the board? (y/N): ");
+    ui_scanf(" %c", &refresh);
+    return refresh == 'y' || refresh == 'Y';
+}
+
+void departure_board(Trip *trips, TripTemplate *templates, Departure *departures) {
+    if (trips == NULL && templates == NULL) {
+        printf("  No trips found in the system.\n");
+        printf("You need to add trips first to show departures.\n");
+        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
+        return;
+    }
+
+    print_header("DEPARTURE BOARD");
+
+    char city[MAX_STRING_LENGTH];
+    printf("Departure city: ");
+    ui_scanf("%99s", city);
+    printf("Rows to show (1-100): ");
+    int max_rows = safe_int_input();
+    if (max_rows < 1) max_rows = 1;
+    if (max_rows > 100) max_rows = 100;
+
+    printf("Board time: 1. Now  2. Specific date/time\nEnter your choice: ");
+    int mode = safe_int_input();
+    long offset = 0;
+    if (mode == 2) {
+        DateTime at;
+        do {
+            printf("Year (1900-2100): ");
+            at.year = safe_int_input();
+            printf("Month (1-12): ");
+            at.month = safe_int_input();
+            printf("Day: ");
+            at.day = safe_int_input();
+            printf("Hour (0-23): ");
+            at.hour = safe_int_input();
+            printf("Minute (0-59): ");
+            at.minute = safe_int_input();
+            
+            if (!is_valid_datetime(at.day, at.month, at.year, at.hour, at.minute)) {
+                printf("Invalid date/time. Please enter valid values.\n");
+            }
+        } while (!is_valid_datetime(at.day, at.month, at.year, at.hour, at.minute));
+        // The board keeps running from that moment, advancing with the clock
+        offset = datetime_to_minutes(at) - current_time_in_minutes();
+    }
+
+    // Seats left come from the departures of converted runs
+    DepartureLookup seats;
+    if (departure_lookup_build(departures, &seats) != 0) {
+        printf("Warning: not enough memory to show seats left.\n");
+    }
+
+    DepartureEntry rows[200];
+    Trip occurrences[100];
+    int refreshed = 0;
+    do {
+        if (refreshed) {
+            clear_screen();
+            print_header("DEPARTURE BOARD");
+        }
+        refreshed = 1;
+        long board_time = current_time_in_minutes() + offset;
+        DateTime shown_time = minutes_to_datetime(board_time);
+        int count = departure_board_query(city, board_time, rows, max_rows);
+
+        // Recurring templates contribute their next virtual occurrences
+        int virtual_count = next_template_occurrences(templates, city, board_time, occurrences, max_rows);
+        for (int i = 0; i < virtual_count; i++) {
+            rows[count].departure = datetime_to_minutes(occurrences[i].departure_time);
+            rows[count].trip = &occurrences[i];
+            count++;
+        }
+        if (virtual_count > 0) {
+            qsort(rows, count, sizeof(DepartureEntry), compare_departure_entries);
+            if (count > max_rows) count = max_rows;
+        }
+
+        printf("\nDepartures from %s after %02d/%02d/%d %02d:%02d\n\n", city,
+               shown_time.day, shown_time.month, shown_time.year, shown_time.hour, shown_time.minute);
+        if (count == 0) {
+            printf("No upcoming departures.\n");
+        } else {
+            set_console_color(2);
+            printf("%-18s %-15s %-10s %-18s %-10s\n", "Departure", "Destination", "Bus", "Arrival", "Seats Left");
+            printf("%-18s %-15s %-10s %-18s %-10s\n", "=========", "===========", "===", "=======", "==========");
+            set_console_color(7);
+            for (int i = 0; i < count; i++) {
+                Trip *trip = rows[i].trip;
+                printf("%02d/%02d/%d %02d:%02d   %-15s %-10d %02d/%02d/%d %02d:%02d   ",
+                       trip->departure_time.day, trip->departure_time.month, trip->departure_time.year,
+                       trip->departure_time.hour, trip->departure_time.minute,
+                       trip->arrival_city,
+                       trip->license_plate,
+                       trip->arrival_time.day, trip->arrival_time.month, trip->arrival_time.year,
+                       trip->arrival_time.hour, trip->arrival_time.minute);
+                Departure *departure = departure_lookup_find(&seats, trip->license_plate, rows[i].departure);
+                if (departure != NULL) {
+                    printf("%-10d\n", seats_left(departure));
+                } else {
+                    printf("%-10s\n", "-");
+                }
+            }
+        }
+
+    } while (departure_board_next());
+    departure_lookup_free(&seats);
+}
+
+// Recurring trip template functions
+static const char *weekday_names[] = {"Mon", "Tue", "Wed", "Thu", "Fri", "Sat", "Sun"};
+
+// Monday = 0 ... Sunday = 6 (01/01/1970 was a Thursday)
+int day_of_week(long day) {
+    return (int)(((day % 7) + 7 + 3) % 7);
+}
+
+static TemplateException* find_template_exception(const TripTemplate *tmpl, long day) {
+    int lo = 0, hi = tmpl->exception_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (tmpl->exceptions[mid].day < day) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < tmpl->exception_count && tmpl->exceptions[lo].day == day) return &tmpl->exceptions[lo];
+    return NULL;
+}
+
+static int add_template_exception(TripTemplate *tmpl, long day, int cancelled) {
+    TemplateException *existing = find_template_exception(tmpl, day);
+    if (existing != NULL) {
+        if (cancelled) existing->cancelled = 1;
+        return 1;
+    }
+
+    TemplateException *grown = (TemplateException*)realloc(tmpl->exceptions, (tmpl->exception_count + 1) * sizeof(TemplateException));
+    if (grown == NULL) return 0;
+    tmpl->exceptions = grown;
+
+    int pos = tmpl->exception_count;
+    while (pos > 0 && tmpl->exceptions[pos - 1].day > day) {
+        tmpl->exceptions[pos] = tmpl->exceptions[pos - 1];
+        pos--;
+    }
+    tmpl->exceptions[pos].day = day;
+    tmpl->exceptions[pos].cancelled = cancelled;
+    tmpl->exception_count++;
+    return 1;
+}
+
+// Whether the template generates a virtual occurrence on this day
+int template_runs_on(const TripTemplate *tmpl, long day) {
+    if (day < days_from_civil(tmpl->valid_from.day, tmpl->valid_from.month, tmpl->valid_from.year)) return 0;
+    if (day > days_from_civil(tmpl->valid_to.day, tmpl->valid_to.month, tmpl->valid_to.year)) return 0;
+    if (!(tmpl->days_of_week & (1 << day_of_week(day)))) return 0;
+    return find_template_exception(tmpl, day) == NULL;
+}
+
+static void fill_occurrence(const TripTemplate *tmpl, long day, Trip *trip) {
+    long departure = day * 1440L + tmpl->departure_hour * 60L + tmpl->departure_minute;
+    trip->license_plate = tmpl->license_plate;
+    trip->client_id = 0;
+    trip->departure_time = minutes_to_datetime(departure);
+    trip->arrival_time = minutes_to_datetime(departure + tmpl->duration_minutes);
+    strcpy(trip->departure_city, tmpl->departure_city);
+    strcpy(trip->arrival_city, tmpl->arrival_city);
+    trip->created_epoch = 0;
+    trip->deleted_epoch = 0;
+    trip->next = NULL;
+}
+
+// Expands the next virtual occurrences leaving city at or after from_time,
+// merged across templates in departure order. Only the days needed to fill
+// max_rows are generated. Returns the number of occurrences written to out.
+int next_template_occurrences(TripTemplate *templates, const char *city, long from_time, Trip *out, int max_rows) {
+    int count = 0;
+    long first_day = from_time >= 0 ? from_time / 1440 : (from_time - 1439) / 1440;
+
+    for (TripTemplate *tmpl = templates; tmpl != NULL; tmpl = tmpl->next) {
+        if (strcmp(tmpl->departure_city, city) != 0 || tmpl->days_of_week == 0) continue;
+
+        long last_day = days_from_civil(tmpl->valid_to.day, tmpl->valid_to.month, tmpl->valid_to.year);
+        long from_day = days_from_civil(tmpl->valid_from.day, tmpl->valid_from.month, tmpl->valid_from.year);
+        if (from_day < first_day) from_day = first_day;
+
+        int taken = 0;
+        for (long day = from_day; day <= last_day && taken < max_rows; day++) {
+            if (!template_runs_on(tmpl, day)) continue;
+            long departure = day * 1440L + tmpl->departure_hour * 60L + tmpl->departure_minute;
+            if (departure < from_time) continue;
+
+            // Insert into the sorted output, dropping whatever falls past max_rows
+            int pos = count;
+            while (pos > 0 && datetime_to_minutes(out[pos - 1].departure_time) > departure) pos--;
+            if (pos >= max_rows) break;
+            if (count < max_rows) count++;
+            memmove(&out[pos + 1], &out[pos], (count - 1 - pos) * sizeof(Trip));
+            fill_occurrence(tmpl, day, &out[pos]);
+            taken++;
+        }
+    }
+    return count;
+}
+
+// Expands every virtual occurrence departing in [from_time, to_time) into
+// a Trip array whose last element links to rest, so the reports and
+// planners that walk a trip list see recurring service as well. Sets
+// *occurrences to the array (NULL when nothing runs; free it when done).
+// Returns the number of occurrences, or -1 on allocation failure.
+int expand_template_occurrences(TripTemplate *templates, long from_time, long to_time, Trip *rest, Trip **occurrences) {
+    *occurrences = NULL;
+    if (to_time <= from_time) return 0;
+    long first_day = from_time >= 0 ? from_time / 1440 : (from_time - 1439) / 1440;
+    long last_day = to_time > 0 ? (to_time - 1) / 1440 : (to_time - 1440) / 1440;
+
+    Trip *out = NULL;
+    int count = 0, capacity = 0;
+    for (TripTemplate *tmpl = templates; tmpl != NULL; tmpl = tmpl->next) {
+        if (tmpl->days_of_week == 0) continue;
+        long from_day = days_from_civil(tmpl->valid_from.day, tmpl->valid_from.month, tmpl->valid_from.year);
+        long to_day = days_from_civil(tmpl->valid_to.day, tmpl->valid_to.month, tmpl->valid_to.year);
+        if (from_day < first_day) from_day = first_day;
+        if (to_day > last_day) to_day = last_day;
+
+        for (long day = from_day; day <= to_day; day++) {
+            if (!template_runs_on(tmpl, day)) continue;
+            long departure = day * 1440L + tmpl->departure_hour * 60L + tmpl->departure_minute;
+            if (departure < from_time || departure >= to_time) continue;
+            if (count == capacity) {
+                int new_capacity = capacity ? capacity * 2 : 64;
+                Trip *grown = (Trip*)realloc(out, new_capacity * sizeof(Trip));
+                if (grown == NULL) {
+                    free(out);
+                    return -1;
+                }
+                out = grown;
+                capacity = new_capacity;
+            }
+            fill_occurrence(tmpl, day, &out[count++]);
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        out[i].next = i + 1 < count ? &out[i + 1] : rest;
+    }
+    *occurrences = out;
+    return count;
+}
+
+// Turns one occurrence into a real trip for client_id and records the day as
+// materialized so the template stops generating it virtually.
+Trip* materialize_occurrence(Trip *head, TripTemplate *tmpl, long day, int client_id) {
+    Trip *new_trip = (Trip*)malloc(sizeof(Trip));
+    if (new_trip == NULL) {
+        printf("Memory allocation error. Cannot book occurrence.\n");
+        return head;
+    }
+    if (!add_template_exception(tmpl, day, 0)) {
+        printf("Memory allocation error. Cannot book occurrence.\n");
+        free(new_trip);
+        return head;
+    }
+
+    fill_occurrence(tmpl, day, new_trip);
+    new_trip->client_id = client_id;
+    trip_indexes_add(new_trip);
+
+    if (head == NULL) return new_trip;
+    Trip *temp = head;
+    while (temp->next != NULL) {
+        temp = temp->next;
+    }
+    temp->next = new_trip;
+    return head;
+}
+
+static TripTemplate* find_template(TripTemplate *head, int template_id) {
+    while (head != NULL && head->template_id != template_id) {
+        head = head->next;
+    }
+    return head;
+}
+
+static void format_days_of_week(int mask, char *out) {
+    out[0] = '\0';
+    for (int d = 0; d < 7; d++) {
+        if (mask & (1 << d)) {
+            if (out[0] != '\0') strcat(out, ",");
+            strcat(out, weekday_names[d]);
+        }
+    }
+    if (out[0] == '\0') strcpy(out, "None");
+}
+
+TripTemplate* add_template_at_end(TripTemplate *head, Bus *buses) {
+    if (!has_buses(buses)) {
+        printf("  No buses available in the system.\n");
+        printf("You need to add buses first before creating trip templates.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to add your first bus.\n");
+        return head;
+    }
+
+    TripTemplate *new_template = (TripTemplate*)malloc(sizeof(TripTemplate));
+    if (new_template == NULL) {
+        printf("Memory allocation error. Cannot add template.\n");
+        return head;
+    }
+
+    print_header("ADD RECURRING TRIP TEMPLATE");
+
+    int template_exists;
+    do {
+        template_exists = 0;
+        printf("Enter template ID: ");
+        new_template->template_id = safe_int_input();
+        if (find_template(head, new_template->template_id) != NULL) {
+            printf("Template ID %d already exists. Please enter a different one.\n", new_template->template_id);
+            template_exists = 1;
+        }
+    } while (template_exists);
+
+    printf("Enter bus license plate: ");
+    new_template->license_plate = safe_int_input();
+    Bus *bus_temp = buses;
+    while (bus_temp != NULL && bus_temp->license_plate != new_template->license_plate) {
+        bus_temp = bus_temp->next;
+    }
+    if (bus_temp == NULL) {
+        printf("Bus with license plate %d not found.\n", new_template->license_plate);
+        free(new_template);
+        return head;
+    }
+
+    printf("Departure city: ");
+    ui_scanf("%99s", new_template->departure_city);
+    printf("Arrival city: ");
+    ui_scanf("%99s", new_template->arrival_city);
+
+    do {
+        printf("Departure hour (0-23): ");
+        new_template->departure_hour = safe_int_input();
+        printf("Departure minute (0-59): ");
+        new_template->departure_minute = safe_int_input();
+        if (!is_valid_time(new_template->departure_hour, new_template->departure_minute)) {
+            printf("Invalid time. Please enter valid values.\n");
+        }
+    } while (!is_valid_time(new_template->departure_hour, new_template->departure_minute));
+
+    do {
+        printf("Trip duration (minutes): ");
+        new_template->duration_minutes = safe_int_input();
+        if (new_template->duration_minutes <= 0) {
+            printf("Duration must be positive.\n");
+        }
+    } while (new_template->duration_minutes <= 0);
+
+    char days[MAX_STRING_LENGTH];
+    int valid_days;
+    do {
+        printf("Days of week as 7 digits Mon-Sun (e.g. 1111100 for weekdays): ");
+        ui_scanf("%99s", days);
+        valid_days = strlen(days) == 7;
+        new_template->days_of_week = 0;
+        for (int d = 0; valid_days && d < 7; d++) {
+            if (days[d] == '1') new_template->days_of_week |= 1 << d;
+            else if (days[d] != '0') valid_days = 0;
+        }
+        if (!valid_days) {
+            printf("Invalid pattern. Use seven 0/1 digits.\n");
+        }
+    } while (!valid_days);
+
+    input_date("\nValid from:", &new_template->valid_from);
+    do {
+        input_date("\nValid until (inclusive):", &new_template->valid_to);
+        if (days_from_civil(new_template->valid_to.day, new_template->valid_to.month, new_template->valid_to.year) <
+            days_from_civil(new_template->valid_from.day, new_template->valid_from.month, new_template->valid_from.year)) {
+            printf("End date must not be before the start date.\n");
+        }
+    } while (days_from_civil(new_template->valid_to.day, new_template->valid_to.month, new_template->valid_to.year) <
+             days_from_civil(new_template->valid_from.day, new_template->valid_from.month, new_template->valid_from.year));
+
+    new_template->exceptions = NULL;
+    new_template->exception_count = 0;
+    new_template->next = NULL;
+
+    if (head == NULL) {
+        printf("Template added successfully! This is your first template.\n");
+        return new_template;
+    } else {
+        TripTemplate *temp = head;
+        while (temp->next != NULL) {
+            temp = temp->next;
+        }
+        temp->next = new_template;
+        printf("Template added successfully!\n");
+        return head;
+    }
+}
+
+void display_templates(TripTemplate *head) {
+    if (head == NULL) {
+        printf("  No trip templates found in the system.\n");
+        printf("You need to add templates first to view them.\n");
+        printf("Please go to 'Recurring Trip Templates' -> 'Add New Template' to create your first template.\n");
+        return;
+    }
+
+    print_header("RECURRING TRIP TEMPLATES");
+
+    set_console_color(2);
+    printf("%-6s %-8s %-12s %-12s %-6s %-6s %-28s %-23s %-6s\n",
+           "ID", "Bus", "Departure", "Arrival", "Time", "Mins", "Days", "Validity", "Except");
+    printf("%-6s %-8s %-12s %-12s %-6s %-6s %-28s %-23s %-6s\n",
+           "==", "===", "=========", "=======", "====", "====", "====", "========", "======");
+    set_console_color(7);
+
+    for (TripTemplate *temp = head; temp != NULL; temp = temp->next) {
+        char days[40];
+        format_days_of_week(temp->days_of_week, days);
+        printf("%-6d %-8d %-12s %-12s %02d:%02d  %-6d %-28s %02d/%02d/%d-%02d/%02d/%d  %-6d\n",
+               temp->template_id,
+               temp->license_plate,
+               temp->departure_city,
+               temp->arrival_city,
+               temp->departure_hour,
+               temp->departure_minute,
+               temp->duration_minutes,
+               days,
+               temp->valid_from.day, temp->valid_from.month, temp->valid_from.year,
+               temp->valid_to.day, temp->valid_to.month, temp->valid_to.year,
+               temp->exception_count);
+    }
+}
+
+void display_template_occurrences(TripTemplate *head) {
+    if (head == NULL) {
+        printf("  No trip templates found in the system.\n");
+        printf("Please go to 'Recurring Trip Templates' -> 'Add New Template' to create your first template.\n");
+        return;
+    }
+
+    print_header("TEMPLATE OCCURRENCES");
+
+    PurchaseDate from, to;
+    input_date("Show occurrences from:", &from);
+    input_date("\nUntil (inclusive):", &to);
+    long first_day = days_from_civil(from.day, from.month, from.year);
+    long last_day = days_from_civil(to.day, to.month, to.year);
+
+    set_console_color(2);
+    printf("\n%-12s %-5s %-6s %-8s %-15s %-15s %-6s %-12s\n",
+           "Date", "Day", "Time", "Bus", "Departure", "Arrival", "ID", "Status");
+    printf("%-12s %-5s %-6s %-8s %-15s %-15s %-6s %-12s\n",
+           "====", "===", "====", "===", "=========", "=======", "==", "======");
+    set_console_color(7);
+
+    // Generated day by day; nothing is stored for the virtual occurrences
+    int shown = 0;
+    for (long day = first_day; day <= last_day; day++) {
+        DateTime date = minutes_to_datetime(day * 1440L);
+        for (TripTemplate *tmpl = head; tmpl != NULL; tmpl = tmpl->next) {
+            if (!(tmpl->days_of_week & (1 << day_of_week(day)))) continue;
+            if (day < days_from_civil(tmpl->valid_from.day, tmpl->valid_from.month, tmpl->valid_from.year) ||
+                day > days_from_civil(tmpl->valid_to.day, tmpl->valid_to.month, tmpl->valid_to.year)) continue;
+
+            TemplateException *exception = find_template_exception(tmpl, day);
+            const char *status = exception == NULL ? "Scheduled" : (exception->cancelled ? "Cancelled" : "Booked");
+            printf("%02d/%02d/%-6d %-5s %02d:%02d  %-8d %-15s %-15s %-6d %-12s\n",
+                   date.day, date.month, date.year,
+                   weekday_names[day_of_week(day)],
+                   tmpl->departure_hour, tmpl->departure_minute,
+                   tmpl->license_plate,
+                   tmpl->departure_city,
+                   tmpl->arrival_city,
+                   tmpl->template_id,
+                   status);
+            shown++;
+        }
+    }
+    printf("\n%d occurrences in range.\n", shown);
+}
+
+static int input_template_day(TripTemplate *templates, TripTemplate **tmpl, long *day) {
+    printf("Enter template ID: ");
+    int template_id = safe_int_input();
+    *tmpl = find_template(templates, template_id);
+    if (*tmpl == NULL) {
+        printf("Template with ID %d not found.\n", template_id);
+        return 0;
+    }
+
+    PurchaseDate date;
+    input_date("Occurrence date:", &date);
+    *day = days_from_civil(date.day, date.month, date.year);
+
+    TemplateException *exception = find_template_exception(*tmpl, *day);
+    if (exception != NULL && exception->cancelled) {
+        printf("That occurrence has been cancelled.\n");
+        return 0;
+    }
+    if (exception == NULL && !template_runs_on(*tmpl, *day)) {
+        printf("Template %d does not run on %02d/%02d/%d.\n", template_id, date.day, date.month, date.year);
+        return 0;
+    }
+    return 1;
+}
+
+Trip* book_template_occurrence(Trip *trips, TripTemplate *templates, Client *clients) {
+    if (templates == NULL) {
+        printf("  No trip templates found in the system.\n");
+        printf("Please go to 'Recurring Trip Templates' -> 'Add New Template' to create your first template.\n");
+        return trips;
+    }
+    if (!has_clients(clients)) {
+        printf("  No clients available in the system.\n");
+        printf("You need to add clients first before booking trips.\n");
+        printf("Please go to 'Client Management' -> 'Add New Client' to add your first client.\n");
+        return trips;
+    }
+
+    print_header("BOOK TEMPLATE OCCURRENCE");
+
+    TripTemplate *tmpl;
+    long day;
+    if (!input_template_day(templates, &tmpl, &day)) return trips;
+
+    printf("Enter client ID: ");
+    int client_id = safe_int_input();
+    Client client;
+    if (!find_client(clients, client_id, &client)) {
+        printf("Client with ID %d not found.\n", client_id);
+        return trips;
+    }
+
+    trips = materialize_occurrence(trips, tmpl, day, client_id);
+    printf("Client %d booked on template %d. The occurrence is now a regular trip.\n", client_id, tmpl->template_id);
+    return trips;
+}
+
+void cancel_template_occurrence(TripTemplate *templates) {
+    if (templates == NULL) {
+        printf("  No trip templates found in the system.\n");
+        printf("Please go to 'Recurring Trip Templates' -> 'Add New Template' to create your first template.\n");
+        return;
+    }
+
+    print_header("CANCEL TEMPLATE OCCURRENCE");
+
+    TripTemplate *tmpl;
+    long day;
+    if (!input_template_day(templates, &tmpl, &day)) return;
+
+    if (find_template_exception(tmpl, day) != NULL) {
+        printf("Note: clients are already booked on this occurrence; their trips are kept.\n");
+    }
+    if (add_template_exception(tmpl, day, 1)) {
+        printf("Occurrence cancelled.\n");
+    } else {
+        printf("Memory allocation error. Cannot cancel occurrence.\n");
+    }
+}
+
+TripTemplate* delete_template(TripTemplate *head) {
+    if (head == NULL) {
+        printf("  No trip templates found in the system.\n");
+        printf("Please go to 'Recurring Trip Templates' -> 'Add New Template' to create your first template.\n");
+        return head;
+    }
+
+    print_header("DELETE TEMPLATE");
+
+    printf("Enter template ID to delete: ");
+    int template_id = safe_int_input();
+
+    TripTemplate *prev = NULL;
+    TripTemplate *temp = head;
+    while (temp != NULL && temp->template_id != template_id) {
+        prev = temp;
+        temp = temp->next;
+    }
+
+    if (temp == NULL) {
+        printf("Template with ID %d not found.\n", template_id);
+        return head;
+    }
+
+    char confirm;
+    printf("\nDelete template %d (%s to %s)? Booked trips are kept. (y/N): ",
+           temp->template_id, temp->departure_city, temp->arrival_city);
+    ui_scanf(" %c", &confirm);
+
+    if (confirm == 'y' || confirm == 'Y') {
+        if (prev == NULL) {
+            head = temp->next;
+        } else {
+            prev->next = temp->next;
+        }
+        free(temp->exceptions);
+        free(temp);
+        printf("Template deleted successfully!\n");
+    } else {
+        printf("Deletion cancelled.\n");
+    }
+
+    return head;
+}
+
+void save_templates_to_file(TripTemplate *head) {
+    FILE *file = fopen(TEMPLATE_FILENAME, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    TripTemplate *temp = head;
+    while (temp != NULL) {
+        fprintf(file, "%d\n%d\n%s\n%s\n%d:%d\n%d\n%d\n%d/%d/%d\n%d/%d/%d\n%d\n",
+                temp->template_id,
+                temp->license_plate,
+                temp->departure_city,
+                temp->arrival_city,
+                temp->departure_hour,
+                temp->departure_minute,
+                temp->duration_minutes,
+                temp->days_of_week,
+                temp->valid_from.day, temp->valid_from.month, temp->valid_from.year,
+                temp->valid_to.day, temp->valid_to.month, temp->valid_to.year,
+                temp->exception_count);
+        for (int i = 0; i < temp->exception_count; i++) {
+            DateTime date = minutes_to_datetime(temp->exceptions[i].day * 1440L);
+            fprintf(file, "%d/%d/%d %d\n", date.day, date.month, date.year, temp->exceptions[i].cancelled);
+        }
+        temp = temp->next;
+    }
+
+    fclose(file);
+}
+
+TripTemplate* load_templates_from_file(TripTemplate *head) {
+    FILE *file = fopen(TEMPLATE_FILENAME, "r");
+    if (file == NULL) {
+        return head;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
+        return head;
+    }
+    rewind(file);
+
+    free_template_list(head);
+    head = NULL;
+    TripTemplate *tail = NULL;
+
+    TripTemplate loaded;
+    while (fscanf(file, "%d\n%d\n%99s\n%99s\n%d:%d\n%d\n%d\n%d/%d/%d\n%d/%d/%d\n%d\n",
+                  &loaded.template_id, &loaded.license_plate,
+                  loaded.departure_city, loaded.arrival_city,
+                  &loaded.departure_hour, &loaded.departure_minute,
+                  &loaded.duration_minutes, &loaded.days_of_week,
+                  &loaded.valid_from.day, &loaded.valid_from.month, &loaded.valid_from.year,
+                  &loaded.valid_to.day, &loaded.valid_to.month, &loaded.valid_to.year,
+                  &loaded.exception_count) == 15) {
+        TripTemplate *new_template = (TripTemplate*)malloc(sizeof(TripTemplate));
+        if (new_template == NULL) {
+            fclose(file);
+            return head;
+        }
+        *new_template = loaded;
+        new_template->exceptions = NULL;
+        new_template->exception_count = 0;
+        new_template->next = NULL;
+
+        // One exception per line; a malformed line is skipped on its own
+        // so the records after it stay aligned
+        for (int i = 0; i < loaded.exception_count; i++) {
+            char line[MAX_STRING_LENGTH];
+            int day, month, year, cancelled;
+            if (fgets(line, sizeof(line), file) == NULL) break;
+            if (sscanf(line, "%d/%d/%d %d", &day, &month, &year, &cancelled) != 4 ||
+                !is_valid_date(day, month, year)) {
+                printf("Warning: skipping malformed exception for template %d.\n", loaded.template_id);
+                continue;
+            }
+            add_template_exception(new_template, days_from_civil(day, month, year), cancelled);
+        }
+
+        if (head == NULL) {
+            head = new_template;
+        } else {
+            tail->next = new_template;
+        }
+        tail = new_template;
+    }
+
+    fclose(file);
+    return head;
+}
+
+void free_template_list(TripTemplate *head) {
+    TripTemplate *temp;
+    while (head != NULL) {
+        temp = head;
+        head = head->next;
+        free(temp->exceptions);
+        free(temp);
+    }
+}
+
+// Seat inventory functions
+static int popcount_word(SeatWord word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    while (word) {
+        word &= word - 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+static int lowest_set_bit(SeatWord word) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+static int seat_map_words(int seat_count) {
+    return (seat_count + SEAT_WORD_BITS - 1) / SEAT_WORD_BITS;
+}
+
+// Bits past seat_count in the last word are kept set so they never look free
+static SeatWord* create_seat_map(int seat_count) {
+    int words = seat_map_words(seat_count);
+    SeatWord *map = (SeatWord*)calloc(words > 0 ? words : 1, sizeof(SeatWord));
+    if (map != NULL && seat_count % SEAT_WORD_BITS != 0) {
+        map[words - 1] = ~(SeatWord)0 << (seat_count % SEAT_WORD_BITS);
+    }
+    return map;
+}
+
+int seat_is_free(const Departure *departure, int seat_number) {
+    if (seat_number < 1 || seat_number > departure->seat_count) return 0;
+    int bit = seat_number - 1;
+    return !(departure->seat_map[bit / SEAT_WORD_BITS] & ((SeatWord)1 << (bit % SEAT_WORD_BITS)));
+}
+
+int seats_left(const Departure *departure) {
+    return departure->seat_count - departure->seats_taken;
+}
+
+int reserve_seat(Departure *departure, int seat_number) {
+    if (!seat_is_free(departure, seat_number)) return 0;
+    int bit = seat_number - 1;
+    departure->seat_map[bit / SEAT_WORD_BITS] |= (SeatWord)1 << (bit % SEAT_WORD_BITS);
+    departure->seats_taken++;
+    return 1;
+}
+
+void release_seat(Departure *departure, int seat_number) {
+    if (seat_number < 1 || seat_number > departure->seat_count || seat_is_free(departure, seat_number)) return;
+    int bit = seat_number - 1;
+    departure->seat_map[bit / SEAT_WORD_BITS] &= ~((SeatWord)1 << (bit % SEAT_WORD_BITS));
+    departure->seats_taken--;
+}
+
+// Reserves the lowest free seat. Returns its number, or 0 if the bus is full.
+int allocate_first_fit_seat(Departure *departure) {
+    int words = seat_map_words(departure->seat_count);
+    for (int w = 0; w < words; w++) {
+        SeatWord free_bits = ~departure->seat_map[w];
+        if (free_bits == 0) continue;
+        int seat_number = w * SEAT_WORD_BITS + lowest_set_bit(free_bits) + 1;
+        reserve_seat(departure, seat_number);
+        return seat_number;
+    }
+    return 0;
+}
+
+// Reserves count adjacent seats (runs may cross word boundaries). Words with
+// too few free seats to matter are skipped using popcount. Returns the first
+// seat number of the block, or 0 if no such block exists.
+int allocate_contiguous_seats(Departure *departure, int count) {
+    if (count < 1 || count > seats_left(departure)) return 0;
+
+    int words = seat_map_words(departure->seat_count);
+    int run_start = 0, run_length = 0;
+    for (int w = 0; w < words; w++) {
+        SeatWord free_bits = ~departure->seat_map[w];
+        if (free_bits == 0) {
+            run_length = 0;
+            continue;
+        }
+        if (free_bits == ~(SeatWord)0) {
+            if (run_length == 0) run_start = w * SEAT_WORD_BITS;
+            run_length += SEAT_WORD_BITS;
+            if (run_length >= count) break;
+            continue;
+        }
+        // A run that does not reach into this word can only finish inside it
+        if (run_length == 0 && popcount_word(free_bits) < count && count <= SEAT_WORD_BITS &&
+            !(free_bits >> (SEAT_WORD_BITS - 1))) {
+            continue;
+        }
+        for (int bit = 0; bit < SEAT_WORD_BITS; bit++) {
+            if (free_bits & ((SeatWord)1 << bit)) {
+                if (run_length == 0) run_start = w * SEAT_WORD_BITS + bit;
+                run_length++;
+                if (run_length >= count) break;
+            } else {
+                run_length = 0;
+            }
+        }
+        if (run_length >= count) break;
+    }
+    if (run_length < count) return 0;
+
+    for (int i = 0; i < count; i++) {
+        reserve_seat(departure, run_start + i + 1);
+    }
+    return run_start + 1;
+}
+
+static Departure* find_departure(Departure *head, int departure_id) {
+    while (head != NULL && head->departure_id != departure_id) {
+        head = head->next;
+    }
+    return head;
+}
+
+static int compare_departure_keys(const void *a, const void *b) {
+    const Departure *x = *(Departure* const*)a;
+    const Departure *y = *(Departure* const*)b;
+    if (x->license_plate != y->license_plate) return x->license_plate < y->license_plate ? -1 : 1;
+    long x_time = datetime_to_minutes(x->departure_time);
+    long y_time = datetime_to_minutes(y->departure_time);
+    return (x_time > y_time) - (x_time < y_time);
+}
+
+// Returns 0, or -1 on allocation failure (the lookup is then empty)
+int departure_lookup_build(Departure *head, DepartureLookup *lookup) {
+    lookup->sorted = NULL;
+    lookup->count = 0;
+    int count = 0;
+    for (Departure *temp = head; temp != NULL; temp = temp->next) count++;
+    if (count == 0) return 0;
+
+    lookup->sorted = (Departure**)malloc(count * sizeof(Departure*));
+    if (lookup->sorted == NULL) return -1;
+    for (Departure *temp = head; temp != NULL; temp = temp->next) {
+        lookup->sorted[lookup->count++] = temp;
+    }
+    qsort(lookup->sorted, count, sizeof(Departure*), compare_departure_keys);
+    return 0;
+}
+
+Departure* departure_lookup_find(const DepartureLookup *lookup, int license_plate, long departure) {
+    int lo = 0, hi = lookup->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        const Departure *temp = lookup->sorted[mid];
+        long time = datetime_to_minutes(temp->departure_time);
+        if (temp->license_plate < license_plate || (temp->license_plate == license_plate && time < departure)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < lookup->count && lookup->sorted[lo]->license_plate == license_plate &&
+        datetime_to_minutes(lookup->sorted[lo]->departure_time) == departure) {
+        return lookup->sorted[lo];
+    }
+    return NULL;
+}
+
+void departure_lookup_free(DepartureLookup *lookup) {
+    free(lookup->sorted);
+    lookup->sorted = NULL;
+    lookup->count = 0;
+}
+
+static Departure* create_departure(int departure_id, int license_plate, int seat_count) {
+    Departure *new_departure = (Departure*)malloc(sizeof(Departure));
+    if (new_departure == NULL) return NULL;
+    new_departure->departure_id = departure_id;
+    new_departure->license_plate = license_plate;
+    new_departure->seat_count = seat_count;
+    new_departure->seats_taken = 0;
+    new_departure->seat_map = create_seat_map(seat_count);
+    new_departure->next = NULL;
+    if (new_departure->seat_map == NULL) {
+        free(new_departure);
+        return NULL;
+    }
+    return new_departure;
+}
+
+static void input_datetime(const char *label, DateTime *dt) {
+    do {
+        printf("%s\n", label);
+        printf("Year (1900-2100): ");
+        dt->year = safe_int_input();
+        printf("Month (1-12): ");
+        dt->month = safe_int_input();
+        printf("Day: ");
+        dt->day = safe_int_input();
+        printf("Hour (0-23): ");
+        dt->hour = safe_int_input();
+        printf("Minute (0-59): ");
+        dt->minute = safe_int_input();
+        
+        if (!is_valid_datetime(dt->day, dt->month, dt->year, dt->hour, dt->minute)) {
+            printf("Invalid date/time. Please enter valid values.\n");
+        }
+    } while (!is_valid_datetime(dt->day, dt->month, dt->year, dt->hour, dt->minute));
+}
+
+Departure* add_departure_at_end(Departure *head, Bus *buses) {
+    if (!has_buses(buses)) {
+        printf("  No buses available in the system.\n");
+        printf("You need to add buses first before creating departures.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to add your first bus.\n");
+        return head;
+    }
+
+    print_header("ADD NEW DEPARTURE");
+
+    int departure_id;
+    do {
+        printf("Enter departure ID: ");
+        departure_id = safe_int_input();
+        if (find_departure(head, departure_id) != NULL) {
+            printf("Departure ID %d already exists. Please enter a different one.\n", departure_id);
+        }
+    } while (find_departure(head, departure_id) != NULL);
+
+    printf("Enter bus license plate: ");
+    int license_plate = safe_int_input();
+    Bus *bus = buses;
+    while (bus != NULL && bus->license_plate != license_plate) {
+        bus = bus->next;
+    }
+    if (bus == NULL) {
+        printf("Bus with license plate %d not found.\n", license_plate);
+        return head;
+    }
+
+    // The seat map is sized from the bus as it is configured today
+    Departure *new_departure = create_departure(departure_id, license_plate, bus->seat_count);
+    if (new_departure == NULL) {
+        printf("Memory allocation error. Cannot add departure.\n");
+        return head;
+    }
+
+    printf("Departure city: ");
+    ui_scanf("%99s", new_departure->departure_city);
+    input_datetime("Departure date and time:", &new_departure->departure_time);
+    printf("\nArrival city: ");
+    ui_scanf("%99s", new_departure->arrival_city);
+    input_datetime("Arrival date and time:", &new_departure->arrival_time);
+
+    if (head == NULL) {
+        printf("Departure added successfully with %d seats! This is your first departure.\n", new_departure->seat_count);
+        return new_departure;
+    } else {
+        Departure *temp = head;
+        while (temp->next != NULL) {
+            temp = temp->next;
+        }
+        temp->next = new_departure;
+        printf("Departure added successfully with %d seats!\n", new_departure->seat_count);
+        return head;
+    }
+}
+
+void display_departures(Departure *head) {
+    if (head == NULL) {
+        printf("  No departures found in the system.\n");
+        printf("You need to add departures first to view them.\n");
+        printf("Please go to 'Seat Bookings' -> 'Add New Departure' to create your first departure.\n");
+        return;
+    }
+
+    print_header("DEPARTURES AND SEATS");
+
+    set_console_color(2);
+    printf("%-8s %-8s %-15s %-15s %-20s %-20s %-8s %-8s\n",
+           "ID", "Bus", "Departure", "Arrival", "Departure Time", "Arrival Time", "Seats", "Left");
+    printf("%-8s %-8s %-15s %-15s %-20s %-20s %-8s %-8s\n",
+           "==", "===", "=========", "=======", "==============", "============", "=====", "====");
+    set_console_color(7);
+
+    for (Departure *temp = head; temp != NULL; temp = temp->next) {
+        printf("%-8d %-8d %-15s %-15s %02d/%02d/%d %02d:%02d     %02d/%02d/%d %02d:%02d     %-8d %-8d\n",
+               temp->departure_id,
+               temp->license_plate,
+               temp->departure_city,
+               temp->arrival_city,
+               temp->departure_time.day, temp->departure_time.month, temp->departure_time.year,
+               temp->departure_time.hour, temp->departure_time.minute,
+               temp->arrival_time.day, temp->arrival_time.month, temp->arrival_time.year,
+               temp->arrival_time.hour, temp->arrival_time.minute,
+               temp->seat_count,
+               seats_left(temp));
+    }
+}
+
+void display_seat_map(Departure *departures, Booking *bookings) {
+    if (departures == NULL) {
+        printf("  No departures found in the system.\n");
+        printf("Please go to 'Seat Bookings' -> 'Add New Departure' to create your first departure.\n");
+        return;
+    }
+
+    print_header("SEAT MAP");
+
+    printf("Enter departure ID: ");
+    int departure_id = safe_int_input();
+    Departure *departure = find_departure(departures, departure_id);
+    if (departure == NULL) {
+        printf("Departure with ID %d not found.\n", departure_id);
+        return;
+    }
+
+    printf("\nDeparture %d: %s to %s, bus %d - %d of %d seats left\n\n",
+           departure->departure_id, departure->departure_city, departure->arrival_city,
+           departure->license_plate, seats_left(departure), departure->seat_count);
+
+    // Four seats per row with an aisle in the middle
+    for (int seat = 1; seat <= departure->seat_count; seat++) {
+        if (seat_is_free(departure, seat)) {
+            set_console_color(2);
+            printf("[%3d]", seat);
+        } else {
+            set_console_color(4);
+            printf("[ XX]");
+        }
+        set_console_color(7);
+        if (seat % 4 == 2) printf("   ");
+        if (seat % 4 == 0 || seat == departure->seat_count) printf("\n");
+    }
+
+    int shown = 0;
+    for (Booking *booking = bookings; booking != NULL; booking = booking->next) {
+        if (booking->departure_id != departure_id) continue;
+        if (shown == 0) {
+            printf("\n%-10s %-10s %-10s\n", "Booking", "Client", "Seat");
+        }
+        printf("%-10d %-10d %-10d\n", booking->booking_id, booking->client_id, booking->seat_number);
+        shown++;
+    }
+}
+
+static int next_booking_id(Booking *head) {
+    int max_id = 0;
+    for (Booking *temp = head; temp != NULL; temp = temp->next) {
+        if (temp->booking_id > max_id) max_id = temp->booking_id;
+    }
+    return max_id + 1;
+}
+
+static Booking* append_booking(Booking *head, Booking **tail, int booking_id, int departure_id, int client_id, int seat_number) {
+    Booking *new_booking = (Booking*)malloc(sizeof(Booking));
+    if (new_booking == NULL) return head;
+    new_booking->booking_id = booking_id;
+    new_booking->departure_id = departure_id;
+    new_booking->client_id = client_id;
+    new_booking->seat_number = seat_number;
+    new_booking->next = NULL;
+
+    if (*tail == NULL) {
+        *tail = head;
+        while (*tail != NULL && (*tail)->next != NULL) {
+            *tail = (*tail)->next;
+        }
+    }
+    if (*tail == NULL) {
+        head = new_booking;
+    } else {
+        (*tail)->next = new_booking;
+    }
+    *tail = new_booking;
+    return head;
+}
+
+Booking* book_seats(Booking *head, Departure *departures, Client *clients) {
+    if (departures == NULL) {
+        printf("  No departures found in the system.\n");
+        printf("Please go to 'Seat Bookings' -> 'Add New Departure' to create your first departure.\n");
+        return head;
+    }
+    if (!has_clients(clients)) {
+        printf("  No clients available in the system.\n");
+        printf("You need to add clients first before booking seats.\n");
+        printf("Please go to 'Client Management' -> 'Add New Client' to add your first client.\n");
+        return head;
+    }
+
+    print_header("BOOK SEATS");
+
+    printf("Enter departure ID: ");
+    int departure_id = safe_int_input();
+    Departure *departure = find_departure(departures, departure_id);
+    if (departure == NULL) {
+        printf("Departure with ID %d not found.\n", departure_id);
+        return head;
+    }
+    printf("Seats left: %d of %d\n", seats_left(departure), departure->seat_count);
+    if (seats_left(departure) == 0) {
+        printf("This departure is fully booked.\n");
+        return head;
+    }
+
+    printf("Enter client ID: ");
+    int client_id = safe_int_input();
+    Client client;
+    if (!find_client(clients, client_id, &client)) {
+        printf("Client with ID %d not found.\n", client_id);
+        return head;
+    }
+
+    printf("1. Specific seat\n2. First free seat(s)\n3. Seats together\nEnter your choice: ");
+    int mode = safe_int_input();
+
+    int seats[SEAT_WORD_BITS * 4];
+    int count = 0;
+    if (mode == 1) {
+        printf("Seat number (1-%d): ", departure->seat_count);
+        int seat_number = safe_int_input();
+        if (!reserve_seat(departure, seat_number)) {
+            printf("Seat %d is not available.\n", seat_number);
+            return head;
+        }
+        seats[count++] = seat_number;
+    } else {
+        printf("Number of seats: ");
+        int wanted = safe_int_input();
+        if (wanted < 1 || wanted > seats_left(departure) || wanted > (int)(sizeof(seats) / sizeof(seats[0]))) {
+            printf("Cannot book %d seats (%d left).\n", wanted, seats_left(departure));
+            return head;
+        }
+        if (mode == 3) {
+            int first = allocate_contiguous_seats(departure, wanted);
+            if (first == 0) {
+                printf("No block of %d adjacent seats is free.\n", wanted);
+                return head;
+            }
+            for (int i = 0; i < wanted; i++) seats[count++] = first + i;
+        } else {
+            for (int i = 0; i < wanted; i++) seats[count++] = allocate_first_fit_seat(departure);
+        }
+    }
+
+    Booking *tail = NULL;
+    int booking_id = next_booking_id(head);
+    printf("\nBooked for client %d:", client_id);
+    for (int i = 0; i < count; i++) {
+        head = append_booking(head, &tail, booking_id++, departure_id, client_id, seats[i]);
+        printf(" %d", seats[i]);
+    }
+    printf("\nSeats left: %d\n", seats_left(departure));
+    return head;
+}
+
+Booking* cancel_booking(Booking *head, Departure *departures) {
+    if (head == NULL) {
+        printf("  No bookings found in the system.\n");
+        return head;
+    }
+
+    print_header("CANCEL BOOKING");
+
+    printf("Enter booking ID to cancel: ");
+    int booking_id = safe_int_input();
+
+    Booking *prev = NULL;
+    Booking *temp = head;
+    while (temp != NULL && temp->booking_id != booking_id) {
+        prev = temp;
+        temp = temp->next;
+    }
+    if (temp == NULL) {
+        printf("Booking with ID %d not found.\n", booking_id);
+        return head;
+    }
+
+    Departure *departure = find_departure(departures, temp->departure_id);
+    if (departure != NULL) {
+        release_seat(departure, temp->seat_number);
+    }
+    if (prev == NULL) {
+        head = temp->next;
+    } else {
+        prev->next = temp->next;
+    }
+    printf("Booking %d cancelled; seat %d is free again.\n", booking_id, temp->seat_number);
+    free(temp);
+    return head;
+}
+
+Departure* delete_departure(Departure *head, Booking **bookings) {
+    if (head == NULL) {
+        printf("  No departures found in the system.\n");
+        return head;
+    }
+
+    print_header("DELETE DEPARTURE");
+
+    printf("Enter departure ID to delete: ");
+    int departure_id = safe_int_input();
+
+    Departure *prev = NULL;
+    Departure *temp = head;
+    while (temp != NULL && temp->departure_id != departure_id) {
+        prev = temp;
+        temp = temp->next;
+    }
+    if (temp == NULL) {
+        printf("Departure with ID %d not found.\n", departure_id);
+        return head;
+    }
+
+    char confirm;
+    printf("\nDelete departure %d and its %d bookings? (y/N): ", departure_id, temp->seats_taken);
+    ui_scanf(" %c", &confirm);
+    if (confirm != 'y' && confirm != 'Y') {
+        printf("Deletion cancelled.\n");
+        return head;
+    }
+
+    Booking *booking_prev = NULL;
+    Booking *booking = *bookings;
+    while (booking != NULL) {
+        Booking *next = booking->next;
+        if (booking->departure_id == departure_id) {
+            if (booking_prev == NULL) {
+                *bookings = next;
+            } else {
+                booking_prev->next = next;
+            }
+            free(booking);
+        } else {
+            booking_prev = booking;
+        }
+        booking = next;
+    }
+
+    if (prev == NULL) {
+        head = temp->next;
+    } else {
+        prev->next = temp->next;
+    }
+    free(temp->seat_map);
+    free(temp);
+    printf("Departure deleted successfully!\n");
+    return head;
+}
+
+typedef struct TripRunRef {
+    long departure;
+    int license_plate;
+    int position;       // index in the trip list
+    Trip *trip;
+} TripRunRef;
+
+static int compare_trip_run_refs(const void *a, const void *b) {
+    const TripRunRef *x = (const TripRunRef*)a;
+    const TripRunRef *y = (const TripRunRef*)b;
+    if (x->departure != y->departure) return x->departure < y->departure ? -1 : 1;
+    if (x->license_plate != y->license_plate) return x->license_plate < y->license_plate ? -1 : 1;
+    int cities = strcmp(x->trip->departure_city, y->trip->departure_city);
+    if (cities != 0) return cities;
+    cities = strcmp(x->trip->arrival_city, y->trip->arrival_city);
+    if (cities != 0) return cities;
+    return x->trip->client_id - y->trip->client_id;
+}
+
+static int client_has_booking(Booking *head, int departure_id, int client_id) {
+    for (Booking *temp = head; temp != NULL; temp = temp->next) {
+        if (temp->departure_id == departure_id && temp->client_id == client_id) return 1;
+    }
+    return 0;
+}
+
+// Collapses per-passenger trip rows into departures with one booking per
+// passenger. Rows of a run that already has a departure are booked into
+// it. Every booked row is removed from the trip list except one, which
+// stays as the run's trip row for the board, planner and rosters and finds
+// its seats by bus and departure time. Passengers that do not fit keep
+// their rows. The caller saves trips, departures and bookings together.
+Departure* convert_trips_to_departures(Departure *head, Booking **bookings, Trip **trips, Bus *buses) {
+    print_header("CONVERT TRIPS TO DEPARTURES");
+
+    int trip_count = 0;
+    for (Trip *trip = *trips; trip != NULL; trip = trip->next) trip_count++;
+    if (trip_count == 0) {
+        printf("No trips to convert.\n");
+        return head;
+    }
+
+    TripRunRef *refs = (TripRunRef*)malloc(trip_count * sizeof(TripRunRef));
+    unsigned char *drop = (unsigned char*)calloc(trip_count, 1);
+    DepartureLookup existing;
+    if (refs == NULL || drop == NULL || departure_lookup_build(head, &existing) != 0) {
+        printf("Memory allocation error. Cannot convert trips.\n");
+        free(refs);
+        free(drop);
+        return head;
+    }
+    int i = 0;
+    for (Trip *trip = *trips; trip != NULL; trip = trip->next, i++) {
+        refs[i].departure = datetime_to_minutes(trip->departure_time);
+        refs[i].license_plate = trip->license_plate;
+        refs[i].position = i;
+        refs[i].trip = trip;
+    }
+    qsort(refs, trip_count, sizeof(TripRunRef), compare_trip_run_refs);
+
+    int next_id = 1;
+    Departure *tail = head;
+    for (Departure *temp = head; temp != NULL; temp = temp->next) {
+        if (temp->departure_id >= next_id) next_id = temp->departure_id + 1;
+        tail = temp;
+    }
+    Booking *booking_tail = NULL;
+    int booking_id = next_booking_id(*bookings);
+    int created = 0, booked = 0, overbooked = 0, removed = 0, conflicts = 0;
+    Departure *previous = NULL;
+
+    for (int start = 0; start < trip_count; ) {
+        int end = start + 1;
+        while (end < trip_count && refs[end].departure == refs[start].departure &&
+               refs[end].license_plate == refs[start].license_plate &&
+               strcmp(refs[end].trip->departure_city, refs[start].trip->departure_city) == 0 &&
+               strcmp(refs[end].trip->arrival_city, refs[start].trip->arrival_city) == 0) {
+            end++;
+        }
+
+        Trip *first = refs[start].trip;
+        Departure *departure = departure_lookup_find(&existing, first->license_plate, refs[start].departure);
+        int reused = departure != NULL;
+        if (departure == NULL && previous != NULL && previous->license_plate == first->license_plate &&
+            datetime_to_minutes(previous->departure_time) == refs[start].departure) {
+            departure = previous;
+        }
+        // A bus cannot serve two routes at once; leave such rows alone
+        if (departure != NULL && (strcmp(departure->departure_city, first->departure_city) != 0 ||
+                                  strcmp(departure->arrival_city, first->arrival_city) != 0)) {
+            conflicts += end - start;
+            start = end;
+            continue;
+        }
+
+        if (departure == NULL) {
+            Bus *bus = buses;
+            while (bus != NULL && bus->license_plate != first->license_plate) {
+                bus = bus->next;
+            }
+            int seat_count = bus != NULL ? bus->seat_count : end - start;
+            if (seat_count < end - start) seat_count = end - start;
+
+            departure = create_departure(next_id, first->license_plate, seat_count);
+            if (departure == NULL) {
+                printf("Memory allocation error. Remaining trips were not converted.\n");
+                break;
+            }
+            departure->departure_time = first->departure_time;
+            departure->arrival_time = first->arrival_time;
+            strcpy(departure->departure_city, first->departure_city);
+            strcpy(departure->arrival_city, first->arrival_city);
+            if (tail == NULL) {
+                head = departure;
+            } else {
+                tail->next = departure;
+            }
+            tail = departure;
+            next_id++;
+            created++;
+        }
+        previous = departure;
+
+        int kept = 0;
+        for (int k = start; k < end; k++) {
+            int client_id = refs[k].trip->client_id;
+            if (reused && client_has_booking(*bookings, departure->departure_id, client_id)) {
+                drop[refs[k].position] = 1;
+                continue;
+            }
+            int seat_number = allocate_first_fit_seat(departure);
+            if (seat_number == 0) {
+                overbooked++;
+                kept++;
+                continue;
+            }
+            Booking *before = booking_tail;
+            *bookings = append_booking(*bookings, &booking_tail, booking_id, departure->departure_id, client_id, seat_number);
+            if (booking_tail == before) {
+                release_seat(departure, seat_number);
+                kept++;
+                continue;
+            }
+            booking_id++;
+            booked++;
+            drop[refs[k].position] = 1;
+        }
+        // The run keeps one trip row
+        if (kept == 0) drop[refs[start].position] = 0;
+        start = end;
+    }
+    departure_lookup_free(&existing);
+    free(refs);
+
+    Trip *prev = NULL;
+    Trip *trip = *trips;
+    for (i = 0; trip != NULL; i++) {
+        Trip *next = trip->next;
+        if (drop[i]) {
+            if (prev == NULL) {
+                *trips = next;
+            } else {
+                prev->next = next;
+            }
+            trip_indexes_remove(trip);
+            free(trip);
+            removed++;
+        } else {
+            prev = trip;
+        }
+        trip = next;
+    }
+    free(drop);
+
+    printf("%d departures created, %d passengers booked, %d of %d trip rows removed.\n",
+           created, booked, removed, trip_count);
+    if (overbooked > 0) {
+        printf("%d passengers did not fit the bus and keep their trip rows.\n", overbooked);
+    }
+    if (conflicts > 0) {
+        printf("%d trip rows were left alone: their bus already runs another route at that time.\n", conflicts);
+    }
+    return head;
+}
+
+void save_departures_to_file(Departure *head) {
+    FILE *file = fopen(DEPARTURE_FILENAME, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    Departure *temp = head;
+    while (temp != NULL) {
+        fprintf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n%s\n%s\n%d\n",
+                temp->departure_id,
+                temp->license_plate,
+                temp->departure_time.day, temp->departure_time.month, temp->departure_time.year,
+                temp->departure_time.hour, temp->departure_time.minute,
+                temp->arrival_time.day, temp->arrival_time.month, temp->arrival_time.year,
+                temp->arrival_time.hour, temp->arrival_time.minute,
+                temp->departure_city,
+                temp->arrival_city,
+                temp->seat_count);
+        temp = temp->next;
+    }
+
+    fclose(file);
+}
+
+Departure* load_departures_from_file(Departure *head) {
+    FILE *file = fopen(DEPARTURE_FILENAME, "r");
+    if (file == NULL) {
+        return head;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
+        return head;
+    }
+    rewind(file);
+
+    free_departure_list(head);
+    head = NULL;
+    Departure *tail = NULL;
+
+    int departure_id, license_plate, seat_count;
+    DateTime dep, arr;
+    char departure_city[MAX_STRING_LENGTH], arrival_city[MAX_STRING_LENGTH];
+    while (fscanf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n%99s\n%99s\n%d\n",
+                  &departure_id, &license_plate,
+                  &dep.day, &dep.month, &dep.year, &dep.hour, &dep.minute,
+                  &arr.day, &arr.month, &arr.year, &arr.hour, &arr.minute,
+                  departure_city, arrival_city, &seat_count) == 15) {
+        Departure *new_departure = create_departure(departure_id, license_plate, seat_count);
+        if (new_departure == NULL) {
+            fclose(file);
+            return head;
+        }
+        new_departure->departure_time = dep;
+        new_departure->arrival_time = arr;
+        strcpy(new_departure->departure_city, departure_city);
+        strcpy(new_departure->arrival_city, arrival_city);
+
+        if (head == NULL) {
+            head = new_departure;
+        } else {
+            tail->next = new_departure;
+        }
+        tail = new_departure;
+    }
+
+    fclose(file);
+    return head;
+}
+
+void free_departure_list(Departure *head) {
+    Departure *temp;
+    while (head != NULL) {
+        temp = head;
+        head = head->next;
+        free(temp->seat_map);
+        free(temp);
+    }
+}
+
+void save_bookings_to_file(Booking *head) {
+    FILE *file = fopen(BOOKING_FILENAME, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    Booking *temp = head;
+    while (temp != NULL) {
+        fprintf(file, "%d\n%d\n%d\n%d\n",
+                temp->booking_id,
+                temp->departure_id,
+                temp->client_id,
+                temp->seat_number);
+        temp = temp->next;
+    }
+
+    fclose(file);
+}
+
+// Seat maps are not stored; they are rebuilt here from the bookings
+Booking* load_bookings_from_file(Booking *head, Departure *departures) {
+    FILE *file = fopen(BOOKING_FILENAME, "r");
+    if (file == NULL) {
+        return head;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
+        return head;
+    }
+    rewind(file);
+
+    free_booking_list(head);
+    head = NULL;
+    Booking *tail = NULL;
+
+    for (Departure *departure = departures; departure != NULL; departure = departure->next) {
+        int words = seat_map_words(departure->seat_count);
+        for (int w = 0; w < words; w++) departure->seat_map[w] = 0;
+        if (departure->seat_count % SEAT_WORD_BITS != 0) {
+            departure->seat_map[words - 1] = ~(SeatWord)0 << (departure->seat_count % SEAT_WORD_BITS);
+        }
+        departure->seats_taken = 0;
+    }
+
+    int booking_id, departure_id, client_id, seat_number;
+    Departure *departure = NULL;
+    while (fscanf(file, "%d\n%d\n%d\n%d\n", &booking_id, &departure_id, &client_id, &seat_number) == 4) {
+        if (departure == NULL || departure->departure_id != departure_id) {
+            departure = find_departure(departures, departure_id);
+        }
+        // Bookings for unknown departures or double-booked seats are dropped
+        if (departure == NULL || !reserve_seat(departure, seat_number)) continue;
+        head = append_booking(head, &tail, booking_id, departure_id, client_id, seat_number);
+    }
+
+    fclose(file);
+    return head;
+}
+
+void free_booking_list(Booking *head) {
+    Booking *temp;
+    while (head != NULL) {
+        temp = head;
+        head = head->next;
+        free(temp);
+    }
+}
+
+// Crew rostering functions
+static EmployeeShifts *crew_index = NULL;
+static int crew_index_count = 0;
+static int crew_index_capacity = 0;
+
+static EmployeeShifts* crew_shifts_for(int employee_id, int create) {
+    int lo = 0, hi = crew_index_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (crew_index[mid].employee_id < employee_id) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < crew_index_count && crew_index[lo].employee_id == employee_id) return &crew_index[lo];
+    if (!create) return NULL;
+
+    if (crew_index_count == crew_index_capacity) {
+        int new_capacity = crew_index_capacity ? crew_index_capacity * 2 : 16;
+        EmployeeShifts *grown = (EmployeeShifts*)realloc(crew_index, new_capacity * sizeof(EmployeeShifts));
+        if (grown == NULL) return NULL;
+        crew_index = grown;
+        crew_index_capacity = new_capacity;
+    }
+    memmove(&crew_index[lo + 1], &crew_index[lo], (crew_index_count - lo) * sizeof(EmployeeShifts));
+    memset(&crew_index[lo], 0, sizeof(EmployeeShifts));
+    crew_index[lo].employee_id = employee_id;
+    crew_index_count++;
+    return &crew_index[lo];
+}
+
+static int shift_lower_bound(const EmployeeShifts *shifts, long start) {
+    int lo = 0, hi = shifts->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (shifts->starts[mid] < start) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static void crew_index_add(int employee_id, long start, long end) {
+    EmployeeShifts *shifts = crew_shifts_for(employee_id, 1);
+    if (shifts == NULL) return;
+
+    if (shifts->count == shifts->capacity) {
+        int new_capacity = shifts->capacity ? shifts->capacity * 2 : 8;
+        long *starts = (long*)realloc(shifts->starts, new_capacity * sizeof(long));
+        if (starts == NULL) return;
+        shifts->starts = starts;
+        long *ends = (long*)realloc(shifts->ends, new_capacity * sizeof(long));
+        if (ends == NULL) return;
+        shifts->ends = ends;
+        shifts->capacity = new_capacity;
+    }
+    int pos = shift_lower_bound(shifts, start);
+    memmove(&shifts->starts[pos + 1], &shifts->starts[pos], (shifts->count - pos) * sizeof(long));
+    memmove(&shifts->ends[pos + 1], &shifts->ends[pos], (shifts->count - pos) * sizeof(long));
+    shifts->starts[pos] = start;
+    shifts->ends[pos] = end;
+    shifts->count++;
+}
+
+static void crew_index_remove(int employee_id, long start) {
+    EmployeeShifts *shifts = crew_shifts_for(employee_id, 0);
+    if (shifts == NULL) return;
+    int pos = shift_lower_bound(shifts, start);
+    if (pos < shifts->count && shifts->starts[pos] == start) {
+        memmove(&shifts->starts[pos], &shifts->starts[pos + 1], (shifts->count - pos - 1) * sizeof(long));
+        memmove(&shifts->ends[pos], &shifts->ends[pos + 1], (shifts->count - pos - 1) * sizeof(long));
+        shifts->count--;
+    }
+}
+
+void crew_index_clear(void) {
+    for (int i = 0; i < crew_index_count; i++) {
+        free(crew_index[i].starts);
+        free(crew_index[i].ends);
+    }
+    free(crew_index);
+    crew_index = NULL;
+    crew_index_count = 0;
+    crew_index_capacity = 0;
+}
+
+void crew_index_rebuild(CrewAssignment *head) {
+    crew_index_clear();
+    for (CrewAssignment *temp = head; temp != NULL; temp = temp->next) {
+        crew_index_add(temp->employee_id,
+                       datetime_to_minutes(temp->departure_time),
+                       datetime_to_minutes(temp->arrival_time));
+    }
+}
+
+// Checks a new shift against the employee's existing ones: neighbours must
+// be at least rest_minutes away and the day's total must stay within
+// CREW_MAX_DAILY_MINUTES. Returns 0 if allowed, 1 for an overlap or short
+// rest, 2 when the daily limit would be exceeded.
+int crew_shift_conflict(int employee_id, long start, long end, int rest_minutes) {
+    EmployeeShifts *shifts = crew_shifts_for(employee_id, 0);
+    if (shifts == NULL || shifts->count == 0) {
+        return end - start > CREW_MAX_DAILY_MINUTES ? 2 : 0;
+    }
+
+    int pos = shift_lower_bound(shifts, start);
+    if (pos > 0 && shifts->ends[pos - 1] + rest_minutes > start) return 1;
+    if (pos < shifts->count && shifts->starts[pos] < end + rest_minutes) return 1;
+
+    long day_start = (start >= 0 ? start / 1440 : (start - 1439) / 1440) * 1440L;
+    long worked = end - start;
+    for (int i = shift_lower_bound(shifts, day_start); i < shifts->count && shifts->starts[i] < day_start + 1440; i++) {
+        worked += shifts->ends[i] - shifts->starts[i];
+    }
+    return worked > CREW_MAX_DAILY_MINUTES ? 2 : 0;
+}
+
+static CrewAssignment* append_crew_assignment(CrewAssignment *head, CrewAssignment **tail, int employee_id, const Trip *run) {
+    CrewAssignment *assignment = (CrewAssignment*)malloc(sizeof(CrewAssignment));
+    if (assignment == NULL) return head;
+    assignment->employee_id = employee_id;
+    assignment->license_plate = run->license_plate;
+    assignment->departure_time = run->departure_time;
+    assignment->arrival_time = run->arrival_time;
+    strcpy(assignment->departure_city, run->departure_city);
+    strcpy(assignment->arrival_city, run->arrival_city);
+    assignment->next = NULL;
+    crew_index_add(employee_id, datetime_to_minutes(run->departure_time), datetime_to_minutes(run->arrival_time));
+
+    if (*tail == NULL) {
+        *tail = head;
+        while (*tail != NULL && (*tail)->next != NULL) {
+            *tail = (*tail)->next;
+        }
+    }
+    if (*tail == NULL) {
+        head = assignment;
+    } else {
+        (*tail)->next = assignment;
+    }
+    *tail = assignment;
+    return head;
+}
+
+CrewAssignment* assign_crew_to_trip(CrewAssignment *head, Employee *employees, Function *functions, Trip *trips) {
+    if (!has_employees(employees) || trips == NULL) {
+        printf("  Employees and trips are both needed to build a roster.\n");
+        printf("Please add employees under 'Employee Management' and trips under 'Trip Management'.\n");
+        return head;
+    }
+
+    print_header("ASSIGN CREW TO TRIP");
+
+    printf("Enter employee ID: ");
+    int employee_id = safe_int_input();
+    Employee employee;
+    if (!find_employee(employees, employee_id, &employee)) {
+        printf("Employee with ID %d not found.\n", employee_id);
+        return head;
+    }
+    for (Function *func = functions; func != NULL; func = func->next) {
+        if (func->function_id == employee.function_id) {
+            printf("Employee %s %s (%s)\n", employee.first_name, employee.last_name, func->function_name);
+            break;
+        }
+    }
+
+    printf("Enter bus license plate of the trip: ");
+    int license_plate = safe_int_input();
+    DateTime departure;
+    input_datetime("Trip departure date and time:", &departure);
+    long start = datetime_to_minutes(departure);
+
+    Trip *run = trips;
+    while (run != NULL && (run->license_plate != license_plate || datetime_to_minutes(run->departure_time) != start)) {
+        run = run->next;
+    }
+    if (run == NULL) {
+        printf("No trip of bus %d leaves at that time.\n", license_plate);
+        return head;
+    }
+
+    for (CrewAssignment *temp = head; temp != NULL; temp = temp->next) {
+        if (temp->employee_id == employee_id && temp->license_plate == license_plate &&
+            datetime_to_minutes(temp->departure_time) == start) {
+            printf("Employee %d is already assigned to this trip.\n", employee_id);
+            return head;
+        }
+    }
+
+    long end = datetime_to_minutes(run->arrival_time);
+    int conflict = crew_shift_conflict(employee_id, start, end, CREW_MIN_REST_MINUTES);
+    if (conflict == 1) {
+        printf("Conflict: employee %d has another shift within %d minutes of this trip.\n", employee_id, CREW_MIN_REST_MINUTES);
+        return head;
+    }
+    if (conflict == 2) {
+        printf("Conflict: employee %d would exceed %d minutes of duty that day.\n", employee_id, CREW_MAX_DAILY_MINUTES);
+        return head;
+    }
+
+    CrewAssignment *tail = NULL;
+    head = append_crew_assignment(head, &tail, employee_id, run);
+    printf("Employee %d assigned to bus %d (%s to %s).\n", employee_id, license_plate, run->departure_city, run->arrival_city);
+    return head;
+}
+
+static int compare_crew_by_employee_time(const void *a, const void *b) {
+    const CrewAssignment *x = *(CrewAssignment* const*)a;
+    const CrewAssignment *y = *(CrewAssignment* const*)b;
+    if (x->employee_id != y->employee_id) return x->employee_id < y->employee_id ? -1 : 1;
+    long dx = datetime_to_minutes(x->departure_time), dy = datetime_to_minutes(y->departure_time);
+    return (dx > dy) - (dx < dy);
+}
+
+void display_crew_roster(CrewAssignment *head, Employee *employees) {
+    if (head == NULL) {
+        printf("  No crew assignments found in the system.\n");
+        printf("Please go to 'Crew Rostering' -> 'Assign Employee to Trip' or run the roster solver.\n");
+        return;
+    }
+
+    print_header("CREW ROSTER");
+
+    int count = 0;
+    for (CrewAssignment *temp = head; temp != NULL; temp = temp->next) count++;
+    CrewAssignment **sorted = (CrewAssignment**)malloc(count * sizeof(CrewAssignment*));
+    if (sorted == NULL) {
+        printf("Memory allocation error. Cannot show roster.\n");
+        return;
+    }
+    int i = 0;
+    for (CrewAssignment *temp = head; temp != NULL; temp = temp->next) sorted[i++] = temp;
+    qsort(sorted, count, sizeof(CrewAssignment*), compare_crew_by_employee_time);
+
+    printf("Total assignments: %d\n\n", count);
+    set_console_color(2);
+    printf("%-10s %-25s %-8s %-15s %-15s %-18s %-18s\n",
+           "Employee", "Name", "Bus", "Departure", "Arrival", "Departure Time", "Arrival Time");
+    printf("%-10s %-25s %-8s %-15s %-15s %-18s %-18s\n",
+           "========", "====", "===", "=========", "=======", "==============", "============");
+    set_console_color(7);
+
+    for (i = 0; i < count; i++) {
+        CrewAssignment *temp = sorted[i];
+        char name[MAX_STRING_LENGTH * 2 + 2] = "Unknown";
+        Employee employee;
+        if (find_employee(employees, temp->employee_id, &employee)) {
+            snprintf(name, sizeof(name), "%s %s", employee.first_name, employee.last_name);
+        }
+        printf("%-10d %-25.25s %-8d %-15s %-15s %02d/%02d/%d %02d:%02d   %02d/%02d/%d %02d:%02d\n",
+               temp->employee_id,
+               name,
+               temp->license_plate,
+               temp->departure_city,
+               temp->arrival_city,
+               temp->departure_time.day, temp->departure_time.month, temp->departure_time.year,
+               temp->departure_time.hour, temp->departure_time.minute,
+               temp->arrival_time.day, temp->arrival_time.month, temp->arrival_time.year,
+               temp->arrival_time.hour, temp->arrival_time.minute);
+    }
+    free(sorted);
+}
+
+CrewAssignment* remove_crew_assignment(CrewAssignment *head) {
+    if (head == NULL) {
+        printf("  No crew assignments found in the system.\n");
+        return head;
+    }
+
+    print_header("REMOVE CREW ASSIGNMENT");
+
+    printf("Enter employee ID: ");
+    int employee_id = safe_int_input();
+    printf("Enter bus license plate of the trip: ");
+    int license_plate = safe_int_input();
+    DateTime departure;
+    input_datetime("Trip departure date and time:", &departure);
+    long start = datetime_to_minutes(departure);
+
+    CrewAssignment *prev = NULL;
+    CrewAssignment *temp = head;
+    while (temp != NULL && (temp->employee_id != employee_id || temp->license_plate != license_plate ||
+                            datetime_to_minutes(temp->departure_time) != start)) {
+        prev = temp;
+        temp = temp->next;
+    }
+    if (temp == NULL) {
+        printf("Assignment not found.\n");
+        return head;
+    }
+
+    crew_index_remove(employee_id, start);
+    if (prev == NULL) {
+        head = temp->next;
+    } else {
+        prev->next = temp->next;
+    }
+    free(temp);
+    printf("Assignment removed.\n");
+    return head;
+}
+
+typedef struct CrewRun {
+    int license_plate;
+    long departure;
+    Trip *trip;
+} CrewRun;
+
+static int compare_crew_runs(const void *a, const void *b) {
+    const CrewRun *x = (const CrewRun*)a;
+    const CrewRun *y = (const CrewRun*)b;
+    if (x->departure != y->departure) return x->departure < y->departure ? -1 : 1;
+    return (x->license_plate > y->license_plate) - (x->license_plate < y->license_plate);
+}
+
+typedef struct CrewCandidate {
+    int employee_id;
+    long available;
+} CrewCandidate;
+
+static void crew_heap_push(CrewCandidate *heap, int *size, CrewCandidate item) {
+    int i = (*size)++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (heap[parent].available <= item.available) break;
+        heap[i] = heap[parent];
+        i = parent;
+    }
+    heap[i] = item;
+}
+
+static CrewCandidate crew_heap_pop(CrewCandidate *heap, int *size) {
+    CrewCandidate top = heap[0];
+    CrewCandidate last = heap[--(*size)];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= *size) break;
+        if (child + 1 < *size && heap[child + 1].available < heap[child].available) child++;
+        if (last.available <= heap[child].available) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    if (*size > 0) heap[i] = last;
+    return top;
+}
+
+typedef struct CrewCandidates {
+    CrewCandidate *items;
+    int count;
+    int capacity;
+    int function_id;
+    int failed;
+} CrewCandidates;
+
+static int crew_candidates_add(CrewCandidates *candidates, const Employee *employee) {
+    if (employee->function_id != candidates->function_id) return 0;
+    if (candidates->count == candidates->capacity) {
+        int new_capacity = candidates->capacity ? candidates->capacity * 2 : 16;
+        CrewCandidate *grown = (CrewCandidate*)realloc(candidates->items, new_capacity * sizeof(CrewCandidate));
+        if (grown == NULL) {
+            candidates->failed = 1;
+            return -1;
+        }
+        candidates->items = grown;
+        candidates->capacity = new_capacity;
+    }
+    candidates->items[candidates->count].employee_id = employee->employee_id;
+    candidates->items[candidates->count].available = LONG_MIN;
+    candidates->count++;
+    return 0;
+}
+
+static int crew_candidate_visit(int key, const void *record, void *context) {
+    Employee employee;
+    (void)key;
+    memcpy(&employee, record, offsetof(Employee, next));
+    return crew_candidates_add((CrewCandidates*)context, &employee) != 0; // stops the scan
+}
+
+// Fills every bus run departing in [from_time, to_time) that has no crew
+// member of function_id yet. Assignments in the window that no longer match
+// a trip (because the trip was changed or deleted) are dropped first, so the
+// solver can simply be re-run after edits. Employees are tried in order of
+// when they become free (min-heap); each candidate is checked against the
+// per-employee shift index. Returns the number of runs left uncovered, or -1
+// on allocation failure.
+int solve_crew_roster(CrewAssignment **head, Employee *employees, int function_id, Trip *trips,
+                      long from_time, long to_time, int rest_minutes, int *stale_removed) {
+    *stale_removed = 0;
+
+    int run_count = 0;
+    for (Trip *trip = trips; trip != NULL; trip = trip->next) {
+        long departure = datetime_to_minutes(trip->departure_time);
+        if (departure >= from_time && departure < to_time) run_count++;
+    }
+    CrewRun *runs = (CrewRun*)malloc((run_count > 0 ? run_count : 1) * sizeof(CrewRun));
+    if (runs == NULL) return -1;
+
+    int n = 0;
+    for (Trip *trip = trips; trip != NULL; trip = trip->next) {
+        long departure = datetime_to_minutes(trip->departure_time);
+        if (departure < from_time || departure >= to_time) continue;
+        runs[n].license_plate = trip->license_plate;
+        runs[n].departure = departure;
+        runs[n].trip = trip;
+        n++;
+    }
+    qsort(runs, n, sizeof(CrewRun), compare_crew_runs);
+    run_count = 0;
+    for (int i = 0; i < n; i++) {
+        if (run_count > 0 && compare_crew_runs(&runs[run_count - 1], &runs[i]) == 0) continue;
+        runs[run_count++] = runs[i];
+    }
+
+    // Drop stale assignments and mark the runs that are already covered
+    char *covered = (char*)calloc(run_count > 0 ? run_count : 1, 1);
+    if (covered == NULL) {
+        free(runs);
+        return -1;
+    }
+    CrewAssignment *prev = NULL;
+    CrewAssignment *temp = *head;
+    while (temp != NULL) {
+        CrewAssignment *next = temp->next;
+        long departure = datetime_to_minutes(temp->departure_time);
+        if (departure >= from_time && departure < to_time) {
+            CrewRun key;
+            key.license_plate = temp->license_plate;
+            key.departure = departure;
+            CrewRun *match = (CrewRun*)bsearch(&key, runs, run_count, sizeof(CrewRun), compare_crew_runs);
+            if (match == NULL || datetime_to_minutes(match->trip->arrival_time) != datetime_to_minutes(temp->arrival_time)) {
+                crew_index_remove(temp->employee_id, departure);
+                if (prev == NULL) {
+                    *head = next;
+                } else {
+                    prev->next = next;
+                }
+                free(temp);
+                (*stale_removed)++;
+                temp = next;
+                continue;
+            }
+            Employee employee;
+            if (find_employee(employees, temp->employee_id, &employee) && employee.function_id == function_id) {
+                covered[match - runs] = 1;
+            }
+        }
+        prev = temp;
+        temp = next;
+    }
+
+    // Only the employees of function_id are read, from the list or the store
+    CrewCandidates candidates = { NULL, 0, 0, function_id, 0 };
+    for (Employee *employee = employees; !candidates.failed && employee != NULL; employee = employee->next) {
+        crew_candidates_add(&candidates, employee);
+    }
+    if (!candidates.failed && employee_store.engine != NULL &&
+        store_scan(&employee_store, crew_candidate_visit, &candidates) != 0) {
+        candidates.failed = 1;
+    }
+    CrewCandidate *rejected = (CrewCandidate*)malloc((candidates.count > 0 ? candidates.count : 1) * sizeof(CrewCandidate));
+    if (candidates.failed || rejected == NULL) {
+        free(candidates.items);
+        free(rejected);
+        free(covered);
+        free(runs);
+        return -1;
+    }
+    // Everyone starts free, so the candidates already form a heap
+    CrewCandidate *heap = candidates.items;
+    int heap_size = candidates.count;
+
+    int uncovered = 0;
+    CrewAssignment *tail = NULL;
+    for (int r = 0; r < run_count; r++) {
+        if (covered[r]) continue;
+        long start = runs[r].departure;
+        long end = datetime_to_minutes(runs[r].trip->arrival_time);
+
+        int rejected_count = 0, assigned = 0;
+        while (heap_size > 0) {
+            CrewCandidate candidate = crew_heap_pop(heap, &heap_size);
+            if (candidate.available <= start &&
+                crew_shift_conflict(candidate.employee_id, start, end, rest_minutes) == 0) {
+                *head = append_crew_assignment(*head, &tail, candidate.employee_id, runs[r].trip);
+                candidate.available = end + rest_minutes;
+                crew_heap_push(heap, &heap_size, candidate);
+                assigned = 1;
+                break;
+            }
+            rejected[rejected_count++] = candidate;
+            // Everyone left in the heap is busy even longer
+            if (candidate.available > start) break;
+        }
+        for (int i = 0; i < rejected_count; i++) {
+            crew_heap_push(heap, &heap_size, rejected[i]);
+        }
+        if (!assigned) uncovered++;
+    }
+
+    free(heap);
+    free(rejected);
+    free(covered);
+    free(runs);
+    return uncovered;
+}
+
+void crew_roster_solver(CrewAssignment **head, Employee *employees, Function *functions, Trip *trips) {
+    if (!has_employees(employees) || trips == NULL) {
+        printf("  Employees and trips are both needed to build a roster.\n");
+        printf("Please add employees under 'Employee Management' and trips under 'Trip Management'.\n");
+        return;
+    }
+
+    print_header("AUTO-ROSTER WEEK");
+
+    printf("Available functions:\n");
+    for (Function *func = functions; func != NULL; func = func->next) {
+        printf("  %d. %s\n", func->function_id, func->function_name);
+    }
+    printf("Enter function ID to roster (e.g. drivers): ");
+    int function_id = safe_int_input();
+
+    PurchaseDate week;
+    input_date("First day of the week:", &week);
+    printf("Minimum rest between trips (minutes, default %d): ", CREW_MIN_REST_MINUTES);
+    int rest_minutes = safe_int_input();
+    if (rest_minutes < 0) rest_minutes = CREW_MIN_REST_MINUTES;
+
+    long from_time = days_from_civil(week.day, week.month, week.year) * 1440L;
+    int stale_removed;
+    clock_t started = clock();
+    int uncovered = solve_crew_roster(head, employees, function_id, trips, from_time, from_time + 7 * 1440L,
+                                      rest_minutes, &stale_removed);
+    double elapsed_ms = 1000.0 * (clock() - started) / CLOCKS_PER_SEC;
+
+    if (uncovered < 0) {
+        printf("Memory allocation error. Cannot build roster.\n");
+        return;
+    }
+    printf("\nRoster updated in %.2f ms.\n", elapsed_ms);
+    if (stale_removed > 0) {
+        printf("%d assignments no longer matched a trip and were removed.\n", stale_removed);
+    }
+    if (uncovered > 0) {
+        set_console_color(4);
+        printf("%d trips could not be covered with the available staff.\n", uncovered);
+        set_console_color(7);
+    } else {
+        printf("Every trip in the week has crew assigned.\n");
+    }
+}
+
+void save_crew_to_file(CrewAssignment *head) {
+    FILE *file = fopen(CREW_FILENAME, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    CrewAssignment *temp = head;
+    while (temp != NULL) {
+        fprintf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n%s\n%s\n",
+                temp->employee_id,
+                temp->license_plate,
+                temp->departure_time.day, temp->departure_time.month, temp->departure_time.year,
+                temp->departure_time.hour, temp->departure_time.minute,
+                temp->arrival_time.day, temp->arrival_time.month, temp->arrival_time.year,
+                temp->arrival_time.hour, temp->arrival_time.minute,
+                temp->departure_city,
+                temp->arrival_city);
+        temp = temp->next;
+    }
+
+    fclose(file);
+}
+
+CrewAssignment* load_crew_from_file(CrewAssignment *head) {
+    FILE *file = fopen(CREW_FILENAME, "r");
+    if (file == NULL) {
+        return head;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
+        return head;
+    }
+    rewind(file);
+
+    free_crew_list(head);
+    head = NULL;
+    CrewAssignment *tail = NULL;
+
+    Trip run;
+    int employee_id;
+    while (fscanf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n%99s\n%99s\n",
+                  &employee_id, &run.license_plate,
+                  &run.departure_time.day, &run.departure_time.month, &run.departure_time.year,
+                  &run.departure_time.hour, &run.departure_time.minute,
+                  &run.arrival_time.day, &run.arrival_time.month, &run.arrival_time.year,
+                  &run.arrival_time.hour, &run.arrival_time.minute,
+                  run.departure_city, run.arrival_city) == 14) {
+        head = append_crew_assignment(head, &tail, employee_id, &run);
+    }
+
+    fclose(file);
+    return head;
+}
+
+void free_crew_list(CrewAssignment *head) {
+    CrewAssignment *temp;
+    while (head != NULL) {
+        temp = head;
+        head = head->next;
+        free(temp);
+    }
+    crew_index_clear();
+}
+
+// Fleet simulator functions
+#define SIM_DEPART 0
+#define SIM_ARRIVE 1
+
+typedef struct SimTripKey {
+    int license_plate;
+    long departure;
+    long arrival;
+    int departure_city;
+    int arrival_city;
+} SimTripKey;
+
+static int compare_sim_trip_keys(const void *a, const void *b) {
+    const SimTripKey *x = (const SimTripKey*)a;
+    const SimTripKey *y = (const SimTripKey*)b;
+    if (x->license_plate != y->license_plate) return x->license_plate < y->license_plate ? -1 : 1;
+    if (x->departure != y->departure) return x->departure < y->departure ? -1 : 1;
+    return (x->arrival > y->arrival) - (x->arrival < y->arrival);
+}
+
+// Turns the trip rows and recurring occurrences departing in
+// [from_time, to_time) into one run per bus departure, chained per bus in
+// departure order so a late arrival can be carried into the bus's next
+// departure. Returns 0 or -1 on allocation failure.
+int build_sim_schedule(Trip *trips, TripTemplate *templates, long from_time, long to_time, SimSchedule *schedule) {
+    memset(schedule, 0, sizeof(SimSchedule));
+
+    Trip *occurrences;
+    if (expand_template_occurrences(templates, from_time, to_time, trips, &occurrences) < 0) return -1;
+    if (occurrences != NULL) trips = occurrences;
+
+    int count = 0;
+    for (Trip *trip = trips; trip != NULL; trip = trip->next) {
+        long departure = datetime_to_minutes(trip->departure_time);
+        if (departure >= from_time && departure < to_time) count++;
+    }
+    if (count == 0) return 0;
+
+    SimTripKey *keys = (SimTripKey*)malloc(count * sizeof(SimTripKey));
+    if (keys == NULL) {
+        free(occurrences);
+        return -1;
+    }
+    int n = 0;
+    for (Trip *trip = trips; trip != NULL; trip = trip->next) {
+        long departure = datetime_to_minutes(trip->departure_time);
+        if (departure < from_time || departure >= to_time) continue;
+        keys[n].license_plate = trip->license_plate;
+        keys[n].departure = departure;
+        keys[n].arrival = datetime_to_minutes(trip->arrival_time);
+        keys[n].departure_city = city_table_intern(&schedule->cities, trip->departure_city);
+        keys[n].arrival_city = city_table_intern(&schedule->cities, trip->arrival_city);
+        if (keys[n].departure_city < 0 || keys[n].arrival_city < 0) {
+            free(occurrences);
+            free(keys);
+            free_sim_schedule(schedule);
+            return -1;
+        }
+        n++;
+    }
+    free(occurrences);
+    qsort(keys, n, sizeof(SimTripKey), compare_sim_trip_keys);
+
+    schedule->runs = (SimRun*)malloc(n * sizeof(SimRun));
+    schedule->first_runs = (int*)malloc(n * sizeof(int));
+    schedule->route_keys = (long*)malloc(n * sizeof(long));
+    if (schedule->runs == NULL || schedule->first_runs == NULL || schedule->route_keys == NULL) {
+        free(keys);
+        free_sim_schedule(schedule);
+        return -1;
+    }
+
+    // Several passengers on one bus departure are a single run
+    long city_count = schedule->cities.count;
+    for (int i = 0; i < n; i++) {
+        if (schedule->run_count > 0 && compare_sim_trip_keys(&keys[i - 1], &keys[i]) == 0) continue;
+        SimRun *run = &schedule->runs[schedule->run_count];
+        run->departure = keys[i].departure;
+        run->arrival = keys[i].arrival;
+        run->license_plate = keys[i].license_plate;
+        run->next_run = -1;
+        schedule->route_keys[schedule->run_count] = keys[i].departure_city * city_count + keys[i].arrival_city;
+
+        if (schedule->run_count > 0 && schedule->runs[schedule->run_count - 1].license_plate == run->license_plate) {
+            schedule->runs[schedule->run_count - 1].next_run = schedule->run_count;
+        } else {
+            schedule->first_runs[schedule->bus_count++] = schedule->run_count;
+        }
+        schedule->run_count++;
+    }
+    free(keys);
+
+    // Number the distinct routes; route_keys keeps one sorted entry per route
+    long *route_of_run = (long*)malloc(schedule->run_count * sizeof(long));
+    if (route_of_run == NULL) {
+        free_sim_schedule(schedule);
+        return -1;
+    }
+    memcpy(route_of_run, schedule->route_keys, schedule->run_count * sizeof(long));
+    qsort(schedule->route_keys, schedule->run_count, sizeof(long), compare_longs);
+    for (int i = 0; i < schedule->run_count; i++) {
+        if (schedule->route_count > 0 && schedule->route_keys[schedule->route_count - 1] == schedule->route_keys[i]) continue;
+        schedule->route_keys[schedule->route_count++] = schedule->route_keys[i];
+    }
+    for (int i = 0; i < schedule->run_count; i++) {
+        long *route = (long*)bsearch(&route_of_run[i], schedule->route_keys, schedule->route_count,
+                                     sizeof(long), compare_longs);
+        schedule->runs[i].route = (int)(route - schedule->route_keys);
+    }
+    free(route_of_run);
+    return 0;
+}
+
+void free_sim_schedule(SimSchedule *schedule) {
+    free(schedule->runs);
+    free(schedule->first_runs);
+    free(schedule->route_keys);
+    city_table_free(&schedule->cities);
+    memset(schedule, 0, sizeof(SimSchedule));
+}
+
+// Earlier time first; arrivals before departures at the same minute so a
+// bus that arrives on time can leave again in that minute, then run index
+// so every replication replays in the same order.
+static int sim_event_before(const SimEvent *x, const SimEvent *y) {
+    if (x->time != y->time) return x->time < y->time;
+    if (x->kind != y->kind) return x->kind > y->kind;
+    return x->run < y->run;
+}
+
+static void sim_queue_push(SimEventQueue *queue, long time, int run, int kind) {
+    SimEvent event;
+    event.time = time;
+    event.run = run;
+    event.kind = kind;
+
+    int i = queue->size++;
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (!sim_event_before(&event, &queue->heap[parent])) break;
+        queue->heap[i] = queue->heap[parent];
+        i = parent;
+    }
+    queue->heap[i] = event;
+}
+
+static SimEvent sim_queue_pop(SimEventQueue *queue) {
+    SimEvent top = queue->heap[0];
+    SimEvent last = queue->heap[--queue->size];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= queue->size) break;
+        if (child + 1 < queue->size && sim_event_before(&queue->heap[child + 1], &queue->heap[child])) child++;
+        if (!sim_event_before(&queue->heap[child], &last)) break;
+        queue->heap[i] = queue->heap[child];
+        i = child;
+    }
+    if (queue->size > 0) queue->heap[i] = last;
+    return top;
+}
+
+// splitmix64: small, fast and good enough for delay sampling
+static unsigned long long sim_random(unsigned long long *state) {
+    unsigned long long z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Delay at a departure: with delay_percent chance, uniform between 1 and
+// twice the mean so the average delay stays at mean_delay.
+static long sim_departure_delay(const SimParams *params, unsigned long long *state) {
+    if (params->mean_delay <= 0 || (int)(sim_random(state) % 100) >= params->delay_percent) return 0;
+    return 1 + (long)(sim_random(state) % (unsigned long long)(2 * params->mean_delay));
+}
+
+// Replays one day/month of the schedule. A bus only leaves once it has
+// arrived from its previous run and had its turnaround, so delays carry
+// forward through the rest of its duties.
+static long long simulate_replication(const SimSchedule *schedule, const SimParams *params, unsigned long long seed,
+                                      SimEventQueue *queue, SimStats *stats) {
+    unsigned long long state = seed;
+    long long events = 0;
+
+    queue->size = 0;
+    for (int b = 0; b < schedule->bus_count; b++) {
+        int first = schedule->first_runs[b];
+        sim_queue_push(queue, schedule->runs[first].departure, first, SIM_DEPART);
+    }
+
+    while (queue->size > 0) {
+        SimEvent event = sim_queue_pop(queue);
+        const SimRun *run = &schedule->runs[event.run];
+        events++;
+
+        if (event.kind == SIM_DEPART) {
+            long departed = event.time + sim_departure_delay(params, &state);
+            sim_queue_push(queue, departed + (run->arrival - run->departure), event.run, SIM_ARRIVE);
+        } else {
+            long late = event.time - run->arrival;
+            if (late < 0) late = 0;
+            stats->delay_sum[event.run] += late;
+            if (late > stats->max_delay[event.run]) stats->max_delay[event.run] = late;
+            if (late <= params->on_time_minutes) stats->on_time[event.run]++;
+
+            if (run->next_run >= 0) {
+                long ready = event.time + params->turnaround_minutes;
+                long scheduled = schedule->runs[run->next_run].departure;
+                sim_queue_push(queue, ready > scheduled ? ready : scheduled, run->next_run, SIM_DEPART);
+            }
+        }
+    }
+    return events;
+}
+
+static int alloc_sim_stats(SimStats *stats, int run_count) {
+    stats->delay_sum = (long long*)calloc(run_count > 0 ? run_count : 1, sizeof(long long));
+    stats->max_delay = (long*)calloc(run_count > 0 ? run_count : 1, sizeof(long));
+    stats->on_time = (int*)calloc(run_count > 0 ? run_count : 1, sizeof(int));
+    stats->events = 0;
+    if (stats->delay_sum == NULL || stats->max_delay == NULL || stats->on_time == NULL) {
+        free_sim_stats(stats);
+        return -1;
+    }
+    return 0;
+}
+
+void free_sim_stats(SimStats *stats) {
+    free(stats->delay_sum);
+    free(stats->max_delay);
+    free(stats->on_time);
+    stats->delay_sum = NULL;
+    stats->max_delay = NULL;
+    stats->on_time = NULL;
+}
+
+typedef struct SimWorker {
+    const SimSchedule *schedule;
+    const SimParams *params;
+    int first_replication;
+    int stride;
+    SimStats stats;
+    int failed;
+} SimWorker;
+
+static void* sim_worker_run(void *arg) {
+    SimWorker *worker = (SimWorker*)arg;
+    SimEventQueue queue;
+    queue.capacity = worker->schedule->bus_count > 0 ? worker->schedule->bus_count : 1;
+    queue.size = 0;
+    queue.heap = (SimEvent*)malloc(queue.capacity * sizeof(SimEvent));
+    if (queue.heap == NULL) {
+        worker->failed = 1;
+        return NULL;
+    }
+
+    for (int r = worker->first_replication; r < worker->params->replications; r += worker->stride) {
+        // Each replication has its own stream, so results do not depend on the thread count
+        unsigned long long seed = worker->params->seed + (unsigned long long)r * 0xD1B54A32D192ED03ULL;
+        worker->stats.events += simulate_replication(worker->schedule, worker->params, seed, &queue, &worker->stats);
+    }
+    free(queue.heap);
+    return NULL;
+}
+
+// Runs params->replications seeded replications spread over params->threads
+// workers (sequentially where threads are not available) and merges their
+// per-run statistics into stats. Returns 0 or -1 on failure.
+int run_fleet_simulation(const SimSchedule *schedule, const SimParams *params, SimStats *stats) {
+    int threads = params->threads;
+    if (threads < 1) threads = 1;
+    if (threads > params->replications) threads = params->replications > 0 ? params->replications : 1;
+#ifdef _WIN32
+    threads = 1;
+#endif
+
+    if (alloc_sim_stats(stats, schedule->run_count) != 0) return -1;
+    SimWorker *workers = (SimWorker*)calloc(threads, sizeof(SimWorker));
+    if (workers == NULL) {
+        free_sim_stats(stats);
+        return -1;
+    }
+
+    int failed = 0;
+    for (int t = 0; t < threads; t++) {
+        workers[t].schedule = schedule;
+        workers[t].params = params;
+        workers[t].first_replication = t;
+        workers[t].stride = threads;
+        if (alloc_sim_stats(&workers[t].stats, schedule->run_count) != 0) failed = 1;
+    }
+
+    if (!failed) {
+#ifdef _WIN32
+        sim_worker_run(&workers[0]);
+#else
+        pthread_t *handles = (pthread_t*)malloc(threads * sizeof(pthread_t));
+        int *started = (int*)calloc(threads, sizeof(int));
+        if (handles == NULL || started == NULL) {
+            failed = 1;
+        } else {
+            for (int t = 1; t < threads; t++) {
+                started[t] = pthread_create(&handles[t], NULL, sim_worker_run, &workers[t]) == 0;
+            }
+            sim_worker_run(&workers[0]);
+            for (int t = 1; t < threads; t++) {
+                if (started[t]) {
+                    pthread_join(handles[t], NULL);
+                } else {
+                    sim_worker_run(&workers[t]);
+                }
+            }
+        }
+        free(handles);
+        free(started);
+#endif
+    }
+
+    for (int t = 0; t < threads; t++) {
+        if (workers[t].failed) failed = 1;
+        if (!failed) {
+            for (int i = 0; i < schedule->run_count; i++) {
+                stats->delay_sum[i] += workers[t].stats.delay_sum[i];
+                stats->on_time[i] += workers[t].stats.on_time[i];
+                if (workers[t].stats.max_delay[i] > stats->max_delay[i]) stats->max_delay[i] = workers[t].stats.max_delay[i];
+            }
+            stats->events += workers[t].stats.events;
+        }
+        free_sim_stats(&workers[t].stats);
+    }
+    free(workers);
+
+    if (failed) {
+        free_sim_stats(stats);
+        return -1;
+    }
+    return 0;
+}
+
+static int available_cores(void) {
+#if !defined(_WIN32) && defined(_SC_NPROCESSORS_ONLN)
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    return cores > 0 ? (int)cores : 1;
+#else
+    return 1;
+#endif
+}
+
+static void print_sim_row(const char *label, int runs, long long delay_sum, long max_delay, int on_time, int replications) {
+    long long samples = (long long)runs * replications;
+    printf("%-32.32s %-6d %-12.1f %-10ld %6.1f%%\n",
+           label, runs,
+           samples > 0 ? (double)delay_sum / samples : 0.0,
+           max_delay,
+           samples > 0 ? 100.0 * on_time / samples : 0.0);
+}
+
+void fleet_delay_simulator(Trip *trips, TripTemplate *templates) {
+    if (trips == NULL && templates == NULL) {
+        printf("  No trips found in the system.\n");
+        printf("You need to schedule trips before running a simulation.\n");
+        printf("Please go to 'Trip Management' -> 'Add Trip' first.\n");
+        return;
+    }
+
+    print_header("FLEET DELAY SIMULATION");
+
+    PurchaseDate first_day;
+    input_date("First day to simulate:", &first_day);
+    printf("Number of days (1 for a day, 30 for a month): ");
+    int days = safe_int_input();
+    if (days < 1) days = 1;
+
+    SimParams params;
+    printf("Chance of a delayed departure (%%): ");
+    params.delay_percent = safe_int_input();
+    if (params.delay_percent < 0) params.delay_percent = 0;
+    if (params.delay_percent > 100) params.delay_percent = 100;
+    printf("Mean delay when delayed (minutes): ");
+    params.mean_delay = safe_int_input();
+    printf("Minimum turnaround between runs (minutes): ");
+    params.turnaround_minutes = safe_int_input();
+    if (params.turnaround_minutes < 0) params.turnaround_minutes = 0;
+    printf("On-time tolerance (minutes): ");
+    params.on_time_minutes = safe_int_input();
+    if (params.on_time_minutes < 0) params.on_time_minutes = 0;
+    printf("Number of replications: ");
+    params.replications = safe_int_input();
+    if (params.replications < 1) params.replications = 1;
+    printf("Random seed: ");
+    params.seed = (unsigned long long)safe_int_input();
+    params.threads = available_cores();
+
+    long from_time = days_from_civil(first_day.day, first_day.month, first_day.year) * 1440L;
+    SimSchedule schedule;
+    if (build_sim_schedule(trips, templates, from_time, from_time + days * 1440L, &schedule) != 0) {
+        printf("Memory allocation error. Cannot run simulation.\n");
+        return;
+    }
+    if (schedule.run_count == 0) {
+        printf("\nNo trips depart in the selected period.\n");
+        free_sim_schedule(&schedule);
+        return;
+    }
+
+    SimStats stats;
+    clock_t started = clock();
+    if (run_fleet_simulation(&schedule, &params, &stats) != 0) {
+        printf("Memory allocation error. Cannot run simulation.\n");
+        free_sim_schedule(&schedule);
+        return;
+    }
+    double cpu_ms = 1000.0 * (clock() - started) / CLOCKS_PER_SEC;
+
+    printf("\n%d runs by %d buses, %d replications on %d threads: %lld events",
+           schedule.run_count, schedule.bus_count, params.replications, params.threads, stats.events);
+    if (cpu_ms > 0) {
+        printf(" (%.1f million events per CPU second)", stats.events / cpu_ms / 1000.0);
+    }
+    printf("\nCPU time %.2f ms\n", cpu_ms);
+
+    // Per-route and per-bus totals from the per-run statistics
+    int groups = schedule.route_count > schedule.bus_count ? schedule.route_count : schedule.bus_count;
+    long long *delay_sum = (long long*)malloc(groups * sizeof(long long));
+    long *max_delay = (long*)malloc(groups * sizeof(long));
+    int *on_time = (int*)malloc(groups * sizeof(int));
+    int *runs = (int*)malloc(groups * sizeof(int));
+    if (delay_sum == NULL || max_delay == NULL || on_time == NULL || runs == NULL) {
+        printf("Memory allocation error. Cannot show results.\n");
+    } else {
+        memset(delay_sum, 0, groups * sizeof(long long));
+        memset(max_delay, 0, groups * sizeof(long));
+        memset(on_time, 0, groups * sizeof(int));
+        memset(runs, 0, groups * sizeof(int));
+        for (int i = 0; i < schedule.run_count; i++) {
+            int route = schedule.runs[i].route;
+            runs[route]++;
+            delay_sum[route] += stats.delay_sum[i];
+            on_time[route] += stats.on_time[i];
+            if (stats.max_delay[i] > max_delay[route]) max_delay[route] = stats.max_delay[i];
+        }
+
+        printf("\n");
+        set_console_color(2);
+        printf("%-32s %-6s %-12s %-10s %7s\n", "Route", "Runs", "Avg Delay", "Max Delay", "On Time");
+        printf("%-32s %-6s %-12s %-10s %7s\n", "=====", "====", "=========", "=========", "=======");
+        set_console_color(7);
+        long city_count = schedule.cities.count;
+        for (int r = 0; r < schedule.route_count; r++) {
+            char label[2 * MAX_STRING_LENGTH + 8];
+            snprintf(label, sizeof(label), "%s -> %s",
+                     schedule.cities.names[schedule.route_keys[r] / city_count],
+                     schedule.cities.names[schedule.route_keys[r] % city_count]);
+            print_sim_row(label, runs[r], delay_sum[r], max_delay[r], on_time[r], params.replications);
+        }
+
+        memset(delay_sum, 0, groups * sizeof(long long));
+        memset(max_delay, 0, groups * sizeof(long));
+        memset(on_time, 0, groups * sizeof(int));
+        memset(runs, 0, groups * sizeof(int));
+        printf("\n");
+        set_console_color(2);
+        printf("%-32s %-6s %-12s %-10s %7s\n", "Bus", "Runs", "Avg Delay", "Max Delay", "On Time");
+        printf("%-32s %-6s %-12s %-10s %7s\n", "===", "====", "=========", "=========", "=======");
+        set_console_color(7);
+        for (int b = 0; b < schedule.bus_count; b++) {
+            for (int i = schedule.first_runs[b]; i >= 0; i = schedule.runs[i].next_run) {
+                runs[b]++;
+                delay_sum[b] += stats.delay_sum[i];
+                on_time[b] += stats.on_time[i];
+                if (stats.max_delay[i] > max_delay[b]) max_delay[b] = stats.max_delay[i];
+            }
+            char label[32];
+            snprintf(label, sizeof(label), "%d", schedule.runs[schedule.first_runs[b]].license_plate);
+            print_sim_row(label, runs[b], delay_sum[b], max_delay[b], on_time[b], params.replications);
+        }
+    }
+
+    free(delay_sum);
+    free(max_delay);
+    free(on_time);
+    free(runs);
+    free_sim_stats(&stats);
+    free_sim_schedule(&schedule);
+}
+
+// Maintenance planner functions
+static BusUsage *bus_usage = NULL;
+static int bus_usage_count = 0;
+static int bus_usage_capacity = 0;
+
+static BusBlocks *bus_blocks = NULL;
+static int bus_blocks_count = 0;
+static int bus_blocks_capacity = 0;
+
+static BusUsage* bus_usage_for(int license_plate, int create) {
+    int lo = 0, hi = bus_usage_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (bus_usage[mid].license_plate < license_plate) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < bus_usage_count && bus_usage[lo].license_plate == license_plate) return &bus_usage[lo];
+    if (!create) return NULL;
+
+    if (bus_usage_count == bus_usage_capacity) {
+        int new_capacity = bus_usage_capacity ? bus_usage_capacity * 2 : 16;
+        BusUsage *grown = (BusUsage*)realloc(bus_usage, new_capacity * sizeof(BusUsage));
+        if (grown == NULL) return NULL;
+        bus_usage = grown;
+        bus_usage_capacity = new_capacity;
+    }
+    memmove(&bus_usage[lo + 1], &bus_usage[lo], (bus_usage_count - lo) * sizeof(BusUsage));
+    memset(&bus_usage[lo], 0, sizeof(BusUsage));
+    bus_usage[lo].license_plate = license_plate;
+    bus_usage_count++;
+    return &bus_usage[lo];
+}
+
+const BusUsage* bus_usage_find(int license_plate) {
+    return bus_usage_for(license_plate, 0);
+}
+
+static int bus_run_lower_bound(const BusUsage *usage, long departure) {
+    int lo = 0, hi = usage->run_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (usage->runs[mid].departure < departure) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// Passenger trips on the same bus departure share one run, so service
+// hours are only counted once per run.
+void bus_usage_add(const Trip *trip) {
+    BusUsage *usage = bus_usage_for(trip->license_plate, 1);
+    if (usage == NULL) return;
+
+    long departure = datetime_to_minutes(trip->departure_time);
+    long arrival = datetime_to_minutes(trip->arrival_time);
+    int pos = bus_run_lower_bound(usage, departure);
+    usage->trip_count++;
+    if (pos < usage->run_count && usage->runs[pos].departure == departure) {
+        usage->runs[pos].trips++;
+        return;
+    }
+
+    if (usage->run_count == usage->run_capacity) {
+        int new_capacity = usage->run_capacity ? usage->run_capacity * 2 : 8;
+        BusRunUsage *grown = (BusRunUsage*)realloc(usage->runs, new_capacity * sizeof(BusRunUsage));
+        if (grown == NULL) {
+            usage->trip_count--;
+            return;
+        }
+        usage->runs = grown;
+        usage->run_capacity = new_capacity;
+    }
+    memmove(&usage->runs[pos + 1], &usage->runs[pos], (usage->run_count - pos) * sizeof(BusRunUsage));
+    usage->runs[pos].departure = departure;
+    usage->runs[pos].arrival = arrival;
+    usage->runs[pos].trips = 1;
+    usage->run_count++;
+    if (arrival > departure) usage->service_minutes += arrival - departure;
+}
+
+// Bulk form of bus_usage_add for updates sorted by plate and departure:
+// each bus's new runs are merged into its run array in one pass instead of
+// one sorted insert per trip
+void bus_usage_add_sorted(const TripIndexUpdate *updates, int count) {
+    int i = 0;
+    while (i < count) {
+        int end = i + 1;
+        while (end < count && updates[end].key == updates[i].key) end++;
+
+        BusUsage *usage = bus_usage_for(updates[i].key, 1);
+        BusRunUsage *merged = usage == NULL ? NULL :
+            (BusRunUsage*)malloc((usage->run_count + (end - i)) * sizeof(BusRunUsage));
+        if (merged == NULL) {
+            for (; i < end; i++) bus_usage_add(updates[i].trip);
+            continue;
+        }
+
+        int old = 0, written = 0;
+        while (old < usage->run_count || i < end) {
+            if (i == end || (old < usage->run_count && usage->runs[old].departure <= updates[i].departure)) {
+                merged[written++] = usage->runs[old++];
+                continue;
+            }
+            usage->trip_count++;
+            if (written > 0 && merged[written - 1].departure == updates[i].departure) {
+                merged[written - 1].trips++;
+            } else {
+                merged[written].departure = updates[i].departure;
+                merged[written].arrival = updates[i].arrival;
+                merged[written].trips = 1;
+                if (updates[i].arrival > updates[i].departure) {
+                    usage->service_minutes += updates[i].arrival - updates[i].departure;
+                }
+                written++;
+            }
+            i++;
+        }
+        free(usage->runs);
+        usage->runs = merged;
+        usage->run_count = written;
+        usage->run_capacity = written;
+    }
+}
+
+void bus_usage_remove(const Trip *trip) {
+    BusUsage *usage = bus_usage_for(trip->license_plate, 0);
+    if (usage == NULL) return;
+
+    long departure = datetime_to_minutes(trip->departure_time);
+    int pos = bus_run_lower_bound(usage, departure);
+    if (pos == usage->run_count || usage->runs[pos].departure != departure) return;
+
+    usage->trip_count--;
+    if (--usage->runs[pos].trips > 0) return;
+
+    BusRunUsage *run = &usage->runs[pos];
+    if (run->arrival > run->departure) usage->service_minutes -= run->arrival - run->departure;
+    memmove(&usage->runs[pos], &usage->runs[pos + 1], (usage->run_count - pos - 1) * sizeof(BusRunUsage));
+    usage->run_count--;
+}
+
+void bus_usage_clear(void) {
+    for (int i = 0; i < bus_usage_count; i++) {
+        free(bus_usage[i].runs);
+    }
+    free(bus_usage);
+    bus_usage = NULL;
+    bus_usage_count = 0;
+    bus_usage_capacity = 0;
+}
+
+static BusBlocks* bus_blocks_for(int license_plate, int create) {
+    int lo = 0, hi = bus_blocks_count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (bus_blocks[mid].license_plate < license_plate) lo = mid + 1;
+        else hi = mid;
+    }
+    if (lo < bus_blocks_count && bus_blocks[lo].license_plate == license_plate) return &bus_blocks[lo];
+    if (!create) return NULL;
+
+    if (bus_blocks_count == bus_blocks_capacity) {
+        int new_capacity = bus_blocks_capacity ? bus_blocks_capacity * 2 : 16;
+        BusBlocks *grown = (BusBlocks*)realloc(bus_blocks, new_capacity * sizeof(BusBlocks));
+        if (grown == NULL) return NULL;
+        bus_blocks = grown;
+        bus_blocks_capacity = new_capacity;
+    }
+    memmove(&bus_blocks[lo + 1], &bus_blocks[lo], (bus_blocks_count - lo) * sizeof(BusBlocks));
+    memset(&bus_blocks[lo], 0, sizeof(BusBlocks));
+    bus_blocks[lo].license_plate = license_plate;
+    bus_blocks_count++;
+    return &bus_blocks[lo];
+}
+
+// Blocks are kept merged, so the only candidate overlapping [start, end)
+// is the last block starting before end.
+int bus_in_maintenance(int license_plate, long start, long end) {
+    BusBlocks *blocks = bus_blocks_for(license_plate, 0);
+    if (blocks == NULL || blocks->count == 0) return 0;
+
+    int lo = 0, hi = blocks->count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (blocks->starts[mid] < end) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo > 0 && blocks->ends[lo - 1] > start;
+}
+
+void maintenance_index_clear(void) {
+    for (int i = 0; i < bus_blocks_count; i++) {
+        free(bus_blocks[i].starts);
+        free(bus_blocks[i].ends);
+    }
+    free(bus_blocks);
+    bus_blocks = NULL;
+    bus_blocks_count = 0;
+    bus_blocks_capacity = 0;
+}
+
+static int compare_maintenance_blocks(const void *a, const void *b) {
+    const MaintenanceBlock *x = *(MaintenanceBlock* const*)a;
+    const MaintenanceBlock *y = *(MaintenanceBlock* const*)b;
+    if (x->license_plate != y->license_plate) return x->license_plate < y->license_plate ? -1 : 1;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+void maintenance_index_rebuild(MaintenanceBlock *head) {
+    maintenance_index_clear();
+
+    int count = 0;
+    for (MaintenanceBlock *temp = head; temp != NULL; temp = temp->next) count++;
+    if (count == 0) return;
+    MaintenanceBlock **sorted = (MaintenanceBlock**)malloc(count * sizeof(MaintenanceBlock*));
+    if (sorted == NULL) return;
+    int i = 0;
+    for (MaintenanceBlock *temp = head; temp != NULL; temp = temp->next) sorted[i++] = temp;
+    qsort(sorted, count, sizeof(MaintenanceBlock*), compare_maintenance_blocks);
+
+    for (i = 0; i < count; i++) {
+        BusBlocks *blocks = bus_blocks_for(sorted[i]->license_plate, 1);
+        if (blocks == NULL) continue;
+        if (blocks->count > 0 && blocks->ends[blocks->count - 1] >= sorted[i]->start) {
+            if (sorted[i]->end > blocks->ends[blocks->count - 1]) blocks->ends[blocks->count - 1] = sorted[i]->end;
+            continue;
+        }
+        if (blocks->count == blocks->capacity) {
+            int new_capacity = blocks->capacity ? blocks->capacity * 2 : 4;
+            long *starts = (long*)realloc(blocks->starts, new_capacity * sizeof(long));
+            if (starts == NULL) continue;
+            blocks->starts = starts;
+            long *ends = (long*)realloc(blocks->ends, new_capacity * sizeof(long));
+            if (ends == NULL) continue;
+            blocks->ends = ends;
+            blocks->capacity = new_capacity;
+        }
+        blocks->starts[blocks->count] = sorted[i]->start;
+        blocks->ends[blocks->count] = sorted[i]->end;
+        blocks->count++;
+    }
+    free(sorted);
+}
+
+MaintenanceRule* add_maintenance_rule(MaintenanceRule *head) {
+    MaintenanceRule *new_rule = (MaintenanceRule*)malloc(sizeof(MaintenanceRule));
+    if (new_rule == NULL) {
+        printf("Memory allocation error. Cannot add new rule.\n");
+        return head;
+    }
+
+    print_header("ADD MAINTENANCE RULE");
+
+    int next_id = 1;
+    for (MaintenanceRule *temp = head; temp != NULL; temp = temp->next) {
+        if (temp->rule_id >= next_id) next_id = temp->rule_id + 1;
+    }
+    new_rule->rule_id = next_id;
+
+    printf("Description (one word, e.g. Inspection): ");
+    ui_scanf("%99s", new_rule->description);
+    printf("Every N service hours (0 to skip): ");
+    new_rule->every_hours = safe_int_input();
+    printf("Every M months since purchase (0 to skip): ");
+    new_rule->every_months = safe_int_input();
+    if (new_rule->every_hours < 0) new_rule->every_hours = 0;
+    if (new_rule->every_months < 0) new_rule->every_months = 0;
+    if (new_rule->every_hours == 0 && new_rule->every_months == 0) {
+        printf("A rule needs an hour or a month interval.\n");
+        free(new_rule);
+        return head;
+    }
+    printf("Duration of the visit (hours): ");
+    new_rule->duration_hours = safe_int_input();
+    if (new_rule->duration_hours < 1) new_rule->duration_hours = 1;
+    new_rule->next = NULL;
+
+    if (head == NULL) {
+        head = new_rule;
+    } else {
+        MaintenanceRule *temp = head;
+        while (temp->next != NULL) {
+            temp = temp->next;
+        }
+        temp->next = new_rule;
+    }
+    printf("Maintenance rule %d added.\n", new_rule->rule_id);
+    return head;
+}
+
+void display_maintenance_rules(MaintenanceRule *head) {
+    if (head == NULL) {
+        printf("  No maintenance rules found in the system.\n");
+        printf("You need to add maintenance rules before planning maintenance.\n");
+        printf("Please go to 'Maintenance Planner' -> 'Add Maintenance Rule' first.\n");
+        return;
+    }
+
+    print_header("MAINTENANCE RULES");
+
+    set_console_color(2);
+    printf("%-6s %-25s %-14s %-14s %-10s\n", "ID", "Description", "Every Hours", "Every Months", "Duration");
+    printf("%-6s %-25s %-14s %-14s %-10s\n", "==", "===========", "===========", "============", "========");
+    set_console_color(7);
+    for (MaintenanceRule *temp = head; temp != NULL; temp = temp->next) {
+        printf("%-6d %-25s %-14d %-14d %dh\n",
+               temp->rule_id, temp->description, temp->every_hours, temp->every_months, temp->duration_hours);
+    }
+}
+
+MaintenanceRule* delete_maintenance_rule(MaintenanceRule *head) {
+    if (head == NULL) {
+        printf("  No maintenance rules found in the system.\n");
+        return head;
+    }
+
+    display_maintenance_rules(head);
+    printf("\nEnter rule ID to delete: ");
+    int rule_id = safe_int_input();
+
+    MaintenanceRule *prev = NULL;
+    MaintenanceRule *temp = head;
+    while (temp != NULL && temp->rule_id != rule_id) {
+        prev = temp;
+        temp = temp->next;
+    }
+    if (temp == NULL) {
+        printf("Rule with ID %d not found.\n", rule_id);
+        return head;
+    }
+
+    char confirm;
+    printf("Delete rule %d (%s)? Planned visits stay in the schedule until the next planning run. (y/n): ",
+           temp->rule_id, temp->description);
+    ui_scanf(" %c", &confirm);
+    if (confirm != 'y' && confirm != 'Y') {
+        printf("Deletion cancelled.\n");
+        return head;
+    }
+
+    if (prev == NULL) {
+        head = temp->next;
+    } else {
+        prev->next = temp->next;
+    }
+    free(temp);
+    printf("Rule deleted.\n");
+    return head;
+}
+
+static int months_since(PurchaseDate since, long at_minutes) {
+    DateTime now = minutes_to_datetime(at_minutes);
+    int months = (now.year - since.year) * 12 + (now.month - since.month);
+    if (now.day < since.day) months--;
+    return months < 0 ? 0 : months;
+}
+
+void bus_usage_report(Bus *buses) {
+    if (buses == NULL) {
+        printf("  No buses found in the system.\n");
+        printf("You need to add buses first before viewing usage.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
+        return;
+    }
+
+    print_header("BUS USAGE");
+
+    long now = current_time_in_minutes();
+    set_console_color(2);
+    printf("%-10s %-8s %-8s %-14s %-14s %-8s %-12s\n",
+           "Bus", "Runs", "Trips", "Hours To Date", "Hours Planned", "Age", "Maintenance");
+    printf("%-10s %-8s %-8s %-14s %-14s %-8s %-12s\n",
+           "===", "====", "=====", "=============", "=============", "===", "===========");
+    set_console_color(7);
+
+    for (Bus *bus = buses; bus != NULL; bus = bus->next) {
+        const BusUsage *usage = bus_usage_find(bus->license_plate);
+        const ArchiveBusTotals *archived = trip_archive_totals(bus->license_plate);
+        int runs = 0, trip_count = 0;
+        long done = 0, planned = 0;
+        if (archived != NULL) {
+            runs = archived->run_count;
+            trip_count = archived->trip_count;
+            done = planned = archived->service_minutes;
+        }
+        if (usage != NULL) {
+            runs += usage->run_count;
+            trip_count += usage->trip_count;
+            planned += usage->service_minutes;
+            for (int i = 0; i < usage->run_count && usage->runs[i].arrival <= now; i++) {
+                done += usage->runs[i].arrival - usage->runs[i].departure;
+            }
+        }
+        BusBlocks *blocks = bus_blocks_for(bus->license_plate, 0);
+        char age[16];
+        snprintf(age, sizeof(age), "%dm", months_since(bus->purchase_date, now));
+        printf("%-10d %-8d %-8d %-14.1f %-14.1f %-8s %d blocks\n",
+               bus->license_plate,
+               runs,
+               trip_count,
+               done / 60.0,
+               planned / 60.0,
+               age,
+               blocks != NULL ? blocks->count : 0);
+    }
+}
+
+// Returns 0, or -1 if the block could not be allocated
+static int append_maintenance_block(MaintenanceBlock **head, MaintenanceBlock **tail,
+                                    int license_plate, int rule_id, long start, long end) {
+    MaintenanceBlock *block = (MaintenanceBlock*)malloc(sizeof(MaintenanceBlock));
+    if (block == NULL) return -1;
+    block->license_plate = license_plate;
+    block->rule_id = rule_id;
+    block->start = start;
+    block->end = end;
+    block->next = NULL;
+
+    if (*tail == NULL) {
+        *tail = *head;
+        while (*tail != NULL && (*tail)->next != NULL) {
+            *tail = (*tail)->next;
+        }
+    }
+    if (*tail == NULL) {
+        *head = block;
+    } else {
+        (*tail)->next = block;
+    }
+    *tail = block;
+    return 0;
+}
+
+// Counts the runs of a bus that overlap [start, end)
+static int maintenance_conflicts(const BusUsage *usage, long start, long end) {
+    if (usage == NULL) return 0;
+    int conflicts = 0;
+    int pos = bus_run_lower_bound(usage, start);
+    if (pos > 0 && usage->runs[pos - 1].arrival > start) conflicts++;
+    while (pos < usage->run_count && usage->runs[pos].departure < end) {
+        conflicts++;
+        pos++;
+    }
+    return conflicts;
+}
+
+// Replaces the planned visits starting in [from_time, to_time) with a fresh
+// plan. Usage rules fire at the arrival of the run that crosses each
+// multiple of every_hours; calendar rules fire at midnight every
+// every_months months after purchase. Only the bus's own usage runs are
+// walked, never the trip list. Returns the number of visits planned and
+// the number of runs they overlap in conflicts, or -1 on allocation
+// failure with the schedule left as it was.
+int plan_maintenance(Bus *buses, MaintenanceRule *rules, long from_time, long to_time,
+                     MaintenanceBlock **schedule, int *conflicts) {
+    *conflicts = 0;
+
+    int planned = 0;
+    MaintenanceBlock *fresh = NULL;
+    MaintenanceBlock *tail = NULL;
+    for (Bus *bus = buses; bus != NULL; bus = bus->next) {
+        const BusUsage *usage = bus_usage_find(bus->license_plate);
+        const ArchiveBusTotals *archived = trip_archive_totals(bus->license_plate);
+        for (MaintenanceRule *rule = rules; rule != NULL; rule = rule->next) {
+            long duration = rule->duration_hours * 60L;
+
+            if (rule->every_hours > 0 && usage != NULL) {
+                long interval = rule->every_hours * 60L;
+                // Hours from archived trips count before the runs still in the list
+                long served = archived != NULL ? archived->service_minutes : 0;
+                for (int i = 0; i < usage->run_count && usage->runs[i].arrival < to_time; i++) {
+                    long before = served;
+                    served += usage->runs[i].arrival - usage->runs[i].departure;
+                    if (served / interval == before / interval) continue;
+                    long start = usage->runs[i].arrival;
+                    if (start < from_time) continue;
+                    if (append_maintenance_block(&fresh, &tail, bus->license_plate, rule->rule_id,
+                                                 start, start + duration) != 0) {
+                        free_maintenance_schedule(fresh);
+                        return -1;
+                    }
+                    *conflicts += maintenance_conflicts(usage, start, start + duration);
+                    planned++;
+                }
+            }
+
+            if (rule->every_months > 0) {
+                for (int k = 1; ; k++) {
+                    int months = bus->purchase_date.month - 1 + k * rule->every_months;
+                    int year = bus->purchase_date.year + months / 12;
+                    int month = months % 12 + 1;
+                    int day = bus->purchase_date.day;
+                    if (day > get_days_in_month(month, year)) day = get_days_in_month(month, year);
+                    long start = days_from_civil(day, month, year) * 1440L;
+                    if (start >= to_time) break;
+                    if (start < from_time) continue;
+                    if (append_maintenance_block(&fresh, &tail, bus->license_plate, rule->rule_id,
+                                                 start, start + duration) != 0) {
+                        free_maintenance_schedule(fresh);
+                        return -1;
+                    }
+                    *conflicts += maintenance_conflicts(usage, start, start + duration);
+                    planned++;
+                }
+            }
+        }
+    }
+
+    MaintenanceBlock *prev = NULL;
+    MaintenanceBlock *temp = *schedule;
+    while (temp != NULL) {
+        MaintenanceBlock *next = temp->next;
+        if (temp->start >= from_time && temp->start < to_time) {
+            if (prev == NULL) {
+                *schedule = next;
+            } else {
+                prev->next = next;
+            }
+            free(temp);
+        } else {
+            prev = temp;
+        }
+        temp = next;
+    }
+    if (prev == NULL) {
+        *schedule = fresh;
+    } else {
+        prev->next = fresh;
+    }
+
+    maintenance_index_rebuild(*schedule);
+    return planned;
+}
+
+void maintenance_planner(Bus *buses, MaintenanceRule *rules, MaintenanceBlock **schedule) {
+    if (buses == NULL) {
+        printf("  No buses found in the system.\n");
+        printf("You need to add buses first before planning maintenance.\n");
+        printf("Please go to 'Bus Management' -> 'Add New Bus' to create your first bus.\n");
+        return;
+    }
+    if (rules == NULL) {
+        printf("  No maintenance rules found in the system.\n");
+        printf("You need to add maintenance rules before planning maintenance.\n");
+        printf("Please go to 'Maintenance Planner' -> 'Add Maintenance Rule' first.\n");
+        return;
+    }
+
+    print_header("PLAN MAINTENANCE");
+
+    PurchaseDate first_day;
+    input_date("Plan from:", &first_day);
+    printf("Number of days to plan: ");
+    int days = safe_int_input();
+    if (days < 1) days = 1;
+
+    long from_time = days_from_civil(first_day.day, first_day.month, first_day.year) * 1440L;
+    int conflicts;
+    int planned = plan_maintenance(buses, rules, from_time, from_time + days * 1440L, schedule, &conflicts);
+    if (planned < 0) {
+        printf("Memory allocation error. Cannot plan maintenance.\n");
+        return;
+    }
+
+    printf("\n%d maintenance visits planned; buses are blocked for new trips during each visit.\n", planned);
+    if (conflicts > 0) {
+        set_console_color(4);
+        printf("%d already scheduled runs overlap a visit and need another bus.\n", conflicts);
+        set_console_color(7);
+    }
+}
+
+void display_maintenance_schedule(MaintenanceBlock *head) {
+    if (head == NULL) {
+        printf("  No maintenance visits planned.\n");
+        printf("Please go to 'Maintenance Planner' -> 'Plan Maintenance' first.\n");
+        return;
+    }
+
+    print_header("MAINTENANCE SCHEDULE");
+
+    int count = 0;
+    for (MaintenanceBlock *temp = head; temp != NULL; temp = temp->next) count++;
+    MaintenanceBlock **sorted = (MaintenanceBlock**)malloc(count * sizeof(MaintenanceBlock*));
+    if (sorted == NULL) {
+        printf("Memory allocation error. Cannot show schedule.\n");
+        return;
+    }
+    int i = 0;
+    for (MaintenanceBlock *temp = head; temp != NULL; temp = temp->next) sorted[i++] = temp;
+    qsort(sorted, count, sizeof(MaintenanceBlock*), compare_maintenance_blocks);
+
+    set_console_color(2);
+    printf("%-10s %-8s %-18s %-18s %-10s\n", "Bus", "Rule", "Start", "End", "Conflicts");
+    printf("%-10s %-8s %-18s %-18s %-10s\n", "===", "====", "=====", "===", "=========");
+    set_console_color(7);
+    for (i = 0; i < count; i++) {
+        DateTime start = minutes_to_datetime(sorted[i]->start);
+        DateTime end = minutes_to_datetime(sorted[i]->end);
+        printf("%-10d %-8d %02d/%02d/%d %02d:%02d   %02d/%02d/%d %02d:%02d   %d\n",
+               sorted[i]->license_plate, sorted[i]->rule_id,
+               start.day, start.month, start.year, start.hour, start.minute,
+               end.day, end.month, end.year, end.hour, end.minute,
+               maintenance_conflicts(bus_usage_find(sorted[i]->license_plate), sorted[i]->start, sorted[i]->end));
+    }
+    free(sorted);
+}
+
+void save_maintenance_rules_to_file(MaintenanceRule *head) {
+    FILE *file = fopen(MAINTENANCE_RULE_FILENAME, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    for (MaintenanceRule *temp = head; temp != NULL; temp = temp->next) {
+        fprintf(file, "%d\n%s\n%d\n%d\n%d\n",
+                temp->rule_id, temp->description, temp->every_hours, temp->every_months, temp->duration_hours);
+    }
+
+    fclose(file);
+}
+
+MaintenanceRule* load_maintenance_rules_from_file(MaintenanceRule *head) {
+    FILE *file = fopen(MAINTENANCE_RULE_FILENAME, "r");
+    if (file == NULL) {
+        return head;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
+        return head;
+    }
+    rewind(file);
+
+    free_maintenance_rule_list(head);
+    head = NULL;
+    MaintenanceRule *tail = NULL;
+
+    MaintenanceRule rule;
+    while (fscanf(file, "%d\n%99s\n%d\n%d\n%d\n",
+                  &rule.rule_id, rule.description, &rule.every_hours, &rule.every_months, &rule.duration_hours) == 5) {
+        MaintenanceRule *new_rule = (MaintenanceRule*)malloc(sizeof(MaintenanceRule));
+        if (new_rule == NULL) break;
+        *new_rule = rule;
+        new_rule->next = NULL;
+        if (tail == NULL) {
+            head = new_rule;
+        } else {
+            tail->next = new_rule;
+        }
+        tail = new_rule;
+    }
+
+    fclose(file);
+    return head;
+}
+
+void free_maintenance_rule_list(MaintenanceRule *head) {
+    MaintenanceRule *temp;
+    while (head != NULL) {
+        temp = head;
+        head = head->next;
+        free(temp);
+    }
+}
+
+void save_maintenance_schedule_to_file(MaintenanceBlock *head) {
+    FILE *file = fopen(MAINTENANCE_FILENAME, "w");
+    if (file == NULL) {
+        return;
+    }
+
+    for (MaintenanceBlock *temp = head; temp != NULL; temp = temp->next) {
+        DateTime start = minutes_to_datetime(temp->start);
+        DateTime end = minutes_to_datetime(temp->end);
+        fprintf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n",
+                temp->license_plate, temp->rule_id,
+                start.day, start.month, start.year, start.hour, start.minute,
+                end.day, end.month, end.year, end.hour, end.minute);
+    }
+
+    fclose(file);
+}
+
+MaintenanceBlock* load_maintenance_schedule_from_file(MaintenanceBlock *head) {
+    FILE *file = fopen(MAINTENANCE_FILENAME, "r");
+    if (file == NULL) {
+        return head;
+    }
+
+    fseek(file, 0L, SEEK_END);
+    if (ftell(file) == 0) {
+        fclose(file);
+        return head;
+    }
+    rewind(file);
+
+    free_maintenance_schedule(head);
+    head = NULL;
+    MaintenanceBlock *tail = NULL;
+
+    int license_plate, rule_id;
+    DateTime start, end;
+    while (fscanf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n",
+                  &license_plate, &rule_id,
+                  &start.day, &start.month, &start.year, &start.hour, &start.minute,
+                  &end.day, &end.month, &end.year, &end.hour, &end.minute) == 12) {
+        if (append_maintenance_block(&head, &tail, license_plate, rule_id,
+                                     datetime_to_minutes(start), datetime_to_minutes(end)) != 0) {
+            printf("Warning: not enough memory to load the whole maintenance schedule.\n");
+            break;
+        }
+    }
+
+    fclose(file);
+    maintenance_index_rebuild(head);
+    return head;
+}
+
+void free_maintenance_schedule(MaintenanceBlock *head) {
+    MaintenanceBlock *temp;
+    while (head != NULL) {
+        temp = head;
+        head = head->next;
+        free(temp);
+    }
+    maintenance_index_clear();
+}
+
+// Autosave functions
+// A background save forks so the child writes a copy-on-write image of the
+// lists as they were at the fork while the parent keeps serving input. The
+// child reports duration and bytes back over a pipe. Without fork (Windows)
+// the autosave runs in the foreground.
+static SaveStats save_stats;
+static int autosave_interval = 0;
+static time_t autosave_last = 0;
+#ifndef _WIN32
+static pid_t autosave_child = -1;
+static int autosave_pipe = -1;
+#endif
+
+static double monotonic_ms(void) {
+#ifndef _WIN32
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+#else
+    return 1000.0 * clock() / CLOCKS_PER_SEC;
+#endif
+}
+
+// Writes the files selected in set->files; returns the bytes now on disk for them
+long save_all_data(const SaveSet *set) {
+    long bytes = 0;
+    if (set->files & SAVE_BUSES) {
+        save_buses_to_file(set->buses);
+        bytes += stored_data_size(BUS_FILENAME, BUS_SLOT_FILENAME);
+    }
+    if (set->files & SAVE_CLIENTS) {
+        save_clients_to_file(set->clients);
+        bytes += stored_data_size(CLIENT_FILENAME, CLIENT_SLOT_FILENAME);
+    }
+    if (set->files & SAVE_EMPLOYEES) {
+        save_employees_to_file(set->employees);
+        bytes += stored_data_size(EMPLOYEE_FILENAME, EMPLOYEE_SLOT_FILENAME);
+    }
+    if (set->files & SAVE_FUNCTIONS) {
+        save_functions_to_file(set->functions);
+        bytes += data_file_size(FUNCTION_FILENAME);
+    }
+    if (set->files & SAVE_TRIPS) {
+        save_trips_to_file(set->trips);
+        bytes += data_file_size(TRIP_FILENAME);
+    }
+    if (set->files & SAVE_TEMPLATES) {
+        save_templates_to_file(set->templates);
+        bytes += data_file_size(TEMPLATE_FILENAME);
+    }
+    if (set->files & SAVE_DEPARTURES) {
+        save_departures_to_file(set->departures);
+        save_bookings_to_file(set->bookings);
+        bytes += data_file_size(DEPARTURE_FILENAME) + data_file_size(BOOKING_FILENAME);
+    }
+    if (set->files & SAVE_CREW) {
+        save_crew_to_file(set->crew);
+        bytes += data_file_size(CREW_FILENAME);
+    }
+    if (set->files & SAVE_MAINTENANCE) {
+        save_maintenance_rules_to_file(set->maintenance_rules);
+        save_maintenance_schedule_to_file(set->maintenance);
+        bytes += data_file_size(MAINTENANCE_RULE_FILENAME) + data_file_size(MAINTENANCE_FILENAME);
+    }
+    return bytes;
+}
+
+// An empty set that writes only the given files; the caller fills in their lists
+SaveSet save_set_for(unsigned int files) {
+    SaveSet set;
+    memset(&set, 0, sizeof(set));
+    set.files = files;
+    return set;
+}
+
+static void record_save(const SaveReport *report, int background) {
+    if (!report->ok) {
+        save_stats.failed_saves++;
+        return;
+    }
+    if (background) save_stats.background_saves++;
+    else save_stats.foreground_saves++;
+    save_stats.last_ms = report->duration_ms;
+    save_stats.total_ms += report->duration_ms;
+    if (report->duration_ms > save_stats.max_ms) save_stats.max_ms = report->duration_ms;
+    save_stats.last_bytes = report->bytes;
+    save_stats.total_bytes += report->bytes;
+    save_stats.last_time = time(NULL);
+    save_stats.last_background = background;
+}
+
+static SaveReport timed_save(const SaveSet *set) {
+    SaveReport report;
+    double started = monotonic_ms();
+    lsm_storage_take_errors();
+    report.bytes = save_all_data(set);
+    report.duration_ms = monotonic_ms() - started;
+    report.ok = lsm_storage_take_errors() == 0;
+    return report;
+}
+
+void autosave_init(void) {
+    const char *setting = getenv("BUSFLOW_AUTOSAVE");
+    autosave_interval = setting != NULL ? atoi(setting) : DEFAULT_AUTOSAVE_SECONDS;
+    if (autosave_interval < 0) autosave_interval = 0;
+    autosave_last = time(NULL);
+}
+
+int autosave_interval_seconds(void) {
+    return autosave_interval;
+}
+
+int autosave_due(void) {
+#ifndef _WIN32
+    if (autosave_child > 0) return 0;
+#endif
+    return autosave_interval > 0 && time(NULL) - autosave_last >= autosave_interval;
+}
+
+// Starts a save of set in the background. Returns 0 if it started (or, on
+// Windows, completed) and -1 if nothing was saved.
+int autosave_start(const SaveSet *set) {
+    autosave_last = time(NULL);
+#ifndef _WIN32
+    if (autosave_child > 0) return -1;
+    int report_pipe[2];
+    if (pipe(report_pipe) != 0) return -1;
+    fflush(NULL); // nothing buffered may be written twice
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(report_pipe[0]);
+        close(report_pipe[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(report_pipe[0]);
+        SaveReport report = timed_save(set);
+        ssize_t written = write(report_pipe[1], &report, sizeof(report));
+        _exit(written == (ssize_t)sizeof(report) ? 0 : 1);
+    }
+    close(report_pipe[1]);
+    autosave_child = pid;
+    autosave_pipe = report_pipe[0];
+    return 0;
+#else
+    SaveReport report = timed_save(set);
+    record_save(&report, 1);
+    return 0;
+#endif
+}
+
+#ifndef _WIN32
+static int autosave_collect(int options) {
+    int status;
+    pid_t done = waitpid(autosave_child, &status, options);
+    if (done == 0) return 0;
+
+    SaveReport report;
+    memset(&report, 0, sizeof(report));
+    if (done != autosave_child || read(autosave_pipe, &report, sizeof(report)) != (ssize_t)sizeof(report) ||
+        !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        report.ok = 0;
+    }
+    close(autosave_pipe);
+    autosave_pipe = -1;
+    autosave_child = -1;
+    record_save(&report, 1);
+    return report.ok ? 1 : -1;
+}
+#endif
+
+// Picks up a finished background save without blocking. Returns 1 if one
+// completed, -1 if one failed and 0 otherwise.
+int autosave_poll(void) {
+#ifndef _WIN32
+    if (autosave_child > 0) return autosave_collect(WNOHANG);
+#endif
+    return 0;
+}
+
+// Foreground saves and exit wait for a background save still writing the
+// files. Returns like autosave_poll.
+int autosave_wait(void) {
+#ifndef _WIN32
+    if (autosave_child > 0) return autosave_collect(0);
+#endif
+    return 0;
+}
+
+// Every save from the menus, batch sessions and exit goes through here, so
+// it never writes a file a background save is still writing. Returns 0, or
+// -1 if a store could not be written.
+int record_foreground_save(const SaveSet *set) {
+    autosave_wait();
+    SaveReport report = timed_save(set);
+    record_save(&report, 0);
+    return report.ok ? 0 : -1;
+}
+
+void display_save_stats(FILE *out) {
+    if (autosave_interval > 0) {
+        fprintf(out, "Autosave interval:      every %d s (BUSFLOW_AUTOSAVE)\n", autosave_interval);
+    } else {
+        fprintf(out, "Autosave interval:      off (BUSFLOW_AUTOSAVE=0)\n");
+    }
+#ifndef _WIN32
+    fprintf(out, "Background save:        %s\n", autosave_child > 0 ? "running" : "idle");
+#endif
+    fprintf(out, "Saves:                  %d foreground, %d background, %d failed\n",
+            save_stats.foreground_saves, save_stats.background_saves, save_stats.failed_saves);
+    int saves = save_stats.foreground_saves + save_stats.background_saves;
+    if (saves == 0) {
+        fprintf(out, "No save completed yet in this session.\n");
+        return;
+    }
+    char when[32];
+    strftime(when, sizeof(when), "%d/%m/%Y %H:%M:%S", localtime(&save_stats.last_time));
+    fprintf(out, "Last save:              %s (%s)\n", when, save_stats.last_background ? "background" : "foreground");
+    fprintf(out, "Last duration / bytes:  %.1f ms / %ld bytes\n", save_stats.last_ms, save_stats.last_bytes);
+    fprintf(out, "Average / max duration: %.1f ms / %.1f ms\n", save_stats.total_ms / saves, save_stats.max_ms);
+    fprintf(out, "Total bytes written:    %lld\n", save_stats.total_bytes);
+}
+
+// Snapshot (MVCC) functions
+// One writer (the batch session / server loop) and any number of reader
+// threads share the trip list. Readers never take a lock while walking it:
+// new trips are linked with a release store after they are fully written,
+// deletes only stamp deleted_epoch, and a trip is unlinked and freed later
+// once no pinned snapshot can see it or stand on it.
+#ifndef _WIN32
+#define SNAPSHOT_LOCK(registry) pthread_mutex_lock(&(registry)->lock)
+#define SNAPSHOT_UNLOCK(registry) pthread_mutex_unlock(&(registry)->lock)
+#else
+// No reader threads on Windows, the writer is alone
+#define SNAPSHOT_LOCK(registry) ((void)(registry))
+#define SNAPSHOT_UNLOCK(registry) ((void)(registry))
+#endif
+
+void snapshot_registry_init(SnapshotRegistry *registry) {
+    memset(registry, 0, sizeof(SnapshotRegistry));
+#ifndef _WIN32
+    pthread_mutex_init(&registry->lock, NULL);
+#endif
+}
+
+void snapshot_registry_destroy(SnapshotRegistry *registry) {
+#ifndef _WIN32
+    pthread_mutex_destroy(&registry->lock);
+#else
+    (void)registry;
+#endif
+}
+
+// Pins the current epoch. Returns the reader slot, or -1 if all are taken.
+int snapshot_begin(SnapshotRegistry *registry, unsigned long *epoch) {
+    int slot = -1;
+    SNAPSHOT_LOCK(registry);
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        if (!registry->active[i]) {
+            slot = i;
+            registry->active[i] = 1;
+            registry->pinned[i] = __atomic_load_n(&registry->current, __ATOMIC_ACQUIRE);
+            *epoch = registry->pinned[i];
+            break;
+        }
+    }
+    SNAPSHOT_UNLOCK(registry);
+    return slot;
+}
+
+void snapshot_end(SnapshotRegistry *registry, int slot) {
+    SNAPSHOT_LOCK(registry);
+    registry->active[slot] = 0;
+    SNAPSHOT_UNLOCK(registry);
+}
+
+// Oldest epoch any reader still sees (the current one when nobody reads)
+unsigned long snapshot_oldest(SnapshotRegistry *registry) {
+    SNAPSHOT_LOCK(registry);
+    unsigned long oldest = registry->current;
+    for (int i = 0; i < MAX_SNAPSHOTS; i++) {
+        if (registry->active[i] && registry->pinned[i] < oldest) oldest = registry->pinned[i];
+    }
+    SNAPSHOT_UNLOCK(registry);
+    return oldest;
+}
+
+// Makes everything the writer did since the last publish visible to new snapshots
+static void snapshot_publish(SnapshotRegistry *registry) {
+    __atomic_store_n(&registry->current, registry->current + 1, __ATOMIC_RELEASE);
+}
+
+int trip_visible(const Trip *trip, unsigned long epoch) {
+    unsigned long deleted = __atomic_load_n(&trip->deleted_epoch, __ATOMIC_RELAXED);
+    return trip->created_epoch <= epoch && (deleted == 0 || epoch < deleted);
+}
+
+static inline Trip *snapshot_next(const Trip *trip) {
+    return __atomic_load_n(&trip->next, __ATOMIC_ACQUIRE);
+}
+
+static int retire_trip(BatchSession *session, Trip *trip) {
+    if (session->retired_count == session->retired_capacity) {
+        int new_capacity = session->retired_capacity ? session->retired_capacity * 2 : 64;
+        RetiredTrip *grown = (RetiredTrip*)realloc(session->retired_trips, new_capacity * sizeof(RetiredTrip));
+        if (grown == NULL) return -1;
+        session->retired_trips = grown;
+        session->retired_capacity = new_capacity;
+    }
+    session->retired_trips[session->retired_count].trip = trip;
+    session->retired_trips[session->retired_count].free_epoch = 0; // set once the unlink is published
+    session->retired_count++;
+    return 0;
+}
+
+static void free_retired_trips(BatchSession *session, unsigned long oldest) {
+    int kept = 0;
+    for (int i = 0; i < session->retired_count; i++) {
+        RetiredTrip retired = session->retired_trips[i];
+        if (retired.free_epoch != 0 && retired.free_epoch <= oldest) {
+            free(retired.trip);
+        } else {
+            session->retired_trips[kept++] = retired;
+        }
+    }
+    session->retired_count = kept;
+}
+
+// Epoch-based reclamation: unlinks deleted trips no snapshot can see any
+// more, then frees unlinked trips once every reader that started before the
+// unlink has finished
+void trip_versions_collect(BatchSession *session) {
+    SnapshotRegistry *registry = &session->snapshots;
+    unsigned long oldest = snapshot_oldest(registry);
+    free_retired_trips(session, oldest);
+    if (session->trip_deletes_pending == 0) return;
+
+    int first_unlinked = session->retired_count;
+    Trip **link = &session->trips;
+    session->trip_tail = NULL;
+    while (*link != NULL) {
+        Trip *trip = *link;
+        if (trip->deleted_epoch != 0 && trip->deleted_epoch <= oldest && retire_trip(session, trip) == 0) {
+            __atomic_store_n(link, trip->next, __ATOMIC_RELEASE);
+            session->trip_deletes_pending--;
+        } else {
+            session->trip_tail = trip;
+            link = &trip->next;
+        }
+    }
+    if (session->retired_count == first_unlinked) return;
+
+    snapshot_publish(registry);
+    for (int i = first_unlinked; i < session->retired_count; i++) {
+        session->retired_trips[i].free_epoch = registry->current;
+    }
+    free_retired_trips(session, snapshot_oldest(registry));
+}
+
+// Batch command functions
+void* id_set_get(const IdSet *set, int key) {
+    if (set->capacity == 0) return NULL;
+    unsigned int mask = set->capacity - 1;
+    for (unsigned int i = ((unsigned int)key * 2654435761u) & mask; ; i = (i + 1) & mask) {
+        if (set->states[i] == 0) return NULL;
+        if (set->states[i] == 1 && set->keys[i] == key) return set->values[i];
+    }
+}
+
+static int id_set_grow(IdSet *set) {
+    IdSet grown;
+    grown.capacity = set->capacity ? set->capacity * 2 : 64;
+    grown.used = 0;
+    grown.keys = (int*)malloc(grown.capacity * sizeof(int));
+    grown.values = (void**)malloc(grown.capacity * sizeof(void*));
+    grown.states = (unsigned char*)calloc(grown.capacity, 1);
+    if (grown.keys == NULL || grown.values == NULL || grown.states == NULL) {
+        free(grown.keys);
+        free(grown.values);
+        free(grown.states);
+        return -1;
+    }
+    for (int i = 0; i < set->capacity; i++) {
+        if (set->states[i] == 1) id_set_add(&grown, set->keys[i], set->values[i]);
+    }
+    id_set_free(set);
+    *set = grown;
+    return 0;
+}
+
+// Returns 1 if added, 0 if already present, -1 on allocation failure
+int id_set_add(IdSet *set, int key, void *value) {
+    if ((set->used + 1) * 4 > set->capacity * 3 && id_set_grow(set) != 0) return -1;
+    unsigned int mask = set->capacity - 1;
+    int free_slot = -1;
+    for (unsigned int i = ((unsigned int)key * 2654435761u) & mask; ; i = (i + 1) & mask) {
+        if (set->states[i] == 1 && set->keys[i] == key) return 0;
+        if (set->states[i] == 2 && free_slot < 0) free_slot = (int)i;
+        if (set->states[i] == 0) {
+            if (free_slot < 0) {
+                free_slot = (int)i;
+                set->used++;
+            }
+            break;
+        }
+    }
+    set->keys[free_slot] = key;
+    set->values[free_slot] = value;
+    set->states[free_slot] = 1;
+    return 1;
+}
+
+void id_set_remove(IdSet *set, int key) {
+    if (set->capacity == 0) return;
+    unsigned int mask = set->capacity - 1;
+    for (unsigned int i = ((unsigned int)key * 2654435761u) & mask; set->states[i] != 0; i = (i + 1) & mask) {
+        if (set->states[i] == 1 && set->keys[i] == key) {
+            set->states[i] = 2;
+            return;
+        }
+    }
+}
+
+void id_set_free(IdSet *set) {
+    free(set->keys);
+    free(set->values);
+    free(set->states);
+    memset(set, 0, sizeof(IdSet));
+}
+
+static int batch_error(BatchSession *session, const char *format, const char *detail) {
+    fprintf(session->out, "line %d: ", session->line_number);
+    fprintf(session->out, format, detail);
+    fprintf(session->out, "\n");
+    session->errors++;
+    return -1;
+}
+
+static int parse_int_token(const char *token, int *value) {
+    char *end;
+    if (token == NULL) return 0;
+    long parsed = strtol(token, &end, 10);
+    if (*end != '\0' || end == token || parsed < INT_MIN || parsed > INT_MAX) return 0;
+    *value = (int)parsed;
+    return 1;
+}
+
+static int parse_float_token(const char *token, float *value) {
+    char *end;
+    if (token == NULL) return 0;
+    *value = strtof(token, &end);
+    return *end == '\0' && end != token;
+}
+
+static int parse_date_token(const char *token, PurchaseDate *date) {
+    char extra;
+    return token != NULL &&
+           sscanf(token, "%d/%d/%d%c", &date->day, &date->month, &date->year, &extra) == 3 &&
+           is_valid_date(date->day, date->month, date->year);
+}
+
+static int parse_datetime_tokens(const char *date_token, const char *time_token, DateTime *dt) {
+    char extra;
+    return date_token != NULL && time_token != NULL &&
+           sscanf(date_token, "%d/%d/%d%c", &dt->day, &dt->month, &dt->year, &extra) == 3 &&
+           sscanf(time_token, "%d:%d%c", &dt->hour, &dt->minute, &extra) == 2 &&
+           is_valid_datetime(dt->day, dt->month, dt->year, dt->hour, dt->minute);
+}
+
+static int copy_name_token(char *dest, size_t size, const char *token) {
+    if (token == NULL || strlen(token) >= size) return 0;
+    strcpy(dest, token);
+    return 1;
+}
+
+static int batch_session_index(BatchSession *session) {
+    for (Bus *bus = session->buses; bus != NULL; bus = bus->next) {
+        if (id_set_add(&session->bus_ids, bus->license_plate, bus) < 0) return -1;
+        session->bus_tail = bus;
+    }
+    for (Client *client = session->clients; client != NULL; client = client->next) {
+        if (id_set_add(&session->client_ids, client->client_id, client) < 0) return -1;
+        session->client_tail = client;
+    }
+    for (Employee *employee = session->employees; employee != NULL; employee = employee->next) {
+        if (id_set_add(&session->employee_ids, employee->employee_id, employee) < 0) return -1;
+        session->employee_tail = employee;
+    }
+    for (Function *func = session->functions; func != NULL; func = func->next) {
+        if (id_set_add(&session->function_ids, func->function_id, func) < 0) return -1;
+        session->function_tail = func;
+    }
+    for (Trip *trip = session->trips; trip != NULL; trip = trip->next) {
+        session->trip_tail = trip;
+    }
+    return 0;
+}
+
+// Loads the entity files and indexes the ids once so every command after
+// that is a hash lookup plus a list append. Returns 0, -1 on allocation
+// failure or -2 if a store is held by another process; on failure the
+// session is already closed.
+int batch_session_open(BatchSession *session, FILE *out) {
+    memset(session, 0, sizeof(BatchSession));
+    snapshot_registry_init(&session->snapshots);
+    session->out = out;
+    read_users_from_file(&session->users);
+
+    lsm_storage_take_errors();
+    session->buses = load_buses_from_file(NULL);
+    session->clients = load_clients_from_file(NULL);
+    session->employees = load_employees_from_file(NULL);
+    session->functions = load_functions_from_file(NULL);
+    session->trips = load_trips_from_file(NULL);
+    session->maintenance = load_maintenance_schedule_from_file(NULL);
+    session->crew = load_crew_from_file(NULL);
+
+    if (lsm_storage_take_errors() > 0) {
+        batch_session_close(session);
+        return -2;
+    }
+    if (batch_session_index(session) != 0) {
+        batch_session_close(session);
+        return -1;
+    }
+    return 0;
+}
+
+static int batch_defer_delete(BatchSession *session, void *record) {
+    if (session->pending_count == session->pending_capacity) {
+        int new_capacity = session->pending_capacity ? session->pending_capacity * 2 : 64;
+        void **grown = (void**)realloc(session->pending_deletes, new_capacity * sizeof(void*));
+        if (grown == NULL) return -1;
+        session->pending_deletes = grown;
+        session->pending_capacity = new_capacity;
+    }
+    session->pending_deletes[session->pending_count++] = record;
+    return 0;
+}
+
+static int compare_pointers(const void *a, const void *b) {
+    const char *x = *(char* const*)a;
+    const char *y = *(char* const*)b;
+    return (x > y) - (x < y);
+}
+
+static int is_pending_delete(const BatchSession *session, const void *record) {
+    return bsearch(&record, session->pending_deletes, session->pending_count, sizeof(void*), compare_pointers) != NULL;
+}
+
+// Deletes only drop the id and queue the record; this unlinks every queued
+// record in one walk per list instead of one walk per delete.
+static void batch_sweep(BatchSession *session) {
+    trip_versions_collect(session);
+    if (session->pending_count == 0) return;
+    qsort(session->pending_deletes, session->pending_count, sizeof(void*), compare_pointers);
+
+    Bus **bus_link = &session->buses;
+    session->bus_tail = NULL;
+    while (*bus_link != NULL) {
+        Bus *bus = *bus_link;
+        if (is_pending_delete(session, bus)) {
+            *bus_link = bus->next;
+            free(bus);
+        } else {
+            session->bus_tail = bus;
+            bus_link = &bus->next;
+        }
+    }
+    Client **client_link = &session->clients;
+    session->client_tail = NULL;
+    while (*client_link != NULL) {
+        Client *client = *client_link;
+        if (is_pending_delete(session, client)) {
+            *client_link = client->next;
+            free(client);
+        } else {
+            session->client_tail = client;
+            client_link = &client->next;
+        }
+    }
+    Employee **employee_link = &session->employees;
+    session->employee_tail = NULL;
+    while (*employee_link != NULL) {
+        Employee *employee = *employee_link;
+        if (is_pending_delete(session, employee)) {
+            *employee_link = employee->next;
+            free(employee);
+        } else {
+            session->employee_tail = employee;
+            employee_link = &employee->next;
+        }
+    }
+    Function **function_link = &session->functions;
+    session->function_tail = NULL;
+    while (*function_link != NULL) {
+        Function *func = *function_link;
+        if (is_pending_delete(session, func)) {
+            *function_link = func->next;
+            free(func);
+        } else {
+            session->function_tail = func;
+            function_link = &func->next;
+        }
+    }
+    session->pending_count = 0;
+}
+
+static int batch_add_bus(BatchSession *session, char **args, int argc) {
+    Bus bus;
+    if (argc != 4 || !parse_int_token(args[0], &bus.license_plate) || !parse_float_token(args[1], &bus.price) ||
+        !parse_date_token(args[2], &bus.purchase_date) || !parse_int_token(args[3], &bus.seat_count)) {
+        return batch_error(session, "%s", "usage: add-bus <plate> <price> <d/m/y> <seats>");
+    }
+    if (id_set_get(&session->bus_ids, bus.license_plate)) {
+        return batch_error(session, "license plate %s already exists", args[0]);
+    }
+
+    Bus *new_bus = (Bus*)malloc(sizeof(Bus));
+    if (new_bus == NULL || id_set_add(&session->bus_ids, bus.license_plate, new_bus) < 0) {
+        free(new_bus);
+        return batch_error(session, "%s", "memory allocation error");
+    }
+    *new_bus = bus;
+    new_bus->next = NULL;
+    if (session->bus_tail == NULL) {
+        session->buses = new_bus;
+    } else {
+        session->bus_tail->next = new_bus;
+    }
+    session->bus_tail = new_bus;
+    return 0;
+}
+
+// Deletes are refused while other records still refer to the one deleted
+static int archive_has_trips(int license_plate, int client_id) {
+    ArchiveQuery query;
+    archive_query_all(&query);
+    query.license_plate = license_plate;
+    query.client_id = client_id;
+    return trip_archive_scan(&query, archived_trip_found, NULL) > 0;
+}
+
+static int batch_delete_bus(BatchSession *session, char **args, int argc) {
+    int license_plate;
+    if (argc != 1 || !parse_int_token(args[0], &license_plate)) {
+        return batch_error(session, "%s", "usage: delete-bus <plate>");
+    }
+
+    Bus *record = (Bus*)id_set_get(&session->bus_ids, license_plate);
+    if (record == NULL) {
+        return batch_error(session, "bus %s not found", args[0]);
+    }
+    const BusUsage *usage = bus_usage_find(license_plate);
+    if ((usage != NULL && usage->trip_count > 0) || archive_has_trips(license_plate, -1)) {
+        return batch_error(session, "bus %s still has trips", args[0]);
+    }
+    if (batch_defer_delete(session, record) != 0) {
+        return batch_error(session, "%s", "memory allocation error");
+    }
+    id_set_remove(&session->bus_ids, license_plate);
+    return 0;
+}
+
+static int batch_add_client(BatchSession *session, char **args, int argc) {
+    Client client;
+    if (argc != 7 || !parse_int_token(args[0], &client.client_id) ||
+        !copy_name_token(client.first_name, sizeof(client.first_name), args[1]) ||
+        !copy_name_token(client.last_name, sizeof(client.last_name), args[2]) ||
+        !copy_name_token(client.phone, sizeof(client.phone), args[3]) ||
+        !copy_name_token(client.city, sizeof(client.city), args[4]) ||
+        !copy_name_token(client.province, sizeof(client.province), args[5]) ||
+        !parse_int_token(args[6], &client.postal_code)) {
+        return batch_error(session, "%s", "usage: add-client <id> <first> <last> <phone> <city> <province> <postal_code>");
+    }
+    if (id_set_get(&session->client_ids, client.client_id)) {
+        return batch_error(session, "client ID %s already exists", args[0]);
+    }
+
+    Client *new_client = (Client*)malloc(sizeof(Client));
+    if (new_client == NULL || id_set_add(&session->client_ids, client.client_id, new_client) < 0) {
+        free(new_client);
+        return batch_error(session, "%s", "memory allocation error");
+    }
+    *new_client = client;
+    new_client->next = NULL;
+    if (session->client_tail == NULL) {
+        session->clients = new_client;
+    } else {
+        session->client_tail->next = new_client;
+    }
+    session->client_tail = new_client;
+    return 0;
+}
+
+static int batch_delete_client(BatchSession *session, char **args, int argc) {
+    int client_id;
+    if (argc != 1 || !parse_int_token(args[0], &client_id)) {
+        return batch_error(session, "%s", "usage: delete-client <id>");
+    }
+
+    Client *record = (Client*)id_set_get(&session->client_ids, client_id);
+    if (record == NULL) {
+        return batch_error(session, "client %s not found", args[0]);
+    }
+    if (client_trip_count(client_id) > 0 || archive_has_trips(-1, client_id)) {
+        return batch_error(session, "client %s still has trips", args[0]);
+    }
+    if (batch_defer_delete(session, record) != 0) {
+        return batch_error(session, "%s", "memory allocation error");
+    }
+    id_set_remove(&session->client_ids, client_id);
+    return 0;
+}
+
+static int batch_add_function(BatchSession *session, char **args, int argc) {
+    Function func;
+    if (argc != 3 || !parse_int_token(args[0], &func.function_id) ||
+        !copy_name_token(func.function_name, sizeof(func.function_name), args[1]) ||
+        !parse_float_token(args[2], &func.salary)) {
+        return batch_error(session, "%s", "usage: add-function <id> <name> <salary>");
+    }
+    if (id_set_get(&session->function_ids, func.function_id)) {
+        return batch_error(session, "function ID %s already exists", args[0]);
+    }
+
+    Function *new_function = (Function*)malloc(sizeof(Function));
+    if (new_function == NULL || id_set_add(&session->function_ids, func.function_id, new_function) < 0) {
+        free(new_function);
+        return batch_error(session, "%s", "memory allocation error");
+    }
+    *new_function = func;
+    new_function->next = NULL;
+    if (session->function_tail == NULL) {
+        session->functions = new_function;
+    } else {
+        session->function_tail->next = new_function;
+    }
+    session->function_tail = new_function;
+    return 0;
+}
+
+static int batch_delete_function(BatchSession *session, char **args, int argc) {
+    int function_id;
+    if (argc != 1 || !parse_int_token(args[0], &function_id)) {
+        return batch_error(session, "%s", "usage: delete-function <id>");
+    }
+
+    Function *record = (Function*)id_set_get(&session->function_ids, function_id);
+    if (record == NULL) {
+        return batch_error(session, "function %s not found", args[0]);
+    }
+    for (Employee *employee = session->employees; employee != NULL; employee = employee->next) {
+        if (employee->function_id == function_id && id_set_get(&session->employee_ids, employee->employee_id) == employee) {
+            return batch_error(session, "function %s is still assigned to employees", args[0]);
+        }
+    }
+    if (batch_defer_delete(session, record) != 0) {
+        return batch_error(session, "%s", "memory allocation error");
+    }
+    id_set_remove(&session->function_ids, function_id);
+    return 0;
+}
+
+static int batch_add_employee(BatchSession *session, char **args, int argc) {
+    Employee employee;
+    if (argc != 5 || !parse_int_token(args[0], &employee.employee_id) ||
+        !copy_name_token(employee.first_name, sizeof(employee.first_name), args[1]) ||
+        !copy_name_token(employee.last_name, sizeof(employee.last_name), args[2]) ||
+        !copy_name_token(employee.phone, sizeof(employee.phone), args[3]) ||
+        !parse_int_token(args[4], &employee.function_id)) {
+        return batch_error(session, "%s", "usage: add-employee <id> <first> <last> <phone> <function_id>");
+    }
+    if (id_set_get(&session->employee_ids, employee.employee_id)) {
+        return batch_error(session, "employee ID %s already exists", args[0]);
+    }
+    if (!id_set_get(&session->function_ids, employee.function_id)) {
+        return batch_error(session, "function %s not found", args[4]);
+    }
+
+    Employee *new_employee = (Employee*)malloc(sizeof(Employee));
+    if (new_employee == NULL || id_set_add(&session->employee_ids, employee.employee_id, new_employee) < 0) {
+        free(new_employee);
+        return batch_error(session, "%s", "memory allocation error");
+    }
+    *new_employee = employee;
+    new_employee->next = NULL;
+    if (session->employee_tail == NULL) {
+        session->employees = new_employee;
+    } else {
+        session->employee_tail->next = new_employee;
+    }
+    session->employee_tail = new_employee;
+    return 0;
+}
+
+static int batch_delete_employee(BatchSession *session, char **args, int argc) {
+    int employee_id;
+    if (argc != 1 || !parse_int_token(args[0], &employee_id)) {
+        return batch_error(session, "%s", "usage: delete-employee <id>");
+    }
+
+    Employee *record = (Employee*)id_set_get(&session->employee_ids, employee_id);
+    if (record == NULL) {
+        return batch_error(session, "employee %s not found", args[0]);
+    }
+    for (CrewAssignment *assignment = session->crew; assignment != NULL; assignment = assignment->next) {
+        if (assignment->employee_id == employee_id) {
+            return batch_error(session, "employee %s is still on the crew roster", args[0]);
+        }
+    }
+    if (batch_defer_delete(session, record) != 0) {
+        return batch_error(session, "%s", "memory allocation error");
+    }
+    id_set_remove(&session->employee_ids, employee_id);
+    return 0;
+}
+
+static int batch_add_trip(BatchSession *session, char **args, int argc) {
+    Trip trip;
+    if (argc != 8 || !parse_int_token(args[0], &trip.license_plate) || !parse_int_token(args[1], &trip.client_id) ||
+        !parse_datetime_tokens(args[2], args[3], &trip.departure_time) ||
+        !parse_datetime_tokens(args[4], args[5], &trip.arrival_time) ||
+        !copy_name_token(trip.departure_city, sizeof(trip.departure_city), args[6]) ||
+        !copy_name_token(trip.arrival_city, sizeof(trip.arrival_city), args[7])) {
+        return batch_error(session, "%s", "usage: add-trip <plate> <client_id> <d/m/y> <h:m> <d/m/y> <h:m> <from> <to>");
+    }
+    if (!id_set_get(&session->bus_ids, trip.license_plate)) {
+        return batch_error(session, "bus %s not found", args[0]);
+    }
+    if (!id_set_get(&session->client_ids, trip.client_id)) {
+        return batch_error(session, "client %s not found", args[1]);
+    }
+    long departure = datetime_to_minutes(trip.departure_time);
+    long arrival = datetime_to_minutes(trip.arrival_time);
+    if (arrival < departure) {
+        return batch_error(session, "%s", "arrival is before departure");
+    }
+    if (bus_in_maintenance(trip.license_plate, departure, arrival)) {
+        return batch_error(session, "bus %s is blocked for maintenance during this trip", args[0]);
+    }
+
+    Trip *new_trip = (Trip*)malloc(sizeof(Trip));
+    if (new_trip == NULL) {
+        return batch_error(session, "%s", "memory allocation error");
+    }
+    *new_trip = trip;
+    new_trip->created_epoch = session->snapshots.current + 1;
+    new_trip->deleted_epoch = 0;
+    new_trip->next = NULL;
+    trip_indexes_add(new_trip);
+    // Fully written before it becomes reachable for snapshot readers
+    if (session->trip_tail == NULL) {
+        __atomic_store_n(&session->trips, new_trip, __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&session->trip_tail->next, new_trip, __ATOMIC_RELEASE);
+    }
+    session->trip_tail = new_trip;
+    snapshot_publish(&session->snapshots);
+    return 0;
+}
+
+static int batch_delete_trip(BatchSession *session, char **args, int argc) {
+    int license_plate, client_id;
+    DateTime departure;
+    if (argc != 4 || !parse_int_token(args[0], &license_plate) || !parse_int_token(args[1], &client_id) ||
+        !parse_datetime_tokens(args[2], args[3], &departure)) {
+        return batch_error(session, "%s", "usage: delete-trip <plate> <client_id> <d/m/y> <h:m>");
+    }
+
+    // Deleted trips have already left the index
+    Trip *temp = trip_indexes_find(license_plate, client_id, datetime_to_minutes(departure));
+    if (temp == NULL) {
+        return batch_error(session, "%s", "trip not found");
+    }
+
+    // Older snapshots keep seeing it; trip_versions_collect unlinks it later
+    trip_indexes_remove(temp);
+    __atomic_store_n(&temp->deleted_epoch, session->snapshots.current + 1, __ATOMIC_RELAXED);
+    session->trip_deletes_pending++;
+    snapshot_publish(&session->snapshots);
+    return 0;
+}
+
+// CSV import functions
+// Rows use the layout `list <entity>` prints; an optional header line is
+// skipped. Fields may not contain commas, and names may not contain
+// whitespace, since the data files store them as single words.
+static const char *import_entity_names[] = {"buses", "clients", "employees", "functions", "trips"};
+static const size_t import_record_sizes[] = {sizeof(Bus), sizeof(Client), sizeof(Employee), sizeof(Function), sizeof(Trip)};
+
+// Fills buffer with the next run of whole lines, always ending in '\n', and
+// keeps the partial last line for the next call. Returns 0 at end of file.
+static size_t import_fill_chunk(ImportReader *reader, char *buffer) {
+    size_t length = reader->carry_length;
+    memcpy(buffer, reader->carry, length);
+    length += fread(buffer + length, 1, IMPORT_CHUNK_SIZE - length, reader->file);
+    reader->carry_length = 0;
+    if (ferror(reader->file)) reader->failed = 1;
+    if (length == 0) return 0;
+
+    if (length < IMPORT_CHUNK_SIZE) {
+        if (buffer[length - 1] != '\n') buffer[length++] = '\n';
+        return length;
+    }
+    size_t end = length;
+    while (end > 0 && buffer[end - 1] != '\n') end--;
+    if (length - end > sizeof(reader->carry)) {
+        // Cut an overlong line here; both halves are rejected as malformed
+        buffer[length++] = '\n';
+        return length;
+    }
+    reader->carry_length = length - end;
+    memcpy(reader->carry, buffer + end, reader->carry_length);
+    return end;
+}
+
+#ifndef _WIN32
+// Reads ahead into whichever buffer the parser has handed back
+static void* import_reader_run(void *arg) {
+    ImportReader *reader = (ImportReader*)arg;
+    for (int i = 0; ; i ^= 1) {
+        pthread_mutex_lock(&reader->lock);
+        while (reader->ready[i] && !reader->stop) pthread_cond_wait(&reader->changed, &reader->lock);
+        int stop = reader->stop;
+        pthread_mutex_unlock(&reader->lock);
+        if (stop) break;
+
+        size_t length = import_fill_chunk(reader, reader->buffers[i]);
+        pthread_mutex_lock(&reader->lock);
+        reader->lengths[i] = length;
+        reader->ready[i] = 1;
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+        if (length == 0) break;
+    }
+    return NULL;
+}
+#endif
+
+static int import_reader_open(ImportReader *reader, FILE *file) {
+    memset(reader, 0, sizeof(ImportReader));
+    reader->file = file;
+    reader->buffers[0] = (char*)malloc(IMPORT_CHUNK_SIZE + 1);
+    reader->buffers[1] = (char*)malloc(IMPORT_CHUNK_SIZE + 1);
+    if (reader->buffers[0] == NULL || reader->buffers[1] == NULL) {
+        free(reader->buffers[0]);
+        free(reader->buffers[1]);
+        return -1;
+    }
+#ifndef _WIN32
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->changed, NULL);
+    reader->threaded = pthread_create(&reader->thread, NULL, import_reader_run, reader) == 0;
+#endif
+    return 0;
+}
+
+// Returns the next chunk, read into buffers[index], or NULL at end of file
+static char* import_reader_next(ImportReader *reader, int index, size_t *length) {
+#ifndef _WIN32
+    if (reader->threaded) {
+        pthread_mutex_lock(&reader->lock);
+        while (!reader->ready[index]) pthread_cond_wait(&reader->changed, &reader->lock);
+        *length = reader->lengths[index];
+        pthread_mutex_unlock(&reader->lock);
+        return *length > 0 ? reader->buffers[index] : NULL;
+    }
+#endif
+    *length = import_fill_chunk(reader, reader->buffers[index]);
+    return *length > 0 ? reader->buffers[index] : NULL;
+}
+
+static void import_reader_release(ImportReader *reader, int index) {
+#ifndef _WIN32
+    if (reader->threaded) {
+        pthread_mutex_lock(&reader->lock);
+        reader->ready[index] = 0;
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+    }
+#else
+    (void)reader;
+    (void)index;
+#endif
+}
+
+static void import_reader_close(ImportReader *reader) {
+#ifndef _WIN32
+    if (reader->threaded) {
+        pthread_mutex_lock(&reader->lock);
+        reader->stop = 1;
+        pthread_cond_broadcast(&reader->changed);
+        pthread_mutex_unlock(&reader->lock);
+        pthread_join(reader->thread, NULL);
+    }
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->changed);
+#endif
+    free(reader->buffers[0]);
+    free(reader->buffers[1]);
+}
+
+// Splits line in place at commas. Returns the field count, or max + 1 when
+// there are more than max fields.
+static int csv_split(char *line, char **fields, int max) {
+    int count = 0;
+    fields[count++] = line;
+    for (char *p = strchr(line, ','); p != NULL; p = strchr(p + 1, ',')) {
+        if (count == max) return max + 1;
+        *p = '\0';
+        fields[count++] = p + 1;
+    }
+    return count;
+}
+
+static int csv_int(const char *field, int *value) {
+    const char *p = field;
+    int negative = *p == '-';
+    if (negative) p++;
+    if (*p == '\0') return 0;
+
+    long long parsed = 0;
+    for (; *p != '\0'; p++) {
+        if (*p < '0' || *p > '9' || parsed > INT_MAX) return 0;
+        parsed = parsed * 10 + (*p - '0');
+    }
+    if (negative) parsed = -parsed;
+    if (parsed < INT_MIN || parsed > INT_MAX) return 0;
+    *value = (int)parsed;
+    return 1;
+}
+
+// Reads the digits up to separator and steps past it
+static int csv_number(const char **cursor, char separator, int *value) {
+    const char *p = *cursor;
+    int parsed = 0, digits = 0;
+    while (*p >= '0' && *p <= '9' && digits < 9) {
+        parsed = parsed * 10 + (*p++ - '0');
+        digits++;
+    }
+    if (digits == 0 || *p != separator) return 0;
+    *value = parsed;
+    *cursor = separator == '\0' ? p : p + 1;
+    return 1;
+}
+
+static int csv_date(const char *field, PurchaseDate *date) {
+    return csv_number(&field, '/', &date->day) && csv_number(&field, '/', &date->month) &&
+           csv_number(&field, '\0', &date->year) && is_valid_date(date->day, date->month, date->year);
+}
+
+static int csv_datetime(const char *field, DateTime *dt) {
+    return csv_number(&field, '/', &dt->day) && csv_number(&field, '/', &dt->month) &&
+           csv_number(&field, ' ', &dt->year) && csv_number(&field, ':', &dt->hour) &&
+           csv_number(&field, '\0', &dt->minute) &&
+           is_valid_datetime(dt->day, dt->month, dt->year, dt->hour, dt->minute);
+}
+
+static int csv_name(char *dest, size_t size, const char *field) {
+    size_t length = 0;
+    for (; field[length] != '\0'; length++) {
+        if (length + 1 >= size || isspace((unsigned char)field[length])) return 0;
+        dest[length] = field[length];
+    }
+    dest[length] = '\0';
+    return length > 0;
+}
+
+static const char* import_parse_bus(char **f, int n, Bus *bus) {
+    if (n != 4) return "expected plate,price,d/m/y,seats";
+    if (!csv_int(f[0], &bus->license_plate)) return "invalid license plate";
+    if (!parse_float_token(f[1], &bus->price)) return "invalid price";
+    if (!csv_date(f[2], &bus->purchase_date)) return "invalid purchase date";
+    if (!csv_int(f[3], &bus->seat_count)) return "invalid seat count";
+    return NULL;
+}
+
+static const char* import_parse_client(char **f, int n, Client *client) {
+    if (n != 7) return "expected id,first,last,phone,city,province,postal_code";
+    if (!csv_int(f[0], &client->client_id)) return "invalid client ID";
+    if (!csv_name(client->first_name, sizeof(client->first_name), f[1]) ||
+        !csv_name(client->last_name, sizeof(client->last_name), f[2])) return "invalid name";
+    if (!csv_name(client->phone, sizeof(client->phone), f[3])) return "invalid phone";
+    if (!csv_name(client->city, sizeof(client->city), f[4]) ||
+        !csv_name(client->province, sizeof(client->province), f[5])) return "invalid city or province";
+    if (!csv_int(f[6], &client->postal_code)) return "invalid postal code";
+    return NULL;
+}
+
+static const char* import_parse_employee(char **f, int n, Employee *employee) {
+    if (n != 5) return "expected id,first,last,phone,function_id";
+    if (!csv_int(f[0], &employee->employee_id)) return "invalid employee ID";
+    if (!csv_name(employee->first_name, sizeof(employee->first_name), f[1]) ||
+        !csv_name(employee->last_name, sizeof(employee->last_name), f[2])) return "invalid name";
+    if (!csv_name(employee->phone, sizeof(employee->phone), f[3])) return "invalid phone";
+    if (!csv_int(f[4], &employee->function_id)) return "invalid function ID";
+    return NULL;
+}
+
+static const char* import_parse_function(char **f, int n, Function *func) {
+    if (n != 3) return "expected id,name,salary";
+    if (!csv_int(f[0], &func->function_id)) return "invalid function ID";
+    if (!csv_name(func->function_name, sizeof(func->function_name), f[1])) return "invalid function name";
+    if (!parse_float_token(f[2], &func->salary)) return "invalid salary";
+    return NULL;
+}
+
+static const char* import_parse_trip(char **f, int n, Trip *trip) {
+    if (n != 6) return "expected plate,client_id,d/m/y h:m,d/m/y h:m,from,to";
+    if (!csv_int(f[0], &trip->license_plate)) return "invalid license plate";
+    if (!csv_int(f[1], &trip->client_id)) return "invalid client ID";
+    if (!csv_datetime(f[2], &trip->departure_time)) return "invalid departure time";
+    if (!csv_datetime(f[3], &trip->arrival_time)) return "invalid arrival time";
+    if (!csv_name(trip->departure_city, sizeof(trip->departure_city), f[4]) ||
+        !csv_name(trip->arrival_city, sizeof(trip->arrival_city), f[5])) return "invalid city";
+    if (datetime_to_minutes(trip->arrival_time) < datetime_to_minutes(trip->departure_time)) {
+        return "arrival is before departure";
+    }
+    trip->created_epoch = 0;
+    trip->deleted_epoch = 0;
+    return NULL;
+}
+
+// Parses one line into a new record. Returns NULL on success, otherwise the
+// reason the row was rejected (and *record is NULL).
+static const char* import_parse_row(int entity, char *line, void **record) {
+    char *fields[8];
+    int count = csv_split(line, fields, 8);
+    const char *error;
+
+    *record = malloc(import_record_sizes[entity]);
+    if (*record == NULL) return "memory allocation error";
+    switch (entity) {
+        case IMPORT_BUSES: error = import_parse_bus(fields, count, (Bus*)*record); break;
+        case IMPORT_CLIENTS: error = import_parse_client(fields, count, (Client*)*record); break;
+        case IMPORT_EMPLOYEES: error = import_parse_employee(fields, count, (Employee*)*record); break;
+        case IMPORT_FUNCTIONS: error = import_parse_function(fields, count, (Function*)*record); break;
+        default: error = import_parse_trip(fields, count, (Trip*)*record); break;
+    }
+    if (error != NULL) {
+        free(*record);
+        *record = NULL;
+    }
+    return error;
+}
+
+static void* import_worker_run(void *arg) {
+    ImportWorker *worker = (ImportWorker*)arg;
+    for (int i = worker->first; i < worker->end; i++) {
+        worker->errors[i] = import_parse_row(worker->entity, worker->lines[i], &worker->records[i]);
+    }
+    return NULL;
+}
+
+// Parses count lines on up to threads workers (sequentially where threads
+// are not available or the chunk is too small to be worth splitting)
+static void import_parse_lines(int entity, char **lines, void **records, const char **errors, int count, int threads) {
+    ImportWorker workers[IMPORT_MAX_WORKERS];
+    if (threads > IMPORT_MAX_WORKERS) threads = IMPORT_MAX_WORKERS;
+    if (threads < 1 || count < 4096) threads = 1;
+#ifdef _WIN32
+    threads = 1;
+#endif
+
+    for (int t = 0; t < threads; t++) {
+        workers[t].entity = entity;
+        workers[t].lines = lines;
+        workers[t].records = records;
+        workers[t].errors = errors;
+        workers[t].first = (int)((long long)count * t / threads);
+        workers[t].end = (int)((long long)count * (t + 1) / threads);
+    }
+#ifdef _WIN32
+    import_worker_run(&workers[0]);
+#else
+    pthread_t handles[IMPORT_MAX_WORKERS];
+    int started[IMPORT_MAX_WORKERS];
+    for (int t = 1; t < threads; t++) {
+        started[t] = pthread_create(&handles[t], NULL, import_worker_run, &workers[t]) == 0;
+    }
+    import_worker_run(&workers[0]);
+    for (int t = 1; t < threads; t++) {
+        if (started[t]) {
+            pthread_join(handles[t], NULL);
+        } else {
+            import_worker_run(&workers[t]);
+        }
+    }
+#endif
+}
+
+static void import_reject(BatchSession *session, const char *path, long line, long *rejected,
+                          const char *format, int value) {
+    if (*rejected < IMPORT_MAX_REPORTED_ERRORS) {
+        fprintf(session->out, "%s:%ld: ", path, line);
+        fprintf(session->out, format, value);
+        fprintf(session->out, "\n");
+    }
+    (*rejected)++;
+}
+
+// Validates parsed rows against the id indexes in file order and links the
+// accepted ones. Trips of one chunk are indexed together and become visible
+// to snapshot readers with a single publish. Returns the number linked.
+static long import_apply(BatchSession *session, int entity, const char *path, const long *numbers,
+                         void **records, const char **errors, int count, long *rejected) {
+    long linked = 0;
+    int trips = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (errors[i] != NULL) {
+            import_reject(session, path, numbers[i], rejected, errors[i], 0);
+            continue;
+        }
+
+        const char *problem = NULL;
+        int id = 0;
+        if (entity == IMPORT_BUSES) {
+            Bus *bus = (Bus*)records[i];
+            id = bus->license_plate;
+            if (id_set_get(&session->bus_ids, id)) problem = "license plate %d already exists";
+            else if (id_set_add(&session->bus_ids, id, bus) < 0) problem = "memory allocation error";
+            else {
+                bus->next = NULL;
+                if (session->bus_tail == NULL) session->buses = bus;
+                else session->bus_tail->next = bus;
+                session->bus_tail = bus;
+            }
+        } else if (entity == IMPORT_CLIENTS) {
+            Client *client = (Client*)records[i];
+            id = client->client_id;
+            if (id_set_get(&session->client_ids, id)) problem = "client ID %d already exists";
+            else if (id_set_add(&session->client_ids, id, client) < 0) problem = "memory allocation error";
+            else {
+                client->next = NULL;
+                if (session->client_tail == NULL) session->clients = client;
+                else session->client_tail->next = client;
+                session->client_tail = client;
+            }
+        } else if (entity == IMPORT_EMPLOYEES) {
+            Employee *employee = (Employee*)records[i];
+            id = employee->employee_id;
+            if (id_set_get(&session->employee_ids, id)) problem = "employee ID %d already exists";
+            else if (!id_set_get(&session->function_ids, employee->function_id)) {
+                id = employee->function_id;
+                problem = "function %d not found";
+            }
+            else if (id_set_add(&session->employee_ids, id, employee) < 0) problem = "memory allocation error";
+            else {
+                employee->next = NULL;
+                if (session->employee_tail == NULL) session->employees = employee;
+                else session->employee_tail->next = employee;
+                session->employee_tail = employee;
+            }
+        } else if (entity == IMPORT_FUNCTIONS) {
+            Function *func = (Function*)records[i];
+            id = func->function_id;
+            if (id_set_get(&session->function_ids, id)) problem = "function ID %d already exists";
+            else if (id_set_add(&session->function_ids, id, func) < 0) problem = "memory allocation error";
+            else {
+                func->next = NULL;
+                if (session->function_tail == NULL) session->functions = func;
+                else session->function_tail->next = func;
+                session->function_tail = func;
+            }
+        } else {
+            Trip *trip = (Trip*)records[i];
+            id = trip->license_plate;
+            if (!id_set_get(&session->bus_ids, id)) problem = "bus %d not found";
+            else if (!id_set_get(&session->client_ids, trip->client_id)) {
+                id = trip->client_id;
+                problem = "client %d not found";
+            } else if (bus_in_maintenance(id, datetime_to_minutes(trip->departure_time),
+                                          datetime_to_minutes(trip->arrival_time))) {
+                problem = "bus %d is blocked for maintenance during this trip";
+            } else {
+                records[trips++] = trip;
+            }
+        }
+
+        if (problem != NULL) {
+            import_reject(session, path, numbers[i], rejected, problem, id);
+            free(records[i]);
+        } else {
+            linked++;
         }
-        bus_temp = bus_temp->next;
     }
-    
-    if (!bus_found) {
-        printf("Bus with license plate %d not found.\n", new_trip->license_plate);
-        free(new_trip);
-        return head;
+    if (trips == 0) return linked;
+
+    // Chain and index the accepted trips, then make them reachable at once
+    unsigned long epoch = session->snapshots.current + 1;
+    for (int i = 0; i < trips; i++) {
+        Trip *trip = (Trip*)records[i];
+        trip->created_epoch = epoch;
+        trip->next = i + 1 < trips ? (Trip*)records[i + 1] : NULL;
     }
+    trip_indexes_add_batch((Trip**)records, trips);
+    if (session->trip_tail == NULL) {
+        __atomic_store_n(&session->trips, (Trip*)records[0], __ATOMIC_RELEASE);
+    } else {
+        __atomic_store_n(&session->trip_tail->next, (Trip*)records[0], __ATOMIC_RELEASE);
+    }
+    session->trip_tail = (Trip*)records[trips - 1];
+    snapshot_publish(&session->snapshots);
+    return linked;
+}
 
-    // Display available clients
-    printf("\nAvailable clients:\n");
-    display_clients(clients);
-    printf("Enter client ID: ");
-    new_trip->client_id = safe_int_input();
-    
-    // Verify client exists
-    Client *client_temp = clients;
-    int client_found = 0;
-    while (client_temp != NULL) {
-        if (client_temp->client_id == new_trip->client_id) {
-            client_found = 1;
-            break;
+// import <entity> <file>: reads the file in chunks on a reader thread,
+// parses each chunk on all cores and links the valid rows. Rejected rows
+// are reported as file:line: reason and do not stop the import. Returns 0,
+// or -1 if any row was rejected or the file could not be read.
+int import_csv(BatchSession *session, int entity, const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return batch_error(session, "cannot open %s", path);
+    }
+    ImportReader reader;
+    if (import_reader_open(&reader, file) != 0) {
+        fclose(file);
+        return batch_error(session, "%s", "memory allocation error");
+    }
+
+    int threads = available_cores();
+    char **lines = NULL;
+    long *numbers = NULL;
+    void **records = NULL;
+    const char **errors = NULL;
+    int capacity = 0;
+    int out_of_memory = 0;
+    long line_number = 0, imported = 0, rejected = 0;
+    double started = monotonic_ms();
+
+    for (int index = 0; !out_of_memory; index ^= 1) {
+        size_t length;
+        char *chunk = import_reader_next(&reader, index, &length);
+        if (chunk == NULL) break;
+
+        int count = 0;
+        for (char *p = chunk, *end = chunk + length; p < end; ) {
+            char *newline = (char*)memchr(p, '\n', end - p);
+            *newline = '\0';
+            if (newline > p && newline[-1] == '\r') newline[-1] = '\0';
+            line_number++;
+            int header = line_number == 1 && !isdigit((unsigned char)*p) && *p != '-';
+            if (*p != '\0' && !header) {
+                if (count == capacity) {
+                    int new_capacity = capacity ? capacity * 2 : 4096;
+                    char **grown_lines = (char**)realloc(lines, new_capacity * sizeof(char*));
+                    if (grown_lines != NULL) lines = grown_lines;
+                    long *grown_numbers = (long*)realloc(numbers, new_capacity * sizeof(long));
+                    if (grown_numbers != NULL) numbers = grown_numbers;
+                    void **grown_records = (void**)realloc(records, new_capacity * sizeof(void*));
+                    if (grown_records != NULL) records = grown_records;
+                    const char **grown_errors = (const char**)realloc((void*)errors, new_capacity * sizeof(char*));
+                    if (grown_errors != NULL) errors = grown_errors;
+                    if (grown_lines == NULL || grown_numbers == NULL || grown_records == NULL || grown_errors == NULL) {
+                        out_of_memory = 1;
+                        break;
+                    }
+                    capacity = new_capacity;
+                }
+                lines[count] = p;
+                numbers[count] = line_number;
+                count++;
+            }
+            p = newline + 1;
         }
-        client_temp = client_temp->next;
+
+        if (!out_of_memory) {
+            import_parse_lines(entity, lines, records, errors, count, threads);
+            imported += import_apply(session, entity, path, numbers, records, errors, count, &rejected);
+        }
+        import_reader_release(&reader, index);
     }
-    
-    if (!client_found) {
-        printf("Client with ID %d not found.\n", new_trip->client_id);
-        free(new_trip);
-        return head;
+
+    import_reader_close(&reader);
+    int read_failed = reader.failed;
+    fclose(file);
+    free(lines);
+    free(numbers);
+    free(records);
+    free((void*)errors);
+
+    double elapsed_ms = monotonic_ms() - started;
+    if (imported > 0) session->dirty = 1;
+    if (rejected > IMPORT_MAX_REPORTED_ERRORS) {
+        fprintf(session->out, "%s: %ld more rejected rows not shown\n", path, rejected - IMPORT_MAX_REPORTED_ERRORS);
+    }
+    fprintf(session->out, "imported %ld %s from %s, %ld rejected (%.1f ms", imported, import_entity_names[entity], path,
+            rejected, elapsed_ms);
+    if (elapsed_ms > 0) fprintf(session->out, ", %.0f rows/s", (imported + rejected) * 1000.0 / elapsed_ms);
+    fprintf(session->out, ")\n");
+
+    if (out_of_memory) return batch_error(session, "%s", "memory allocation error");
+    if (read_failed) return batch_error(session, "error reading %s", path);
+    if (rejected > 0) {
+        session->errors++;
+        return -1;
     }
+    return 0;
+}
 
-    // Input departure details
-    printf("\nEnter departure details:\n");
-    printf("Departure city: ");
-    scanf("%99s", new_trip->departure_city);
-    
-    DateTime departure;
-    do {
-        printf("Departure date and time:\n");
-        printf("Year (1900-2100): ");
-        departure.year = safe_int_input();
-        printf("Month (1-12): ");
-        departure.month = safe_int_input();
-        printf("Day: ");
-        departure.day = safe_int_input();
-        printf("Hour (0-23): ");
-        departure.hour = safe_int_input();
-        printf("Minute (0-59): ");
-        departure.minute = safe_int_input();
-        
-        if (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute)) {
-            printf("Invalid date/time. Please enter valid values.\n");
+static int batch_import(BatchSession *session, char **args, int argc) {
+    if (argc == 2) {
+        for (int entity = IMPORT_BUSES; entity <= IMPORT_TRIPS; entity++) {
+            if (strcmp(args[0], import_entity_names[entity]) == 0) return import_csv(session, entity, args[1]);
         }
-    } while (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute));
+    }
+    return batch_error(session, "usage: %s <buses|clients|employees|functions|trips> <file.csv>", "import");
+}
 
-    new_trip->departure_time = departure;
+// Export functions
+// Streaming CSV and NDJSON exports. Each entity declares its fields once as
+// an X-macro list of (name, kind, expression), like the display tables, and
+// DEFINE_EXPORT expands it into a CSV header and one row function per
+// format. Rows go through one reusable buffer that is written out in large
+// blocks. CSV output without joined fields can be read back by import.
+static ExportWriter export_writer;
+
+ExportWriter* export_begin(FILE *out, int format) {
+    export_writer.out = out;
+    export_writer.format = format;
+    export_writer.length = 0;
+    export_writer.bytes = 0;
+    return &export_writer;
+}
 
-    // Input arrival details
-    printf("\nEnter arrival details:\n");
-    printf("Arrival city: ");
-    scanf("%99s", new_trip->arrival_city);
-    
-    DateTime arrival;
-    do {
-        printf("Arrival date and time:\n");
-        printf("Year (1900-2100): ");
-        arrival.year = safe_int_input();
-        printf("Month (1-12): ");
-        arrival.month = safe_int_input();
-        printf("Day: ");
-        arrival.day = safe_int_input();
-        printf("Hour (0-23): ");
-        arrival.hour = safe_int_input();
-        printf("Minute (0-59): ");
-        arrival.minute = safe_int_input();
-        
-        if (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute)) {
-            printf("Invalid date/time. Please enter valid values.\n");
-        }
-    } while (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute));
+void export_flush(ExportWriter *writer) {
+    if (writer->length > 0) {
+        fwrite(writer->buffer, 1, writer->length, writer->out);
+        writer->bytes += writer->length;
+        writer->length = 0;
+    }
+}
 
-    new_trip->arrival_time = arrival;
+static void export_put_raw(ExportWriter *writer, const char *text, size_t length) {
+    memcpy(writer->buffer + writer->length, text, length);
+    writer->length += length;
+}
 
-    new_trip->next = NULL;
-    
-    if (head == NULL) {
-        printf("Trip added successfully! This is your first trip.\n");
-        return new_trip;
+static void export_put_int(ExportWriter *writer, long long value, int json) {
+    (void)json;
+    writer->length += format_signed(writer->buffer + writer->length, value);
+}
+
+static void export_put_money(ExportWriter *writer, double value, int json) {
+    (void)json;
+    writer->length = (size_t)(format_money(writer->buffer + writer->length, value) - writer->buffer);
+}
+
+// CSV quotes a field only when it holds a separator or a quote; JSON
+// escapes quotes, backslashes and control characters
+static void export_put_text(ExportWriter *writer, const char *text, int json) {
+    size_t length = strlen(text);
+    if (length > MAX_STRING_LENGTH) length = MAX_STRING_LENGTH;
+    char *p = writer->buffer + writer->length;
+
+    if (!json) {
+        int quote = 0;
+        for (size_t i = 0; i < length && !quote; i++) {
+            quote = text[i] == ',' || text[i] == '"' || text[i] == '\n' || text[i] == '\r';
+        }
+        if (!quote) {
+            export_put_raw(writer, text, length);
+            return;
+        }
+        *p++ = '"';
+        for (size_t i = 0; i < length; i++) {
+            if (text[i] == '"') *p++ = '"';
+            *p++ = text[i];
+        }
+        *p++ = '"';
     } else {
-        Trip *temp = head;
-        while (temp->next != NULL) {
-            temp = temp->next;
+        *p++ = '"';
+        for (size_t i = 0; i < length; i++) {
+            unsigned char c = (unsigned char)text[i];
+            if (c == '"' || c == '\\') {
+                *p++ = '\\';
+                *p++ = (char)c;
+            } else if (c < 0x20) {
+                memcpy(p, "\\u00", 4);
+                p[4] = "0123456789abcdef"[c >> 4];
+                p[5] = "0123456789abcdef"[c & 15];
+                p += 6;
+            } else {
+                *p++ = (char)c;
+            }
         }
-        temp->next = new_trip;
-        printf("Trip added successfully!\n");
-        return head;
+        *p++ = '"';
     }
+    writer->length = (size_t)(p - writer->buffer);
 }
 
-void display_trips(Trip *head, Bus *buses, Client *clients) {
-    if (head == NULL) {
-        printf("  No trips found in the system.\n");
-        printf("You need to add trips first to view them.\n");
-        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
-        return;
+// CSV dates match the data files (d/m/y); JSON dates are ISO 8601
+static void export_put_date(ExportWriter *writer, PurchaseDate date, int json) {
+    char *p = writer->buffer + writer->length;
+    if (json) {
+        *p++ = '"';
+        p += format_signed(p, date.year);
+        *p++ = '-';
+        p = format_pair(p, date.month);
+        *p++ = '-';
+        p = format_pair(p, date.day);
+        *p++ = '"';
+    } else {
+        p += format_signed(p, date.day);
+        *p++ = '/';
+        p += format_signed(p, date.month);
+        *p++ = '/';
+        p += format_signed(p, date.year);
     }
+    writer->length = (size_t)(p - writer->buffer);
+}
 
-    print_header("TRIP DATABASE");
-    
-    // Count trips
-    int trip_count = 0;
-    Trip *temp = head;
-    while (temp != NULL) {
-        trip_count++;
-        temp = temp->next;
+static void export_put_datetime(ExportWriter *writer, DateTime time, int json) {
+    char *p = writer->buffer + writer->length;
+    if (json) {
+        *p++ = '"';
+        p += format_signed(p, time.year);
+        *p++ = '-';
+        p = format_pair(p, time.month);
+        *p++ = '-';
+        p = format_pair(p, time.day);
+        *p++ = 'T';
+        p = format_pair(p, time.hour);
+        *p++ = ':';
+        p = format_pair(p, time.minute);
+        *p++ = '"';
+    } else {
+        p += format_signed(p, time.day);
+        *p++ = '/';
+        p += format_signed(p, time.month);
+        *p++ = '/';
+        p += format_signed(p, time.year);
+        *p++ = ' ';
+        p += format_signed(p, time.hour);
+        *p++ = ':';
+        p = format_pair(p, time.minute);
+    }
+    writer->length = (size_t)(p - writer->buffer);
+}
+
+// Replaces the separator after the last field with the row terminator
+static void export_end_row(ExportWriter *writer, int json) {
+    if (json) {
+        writer->buffer[writer->length - 1] = '}';
+        writer->buffer[writer->length++] = '\n';
+    } else {
+        writer->buffer[writer->length - 1] = '\n';
     }
-    
-    printf("Total trips in database: %d\n\n", trip_count);
-    
-    set_console_color(2);
-    printf("%-10s %-10s %-15s %-15s %-20s %-20s\n", 
-           "Bus", "Client", "Departure", "Arrival", "Departure Time", "Arrival Time");
-    printf("%-10s %-10s %-15s %-15s %-20s %-20s\n", 
-           "===", "======", "=========", "=======", "==============", "============");
-    set_console_color(7);
+    if (writer->length + EXPORT_ROW_RESERVE > EXPORT_BUFFER_SIZE) {
+        export_flush(writer);
+    }
+}
 
-    temp = head;
-    while (temp != NULL) {
-        printf("%-10d %-10d %-15s %-15s %02d/%02d/%d %02d:%02d     %02d/%02d/%d %02d:%02d\n",
-               temp->license_plate,
-               temp->client_id,
-               temp->departure_city,
-               temp->arrival_city,
-               temp->departure_time.day,
-               temp->departure_time.month,
-               temp->departure_time.year,
-               temp->departure_time.hour,
-               temp->departure_time.minute,
-               temp->arrival_time.day,
-               temp->arrival_time.month,
-               temp->arrival_time.year,
-               temp->arrival_time.hour,
-               temp->arrival_time.minute);
-        temp = temp->next;
+#define EXPORT_FIELD_TITLE(name, kind, expr) name ","
+#define EXPORT_FIELD_CSV(name, kind, expr)                                 \
+    export_put_##kind(writer, (expr), 0);                                  \
+    writer->buffer[writer->length++] = ',';
+#define EXPORT_FIELD_JSON(name, kind, expr)                                \
+    export_put_raw(writer, "\"" name "\":", sizeof("\"" name "\":") - 1);  \
+    export_put_##kind(writer, (expr), 1);                                  \
+    writer->buffer[writer->length++] = ',';
+
+#define DEFINE_EXPORT(name, row_type, context_type, FIELDS)                                  \
+    static const char name##_csv_header[] = FIELDS(EXPORT_FIELD_TITLE);                      \
+    static void name##_csv_row(ExportWriter *writer, const row_type *row, context_type context) { \
+        (void)context;                                                                       \
+        FIELDS(EXPORT_FIELD_CSV)                                                             \
+        export_end_row(writer, 0);                                                           \
+    }                                                                                        \
+    static void name##_json_row(ExportWriter *writer, const row_type *row, context_type context) { \
+        (void)context;                                                                       \
+        writer->buffer[writer->length++] = '{';                                              \
+        FIELDS(EXPORT_FIELD_JSON)                                                            \
+        export_end_row(writer, 1);                                                           \
+    }
+
+// Joined fields are looked up through the session's id indexes
+static const char *export_client_field(const Trip *trip, const IdSet *clients, int last_name) {
+    const Client *client = (const Client*)id_set_get(clients, trip->client_id);
+    if (client == NULL) return "";
+    return last_name ? client->last_name : client->first_name;
+}
+
+static const char *export_function_name(const Employee *employee, const IdSet *functions) {
+    const Function *func = (const Function*)id_set_get(functions, employee->function_id);
+    return func != NULL ? func->function_name : "";
+}
+
+#define BUS_EXPORT_FIELDS(FIELD)                                    \
+    FIELD("license_plate", int, row->license_plate)                 \
+    FIELD("price", money, row->price)                               \
+    FIELD("purchase_date", date, row->purchase_date)                \
+    FIELD("seat_count", int, row->seat_count)
+
+#define CLIENT_EXPORT_FIELDS(FIELD)                                 \
+    FIELD("client_id", int, row->client_id)                         \
+    FIELD("first_name", text, row->first_name)                      \
+    FIELD("last_name", text, row->last_name)                        \
+    FIELD("phone", text, row->phone)                                \
+    FIELD("city", text, row->city)                                  \
+    FIELD("province", text, row->province)                          \
+    FIELD("postal_code", int, row->postal_code)
+
+#define EMPLOYEE_EXPORT_FIELDS(FIELD)                               \
+    FIELD("employee_id", int, row->employee_id)                     \
+    FIELD("first_name", text, row->first_name)                      \
+    FIELD("last_name", text, row->last_name)                        \
+    FIELD("phone", text, row->phone)                                \
+    FIELD("function_id", int, row->function_id)
+
+#define EMPLOYEE_JOINED_EXPORT_FIELDS(FIELD)                        \
+    EMPLOYEE_EXPORT_FIELDS(FIELD)                                   \
+    FIELD("function_name", text, export_function_name(row, context))
+
+#define FUNCTION_EXPORT_FIELDS(FIELD)                               \
+    FIELD("function_id", int, row->function_id)                     \
+    FIELD("function_name", text, row->function_name)                \
+    FIELD("salary", money, row->salary)
+
+#define TRIP_EXPORT_FIELDS(FIELD)                                   \
+    FIELD("license_plate", int, row->license_plate)                 \
+    FIELD("client_id", int, row->client_id)                         \
+    FIELD("departure_time", datetime, row->departure_time)          \
+    FIELD("arrival_time", datetime, row->arrival_time)              \
+    FIELD("departure_city", text, row->departure_city)              \
+    FIELD("arrival_city", text, row->arrival_city)
+
+#define TRIP_JOINED_EXPORT_FIELDS(FIELD)                            \
+    TRIP_EXPORT_FIELDS(FIELD)                                       \
+    FIELD("client_first_name", text, export_client_field(row, context, 0)) \
+    FIELD("client_last_name", text, export_client_field(row, context, 1))
+
+DEFINE_EXPORT(bus_export, Bus, const void *, BUS_EXPORT_FIELDS)
+DEFINE_EXPORT(client_export, Client, const void *, CLIENT_EXPORT_FIELDS)
+DEFINE_EXPORT(employee_export, Employee, const void *, EMPLOYEE_EXPORT_FIELDS)
+DEFINE_EXPORT(employee_joined_export, Employee, const IdSet *, EMPLOYEE_JOINED_EXPORT_FIELDS)
+DEFINE_EXPORT(function_export, Function, const void *, FUNCTION_EXPORT_FIELDS)
+DEFINE_EXPORT(trip_export, Trip, const void *, TRIP_EXPORT_FIELDS)
+DEFINE_EXPORT(trip_joined_export, Trip, const IdSet *, TRIP_JOINED_EXPORT_FIELDS)
+
+// Writes the CSV header without the trailing separator
+#define EXPORT_HEADER(writer, name)                                                   \
+    do {                                                                              \
+        if ((writer)->format == EXPORT_CSV) {                                         \
+            export_put_raw(writer, name##_csv_header, sizeof(name##_csv_header) - 2); \
+            (writer)->buffer[(writer)->length++] = '\n';                              \
+        }                                                                             \
+    } while (0)
+
+#define EXPORT_ROWS(writer, name, type, head, condition, context)                     \
+    do {                                                                              \
+        EXPORT_HEADER(writer, name);                                                  \
+        for (const type *row = (head); row != NULL; row = row->next) {                \
+            if (!(condition)) continue;                                               \
+            if ((writer)->format == EXPORT_CSV) name##_csv_row(writer, row, context);  \
+            else name##_json_row(writer, row, context);                               \
+            rows++;                                                                   \
+        }                                                                             \
+    } while (0)
+
+static int export_archived_trip(const Trip *trip, void *context) {
+    ArchiveExport *export = (ArchiveExport*)context;
+    ExportWriter *writer = export->writer;
+    if (export->clients != NULL) {
+        if (writer->format == EXPORT_CSV) trip_joined_export_csv_row(writer, trip, export->clients);
+        else trip_joined_export_json_row(writer, trip, export->clients);
+    } else {
+        if (writer->format == EXPORT_CSV) trip_export_csv_row(writer, trip, NULL);
+        else trip_export_json_row(writer, trip, NULL);
     }
+    export->rows++;
+    return 0;
 }
 
-Trip* modify_trip(Trip *head, Bus *buses, Client *clients) {
-    if (head == NULL) {
-        printf("  No trips found in the system.\n");
-        printf("You need to add trips first before modifying them.\n");
-        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
-        return head;
+// Streams every live record of entity (an IMPORT_* code) through writer
+// and flushes it. Returns the number of rows written.
+long export_entity(BatchSession *session, ExportWriter *writer, int entity, int joined) {
+    long rows = 0;
+    batch_sweep(session);
+    switch (entity) {
+        case IMPORT_BUSES:
+            EXPORT_ROWS(writer, bus_export, Bus, session->buses, 1, NULL);
+            break;
+        case IMPORT_CLIENTS:
+            EXPORT_ROWS(writer, client_export, Client, session->clients, 1, NULL);
+            break;
+        case IMPORT_EMPLOYEES:
+            if (joined) EXPORT_ROWS(writer, employee_joined_export, Employee, session->employees, 1, &session->function_ids);
+            else EXPORT_ROWS(writer, employee_export, Employee, session->employees, 1, NULL);
+            break;
+        case IMPORT_FUNCTIONS:
+            EXPORT_ROWS(writer, function_export, Function, session->functions, 1, NULL);
+            break;
+        default: {
+            if (joined) EXPORT_ROWS(writer, trip_joined_export, Trip, session->trips, row->deleted_epoch == 0, &session->client_ids);
+            else EXPORT_ROWS(writer, trip_export, Trip, session->trips, row->deleted_epoch == 0, NULL);
+            ArchiveExport export = { writer, joined ? &session->client_ids : NULL, 0 };
+            ArchiveQuery query;
+            archive_query_all(&query);
+            trip_archive_scan(&query, export_archived_trip, &export);
+            rows += export.rows;
+            break;
+        }
     }
+    export_flush(writer);
+    return rows;
+}
 
-    // Check prerequisites
-    if (!has_buses(buses)) {
-        printf("  No buses available in the system.\n");
-        printf("You need buses available to modify trips.\n");
-        return head;
+// export <entity> <csv|ndjson> [--join] [file]: without a file the rows go
+// to the command output, so `busflow exec` can feed a pipe
+static int batch_export(BatchSession *session, char **args, int argc) {
+    int entity = -1, format = -1, joined = 0;
+    const char *path = NULL;
+    if (argc >= 2) {
+        for (int i = IMPORT_BUSES; i <= IMPORT_TRIPS; i++) {
+            if (strcmp(args[0], import_entity_names[i]) == 0) entity = i;
+        }
+        if (strcmp(args[1], "csv") == 0) format = EXPORT_CSV;
+        else if (strcmp(args[1], "ndjson") == 0) format = EXPORT_NDJSON;
     }
-    
-    if (!has_clients(clients)) {
-        printf("  No clients available in the system.\n");
-        printf("You need clients available to modify trips.\n");
-        return head;
+    int next = 2;
+    if (next < argc && strcmp(args[next], "--join") == 0) {
+        joined = 1;
+        next++;
+    }
+    if (next < argc) path = args[next++];
+    if (entity < 0 || format < 0 || next != argc) {
+        return batch_error(session, "usage: %s <buses|clients|employees|functions|trips> <csv|ndjson> [--join] [file]", "export");
     }
 
-    print_header("MODIFY TRIP");
-    
-    printf("Enter bus license plate of the trip to modify: ");
-    int license_plate = safe_int_input();
-    printf("Enter client ID of the trip to modify: ");
-    int client_id = safe_int_input();
+    if (path == NULL) {
+        export_entity(session, export_begin(session->out, format), entity, joined);
+        return 0;
+    }
 
-    Trip *temp = head;
-    while (temp != NULL && (temp->license_plate != license_plate || temp->client_id != client_id)) {
-        temp = temp->next;
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        return batch_error(session, "cannot create %s", path);
+    }
+    double started = monotonic_ms();
+    ExportWriter *writer = export_begin(file, format);
+    long rows = export_entity(session, writer, entity, joined);
+    int failed = ferror(file);
+    if (fclose(file) != 0) failed = 1;
+    double elapsed_ms = monotonic_ms() - started;
+    if (failed) {
+        return batch_error(session, "error writing %s", path);
+    }
+
+    fprintf(session->out, "exported %ld %s to %s, %llu bytes (%.1f ms", rows, import_entity_names[entity], path,
+            writer->bytes, elapsed_ms);
+    if (elapsed_ms > 0) fprintf(session->out, ", %.0f MB/s", writer->bytes / 1e3 / elapsed_ms);
+    fprintf(session->out, ")\n");
+    return 0;
+}
+
+// Reload functions
+// The Reload menu items diff the file against the list instead of freeing
+// it and parsing everything again. Records are matched by primary key (bus
+// + client + departure for trips) and compared by a hash of their fields,
+// so only inserted, updated and deleted records touch the list. Updated
+// records keep their address and only changed trips are re-indexed.
+#define RELOAD_HASH_SEED 0xCBF29CE484222325ULL
+#define HASH_FIELD(hash, field) hash_bytes(hash, &(field), sizeof(field))
+#define HASH_TEXT(hash, text) hash_bytes(hash, text, strlen(text) + 1)
+
+static unsigned long long hash_bytes(unsigned long long hash, const void *data, size_t length) {
+    const unsigned char *bytes = (const unsigned char*)data;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+static unsigned long long bus_record_hash(const Bus *bus) {
+    unsigned long long hash = RELOAD_HASH_SEED;
+    hash = HASH_FIELD(hash, bus->license_plate);
+    hash = HASH_FIELD(hash, bus->price);
+    hash = HASH_FIELD(hash, bus->purchase_date);
+    return HASH_FIELD(hash, bus->seat_count);
+}
+
+static unsigned long long client_record_hash(const Client *client) {
+    unsigned long long hash = RELOAD_HASH_SEED;
+    hash = HASH_FIELD(hash, client->client_id);
+    hash = HASH_TEXT(hash, client->first_name);
+    hash = HASH_TEXT(hash, client->last_name);
+    hash = HASH_TEXT(hash, client->phone);
+    hash = HASH_TEXT(hash, client->city);
+    hash = HASH_TEXT(hash, client->province);
+    return HASH_FIELD(hash, client->postal_code);
+}
+
+static unsigned long long employee_record_hash(const Employee *employee) {
+    unsigned long long hash = RELOAD_HASH_SEED;
+    hash = HASH_FIELD(hash, employee->employee_id);
+    hash = HASH_TEXT(hash, employee->first_name);
+    hash = HASH_TEXT(hash, employee->last_name);
+    hash = HASH_TEXT(hash, employee->phone);
+    return HASH_FIELD(hash, employee->function_id);
+}
+
+static unsigned long long function_record_hash(const Function *func) {
+    unsigned long long hash = RELOAD_HASH_SEED;
+    hash = HASH_FIELD(hash, func->function_id);
+    hash = HASH_TEXT(hash, func->function_name);
+    return HASH_FIELD(hash, func->salary);
+}
+
+static unsigned long long trip_record_hash(const Trip *trip) {
+    unsigned long long hash = RELOAD_HASH_SEED;
+    hash = HASH_FIELD(hash, trip->license_plate);
+    hash = HASH_FIELD(hash, trip->client_id);
+    hash = HASH_FIELD(hash, trip->departure_time);
+    hash = HASH_FIELD(hash, trip->arrival_time);
+    hash = HASH_TEXT(hash, trip->departure_city);
+    return HASH_TEXT(hash, trip->arrival_city);
+}
+
+// Trips have no id; a bus carries a client on one departure only once
+static unsigned long long trip_record_key(const Trip *trip) {
+    long departure = datetime_to_minutes(trip->departure_time);
+    unsigned long long hash = RELOAD_HASH_SEED;
+    hash = HASH_FIELD(hash, trip->license_plate);
+    hash = HASH_FIELD(hash, trip->client_id);
+    return HASH_FIELD(hash, departure);
+}
+
+static int compare_reload_keys(const void *a, const void *b) {
+    const ReloadEntry *x = (const ReloadEntry*)a;
+    const ReloadEntry *y = (const ReloadEntry*)b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return (x->hash > y->hash) - (x->hash < y->hash);
+}
+
+static int compare_reload_positions(const void *a, const void *b) {
+    return ((const ReloadEntry*)a)->position - ((const ReloadEntry*)b)->position;
+}
+
+static void reload_pair(ReloadEntry *memory, ReloadEntry *file) {
+    memory->partner = file->record;
+    file->partner = memory->record;
+    file->changed = memory->hash != file->hash;
+}
+
+// Pairs memory and file entries with equal keys and flags pairs whose
+// fields differ. When a key repeats, identical records are paired first so
+// that removing one of them reads as a delete, not as updates. Both arrays
+// are returned in list order.
+static void reload_match(ReloadEntry *memory, int memory_count, ReloadEntry *file, int file_count) {
+    qsort(memory, memory_count, sizeof(ReloadEntry), compare_reload_keys);
+    qsort(file, file_count, sizeof(ReloadEntry), compare_reload_keys);
+    int i = 0, j = 0;
+    while (i < memory_count && j < file_count) {
+        if (memory[i].key < file[j].key) {
+            i++;
+            continue;
+        }
+        if (memory[i].key > file[j].key) {
+            j++;
+            continue;
+        }
+
+        int memory_end = i, file_end = j;
+        while (memory_end < memory_count && memory[memory_end].key == memory[i].key) memory_end++;
+        while (file_end < file_count && file[file_end].key == file[j].key) file_end++;
+        if (memory_end - i == 1 && file_end - j == 1) {
+            reload_pair(&memory[i], &file[j]);
+        } else {
+            // Both runs are sorted by hash: merge equal hashes, then pair the rest
+            for (int a = i, b = j; a < memory_end && b < file_end; ) {
+                if (memory[a].hash < file[b].hash) a++;
+                else if (memory[a].hash > file[b].hash) b++;
+                else reload_pair(&memory[a++], &file[b++]);
+            }
+            for (int a = i, b = j; a < memory_end && b < file_end; a++, b++) {
+                while (a < memory_end && memory[a].partner != NULL) a++;
+                while (b < file_end && file[b].partner != NULL) b++;
+                if (a < memory_end && b < file_end) reload_pair(&memory[a], &file[b]);
+            }
+        }
+        i = memory_end;
+        j = file_end;
     }
+    qsort(memory, memory_count, sizeof(ReloadEntry), compare_reload_positions);
+    qsort(file, file_count, sizeof(ReloadEntry), compare_reload_positions);
+}
 
-    if (temp == NULL) {
-        printf("Trip not found.\n");
+// Expands to reload_<name>_from_file for a list keyed by an int id. Deleted
+// records are unlinked in one walk, inserted ones are appended in file order
+// and updated ones are overwritten in place.
+#define DEFINE_RELOAD(name, type, filename, slot_filename, load_list, free_list, key_field, record_hash) \
+    type* reload_##name##_from_file(type *head, ReloadReport *report) {                               \
+        memset(report, 0, sizeof(ReloadReport));                                                      \
+        if (stored_data_size(filename, slot_filename) == 0) return head;                              \
+        double started = monotonic_ms();                                                              \
+        report->found = 1;                                                                            \
+        type *loaded = load_list(NULL);                                                               \
+        int memory_count = 0, file_count = 0;                                                         \
+        for (type *record = head; record != NULL; record = record->next) memory_count++;              \
+        for (type *record = loaded; record != NULL; record = record->next) file_count++;              \
+                                                                                                      \
+        ReloadEntry *memory = (ReloadEntry*)calloc(memory_count + 1, sizeof(ReloadEntry));            \
+        ReloadEntry *file = (ReloadEntry*)calloc(file_count + 1, sizeof(ReloadEntry));                \
+        if (memory == NULL || file == NULL) {                                                         \
+            /* Not enough memory to diff: replace the list as a plain load does */                    \
+            free(memory);                                                                             \
+            free(file);                                                                               \
+            free_list(head);                                                                          \
+            report->inserted = file_count;                                                            \
+            report->deleted = memory_count;                                                           \
+            report->elapsed_ms = monotonic_ms() - started;                                            \
+            return loaded;                                                                            \
+        }                                                                                             \
+        int n = 0;                                                                                    \
+        for (type *record = head; record != NULL; record = record->next, n++) {                       \
+            memory[n].key = (unsigned int)record->key_field;                                          \
+            memory[n].hash = record_hash(record);                                                     \
+            memory[n].position = n;                                                                   \
+            memory[n].record = record;                                                                \
+        }                                                                                             \
+        n = 0;                                                                                        \
+        for (type *record = loaded; record != NULL; record = record->next, n++) {                     \
+            file[n].key = (unsigned int)record->key_field;                                            \
+            file[n].hash = record_hash(record);                                                       \
+            file[n].position = n;                                                                     \
+            file[n].record = record;                                                                  \
+        }                                                                                             \
+        reload_match(memory, memory_count, file, file_count);                                         \
+                                                                                                      \
+        type **link = &head;                                                                          \
+        for (int i = 0; i < memory_count; i++) {                                                      \
+            type *record = *link;                                                                     \
+            if (memory[i].partner == NULL) {                                                          \
+                *link = record->next;                                                                 \
+                free(record);                                                                         \
+                report->deleted++;                                                                    \
+            } else {                                                                                  \
+                link = &record->next;                                                                 \
+            }                                                                                         \
+        }                                                                                             \
+        for (int j = 0; j < file_count; j++) {                                                        \
+            type *record = (type*)file[j].record;                                                     \
+            type *target = (type*)file[j].partner;                                                    \
+            if (target == NULL) {                                                                     \
+                record->next = NULL;                                                                  \
+                *link = record;                                                                       \
+                link = &record->next;                                                                 \
+                report->inserted++;                                                                   \
+                continue;                                                                             \
+            }                                                                                         \
+            if (file[j].changed) {                                                                    \
+                type *next = target->next;                                                            \
+                *target = *record;                                                                    \
+                target->next = next;                                                                  \
+                report->updated++;                                                                    \
+            } else {                                                                                  \
+                report->unchanged++;                                                                  \
+            }                                                                                         \
+            free(record);                                                                             \
+        }                                                                                             \
+        free(memory);                                                                                 \
+        free(file);                                                                                   \
+        report->elapsed_ms = monotonic_ms() - started;                                                \
+        return head;                                                                                  \
+    }
+
+DEFINE_RELOAD(buses, Bus, BUS_FILENAME, BUS_SLOT_FILENAME, load_buses_from_file, free_bus_list, license_plate,
+              bus_record_hash)
+DEFINE_RELOAD(clients, Client, CLIENT_FILENAME, CLIENT_SLOT_FILENAME, load_clients_from_file, free_client_list, client_id,
+              client_record_hash)
+DEFINE_RELOAD(employees, Employee, EMPLOYEE_FILENAME, EMPLOYEE_SLOT_FILENAME, load_employees_from_file, free_employee_list,
+              employee_id, employee_record_hash)
+DEFINE_RELOAD(functions, Function, FUNCTION_FILENAME, NULL, load_functions_from_file, free_function_list, function_id,
+              function_record_hash)
+
+// Same diff for trips; deleted and updated trips leave the departure and
+// usage indexes one by one and the new versions are added in one batch
+Trip* reload_trips_from_file(Trip *head, ReloadReport *report) {
+    memset(report, 0, sizeof(ReloadReport));
+    FILE *source = fopen(TRIP_FILENAME, "r");
+    if (source == NULL) return head;
+    if (data_file_size(TRIP_FILENAME) == 0) {
+        fclose(source);
         return head;
     }
+    double started = monotonic_ms();
+    report->found = 1;
+    Trip *loaded = read_trip_records(source);
+    fclose(source);
+
+    int memory_count = 0, file_count = 0;
+    for (Trip *trip = head; trip != NULL; trip = trip->next) memory_count++;
+    for (Trip *trip = loaded; trip != NULL; trip = trip->next) file_count++;
+
+    ReloadEntry *memory = (ReloadEntry*)calloc(memory_count + 1, sizeof(ReloadEntry));
+    ReloadEntry *file = (ReloadEntry*)calloc(file_count + 1, sizeof(ReloadEntry));
+    Trip **reindex = (Trip**)malloc((file_count + 1) * sizeof(Trip*));
+    if (memory == NULL || file == NULL || reindex == NULL) {
+        free(memory);
+        free(file);
+        free(reindex);
+        free_trip_list(head);
+        trip_indexes_rebuild(loaded);
+        report->inserted = file_count;
+        report->deleted = memory_count;
+        report->elapsed_ms = monotonic_ms() - started;
+        return loaded;
+    }
+    int n = 0;
+    for (Trip *trip = head; trip != NULL; trip = trip->next, n++) {
+        memory[n].key = trip_record_key(trip);
+        memory[n].hash = trip_record_hash(trip);
+        memory[n].position = n;
+        memory[n].record = trip;
+    }
+    n = 0;
+    for (Trip *trip = loaded; trip != NULL; trip = trip->next, n++) {
+        file[n].key = trip_record_key(trip);
+        file[n].hash = trip_record_hash(trip);
+        file[n].position = n;
+        file[n].record = trip;
+    }
+    reload_match(memory, memory_count, file, file_count);
+
+    Trip **link = &head;
+    for (int i = 0; i < memory_count; i++) {
+        Trip *trip = *link;
+        if (memory[i].partner == NULL) {
+            trip_indexes_remove(trip);
+            *link = trip->next;
+            free(trip);
+            report->deleted++;
+        } else {
+            link = &trip->next;
+        }
+    }
+    int reindexed = 0;
+    for (int j = 0; j < file_count; j++) {
+        Trip *trip = (Trip*)file[j].record;
+        Trip *target = (Trip*)file[j].partner;
+        if (target == NULL) {
+            trip->next = NULL;
+            *link = trip;
+            link = &trip->next;
+            reindex[reindexed++] = trip;
+            report->inserted++;
+            continue;
+        }
+        if (file[j].changed) {
+            trip_indexes_remove(target);
+            Trip *next = target->next;
+            *target = *trip;
+            target->next = next;
+            reindex[reindexed++] = target;
+            report->updated++;
+        } else {
+            report->unchanged++;
+        }
+        free(trip);
+    }
+    if (reindexed > 0) trip_indexes_add_batch(reindex, reindexed);
 
-    printf("\nCurrent trip details:\n");
-    printf("Bus: %d, Client: %d\n", temp->license_plate, temp->client_id);
-    printf("Route: %s to %s\n", temp->departure_city, temp->arrival_city);
-    printf("Departure: %02d/%02d/%d %02d:%02d\n", 
-           temp->departure_time.day, temp->departure_time.month, temp->departure_time.year,
-           temp->departure_time.hour, temp->departure_time.minute);
-    printf("Arrival: %02d/%02d/%d %02d:%02d\n", 
-           temp->arrival_time.day, temp->arrival_time.month, temp->arrival_time.year,
-           temp->arrival_time.hour, temp->arrival_time.minute);
+    free(memory);
+    free(file);
+    free(reindex);
+    report->elapsed_ms = monotonic_ms() - started;
+    return head;
+}
 
-    printf("\nEnter new details:\n");
-    printf("New departure city: ");
-    scanf("%99s", temp->departure_city);
-    printf("New arrival city: ");
-    scanf("%99s", temp->arrival_city);
+void display_reload_report(const char *entity, const ReloadReport *report) {
+    if (!report->found) {
+        printf("\nNo saved %s found; the list was left unchanged.\n", entity);
+        return;
+    }
+    set_console_color(2);
+    printf("\nReloaded %s from file (%.1f ms):\n", entity, report->elapsed_ms);
+    set_console_color(7);
+    printf("  Inserted:  %d\n", report->inserted);
+    printf("  Updated:   %d\n", report->updated);
+    printf("  Deleted:   %d\n", report->deleted);
+    printf("  Unchanged: %d\n", report->unchanged);
+}
 
-    // Update departure time
-    DateTime departure;
-    do {
-        printf("New departure date and time:\n");
-        printf("Year (1900-2100): ");
-        departure.year = safe_int_input();
-        printf("Month (1-12): ");
-        departure.month = safe_int_input();
-        printf("Day: ");
-        departure.day = safe_int_input();
-        printf("Hour (0-23): ");
-        departure.hour = safe_int_input();
-        printf("Minute (0-59): ");
-        departure.minute = safe_int_input();
-        
-        if (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute)) {
-            printf("Invalid date/time. Please enter valid values.\n");
+static void write_trip_record(FILE *out, const Trip *trip) {
+    fprintf(out, "%d,%d,%d/%d/%d %d:%02d,%d/%d/%d %d:%02d,%s,%s\n", trip->license_plate, trip->client_id,
+            trip->departure_time.day, trip->departure_time.month, trip->departure_time.year,
+            trip->departure_time.hour, trip->departure_time.minute,
+            trip->arrival_time.day, trip->arrival_time.month, trip->arrival_time.year,
+            trip->arrival_time.hour, trip->arrival_time.minute,
+            trip->departure_city, trip->arrival_city);
+}
+
+static int archived_trip_record(const Trip *trip, void *context) {
+    write_trip_record((FILE*)context, trip);
+    return 0;
+}
+
+// list / count write one comma-separated line per record, in file order;
+// archived trips follow the live ones
+static int batch_list(BatchSession *session, char **args, int argc, int count_only) {
+    if (argc != 1) {
+        return batch_error(session, "usage: %s <buses|clients|employees|functions|trips>", count_only ? "count" : "list");
+    }
+
+    batch_sweep(session);
+    FILE *out = session->out;
+    int count = 0;
+    if (strcmp(args[0], "buses") == 0) {
+        for (Bus *bus = session->buses; bus != NULL; bus = bus->next, count++) {
+            if (count_only) continue;
+            fprintf(out, "%d,%.2f,%d/%d/%d,%d\n", bus->license_plate, bus->price,
+                    bus->purchase_date.day, bus->purchase_date.month, bus->purchase_date.year, bus->seat_count);
         }
-    } while (!is_valid_datetime(departure.day, departure.month, departure.year, departure.hour, departure.minute));
+    } else if (strcmp(args[0], "clients") == 0) {
+        for (Client *client = session->clients; client != NULL; client = client->next, count++) {
+            if (count_only) continue;
+            fprintf(out, "%d,%s,%s,%s,%s,%s,%d\n", client->client_id, client->first_name, client->last_name,
+                    client->phone, client->city, client->province, client->postal_code);
+        }
+    } else if (strcmp(args[0], "employees") == 0) {
+        for (Employee *employee = session->employees; employee != NULL; employee = employee->next, count++) {
+            if (count_only) continue;
+            fprintf(out, "%d,%s,%s,%s,%d\n", employee->employee_id, employee->first_name, employee->last_name,
+                    employee->phone, employee->function_id);
+        }
+    } else if (strcmp(args[0], "functions") == 0) {
+        for (Function *func = session->functions; func != NULL; func = func->next, count++) {
+            if (count_only) continue;
+            fprintf(out, "%d,%s,%.2f\n", func->function_id, func->function_name, func->salary);
+        }
+    } else if (strcmp(args[0], "trips") == 0) {
+        for (Trip *trip = session->trips; trip != NULL; trip = trip->next) {
+            if (trip->deleted_epoch != 0) continue;
+            count++;
+            if (!count_only) write_trip_record(out, trip);
+        }
+        if (count_only) {
+            count += (int)trip_archive_rows();
+        } else {
+            ArchiveQuery query;
+            archive_query_all(&query);
+            count += (int)trip_archive_scan(&query, archived_trip_record, out);
+        }
+    } else {
+        return batch_error(session, "unknown entity '%s'", args[0]);
+    }
 
-    temp->departure_time = departure;
+    if (count_only) fprintf(out, "%d\n", count);
+    return 0;
+}
 
-    // Update arrival time
-    DateTime arrival;
-    do {
-        printf("New arrival date and time:\n");
-        printf("Year (1900-2100): ");
-        arrival.year = safe_int_input();
-        printf("Month (1-12): ");
-        arrival.month = safe_int_input();
-        printf("Day: ");
-        arrival.day = safe_int_input();
-        printf("Hour (0-23): ");
-        arrival.hour = safe_int_input();
-        printf("Minute (0-59): ");
-        arrival.minute = safe_int_input();
-        
-        if (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute)) {
-            printf("Invalid date/time. Please enter valid values.\n");
+// Same aligned layout as the display screens, for reports and large exports
+static int batch_table(BatchSession *session, char **args, int argc) {
+    if (argc != 1) {
+        return batch_error(session, "usage: %s <buses|clients|employees|functions|trips>", "table");
+    }
+
+    batch_sweep(session);
+    TableWriter *writer = table_begin(session->out);
+    if (strcmp(args[0], "buses") == 0) {
+        TABLE_HEADER(writer, bus_table);
+        for (Bus *bus = session->buses; bus != NULL; bus = bus->next) {
+            bus_table_row(writer, bus, NULL);
         }
-    } while (!is_valid_datetime(arrival.day, arrival.month, arrival.year, arrival.hour, arrival.minute));
+    } else if (strcmp(args[0], "clients") == 0) {
+        TABLE_HEADER(writer, client_table);
+        for (Client *client = session->clients; client != NULL; client = client->next) {
+            client_table_row(writer, client, NULL);
+        }
+    } else if (strcmp(args[0], "employees") == 0) {
+        TABLE_HEADER(writer, employee_table);
+        for (Employee *employee = session->employees; employee != NULL; employee = employee->next) {
+            employee_table_row(writer, employee, session->functions);
+        }
+    } else if (strcmp(args[0], "functions") == 0) {
+        TABLE_HEADER(writer, function_table);
+        for (Function *func = session->functions; func != NULL; func = func->next) {
+            function_table_row(writer, func, NULL);
+        }
+    } else if (strcmp(args[0], "trips") == 0) {
+        TABLE_HEADER(writer, trip_table);
+        for (Trip *trip = session->trips; trip != NULL; trip = trip->next) {
+            if (trip->deleted_epoch == 0) trip_table_row(writer, trip, NULL);
+        }
+        ArchiveQuery query;
+        archive_query_all(&query);
+        trip_archive_scan(&query, archived_trip_table_row, writer);
+    } else {
+        return batch_error(session, "unknown entity '%s'", args[0]);
+    }
+    table_flush(writer);
+    return 0;
+}
 
-    temp->arrival_time = arrival;
+static SaveSet batch_save_set(const BatchSession *session) {
+    SaveSet set;
+    memset(&set, 0, sizeof(set));
+    set.buses = session->buses;
+    set.clients = session->clients;
+    set.employees = session->employees;
+    set.functions = session->functions;
+    set.trips = session->trips;
+    set.files = SAVE_CORE;
+    return set;
+}
 
-    printf("Trip information updated successfully!\n");
-    return head;
+static int batch_save(BatchSession *session) {
+    batch_sweep(session);
+    SaveSet set = batch_save_set(session);
+    if (record_foreground_save(&set) != 0) return -1; // still dirty
+    session->dirty = 0;
+    return 0;
 }
 
-Trip* delete_trip(Trip *head) {
-    if (head == NULL) {
-        printf("  No trips found in the system.\n");
-        printf("You need to add trips first before deleting them.\n");
-        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
-        return head;
-    }
+// Background save of a consistent point in time; deferred deletes are
+// applied first so the copy the save process writes has none pending
+static void batch_autosave(BatchSession *session) {
+    batch_sweep(session);
+    SaveSet set = batch_save_set(session);
+    if (autosave_start(&set) == 0) session->dirty = 0;
+}
 
-    print_header("DELETE TRIP");
-    
-    printf("Enter bus license plate of the trip to delete: ");
-    int license_plate = safe_int_input();
-    printf("Enter client ID of the trip to delete: ");
-    int client_id = safe_int_input();
+// Runs one command line. Blank lines and lines starting with '#' are
+// ignored; everything except login needs an authenticated session.
+// Returns 0 on success and -1 after reporting an error to session->out.
+int batch_execute_line(BatchSession *session, char *line) {
+    char *args[16];
+    int argc = 0;
+    session->line_number++;
 
-    Trip *prev = NULL;
-    Trip *temp = head;
-    while (temp != NULL && (temp->license_plate != license_plate || temp->client_id != client_id)) {
-        prev = temp;
-        temp = temp->next;
+    for (char *token = strtok(line, " \t\r\n"); token != NULL; token = strtok(NULL, " \t\r\n")) {
+        if (argc == 16) return batch_error(session, "%s", "too many arguments");
+        args[argc++] = token;
     }
+    if (argc == 0 || args[0][0] == '#') return 0;
 
-    if (temp == NULL) {
-        printf("Trip not found.\n");
-        return head;
+    const char *command = args[0];
+    if (strcmp(command, "login") == 0) {
+        if (argc != 3 || !check_credentials(&session->users, args[1], args[2])) {
+            return batch_error(session, "%s", "invalid username or password");
+        }
+        session->authenticated = 1;
+        return 0;
+    }
+    if (!session->authenticated) {
+        return batch_error(session, "'%s' needs a login first", command);
+    }
+
+    int result;
+    int modifies = 1;
+    if (strcmp(command, "add-bus") == 0) result = batch_add_bus(session, args + 1, argc - 1);
+    else if (strcmp(command, "delete-bus") == 0) result = batch_delete_bus(session, args + 1, argc - 1);
+    else if (strcmp(command, "add-client") == 0) result = batch_add_client(session, args + 1, argc - 1);
+    else if (strcmp(command, "delete-client") == 0) result = batch_delete_client(session, args + 1, argc - 1);
+    else if (strcmp(command, "add-function") == 0) result = batch_add_function(session, args + 1, argc - 1);
+    else if (strcmp(command, "delete-function") == 0) result = batch_delete_function(session, args + 1, argc - 1);
+    else if (strcmp(command, "add-employee") == 0) result = batch_add_employee(session, args + 1, argc - 1);
+    else if (strcmp(command, "delete-employee") == 0) result = batch_delete_employee(session, args + 1, argc - 1);
+    else if (strcmp(command, "add-trip") == 0) result = batch_add_trip(session, args + 1, argc - 1);
+    else if (strcmp(command, "delete-trip") == 0) result = batch_delete_trip(session, args + 1, argc - 1);
+    else if (strcmp(command, "import") == 0) result = batch_import(session, args + 1, argc - 1);
+    else {
+        modifies = 0;
+        if (strcmp(command, "list") == 0) result = batch_list(session, args + 1, argc - 1, 0);
+        else if (strcmp(command, "count") == 0) result = batch_list(session, args + 1, argc - 1, 1);
+        else if (strcmp(command, "table") == 0) result = batch_table(session, args + 1, argc - 1);
+        else if (strcmp(command, "export") == 0) result = batch_export(session, args + 1, argc - 1);
+        else if (strcmp(command, "save") == 0) {
+            if (batch_save(session) != 0) return batch_error(session, "%s", "the data could not be saved");
+            result = 0;
+        }
+        else if (strcmp(command, "stats") == 0) {
+            display_save_stats(session->out);
+            result = 0;
+        }
+        else return batch_error(session, "unknown command '%s'", command);
     }
 
-   
+    if (result == 0) {
+        session->applied++;
+        if (modifies) session->dirty = 1;
+    }
+    return result;
+}
 
-    // Show trip details before deletion
-    printf("\nTrip to be deleted:\n");
-    printf("Bus: %d, Client: %d\n", temp->license_plate, temp->client_id);
-    printf("Route: %s to %s\n", temp->departure_city, temp->arrival_city);
-    printf("Departure: %02d/%02d/%d %02d:%02d\n", 
-           temp->departure_time.day, temp->departure_time.month, temp->departure_time.year,
-           temp->departure_time.hour, temp->departure_time.minute);
-    printf("Arrival: %02d/%02d/%d %02d:%02d\n", 
-           temp->arrival_time.day, temp->arrival_time.month, temp->arrival_time.year,
-           temp->arrival_time.hour, temp->arrival_time.minute);
-    
-    // Confirm deletion
-    char confirm;
-    printf("\nAre you sure you want to delete this trip? (y/N): ");
-    scanf(" %c", &confirm);
-    
-    if (confirm == 'y' || confirm == 'Y') {
-        if (prev == NULL) {
-            head = temp->next;
-        } else {
-            prev->next = temp->next;
+// Saves once if anything changed since the last save, then frees the
+// session. Returns 0, or -1 if that save failed.
+int batch_session_close(BatchSession *session) {
+    int result = 0;
+    if (session->authenticated && session->dirty) {
+        result = batch_save(session);
+    }
+    free_bus_list(session->buses);
+    free_client_list(session->clients);
+    free_employee_list(session->employees);
+    free_function_list(session->functions);
+    free_trip_list(session->trips);
+    for (int i = 0; i < session->retired_count; i++) {
+        free(session->retired_trips[i].trip);
+    }
+    free(session->retired_trips);
+    snapshot_registry_destroy(&session->snapshots);
+    free_maintenance_schedule(session->maintenance);
+    free_crew_list(session->crew);
+    id_set_free(&session->bus_ids);
+    id_set_free(&session->client_ids);
+    id_set_free(&session->employee_ids);
+    id_set_free(&session->function_ids);
+    free(session->pending_deletes);
+    user_store_free(&session->users);
+    memset(session, 0, sizeof(BatchSession));
+    return result;
+}
+
+// busflow exec: reads commands from in until EOF. BUSFLOW_USER and
+// BUSFLOW_PASSWORD, when both set, log in before the first line so scripts
+// need not carry credentials. Returns the process exit status.
+int run_batch_script(FILE *in, FILE *out) {
+    BatchSession *session = (BatchSession*)malloc(sizeof(BatchSession));
+    int opened = session != NULL ? batch_session_open(session, out) : -1;
+    if (opened != 0) {
+        if (opened == -2) fprintf(out, "The data stores are in use. Cannot start batch session.\n");
+        else fprintf(out, "Memory allocation error. Cannot start batch session.\n");
+        free(session);
+        return 1;
+    }
+
+    const char *username = getenv("BUSFLOW_USER");
+    const char *password = getenv("BUSFLOW_PASSWORD");
+    if (username != NULL && password != NULL) {
+        if (!check_credentials(&session->users, username, password)) {
+            fprintf(out, "Invalid BUSFLOW_USER or BUSFLOW_PASSWORD.\n");
+            batch_session_close(session);
+            free(session);
+            return 1;
         }
-        free(temp);
-        printf("Trip deleted successfully!\n");
-    } else {
-        printf("Deletion cancelled.\n");
+        session->authenticated = 1;
     }
-    
-    return head;
-}
 
-void search_trip(Trip *head, Bus *buses, Client *clients) {
-    if (head == NULL) {
-        printf("  No trips found in the system.\n");
-        printf("You need to add trips first before searching for them.\n");
-        printf("Please go to 'Trip Management' -> 'Add New Trip' to create your first trip.\n");
-        return;
+    char line[1024];
+    clock_t started = clock();
+    while (fgets(line, sizeof(line), in) != NULL) {
+        // Without a login nothing after this line can run either
+        if (batch_execute_line(session, line) != 0 && !session->authenticated) break;
     }
+    double elapsed_ms = 1000.0 * (clock() - started) / CLOCKS_PER_SEC;
 
-    print_header("SEARCH TRIP");
-    
-    printf("Enter bus license plate to search: ");
-    int license_plate = safe_int_input();
-    printf("Enter client ID to search: ");
-    int client_id = safe_int_input();
+    int errors = session->errors;
+    fprintf(out, "%d commands applied, %d errors (%.1f ms)\n", session->applied, errors, elapsed_ms);
+    if (batch_session_close(session) != 0) {
+        fprintf(out, "The changes could not be saved.\n");
+        errors++;
+    }
+    free(session);
+    return errors > 0 ? 1 : 0;
+}
 
-    Trip *temp = head;
-    while (temp != NULL && (temp->license_plate != license_plate || temp->client_id != client_id)) {
-        temp = temp->next;
+// Server mode functions
+// busflow serve keeps one dataset in memory and runs the batch command set
+// for every connected client from a single epoll loop, so concurrent
+// operators see each other's changes and the files are written by one
+// process only.
+#ifdef __linux__
+static volatile sig_atomic_t server_stop = 0;
+
+// Finished snapshot reads, handed back to the event loop through a pipe
+static int server_wake_pipe[2] = {-1, -1};
+static pthread_mutex_t server_done_lock = PTHREAD_MUTEX_INITIALIZER;
+static SnapshotJob *server_done_jobs = NULL;
+static int server_jobs_running = 0;
+
+static void server_signal_handler(int signal_number) {
+    (void)signal_number;
+    server_stop = 1;
+}
+
+static int server_reserve(char **buffer, size_t *capacity, size_t needed) {
+    if (needed <= *capacity) return 0;
+    size_t new_capacity = *capacity ? *capacity : 4096;
+    while (new_capacity < needed) new_capacity *= 2;
+    char *grown = (char*)realloc(*buffer, new_capacity);
+    if (grown == NULL) return -1;
+    *buffer = grown;
+    *capacity = new_capacity;
+    return 0;
+}
+
+static void server_free_connection(ServerConnection *conn) {
+    free(conn->input);
+    free(conn->output);
+    free(conn);
+}
+
+// A connection with a snapshot read in flight is freed when the read completes
+static void server_close_connection(int epoll_fd, ServerConnection *conn) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    conn->fd = -1;
+    if (!conn->busy) server_free_connection(conn);
+}
+
+static int server_queue_response(ServerConnection *conn, int ok, const char *payload, size_t payload_length) {
+    char frame[32];
+    int frame_length = snprintf(frame, sizeof(frame), "%c %lu\n", ok ? '+' : '-', (unsigned long)payload_length);
+    size_t needed = conn->output_length + frame_length + payload_length;
+    if (server_reserve(&conn->output, &conn->output_capacity, needed) != 0) return -1;
+    memcpy(conn->output + conn->output_length, frame, frame_length);
+    memcpy(conn->output + conn->output_length + frame_length, payload, payload_length);
+    conn->output_length = needed;
+    return 0;
+}
+
+// Reader thread body: walks the trip list as of job->epoch without locks,
+// then the archive, which only busflow archive changes
+static void *server_snapshot_worker(void *arg) {
+    SnapshotJob *job = (SnapshotJob*)arg;
+    FILE *capture = open_memstream(&job->payload, &job->payload_length);
+    if (capture != NULL) {
+        TableWriter *writer = NULL;
+        if (job->kind == SNAPSHOT_TABLE && (writer = (TableWriter*)malloc(sizeof(TableWriter))) != NULL) {
+            writer->out = capture;
+            writer->length = 0;
+            TABLE_HEADER(writer, trip_table);
+        }
+        long count = 0;
+        for (Trip *trip = job->head; trip != NULL; trip = snapshot_next(trip)) {
+            if (!trip_visible(trip, job->epoch)) continue;
+            count++;
+            if (job->kind == SNAPSHOT_LIST) write_trip_record(capture, trip);
+            else if (writer != NULL) trip_table_row(writer, trip, NULL);
+        }
+        ArchiveQuery query;
+        archive_query_all(&query);
+        if (job->kind == SNAPSHOT_COUNT) count += trip_archive_rows();
+        else if (job->kind == SNAPSHOT_LIST) trip_archive_scan(&query, archived_trip_record, capture);
+        else if (writer != NULL) trip_archive_scan(&query, archived_trip_table_row, writer);
+        if (writer != NULL) {
+            table_flush(writer);
+            free(writer);
+        }
+        if (job->kind == SNAPSHOT_COUNT) fprintf(capture, "%ld\n", count);
+        fclose(capture);
     }
 
-    if (temp == NULL) {
-        printf("Trip not found.\n");
-    } else {
-        printf("\nTrip found!\n\n");
-        set_console_color(2);
-        printf("%-10s %-10s %-15s %-15s %-20s %-20s\n", 
-               "Bus", "Client", "Departure", "Arrival", "Departure Time", "Arrival Time");
-        printf("%-10s %-10s %-15s %-15s %-20s %-20s\n", 
-               "===", "======", "=========", "=======", "==============", "============");
-        set_console_color(7);
-        printf("%-10d %-10d %-15s %-15s %02d/%02d/%d %02d:%02d   %02d/%02d/%d %02d:%02d\n",
-               temp->license_plate,
-               temp->client_id,
-               temp->departure_city,
-               temp->arrival_city,
-               temp->departure_time.day,
-               temp->departure_time.month,
-               temp->departure_time.year,
-               temp->departure_time.hour,
-               temp->departure_time.minute,
-               temp->arrival_time.day,
-               temp->arrival_time.month,
-               temp->arrival_time.year,
-               temp->arrival_time.hour,
-               temp->arrival_time.minute);
+    pthread_mutex_lock(&server_done_lock);
+    job->next = server_done_jobs;
+    server_done_jobs = job;
+    pthread_mutex_unlock(&server_done_lock);
+    char wake = 1;
+    while (write(server_wake_pipe[1], &wake, 1) < 0 && errno == EINTR) {
     }
+    return NULL;
 }
 
-void save_trips_to_file(Trip *head) {
-    FILE *file = fopen(TRIP_FILENAME, "w");
-    if (file == NULL) {
-        return;
+// Trip listings are the long reads; they run on a snapshot in their own
+// thread so writes from other connections keep flowing. Returns 1 if the
+// request was handed off, 0 to run it inline.
+static int server_start_snapshot_read(BatchSession *session, ServerConnection *conn, const char *line) {
+    char command[16], entity[16], extra[2];
+    if (!conn->authenticated || sscanf(line, "%15s %15s %1s", command, entity, extra) != 2 ||
+        strcmp(entity, "trips") != 0) {
+        return 0;
+    }
+    int kind;
+    if (strcmp(command, "list") == 0) kind = SNAPSHOT_LIST;
+    else if (strcmp(command, "count") == 0) kind = SNAPSHOT_COUNT;
+    else if (strcmp(command, "table") == 0) kind = SNAPSHOT_TABLE;
+    else return 0;
+
+    SnapshotJob *job = (SnapshotJob*)calloc(1, sizeof(SnapshotJob));
+    if (job == NULL) return 0;
+    job->slot = snapshot_begin(&session->snapshots, &job->epoch);
+    if (job->slot < 0) {
+        free(job);
+        return 0;
+    }
+    job->conn = conn;
+    job->kind = kind;
+    job->head = session->trips;
+
+    pthread_t thread;
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    int started = pthread_create(&thread, &attributes, server_snapshot_worker, job) == 0;
+    pthread_attr_destroy(&attributes);
+    if (!started) {
+        snapshot_end(&session->snapshots, job->slot);
+        free(job);
+        return 0;
     }
+    conn->busy = 1;
+    conn->line_number++;
+    session->applied++;
+    server_jobs_running++;
+    return 1;
+}
 
-    Trip *temp = head;
-    while (temp != NULL) {
-        fprintf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n%s\n%s\n",
-                temp->license_plate,
-                temp->client_id,
-                temp->departure_time.day,
-                temp->departure_time.month,
-                temp->departure_time.year,
-                temp->departure_time.hour,
-                temp->departure_time.minute,
-                temp->arrival_time.day,
-                temp->arrival_time.month,
-                temp->arrival_time.year,
-                temp->arrival_time.hour,
-                temp->arrival_time.minute,
-                temp->departure_city,
-                temp->arrival_city);
-        temp = temp->next;
+// Runs one request line against the shared session with this connection's
+// login state and queues the framed response
+static int server_handle_line(BatchSession *session, ServerConnection *conn, char *line) {
+    if (server_start_snapshot_read(session, conn, line)) return 0;
+
+    char *payload = NULL;
+    size_t payload_length = 0;
+    FILE *capture = open_memstream(&payload, &payload_length);
+    if (capture == NULL) return -1;
+
+    session->out = capture;
+    session->authenticated = conn->authenticated;
+    session->line_number = conn->line_number;
+    int result = batch_execute_line(session, line);
+    conn->authenticated = session->authenticated;
+    conn->line_number = session->line_number;
+    session->out = stdout;
+    fclose(capture);
+
+    int queued = server_queue_response(conn, result == 0, payload, payload_length);
+    free(payload);
+    return queued;
+}
+
+// Sends as much queued output as the socket takes and switches EPOLLOUT on
+// or off accordingly. Returns -1 if the connection should be dropped.
+static int server_flush(int epoll_fd, ServerConnection *conn) {
+    while (conn->output_sent < conn->output_length) {
+        ssize_t sent = send(conn->fd, conn->output + conn->output_sent,
+                            conn->output_length - conn->output_sent, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        conn->output_sent += (size_t)sent;
+    }
+    if (conn->output_sent == conn->output_length) {
+        conn->output_sent = conn->output_length = 0;
     }
 
-    fclose(file);
+    int want_write = conn->output_length > 0;
+    if (want_write != conn->want_write) {
+        struct epoll_event event;
+        event.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+        event.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) != 0) return -1;
+        conn->want_write = want_write;
+    }
+    return 0;
 }
 
-Trip* load_trips_from_file(Trip *head) {
-    FILE *file = fopen(TRIP_FILENAME, "r");
-    if (file == NULL) {
-        return head;
+// Answers an oversized request with an error, sent as far as the socket
+// takes it right away. Returns -1: the connection is closed after this.
+static int server_reject_oversized(ServerConnection *conn) {
+    static const char message[] = "Request too long.\n";
+    if (server_queue_response(conn, 0, message, sizeof(message) - 1) != 0) return -1;
+    while (conn->output_sent < conn->output_length) {
+        ssize_t sent = send(conn->fd, conn->output + conn->output_sent,
+                            conn->output_length - conn->output_sent, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) continue;
+        if (sent <= 0) break;
+        conn->output_sent += (size_t)sent;
+    }
+    return -1;
+}
+
+// Answers complete buffered lines in order, stopping while a snapshot read
+// holds the connection so responses keep request order. Returns -1 if the
+// connection should be dropped, including when the line still being read
+// is already longer than SERVER_MAX_REQUEST.
+static int server_process_input(BatchSession *session, ServerConnection *conn) {
+    size_t start = 0;
+    for (size_t i = 0; i < conn->input_length && !conn->busy; i++) {
+        if (conn->input[i] != '\n') continue;
+        if (i - start > SERVER_MAX_REQUEST) return server_reject_oversized(conn);
+        conn->input[i] = '\0';
+        if (server_handle_line(session, conn, conn->input + start) != 0) return -1;
+        start = i + 1;
+    }
+    memmove(conn->input, conn->input + start, conn->input_length - start);
+    conn->input_length -= start;
+
+    size_t line_start = conn->input_length;
+    while (line_start > 0 && conn->input[line_start - 1] != '\n') line_start--;
+    if (conn->input_length - line_start > SERVER_MAX_REQUEST) return server_reject_oversized(conn);
+    return 0;
+}
+
+// Reads what is available in chunks and answers each complete line as it
+// arrives. The buffer never grows past SERVER_MAX_PENDING: a client that
+// fills it (requests queued behind a snapshot read) is rejected. Returns
+// -1 when the client hung up or sent too much.
+static int server_read(BatchSession *session, ServerConnection *conn) {
+    for (;;) {
+        if (conn->input_length >= SERVER_MAX_PENDING) return server_reject_oversized(conn);
+        size_t wanted = SERVER_MAX_PENDING - conn->input_length;
+        if (wanted > SERVER_MAX_REQUEST) wanted = SERVER_MAX_REQUEST;
+        if (server_reserve(&conn->input, &conn->input_capacity, conn->input_length + wanted) != 0) return -1;
+        ssize_t received = recv(conn->fd, conn->input + conn->input_length, wanted, 0);
+        if (received == 0) return -1;
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        conn->input_length += (size_t)received;
+        if (server_process_input(session, conn) != 0) return -1;
     }
+    return 0;
+}
 
-    // Check if file is empty
-    fseek(file, 0L, SEEK_END);
-    if (ftell(file) == 0) {
-        fclose(file);
-        return head;
+// Unpins finished snapshot reads, sends their answers and resumes the
+// requests queued behind them
+static void server_complete_snapshot_reads(int epoll_fd, BatchSession *session) {
+    char drain[64];
+    while (read(server_wake_pipe[0], drain, sizeof(drain)) > 0) {
+    }
+    pthread_mutex_lock(&server_done_lock);
+    SnapshotJob *jobs = server_done_jobs;
+    server_done_jobs = NULL;
+    pthread_mutex_unlock(&server_done_lock);
+
+    while (jobs != NULL) {
+        SnapshotJob *job = jobs;
+        jobs = jobs->next;
+        ServerConnection *conn = job->conn;
+        snapshot_end(&session->snapshots, job->slot);
+        server_jobs_running--;
+        conn->busy = 0;
+        if (conn->fd < 0) {
+            server_free_connection(conn);
+        } else if (server_queue_response(conn, job->payload != NULL, job->payload ? job->payload : "", job->payload_length) != 0 ||
+                   server_process_input(session, conn) != 0 || server_flush(epoll_fd, conn) != 0) {
+            server_close_connection(epoll_fd, conn);
+        }
+        free(job->payload);
+        free(job);
     }
-    rewind(file);
+    // Old versions the finished readers were holding back can go now
+    trip_versions_collect(session);
+}
 
-    // Free existing list first
-    free_trip_list(head);
-    head = NULL;
+static int server_accept(int epoll_fd, int listen_fd) {
+    for (;;) {
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        ServerConnection *conn = (ServerConnection*)calloc(1, sizeof(ServerConnection));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = conn;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0) {
+            close(fd);
+            free(conn);
+        }
+    }
+}
 
-    Trip *new_trip;
-    int license_plate, client_id;
-    int dep_day, dep_month, dep_year, dep_hour, dep_minute;
-    int arr_day, arr_month, arr_year, arr_hour, arr_minute;
-    char departure_city[MAX_STRING_LENGTH], arrival_city[MAX_STRING_LENGTH];
-    
-    while (fscanf(file, "%d\n%d\n%d/%d/%d %d:%d\n%d/%d/%d %d:%d\n%99s\n%99s\n",
-                  &license_plate, &client_id,
-                  &dep_day, &dep_month, &dep_year, &dep_hour, &dep_minute,
-                  &arr_day, &arr_month, &arr_year, &arr_hour, &arr_minute,
-                  departure_city, arrival_city) == 14) {
-        new_trip = (Trip*)malloc(sizeof(Trip));
-        if (new_trip == NULL) {
-            fclose(file);
-            return head;
+int run_server(const char *socket_path) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    BatchSession *session = (BatchSession*)malloc(sizeof(BatchSession));
+    int opened = session != NULL ? batch_session_open(session, stdout) : -1;
+    if (opened != 0) {
+        if (opened == -2) fprintf(stderr, "The data stores are in use. Cannot start server.\n");
+        else fprintf(stderr, "Memory allocation error. Cannot start server.\n");
+        free(session);
+        return 1;
+    }
+
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    unlink(socket_path); // left behind by a server that did not shut down cleanly
+    if (listen_fd < 0 || epoll_fd < 0 || pipe2(server_wake_pipe, O_NONBLOCK | O_CLOEXEC) != 0 ||
+        bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+        listen(listen_fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Cannot listen on %s\n", socket_path);
+        if (listen_fd >= 0) close(listen_fd);
+        if (epoll_fd >= 0) close(epoll_fd);
+        batch_session_close(session);
+        free(session);
+        return 1;
+    }
+
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = NULL; // the listening socket
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.ptr = server_wake_pipe;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, server_wake_pipe[0], &event);
+
+    signal(SIGINT, server_signal_handler);
+    signal(SIGTERM, server_signal_handler);
+    printf("Serving %s (Ctrl+C saves and stops)\n", socket_path);
+    fflush(stdout);
+
+    autosave_init();
+    struct epoll_event events[SERVER_MAX_EVENTS];
+    while (!server_stop) {
+        // A failed background save leaves the changes unsaved
+        if (autosave_poll() < 0) session->dirty = 1;
+        if (session->dirty && autosave_due()) batch_autosave(session);
+
+        // Wake up for the next autosave, and poll while a save process runs
+        int timeout = -1;
+        if (autosave_interval_seconds() > 0) timeout = 1000;
+        int snapshot_reads_done = 0;
+        int ready = epoll_wait(epoll_fd, events, SERVER_MAX_EVENTS, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            break;
         }
+        for (int i = 0; i < ready; i++) {
+            ServerConnection *conn = (ServerConnection*)events[i].data.ptr;
+            if (conn == NULL) {
+                server_accept(epoll_fd, listen_fd);
+                continue;
+            }
+            if (events[i].data.ptr == (void*)server_wake_pipe) {
+                snapshot_reads_done = 1; // after this batch, it may close connections listed in it
+                continue;
+            }
+            int drop = (events[i].events & (EPOLLHUP | EPOLLERR)) && !(events[i].events & EPOLLIN);
+            if (!drop && (events[i].events & EPOLLIN)) drop = server_read(session, conn) != 0;
+            if (!drop) drop = server_flush(epoll_fd, conn) != 0;
+            if (drop) server_close_connection(epoll_fd, conn);
+        }
+        if (snapshot_reads_done) server_complete_snapshot_reads(epoll_fd, session);
+    }
 
-        new_trip->license_plate = license_plate;
-        new_trip->client_id = client_id;
-        new_trip->departure_time.day = dep_day;
-        new_trip->departure_time.month = dep_month;
-        new_trip->departure_time.year = dep_year;
-        new_trip->departure_time.hour = dep_hour;
-        new_trip->departure_time.minute = dep_minute;
-        new_trip->arrival_time.day = arr_day;
-        new_trip->arrival_time.month = arr_month;
-        new_trip->arrival_time.year = arr_year;
-        new_trip->arrival_time.hour = arr_hour;
-        new_trip->arrival_time.minute = arr_minute;
-        strncpy(new_trip->departure_city, departure_city, MAX_STRING_LENGTH - 1);
-        strncpy(new_trip->arrival_city, arrival_city, MAX_STRING_LENGTH - 1);
-        new_trip->departure_city[MAX_STRING_LENGTH - 1] = '\0';
-        new_trip->arrival_city[MAX_STRING_LENGTH - 1] = '\0';
-        new_trip->next = NULL;
+    // Readers still running hold pinned versions; let them finish first
+    while (server_jobs_running > 0) {
+        if (epoll_wait(epoll_fd, events, 1, 100) >= 0) server_complete_snapshot_reads(epoll_fd, session);
+    }
+    // Connections still open are simply closed; their answers are already sent or lost with them
+    close(listen_fd);
+    close(epoll_fd);
+    close(server_wake_pipe[0]);
+    close(server_wake_pipe[1]);
+    unlink(socket_path);
 
-        if (head == NULL) {
-            head = new_trip;
-        } else {
-            Trip *temp = head;
-            while (temp->next != NULL) {
-                temp = temp->next;
+    printf("%d commands applied, %d errors\n", session->applied, session->errors);
+    if (autosave_wait() < 0) session->dirty = 1;
+    session->authenticated = 1; // let close save whatever clients changed
+    int result = batch_session_close(session);
+    free(session);
+    if (result != 0) {
+        fprintf(stderr, "The changes could not be saved.\n");
+        return 1;
+    }
+    return 0;
+}
+
+// busflow connect: sends each input line as a request and prints the
+// answer. Returns non-zero if any request failed.
+int run_client(const char *socket_path, FILE *in, FILE *out) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address.sun_path)) {
+        fprintf(stderr, "Socket path too long: %s\n", socket_path);
+        return 1;
+    }
+    strcpy(address.sun_path, socket_path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0) {
+        fprintf(stderr, "Cannot connect to %s. Is 'busflow serve' running?\n", socket_path);
+        if (fd >= 0) close(fd);
+        return 1;
+    }
+    FILE *responses = fdopen(dup(fd), "r");
+    if (responses == NULL) {
+        close(fd);
+        return 1;
+    }
+
+    int interactive = isatty(fileno(in));
+    int failed = 0;
+    char line[SERVER_MAX_REQUEST];
+    for (;;) {
+        if (interactive) {
+            fprintf(out, "busflow> ");
+            fflush(out);
+        }
+        if (fgets(line, sizeof(line), in) == NULL) break;
+        size_t length = strlen(line);
+        if (length == 0 || line[length - 1] != '\n') {
+            if (length == sizeof(line) - 1) {
+                fprintf(stderr, "Request too long.\n");
+                failed = 1;
+                break;
             }
-            temp->next = new_trip;
+            line[length++] = '\n'; // last line without a newline
+        }
+
+        size_t sent = 0;
+        while (sent < length) {
+            ssize_t written = send(fd, line + sent, length - sent, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) continue;
+            if (written <= 0) break;
+            sent += (size_t)written;
+        }
+
+        char status;
+        unsigned long payload_length;
+        // Frame header, then exactly one newline (the payload may start with spaces)
+        if (sent < length || fscanf(responses, "%c %lu", &status, &payload_length) != 2 ||
+            fgetc(responses) != '\n') {
+            fprintf(stderr, "Connection to server lost.\n");
+            failed = 1;
+            break;
+        }
+        char chunk[4096];
+        while (payload_length > 0) {
+            size_t want = payload_length < sizeof(chunk) ? payload_length : sizeof(chunk);
+            size_t got = fread(chunk, 1, want, responses);
+            if (got == 0) break;
+            fwrite(chunk, 1, got, out);
+            payload_length -= got;
         }
+        if (status != '+') failed = 1;
     }
 
-    fclose(file);
-    return head;
+    fclose(responses);
+    close(fd);
+    return failed;
+}
+#else
+int run_server(const char *socket_path) {
+    (void)socket_path;
+    fprintf(stderr, "Server mode is only available on Linux.\n");
+    return 1;
 }
 
-void free_trip_list(Trip *head) {
-    Trip *temp;
-    while (head != NULL) {
-        temp = head;
-        head = head->next;
-        free(temp);
-    }
+int run_client(const char *socket_path, FILE *in, FILE *out) {
+    (void)socket_path;
+    (void)in;
+    (void)out;
+    fprintf(stderr, "Server mode is only available on Linux.\n");
+    return 1;
 }
+#endif
+
+// Benchmarks and tests include this file with BUSFLOW_NO_MAIN defined
+#ifndef BUSFLOW_NO_MAIN
+int main(int argc, char *argv[]) {
+    // Headless mode: busflow exec [script|-]
+    if (argc >= 2 && strcmp(argv[1], "exec") == 0) {
+        FILE *in = stdin;
+        if (argc >= 3 && strcmp(argv[2], "-") != 0) {
+            in = fopen(argv[2], "r");
+            if (in == NULL) {
+                fprintf(stderr, "Cannot open %s\n", argv[2]);
+                return 1;
+            }
+        }
+        int status = run_batch_script(in, stdout);
+        if (in != stdin) fclose(in);
+        return status;
+    }
+    // Shared dataset: busflow serve [socket] / busflow connect [socket]
+    if (argc >= 2 && strcmp(argv[1], "serve") == 0) {
+        return run_server(argc >= 3 ? argv[2] : SERVER_SOCKET_FILENAME);
+    }
+    if (argc >= 2 && strcmp(argv[1], "connect") == 0) {
+        return run_client(argc >= 3 ? argv[2] : SERVER_SOCKET_FILENAME, stdin, stdout);
+    }
+    // Maintenance: busflow archive
+    if (argc >= 2 && strcmp(argv[1], "archive") == 0) {
+        return run_archive_maintenance(stdout);
+    }
+
+    ui_init();
 
-int main() {
     Bus *buses = NULL;
     Client *clients = NULL;
     Employee *employees = NULL;
     Function *functions = NULL;
     Trip *trips = NULL;
+    TripTemplate *templates = NULL;
+    Departure *departures = NULL;
+    Booking *bookings = NULL;
+    CrewAssignment *crew = NULL;
+    MaintenanceRule *maintenance_rules = NULL;
+    MaintenanceBlock *maintenance = NULL;
     
-    User users[MAX_USERS];
-    int num_users = 0;
+    UserStore users;
+    user_store_init(&users);
     
     // Load users from file
-    num_users = read_users_from_file(users);
+    read_users_from_file(&users);
     
     int choice;
     do {
@@ -2454,27 +14051,38 @@ int main() {
         
         switch (choice) {
             case 1:
-                if (authenticate_user(users, num_users)) {
+                if (authenticate_user(&users)) {
                     printf("\nLogin successful! Welcome to the system.\n");
                     pause_screen();
                     
                     // Auto-load all data when user logs in
                     // printf("Loading system data...\n");
+                    slot_storage_attach();
+                    lsm_storage_attach();
                     buses = load_buses_from_file(buses);
                     clients = load_clients_from_file(clients);
                     employees = load_employees_from_file(employees);
                     functions = load_functions_from_file(functions);
                     trips = load_trips_from_file(trips);
+                    templates = load_templates_from_file(templates);
+                    departures = load_departures_from_file(departures);
+                    bookings = load_bookings_from_file(bookings, departures);
+                    crew = load_crew_from_file(crew);
+                    maintenance_rules = load_maintenance_rules_from_file(maintenance_rules);
+                    maintenance = load_maintenance_schedule_from_file(maintenance);
+                    slot_storage_convert(buses, clients, employees);
+                    lsm_storage_convert(&clients, &employees);
                     // printf("System ready!\n");
                     // pause_screen();
                     
-                    main_menu(&buses, &clients, &employees, &functions, &trips);
+                    main_menu(&buses, &clients, &employees, &functions, &trips, &templates, &departures, &bookings, &crew,
+                              &maintenance_rules, &maintenance);
                 } else {
                     printf("\nInvalid username or password. Please try again.\n");
                 }
                 break;
             case 2:
-                register_user(users, &num_users);
+                register_user(&users);
                 break;
             case 0:
                 printf("\nThank you for using Bus Management System. Goodbye!\n");
@@ -2489,13 +14097,12 @@ int main() {
     } while (choice != 0);
     
     // Auto-save all data before exit
-    if (buses || clients || employees || functions || trips) {
+    if (buses || clients || employees || functions || trips || templates || departures || crew ||
+        maintenance_rules || maintenance) {
         // printf("Saving system data...\n");
-        save_buses_to_file(buses);
-        save_clients_to_file(clients);
-        save_employees_to_file(employees);
-        save_functions_to_file(functions);
-        save_trips_to_file(trips);
+        SaveSet data = { buses, clients, employees, functions, trips, templates, departures, bookings,
+                         crew, maintenance_rules, maintenance, SAVE_ALL };
+        record_foreground_save(&data);
         // printf("Data saved successfully!\n");
     }
     
@@ -2505,14 +14112,33 @@ int main() {
     free_employee_list(employees);
     free_function_list(functions);
     free_trip_list(trips);
+    free_template_list(templates);
+    free_booking_list(bookings);
+    free_departure_list(departures);
+    free_crew_list(crew);
+    free_maintenance_rule_list(maintenance_rules);
+    free_maintenance_schedule(maintenance);
+    lsm_storage_detach();
+    trip_archive_close();
+    user_store_free(&users);
     
     return 0;
 }
+#endif
 
 // Basic menu structure - this needs to be expanded with all menu functions
-void main_menu(Bus **buses, Client **clients, Employee **employees, Function **functions, Trip **trips) {
+void main_menu(Bus **buses, Client **clients, Employee **employees, Function **functions, Trip **trips, TripTemplate **templates,
+               Departure **departures, Booking **bookings, CrewAssignment **crew,
+               MaintenanceRule **maintenance_rules, MaintenanceBlock **maintenance) {
     int choice;
+    autosave_init();
     do {
+        // Between actions every list is consistent, so this is where autosave snapshots
+        SaveSet data = { *buses, *clients, *employees, *functions, *trips, *templates, *departures, *bookings,
+                         *crew, *maintenance_rules, *maintenance, SAVE_ALL };
+        autosave_poll();
+        if (autosave_due()) autosave_start(&data);
+
         print_header("BUS MANAGEMENT SYSTEM - MAIN MENU");
         set_console_color(2);
         printf("Welcome to the Bus Management System\n\n");
@@ -2522,10 +14148,17 @@ void main_menu(Bus **buses, Client **clients, Employee **employees, Function **f
         printf("4. Function Management\n");
         printf("5. Trip Management\n");
         printf("6. Save All Data\n");
+        printf("7. Reports & Planning\n");
+        printf("8. Recurring Trip Templates\n");
+        printf("9. Seat Bookings\n");
+        printf("10. Crew Rostering\n");
+        printf("11. Maintenance Planner\n");
+        printf("12. Save Statistics\n");
         printf("0. Logout\n");
         set_console_color(7);
         printf("\nEnter your choice: ");
         choice = safe_int_input();
+
         
         switch (choice) {
             case 1:
@@ -2545,28 +14178,39 @@ void main_menu(Bus **buses, Client **clients, Employee **employees, Function **f
                 break;
             case 6:
                 printf("Saving all data...\n");
-                save_buses_to_file(*buses);
-                save_clients_to_file(*clients);
-                save_employees_to_file(*employees);
-                save_functions_to_file(*functions);
-                save_trips_to_file(*trips);
+                record_foreground_save(&data);
                 printf("All data saved successfully!\n");
                 break;
+            case 7:
+                report_menu(*buses, trips, *templates, *departures);
+                break;
+            case 8:
+                template_menu(*buses, *clients, trips, templates);
+                break;
+            case 9:
+                booking_menu(*buses, *clients, trips, departures, bookings);
+                break;
+            case 10:
+                crew_menu(*employees, *functions, *trips, crew);
+                break;
+            case 11:
+                maintenance_menu(*buses, maintenance_rules, maintenance);
+                break;
+            case 12:
+                print_header("SAVE STATISTICS");
+                display_save_stats(stdout);
+                break;
             case 0:
                 printf("\nLogging out...\n");
                 // // Auto-save before logout
                 // printf("Auto-saving data...\n");
-                save_buses_to_file(*buses);
-                save_clients_to_file(*clients);
-                save_employees_to_file(*employees);
-                save_functions_to_file(*functions);
-                save_trips_to_file(*trips);
+                record_foreground_save(&data);
                 // printf("Data saved successfully!\n");
                 break;
             default:
                 printf("\nInvalid choice. Please try again.\n");
         }
-        
+
         if (choice != 0) {
             pause_screen();
         }
@@ -2575,6 +14219,7 @@ void main_menu(Bus **buses, Client **clients, Employee **employees, Function **f
 
 void bus_menu(Bus **buses, Client *clients, Employee *employees, Function *functions, Trip *trips) {
     int choice;
+    ReloadReport reload;
     do {
         print_header("BUS MANAGEMENT");
         
@@ -2616,11 +14261,16 @@ void bus_menu(Bus **buses, Client *clients, Employee *employees, Function *funct
             case 5:
                 search_bus(*buses);
                 break;
-            case 6:
-                save_buses_to_file(*buses);
+            case 6: {
+                SaveSet set = save_set_for(SAVE_BUSES);
+                set.buses = *buses;
+                record_foreground_save(&set);
                 break;
+            }
             case 7:
-                *buses = load_buses_from_file(*buses);
+                autosave_wait();
+                *buses = reload_buses_from_file(*buses, &reload);
+                display_reload_report("buses", &reload);
                 break;
             case 0:
                 return;
@@ -2636,17 +14286,25 @@ void bus_menu(Bus **buses, Client *clients, Employee *employees, Function *funct
 
 void client_menu(Bus *buses, Client **clients, Employee *employees, Function *functions, Trip *trips) {
     int choice;
+    ReloadReport reload;
     do {
         print_header("CLIENT MANAGEMENT");
         
         // Show current client count
-        int client_count = 0;
-        Client *temp = *clients;
-        while (temp != NULL) {
-            client_count++;
-            temp = temp->next;
+        int stored = lsm_storage_attached();
+        if (stored) {
+            printf("Client store: ");
+            store_describe(&client_store, stdout);
+            printf("\n");
+        } else {
+            int client_count = 0;
+            Client *temp = *clients;
+            while (temp != NULL) {
+                client_count++;
+                temp = temp->next;
+            }
+            printf("Current clients in system: %d\n\n", client_count);
         }
-        printf("Current clients in system: %d\n\n", client_count);
         
         set_console_color(2);
         printf("1. Add New Client\n");
@@ -2663,25 +14321,40 @@ void client_menu(Bus *buses, Client **clients, Employee *employees, Function *fu
         
         switch (choice) {
             case 1:
-                *clients = add_client_at_end(*clients);
+                if (stored) add_client_to_store();
+                else *clients = add_client_at_end(*clients);
                 break;
             case 2:
-                display_clients(*clients);
+                if (stored) display_client_store();
+                else display_clients(*clients);
                 break;
             case 3:
-                *clients = modify_client(*clients);
+                if (stored) modify_client_in_store();
+                else *clients = modify_client(*clients);
                 break;
             case 4:
-                *clients = delete_client(*clients);
+                if (stored) delete_client_from_store();
+                else *clients = delete_client(*clients);
                 break;
             case 5:
-                search_client(*clients);
+                if (stored) search_client_in_store();
+                else search_client(*clients);
                 break;
-            case 6:
-                save_clients_to_file(*clients);
+            case 6: {
+                SaveSet set = save_set_for(SAVE_CLIENTS);
+                set.clients = *clients;
+                record_foreground_save(&set);
+                if (stored) printf("Clients are written to the store as they change.\n");
                 break;
+            }
             case 7:
-                *clients = load_clients_from_file(*clients);
+                if (stored) {
+                    printf("Clients are read from the store on every access; there is nothing to reload.\n");
+                    break;
+                }
+                autosave_wait();
+                *clients = reload_clients_from_file(*clients, &reload);
+                display_reload_report("clients", &reload);
                 break;
             case 0:
                 return;
@@ -2697,17 +14370,25 @@ void client_menu(Bus *buses, Client **clients, Employee *employees, Function *fu
 
 void employee_menu(Bus *buses, Client *clients, Employee **employees, Function *functions, Trip *trips) {
     int choice;
+    ReloadReport reload;
     do {
         print_header("EMPLOYEE MANAGEMENT");
         
         // Show current employee count
-        int employee_count = 0;
-        Employee *temp = *employees;
-        while (temp != NULL) {
-            employee_count++;
-            temp = temp->next;
+        int stored = lsm_storage_attached();
+        if (stored) {
+            printf("Employee store: ");
+            store_describe(&employee_store, stdout);
+            printf("\n");
+        } else {
+            int employee_count = 0;
+            Employee *temp = *employees;
+            while (temp != NULL) {
+                employee_count++;
+                temp = temp->next;
+            }
+            printf("Current employees in system: %d\n\n", employee_count);
         }
-        printf("Current employees in system: %d\n\n", employee_count);
         
         set_console_color(2);
         printf("1. Add New Employee\n");
@@ -2724,25 +14405,40 @@ void employee_menu(Bus *buses, Client *clients, Employee **employees, Function *
         
         switch (choice) {
             case 1:
-                *employees = add_employee_at_end(*employees, functions);
+                if (stored) add_employee_to_store(functions);
+                else *employees = add_employee_at_end(*employees, functions);
                 break;
             case 2:
-                display_employees(*employees, functions);
+                if (stored) display_employee_store(functions);
+                else display_employees(*employees, functions);
                 break;
             case 3:
-                *employees = modify_employee(*employees, functions);
+                if (stored) modify_employee_in_store(functions);
+                else *employees = modify_employee(*employees, functions);
                 break;
             case 4:
-                *employees = delete_employee(*employees);
+                if (stored) delete_employee_from_store();
+                else *employees = delete_employee(*employees);
                 break;
             case 5:
-                search_employee(*employees, functions);
+                if (stored) search_employee_in_store(functions);
+                else search_employee(*employees, functions);
                 break;
-            case 6:
-                save_employees_to_file(*employees);
+            case 6: {
+                SaveSet set = save_set_for(SAVE_EMPLOYEES);
+                set.employees = *employees;
+                record_foreground_save(&set);
+                if (stored) printf("Employees are written to the store as they change.\n");
                 break;
+            }
             case 7:
-                *employees = load_employees_from_file(*employees);
+                if (stored) {
+                    printf("Employees are read from the store on every access; there is nothing to reload.\n");
+                    break;
+                }
+                autosave_wait();
+                *employees = reload_employees_from_file(*employees, &reload);
+                display_reload_report("employees", &reload);
                 break;
             case 0:
                 return;
@@ -2758,6 +14454,7 @@ void employee_menu(Bus *buses, Client *clients, Employee **employees, Function *
 
 void function_menu(Bus *buses, Client *clients, Employee *employees, Function **functions, Trip *trips) {
     int choice;
+    ReloadReport reload;
     do {
         print_header("FUNCTION MANAGEMENT");
         
@@ -2799,11 +14496,16 @@ void function_menu(Bus *buses, Client *clients, Employee *employees, Function **
             case 5:
                 search_function(*functions);
                 break;
-            case 6:
-                save_functions_to_file(*functions);
+            case 6: {
+                SaveSet set = save_set_for(SAVE_FUNCTIONS);
+                set.functions = *functions;
+                record_foreground_save(&set);
                 break;
+            }
             case 7:
-                *functions = load_functions_from_file(*functions);
+                autosave_wait();
+                *functions = reload_functions_from_file(*functions, &reload);
+                display_reload_report("functions", &reload);
                 break;
             case 0:
                 return;
@@ -2819,6 +14521,7 @@ void function_menu(Bus *buses, Client *clients, Employee *employees, Function **
 
 void trip_menu(Bus *buses, Client *clients, Employee *employees, Function *functions, Trip **trips) {
     int choice;
+    ReloadReport reload;
     do {
         print_header("TRIP MANAGEMENT");
         
@@ -2860,12 +14563,329 @@ void trip_menu(Bus *buses, Client *clients, Employee *employees, Function *funct
             case 5:
                 search_trip(*trips, buses, clients);
                 break;
-            case 6:
-                save_trips_to_file(*trips);
+            case 6: {
+                SaveSet set = save_set_for(SAVE_TRIPS);
+                set.trips = *trips;
+                record_foreground_save(&set);
                 break;
+            }
             case 7:
-                *trips = load_trips_from_file(*trips);
+                autosave_wait();
+                *trips = reload_trips_from_file(*trips, &reload);
+                display_reload_report("trips", &reload);
+                break;
+            case 0:
+                return;
+            default:
+                printf("\nInvalid choice. Please try again.\n");
+        }
+        
+        if (choice != 0) {
+            pause_screen();
+        }
+    } while (choice != 0);
+}
+
+void report_menu(Bus *buses, Trip **trips, TripTemplate *templates, Departure *departures) {
+    int choice;
+    do {
+        print_header("REPORTS & PLANNING");
+        
+        set_console_color(2);
+        printf("1. Fleet Utilization Report\n");
+        printf("2. Minimum Fleet Optimizer\n");
+        printf("3. Journey Planner\n");
+        printf("4. Departure Board\n");
+        printf("5. Delay Simulation\n");
+        printf("6. Fleet Valuation\n");
+        printf("0. Back to Main Menu\n");
+        set_console_color(7);
+        printf("\nEnter your choice: ");
+        choice = safe_int_input();
+        
+        switch (choice) {
+            case 1:
+                fleet_utilization_report(buses, *trips, templates);
+                break;
+            case 2:
+                fleet_assignment_optimizer(buses, *trips, templates, departures);
+                break;
+            case 3:
+                journey_planner(*trips, templates);
+                break;
+            case 4:
+                departure_board(*trips, templates, departures);
+                break;
+            case 5:
+                fleet_delay_simulator(*trips, templates);
+                break;
+            case 6:
+                fleet_valuation_report(buses);
+                break;
+            case 0:
+                return;
+            default:
+                printf("\nInvalid choice. Please try again.\n");
+        }
+        
+        if (choice != 0) {
+            pause_screen();
+        }
+    } while (choice != 0);
+}
+
+void template_menu(Bus *buses, Client *clients, Trip **trips, TripTemplate **templates) {
+    int choice;
+    do {
+        print_header("RECURRING TRIP TEMPLATES");
+        
+        int template_count = 0;
+        TripTemplate *temp = *templates;
+        while (temp != NULL) {
+            template_count++;
+            temp = temp->next;
+        }
+        printf("Current templates in system: %d\n\n", template_count);
+        
+        set_console_color(2);
+        printf("1. Add New Template\n");
+        printf("2. View All Templates\n");
+        printf("3. View Occurrences in Date Range\n");
+        printf("4. Book Client on Occurrence\n");
+        printf("5. Cancel Occurrence\n");
+        printf("6. Delete Template\n");
+        printf("7. Save Templates to File\n");
+        printf("8. Reload Templates from File\n");
+        printf("0. Back to Main Menu\n");
+        set_console_color(7);
+        printf("\nEnter your choice: ");
+        choice = safe_int_input();
+        
+        switch (choice) {
+            case 1:
+                *templates = add_template_at_end(*templates, buses);
                 break;
+            case 2:
+                display_templates(*templates);
+                break;
+            case 3:
+                display_template_occurrences(*templates);
+                break;
+            case 4:
+                *trips = book_template_occurrence(*trips, *templates, clients);
+                break;
+            case 5:
+                cancel_template_occurrence(*templates);
+                break;
+            case 6:
+                *templates = delete_template(*templates);
+                break;
+            case 7: {
+                SaveSet set = save_set_for(SAVE_TEMPLATES);
+                set.templates = *templates;
+                record_foreground_save(&set);
+                break;
+            }
+            case 8:
+                autosave_wait();
+                *templates = load_templates_from_file(*templates);
+                break;
+            case 0:
+                return;
+            default:
+                printf("\nInvalid choice. Please try again.\n");
+        }
+        
+        if (choice != 0) {
+            pause_screen();
+        }
+    } while (choice != 0);
+}
+
+void booking_menu(Bus *buses, Client *clients, Trip **trips, Departure **departures, Booking **bookings) {
+    int choice;
+    do {
+        print_header("SEAT BOOKINGS");
+        
+        int departure_count = 0, booking_count = 0;
+        for (Departure *temp = *departures; temp != NULL; temp = temp->next) departure_count++;
+        for (Booking *temp = *bookings; temp != NULL; temp = temp->next) booking_count++;
+        printf("Current departures in system: %d (%d seats booked)\n\n", departure_count, booking_count);
+        
+        set_console_color(2);
+        printf("1. Add New Departure\n");
+        printf("2. View All Departures\n");
+        printf("3. View Seat Map\n");
+        printf("4. Book Seats\n");
+        printf("5. Cancel Booking\n");
+        printf("6. Delete Departure\n");
+        printf("7. Convert Trips to Departures\n");
+        printf("8. Save Departures and Bookings to File\n");
+        printf("9. Reload Departures and Bookings from File\n");
+        printf("0. Back to Main Menu\n");
+        set_console_color(7);
+        printf("\nEnter your choice: ");
+        choice = safe_int_input();
+        
+        switch (choice) {
+            case 1:
+                *departures = add_departure_at_end(*departures, buses);
+                break;
+            case 2:
+                display_departures(*departures);
+                break;
+            case 3:
+                display_seat_map(*departures, *bookings);
+                break;
+            case 4:
+                *bookings = book_seats(*bookings, *departures, clients);
+                break;
+            case 5:
+                *bookings = cancel_booking(*bookings, *departures);
+                break;
+            case 6:
+                *departures = delete_departure(*departures, bookings);
+                break;
+            case 7: {
+                *departures = convert_trips_to_departures(*departures, bookings, trips, buses);
+                // The removed trip rows and their bookings reach the files together
+                SaveSet set = save_set_for(SAVE_TRIPS | SAVE_DEPARTURES);
+                set.trips = *trips;
+                set.departures = *departures;
+                set.bookings = *bookings;
+                record_foreground_save(&set);
+                break;
+            }
+            case 8: {
+                SaveSet set = save_set_for(SAVE_DEPARTURES);
+                set.departures = *departures;
+                set.bookings = *bookings;
+                record_foreground_save(&set);
+                break;
+            }
+            case 9:
+                autosave_wait();
+                *departures = load_departures_from_file(*departures);
+                *bookings = load_bookings_from_file(*bookings, *departures);
+                break;
+            case 0:
+                return;
+            default:
+                printf("\nInvalid choice. Please try again.\n");
+        }
+        
+        if (choice != 0) {
+            pause_screen();
+        }
+    } while (choice != 0);
+}
+
+void crew_menu(Employee *employees, Function *functions, Trip *trips, CrewAssignment **crew) {
+    int choice;
+    do {
+        print_header("CREW ROSTERING");
+        
+        int assignment_count = 0;
+        for (CrewAssignment *temp = *crew; temp != NULL; temp = temp->next) assignment_count++;
+        printf("Current crew assignments in system: %d\n\n", assignment_count);
+        
+        set_console_color(2);
+        printf("1. Assign Employee to Trip\n");
+        printf("2. View Roster\n");
+        printf("3. Remove Assignment\n");
+        printf("4. Auto-Roster Week\n");
+        printf("5. Save Roster to File\n");
+        printf("6. Reload Roster from File\n");
+        printf("0. Back to Main Menu\n");
+        set_console_color(7);
+        printf("\nEnter your choice: ");
+        choice = safe_int_input();
+        
+        switch (choice) {
+            case 1:
+                *crew = assign_crew_to_trip(*crew, employees, functions, trips);
+                break;
+            case 2:
+                display_crew_roster(*crew, employees);
+                break;
+            case 3:
+                *crew = remove_crew_assignment(*crew);
+                break;
+            case 4:
+                crew_roster_solver(crew, employees, functions, trips);
+                break;
+            case 5: {
+                SaveSet set = save_set_for(SAVE_CREW);
+                set.crew = *crew;
+                record_foreground_save(&set);
+                break;
+            }
+            case 6:
+                autosave_wait();
+                *crew = load_crew_from_file(*crew);
+                break;
+            case 0:
+                return;
+            default:
+                printf("\nInvalid choice. Please try again.\n");
+        }
+        
+        if (choice != 0) {
+            pause_screen();
+        }
+    } while (choice != 0);
+}
+
+void maintenance_menu(Bus *buses, MaintenanceRule **rules, MaintenanceBlock **schedule) {
+    int choice;
+    do {
+        print_header("MAINTENANCE PLANNER");
+        
+        int rule_count = 0, visit_count = 0;
+        for (MaintenanceRule *temp = *rules; temp != NULL; temp = temp->next) rule_count++;
+        for (MaintenanceBlock *temp = *schedule; temp != NULL; temp = temp->next) visit_count++;
+        printf("Maintenance rules: %d, planned visits: %d\n\n", rule_count, visit_count);
+        
+        set_console_color(2);
+        printf("1. Add Maintenance Rule\n");
+        printf("2. View Maintenance Rules\n");
+        printf("3. Delete Maintenance Rule\n");
+        printf("4. Bus Usage Report\n");
+        printf("5. Plan Maintenance\n");
+        printf("6. View Maintenance Schedule\n");
+        printf("7. Save Maintenance Data\n");
+        printf("0. Back to Main Menu\n");
+        set_console_color(7);
+        printf("\nEnter your choice: ");
+        choice = safe_int_input();
+        
+        switch (choice) {
+            case 1:
+                *rules = add_maintenance_rule(*rules);
+                break;
+            case 2:
+                display_maintenance_rules(*rules);
+                break;
+            case 3:
+                *rules = delete_maintenance_rule(*rules);
+                break;
+            case 4:
+                bus_usage_report(buses);
+                break;
+            case 5:
+                maintenance_planner(buses, *rules, schedule);
+                break;
+            case 6:
+                display_maintenance_schedule(*schedule);
+                break;
+            case 7: {
+                SaveSet set = save_set_for(SAVE_MAINTENANCE);
+                set.maintenance_rules = *rules;
+                set.maintenance = *schedule;
+                record_foreground_save(&set);
+                printf("Maintenance data saved.\n");
+                break;
+            }
             case 0:
                 return;
             default:
@@ -2884,7 +14904,11 @@ int has_buses(Bus *head) {
 }
 
 int has_clients(Client *head) {
-    return head != NULL;
+    return head != NULL || store_has_records(&client_store);
+}
+
+int has_employees(Employee *head) {
+    return head != NULL || store_has_records(&employee_store);
 }
 
 int has_functions(Function *head) {
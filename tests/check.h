@@ -0,0 +1,45 @@
+// Shared by the behaviour tests. Each test includes src/main.c with
+// BUSFLOW_NO_MAIN defined, then this file. The program reads and writes
+// ../data relative to the working directory, so every test runs in a
+// scratch directory of its own and never touches the real data.
+#ifndef BUSFLOW_TEST_CHECK_H
+#define BUSFLOW_TEST_CHECK_H
+
+static int check_count = 0;
+static int check_failures = 0;
+static char check_scratch[64];
+
+#define CHECK(condition)                                                            \
+    do {                                                                            \
+        check_count++;                                                              \
+        if (!(condition)) {                                                         \
+            check_failures++;                                                       \
+            printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition);   \
+        }                                                                           \
+    } while (0)
+
+// Creates /tmp/busflow-test-XXXXXX with data/ and run/ inside and changes
+// into run/, so ../data is the scratch data directory. Returns 0 or -1.
+static int check_enter_scratch(void) {
+    char path[sizeof(check_scratch) + 8];
+    snprintf(check_scratch, sizeof(check_scratch), "/tmp/busflow-test-XXXXXX");
+    if (mkdtemp(check_scratch) == NULL) return -1;
+    snprintf(path, sizeof(path), "%s/data", check_scratch);
+    if (mkdir(path, 0755) != 0) return -1;
+    snprintf(path, sizeof(path), "%s/run", check_scratch);
+    if (mkdir(path, 0755) != 0 || chdir(path) != 0) return -1;
+    return 0;
+}
+
+// Reports the result, removes the scratch directory and returns the exit status
+static int check_finish(const char *name) {
+    printf("%s: %d checks, %d failed\n", name, check_count, check_failures);
+    if (check_scratch[0] != '\0' && chdir("/tmp") == 0) {
+        char command[sizeof(check_scratch) + 16];
+        snprintf(command, sizeof(command), "rm -rf %s", check_scratch);
+        if (system(command) != 0) printf("Could not remove %s\n", check_scratch);
+    }
+    return check_failures > 0 ? 1 : 0;
+}
+
+#endif
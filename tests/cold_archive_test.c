@@ -0,0 +1,199 @@
+// Cold archive tier: the zigzag varint coding of cold blocks round-trips
+// extreme and negative deltas and rejects damaged blocks, and trips moved
+// into the archive come back unchanged once their partitions are cold.
+//
+//   gcc -Wall -Wextra -std=c99 -O2 -pthread -o cold_archive_test tests/cold_archive_test.c
+//   ./cold_archive_test
+#define BUSFLOW_NO_MAIN
+#include "../src/main.c"
+#include "check.h"
+
+#define TEST_MONTHS 3
+#define TEST_TRIPS_PER_MONTH 6000
+
+// Encodes rows the way archive_partition_compress does: a mask byte of the
+// columns that changed, then one varint delta for each of them
+static size_t encode_rows(const int rows[][ARCHIVE_COLUMNS], int count, unsigned char *out) {
+    long long previous[ARCHIVE_COLUMNS] = {0};
+    unsigned char *p = out;
+    for (int row = 0; row < count; row++) {
+        unsigned char *changed = p++;
+        *changed = 0;
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            long long value = rows[row][column];
+            if (column == ARCHIVE_ARRIVAL) value -= rows[row][ARCHIVE_DEPARTURE];
+            if (value == previous[column]) continue;
+            *changed |= (unsigned char)(1u << column);
+            p = cold_put_varint(p, value - previous[column]);
+            previous[column] = value;
+        }
+    }
+    return (size_t)(p - out);
+}
+
+static void test_varint_round_trip(void) {
+    static int scratch[ARCHIVE_COLUMNS * ARCHIVE_BLOCK_ROWS];
+    // Plate, client, departure, arrival, from, to. Deltas swing between the
+    // ends of the int range; the last row arrives before it departs.
+    const int rows[][ARCHIVE_COLUMNS] = {
+        { 1, 1, 28000000, 28000060, 0, 1 },
+        { INT_MAX, INT_MIN, 28000000, 28000060, 0, 1 },
+        { INT_MIN, INT_MAX, 28000001, 28000001, INT_MAX, 0 },
+        { 0, -1, 27999999, 28000500, INT_MIN, INT_MAX },
+        { 0, -1, 27999999, 28000500, INT_MIN, INT_MAX },
+        { 63, 64, 28000064, 28000000, 127, 128 },
+    };
+    const int count = (int)(sizeof(rows) / sizeof(rows[0]));
+    unsigned char block[sizeof(rows) * 2 + 64];
+    size_t length = encode_rows(rows, count, block);
+
+    CHECK(cold_decode_block(block, length, count, scratch) == 0);
+    int wrong = 0;
+    for (int row = 0; row < count; row++) {
+        for (int column = 0; column < ARCHIVE_COLUMNS; column++) {
+            if (scratch[column * ARCHIVE_BLOCK_ROWS + row] != rows[row][column]) wrong++;
+        }
+    }
+    CHECK(wrong == 0);
+    // A repeated row costs only its mask byte
+    unsigned char shorter[sizeof(block)];
+    CHECK(encode_rows(rows, 5, shorter) == encode_rows(rows, 4, shorter) + 1);
+
+    // Every delta size, from one byte to the ten a 64-bit zigzag value takes
+    const long long deltas[] = { 0, 1, -1, 63, -64, 64, 8191, -8192, 1LL << 40, -(1LL << 40),
+                                 LLONG_MAX, LLONG_MIN };
+    for (size_t i = 0; i < sizeof(deltas) / sizeof(deltas[0]); i++) {
+        unsigned char bytes[16];
+        unsigned char *end = cold_put_varint(bytes, deltas[i]);
+        CHECK(end - bytes >= 1 && end - bytes <= 10);
+        unsigned long long zigzag = 0;
+        int shift = 0;
+        for (unsigned char *p = bytes; p < end; p++, shift += 7) {
+            zigzag |= (unsigned long long)(*p & 0x7F) << shift;
+        }
+        long long decoded = (long long)(zigzag >> 1) ^ -(long long)(zigzag & 1);
+        CHECK(decoded == deltas[i]);
+    }
+
+    // Damaged blocks are refused rather than read past their end
+    CHECK(cold_decode_block(block, length - 1, count, scratch) == -1);
+    CHECK(cold_decode_block(block, length, count + 1, scratch) == -1);
+    unsigned char endless[16];
+    endless[0] = 1u << ARCHIVE_PLATE;
+    memset(endless + 1, 0xFF, sizeof(endless) - 1);
+    CHECK(cold_decode_block(endless, sizeof(endless), 1, scratch) == -1);
+}
+
+typedef struct TripMatch {
+    Trip **expected;
+    int count;
+    int found;
+    int wrong;
+} TripMatch;
+
+static int compare_test_trips(const void *a, const void *b) {
+    const Trip *x = *(Trip* const*)a;
+    const Trip *y = *(Trip* const*)b;
+    return (x->client_id > y->client_id) - (x->client_id < y->client_id);
+}
+
+// Client ids are unique, so each archived trip is looked up by client
+static int match_archived_trip(const Trip *trip, void *context) {
+    TripMatch *match = (TripMatch*)context;
+    Trip key;
+    key.client_id = trip->client_id;
+    Trip *key_pointer = &key;
+    Trip **found = (Trip**)bsearch(&key_pointer, match->expected, match->count, sizeof(Trip*), compare_test_trips);
+    if (found == NULL || (*found)->license_plate != trip->license_plate ||
+        datetime_to_minutes((*found)->departure_time) != datetime_to_minutes(trip->departure_time) ||
+        datetime_to_minutes((*found)->arrival_time) != datetime_to_minutes(trip->arrival_time) ||
+        strcmp((*found)->departure_city, trip->departure_city) != 0 ||
+        strcmp((*found)->arrival_city, trip->arrival_city) != 0) {
+        match->wrong++;
+    }
+    match->found++;
+    return 0;
+}
+
+static void test_cold_partitions(void) {
+    static const char *const cities[] = { "Paris", "Lyon", "Nice", "Lille", "Nantes" };
+    const int total = TEST_MONTHS * TEST_TRIPS_PER_MONTH;
+    // archive_old_trips frees the list it archives, so the expected trips are copies
+    Trip *copies = (Trip*)calloc(total, sizeof(Trip));
+    Trip **expected = (Trip**)malloc(total * sizeof(Trip*));
+    Trip *head = NULL;
+    CHECK(copies != NULL && expected != NULL);
+    if (copies == NULL || expected == NULL) {
+        free(copies);
+        free(expected);
+        return;
+    }
+
+    // Runs of several passengers share plate and times, so many rows only
+    // change a few columns
+    long first_day = days_from_civil(1, 1, 2020);
+    for (int i = 0; i < total; i++) {
+        Trip *trip = &copies[i];
+        int month = i / TEST_TRIPS_PER_MONTH;
+        int run = i / 4;
+        long departure = (first_day + month * 31 + run % 28) * 1440L + (run * 37) % 1440;
+        trip->license_plate = 100 + run % 40;
+        trip->client_id = i + 1;
+        trip->departure_time = minutes_to_datetime(departure);
+        trip->arrival_time = minutes_to_datetime(departure + 30 + (run * 13) % 600);
+        strcpy(trip->departure_city, cities[run % 5]);
+        strcpy(trip->arrival_city, cities[(run + 2) % 5]);
+        expected[i] = trip;
+        Trip *copy = (Trip*)malloc(sizeof(Trip));
+        if (copy == NULL) break;
+        *copy = *trip;
+        copy->next = head;
+        head = copy;
+    }
+
+    int archived = archive_old_trips(&head);
+    CHECK(archived == total);
+    CHECK(head == NULL);
+    for (int month = 0; month < TEST_MONTHS; month++) {
+        char path[MAX_STRING_LENGTH + 16];
+        archive_partition_path(2020 * 12 + month, "cold", path, sizeof(path));
+        CHECK(access(path, R_OK) == 0);
+        archive_partition_path(2020 * 12 + month, "plate", path, sizeof(path));
+        CHECK(access(path, F_OK) != 0);
+    }
+
+    // Read back from disk: every row decodes to the trip that went in
+    trip_archive_close();
+    qsort(expected, total, sizeof(Trip*), compare_test_trips);
+    TripMatch match = { expected, total, 0, 0 };
+    ArchiveQuery query;
+    archive_query_all(&query);
+    trip_archive_scan(&query, match_archived_trip, &match);
+    CHECK(match.found == total);
+    CHECK(match.wrong == 0);
+
+    // A narrow query decodes only the blocks its ranges overlap and still finds its row
+    TripMatch one = { expected, total, 0, 0 };
+    archive_query_all(&query);
+    query.client_id = TEST_TRIPS_PER_MONTH + 17;
+    trip_archive_scan(&query, match_archived_trip, &one);
+    CHECK(one.found == 1 && one.wrong == 0);
+
+    free(expected);
+    free(copies);
+}
+
+int main(void) {
+    if (check_enter_scratch() != 0) {
+        printf("Cannot create a scratch directory.\n");
+        return 1;
+    }
+    // Everything written below is old enough to archive, seal and compress at once
+    setenv("BUSFLOW_ARCHIVE_DAYS", "30", 1);
+    setenv("BUSFLOW_COLD_MONTHS", "1", 1);
+    setenv("BUSFLOW_RETENTION_MONTHS", "0", 1);
+
+    test_varint_round_trip();
+    test_cold_partitions();
+    return check_finish("cold_archive_test");
+}
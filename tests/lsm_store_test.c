@@ -0,0 +1,161 @@
+// LSM store: random puts and removes checked against a plain array through
+// flushes and tiered compactions, then recovery of changes that only
+// reached the log, including a torn last record.
+//
+//   gcc -Wall -Wextra -std=c99 -O2 -pthread -o lsm_store_test tests/lsm_store_test.c
+//   ./lsm_store_test
+#define BUSFLOW_NO_MAIN
+#include "../src/main.c"
+#include "check.h"
+
+#define TEST_KEYS 20000
+#define TEST_STORE "../data/test"
+
+static int expected_value[TEST_KEYS];
+static unsigned char expected_live[TEST_KEYS];
+
+typedef struct ScanCheck {
+    int count;
+    int previous_key;
+    int mismatches;
+} ScanCheck;
+
+static int scan_visit(int key, const void *record, void *context) {
+    ScanCheck *check = (ScanCheck*)context;
+    int value;
+    memcpy(&value, record, sizeof(int));
+    if (key <= check->previous_key || key < 0 || key >= TEST_KEYS ||
+        !expected_live[key] || expected_value[key] != value) {
+        check->mismatches++;
+    }
+    check->previous_key = key;
+    check->count++;
+    return 0;
+}
+
+// Every key answers as the array says, and a scan returns exactly the
+// live keys in order
+static void check_contents(void *tree) {
+    int wrong = 0, live = 0;
+    for (int key = 0; key < TEST_KEYS; key++) {
+        int value = -1;
+        int found = lsm_get(tree, key, &value);
+        if (expected_live[key]) live++;
+        if (found != expected_live[key] || (found && value != expected_value[key])) wrong++;
+    }
+    CHECK(wrong == 0);
+
+    ScanCheck check = { 0, -1, 0 };
+    CHECK(lsm_scan(tree, scan_visit, &check) == 0);
+    CHECK(check.mismatches == 0);
+    CHECK(check.count == live);
+}
+
+// With tree NULL only the array changes, to follow what another process did
+static void apply_random_changes(void *tree, int changes, int key_range) {
+    for (int i = 0; i < changes; i++) {
+        int key = rand() % key_range;
+        if (rand() % 8 == 0) {
+            if (tree != NULL) lsm_remove(tree, key);
+            expected_live[key] = 0;
+        } else {
+            int value = rand();
+            if (tree != NULL) lsm_put(tree, key, &value);
+            expected_value[key] = value;
+            expected_live[key] = 1;
+        }
+    }
+}
+
+// Waits until the compactor has no full tier left to merge
+static void wait_for_compaction(LsmTree *tree) {
+    for (int i = 0; i < 500; i++) {
+        int first, idle;
+        pthread_mutex_lock(&tree->lock);
+        idle = !tree->compacting && lsm_pick_tier(tree, &first) == 0;
+        pthread_mutex_unlock(&tree->lock);
+        if (idle) return;
+        usleep(10000);
+    }
+}
+
+static void test_compaction(void) {
+    int created;
+    LsmTree *tree = (LsmTree*)lsm_open(TEST_STORE, sizeof(int), &created);
+    CHECK(tree != NULL && created);
+    if (tree == NULL) return;
+
+    // Spread over the key space, then rewrite a small hot range so newer
+    // runs hide older versions and tombstones
+    apply_random_changes(tree, 20 * LSM_MEMTABLE_LIMIT, TEST_KEYS);
+    apply_random_changes(tree, 10 * LSM_MEMTABLE_LIMIT, TEST_KEYS / 10);
+    wait_for_compaction(tree);
+    CHECK(tree->compactions > 0);
+    CHECK(tree->run_count < LSM_COMPACTION_TRIGGER * 3);
+    check_contents(tree);
+
+    lsm_close(tree);
+    tree = (LsmTree*)lsm_open(TEST_STORE, sizeof(int), &created);
+    CHECK(tree != NULL && !created);
+    if (tree == NULL) return;
+    check_contents(tree);
+    lsm_close(tree);
+}
+
+static void test_recovery(void) {
+    // A child makes changes that stay below a flush and exits without
+    // closing the store, as if the process had been killed
+    pid_t pid = fork();
+    if (pid == 0) {
+        int created;
+        LsmTree *tree = (LsmTree*)lsm_open(TEST_STORE, sizeof(int), &created);
+        if (tree == NULL) _exit(1);
+        srand(11);
+        apply_random_changes(tree, LSM_MEMTABLE_LIMIT / 2, TEST_KEYS);
+        _exit(0);
+    }
+    int status;
+    CHECK(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    srand(11);
+    apply_random_changes(NULL, LSM_MEMTABLE_LIMIT / 2, TEST_KEYS);
+
+    // Half a record at the end of the log, as a crash mid-write leaves it
+    FILE *log = fopen(TEST_STORE ".log", "ab");
+    CHECK(log != NULL);
+    if (log != NULL) {
+        char torn[sizeof(LsmEntry) + sizeof(int)];
+        memset(torn, 0x5A, sizeof(torn));
+        fwrite(torn, sizeof(torn) / 2, 1, log);
+        fclose(log);
+    }
+
+    int created;
+    LsmTree *tree = (LsmTree*)lsm_open(TEST_STORE, sizeof(int), &created);
+    CHECK(tree != NULL && !created);
+    if (tree == NULL) return;
+    CHECK(tree->memtable_count > 0);
+    check_contents(tree);
+    lsm_close(tree);
+}
+
+static void test_exclusive_open(void) {
+    int created;
+    LsmTree *tree = (LsmTree*)lsm_open(TEST_STORE, sizeof(int), &created);
+    CHECK(tree != NULL);
+    if (tree == NULL) return;
+    // flock is per open file, so a second open in the same process conflicts too
+    CHECK(lsm_open(TEST_STORE, sizeof(int), &created) == NULL);
+    lsm_close(tree);
+}
+
+int main(void) {
+    if (check_enter_scratch() != 0) {
+        printf("Cannot create a scratch directory.\n");
+        return 1;
+    }
+    srand(7);
+    test_compaction();
+    test_recovery();
+    test_exclusive_open();
+    return check_finish("lsm_store_test");
+}
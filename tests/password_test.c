@@ -0,0 +1,135 @@
+// Password hashing: PBKDF2-HMAC-SHA256 against published test vectors,
+// verification of the two older stored formats, and the upgrade of an old
+// hash in the users file at login.
+//
+//   gcc -Wall -Wextra -std=c99 -O2 -pthread -o password_test tests/password_test.c
+//   ./password_test
+#define BUSFLOW_NO_MAIN
+#include "../src/main.c"
+#include "check.h"
+
+// Hashes in the two formats that predate PBKDF2, for the password "pw" and
+// "correct horse": the original unprefixed secure_encrypt_password text and
+// the $s1$ 64-bit mixer at cost 6
+#define ORIGINAL_PW_HASH "484e21244bcfb4979ec722ba3af82b04"
+#define ORIGINAL_HORSE_HASH "1f4d22774c99ea9f9b9674ba3bf77908"
+#define S1_HORSE_HASH "$s1$6$0123456789abcdef$004228ce1f2ca0458e1b20591bd9dc57"
+
+static int pbkdf2_matches(const char *password, const char *salt, unsigned long iterations, const char *hex) {
+    unsigned char derived[32];
+    char text[65];
+    pbkdf2_sha256(password, salt, iterations, derived);
+    for (int i = 0; i < 32; i++) sprintf(text + i * 2, "%02x", derived[i]);
+    return strcmp(text, hex) == 0;
+}
+
+static void test_pbkdf2_vectors(void) {
+    // RFC 7914 section 11 and the common PBKDF2-HMAC-SHA256 vectors (first 32 bytes)
+    CHECK(pbkdf2_matches("password", "salt", 1,
+                         "120fb6cffcf8b32c43e7225256c4f837a86548c92ccc35480805987cb70be17b"));
+    CHECK(pbkdf2_matches("password", "salt", 2,
+                         "ae4d0c95af6b46d32d0adff928f06dd02a303f8ef3c251dfd6e2d85a95474c43"));
+    CHECK(pbkdf2_matches("password", "salt", 4096,
+                         "c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a"));
+    CHECK(pbkdf2_matches("passwordPASSWORDpassword", "saltSALTsaltSALTsaltSALTsaltSALTsalt", 4096,
+                         "348c89dbcbd32b2f32d814b8116e84cf2b17347ebc1800181c4e2a1fb8dd53e1"));
+    CHECK(pbkdf2_matches("passwd", "salt", 1,
+                         "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"));
+}
+
+static void test_stored_formats(void) {
+    char hash[MAX_STRING_LENGTH * 2];
+    make_password_hash("correct horse", MIN_PASSWORD_COST, hash);
+    CHECK(strncmp(hash, PASSWORD_HASH_PREFIX "1024$", strlen(PASSWORD_HASH_PREFIX "1024$")) == 0);
+    CHECK(password_matches("correct horse", hash));
+    CHECK(!password_matches("correct horsE", hash));
+    CHECK(!password_matches("", hash));
+
+    // Two hashes of one password differ by their salt
+    char other[MAX_STRING_LENGTH * 2];
+    make_password_hash("correct horse", MIN_PASSWORD_COST, other);
+    CHECK(strcmp(hash, other) != 0);
+
+    // A damaged digest or an iteration count outside the allowed costs never matches
+    char damaged[MAX_STRING_LENGTH * 2];
+    strcpy(damaged, hash);
+    damaged[strlen(damaged) - 1] = damaged[strlen(damaged) - 1] == '0' ? '1' : '0';
+    CHECK(!password_matches("correct horse", damaged));
+    damaged[strlen(damaged) - 1] = '\0';
+    CHECK(!password_matches("correct horse", damaged));
+    CHECK(!password_matches("correct horse", PASSWORD_HASH_PREFIX "1$0123$0123"));
+
+    CHECK(password_matches("pw", ORIGINAL_PW_HASH));
+    CHECK(password_matches("correct horse", ORIGINAL_HORSE_HASH));
+    CHECK(!password_matches("pw", ORIGINAL_HORSE_HASH));
+    CHECK(password_matches("correct horse", S1_HORSE_HASH));
+    CHECK(!password_matches("pw", S1_HORSE_HASH));
+    CHECK(!password_matches("correct horse", "$s1$2$0123456789abcdef$004228ce1f2ca0458e1b20591bd9dc57"));
+
+    CHECK(password_needs_rehash(ORIGINAL_PW_HASH));
+    CHECK(password_needs_rehash(S1_HORSE_HASH));
+    CHECK(!password_needs_rehash(hash));
+}
+
+static int user_line_starts(const char *username, const char *prefix) {
+    char line[MAX_STRING_LENGTH * 3];
+    FILE *file = fopen(FILENAME, "r");
+    int found = 0;
+    size_t length = strlen(username);
+    while (file != NULL && fgets(line, sizeof(line), file) != NULL) {
+        if (strncmp(line, username, length) == 0 && line[length] == ' ') {
+            found = strncmp(line + length + 1, prefix, strlen(prefix)) == 0;
+        }
+    }
+    if (file != NULL) fclose(file);
+    return found;
+}
+
+static void test_upgrade_at_login(void) {
+    char current[MAX_STRING_LENGTH * 2];
+    make_password_hash("carol's", MIN_PASSWORD_COST, current);
+    FILE *file = fopen(FILENAME, "w");
+    CHECK(file != NULL);
+    if (file == NULL) return;
+    fprintf(file, "alice %s\nbob %s\ncarol %s\n", ORIGINAL_PW_HASH, S1_HORSE_HASH, current);
+    fclose(file);
+
+    UserStore store;
+    user_store_init(&store);
+    CHECK(read_users_from_file(&store) == 3);
+
+    // A wrong password changes nothing
+    CHECK(!check_credentials(&store, "alice", "wrong"));
+    CHECK(user_line_starts("alice", ORIGINAL_PW_HASH));
+
+    CHECK(check_credentials(&store, "alice", "pw"));
+    CHECK(check_credentials(&store, "bob", "correct horse"));
+    CHECK(check_credentials(&store, "carol", "carol's"));
+    CHECK(user_line_starts("alice", PASSWORD_HASH_PREFIX "1024$"));
+    CHECK(user_line_starts("bob", PASSWORD_HASH_PREFIX "1024$"));
+    CHECK(user_line_starts("carol", current));
+    user_store_free(&store);
+
+    // The upgraded file still logs everyone in; a higher cost rehashes again
+    setenv("BUSFLOW_HASH_COST", "11", 1);
+    user_store_init(&store);
+    read_users_from_file(&store);
+    CHECK(check_credentials(&store, "alice", "pw"));
+    CHECK(check_credentials(&store, "bob", "correct horse"));
+    CHECK(!check_credentials(&store, "bob", "pw"));
+    CHECK(user_line_starts("alice", PASSWORD_HASH_PREFIX "2048$"));
+    CHECK(user_line_starts("carol", current));
+    user_store_free(&store);
+}
+
+int main(void) {
+    if (check_enter_scratch() != 0) {
+        printf("Cannot create a scratch directory.\n");
+        return 1;
+    }
+    setenv("BUSFLOW_HASH_COST", "10", 1); // the minimum, to keep the test quick
+    test_pbkdf2_vectors();
+    test_stored_formats();
+    test_upgrade_at_login();
+    return check_finish("password_test");
+}
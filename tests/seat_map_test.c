@@ -0,0 +1,104 @@
+// Seat bitmaps: random reservations, releases and allocations checked
+// against a plain array of seats, for bus sizes on and around the 64-seat
+// word boundary.
+//
+//   gcc -Wall -Wextra -std=c99 -O2 -pthread -o seat_map_test tests/seat_map_test.c
+//   ./seat_map_test
+#define BUSFLOW_NO_MAIN
+#include "../src/main.c"
+#include "check.h"
+
+#define TEST_MAX_SEATS 200
+
+static unsigned char taken[TEST_MAX_SEATS + 1];
+
+static int naive_first_fit(int seat_count) {
+    for (int seat = 1; seat <= seat_count; seat++) {
+        if (!taken[seat]) return seat;
+    }
+    return 0;
+}
+
+static int naive_contiguous(int seat_count, int count) {
+    int run = 0;
+    for (int seat = 1; seat <= seat_count; seat++) {
+        run = taken[seat] ? 0 : run + 1;
+        if (run == count) return seat - count + 1;
+    }
+    return 0;
+}
+
+// Counts the seats where the bitmap and the array disagree
+static int compare_seats(const Departure *departure) {
+    int wrong = 0, used = 0;
+    for (int seat = 1; seat <= departure->seat_count; seat++) {
+        if (seat_is_free(departure, seat) == taken[seat]) wrong++;
+        used += taken[seat];
+    }
+    if (seat_is_free(departure, 0) || seat_is_free(departure, departure->seat_count + 1)) wrong++;
+    if (seats_left(departure) != departure->seat_count - used) wrong++;
+    return wrong;
+}
+
+static void test_seat_count(int seat_count) {
+    Departure departure;
+    memset(&departure, 0, sizeof(departure));
+    departure.seat_count = seat_count;
+    departure.seat_map = create_seat_map(seat_count);
+    CHECK(departure.seat_map != NULL);
+    if (departure.seat_map == NULL) return;
+    memset(taken, 0, sizeof(taken));
+
+    int wrong = 0;
+    for (int step = 0; step < 20000; step++) {
+        int action = rand() % 4;
+        if (action == 0) {
+            int seat = rand() % (seat_count + 2);
+            int expected = seat >= 1 && seat <= seat_count && !taken[seat];
+            if (reserve_seat(&departure, seat) != expected) wrong++;
+            if (expected) taken[seat] = 1;
+        } else if (action == 1) {
+            // Release more often than reserve so the bus keeps emptying
+            for (int i = 0; i < 2; i++) {
+                int seat = rand() % (seat_count + 2);
+                release_seat(&departure, seat);
+                if (seat >= 1 && seat <= seat_count) taken[seat] = 0;
+            }
+        } else if (action == 2) {
+            int expected = naive_first_fit(seat_count);
+            if (allocate_first_fit_seat(&departure) != expected) wrong++;
+            if (expected) taken[expected] = 1;
+        } else {
+            // Mostly small groups, sometimes one wider than a word
+            int count = rand() % 8 == 0 ? 1 + rand() % (seat_count + 1) : 1 + rand() % 6;
+            int expected = naive_contiguous(seat_count, count);
+            if (allocate_contiguous_seats(&departure, count) != expected) wrong++;
+            for (int i = 0; expected && i < count; i++) taken[expected + i] = 1;
+        }
+        wrong += compare_seats(&departure);
+    }
+    CHECK(wrong == 0);
+
+    // A full bus allocates nothing; an empty one takes a block of every seat
+    while (allocate_first_fit_seat(&departure) != 0) continue;
+    CHECK(seats_left(&departure) == 0);
+    CHECK(allocate_contiguous_seats(&departure, 1) == 0);
+    for (int seat = 1; seat <= seat_count; seat++) release_seat(&departure, seat);
+    CHECK(seats_left(&departure) == seat_count);
+    CHECK(allocate_contiguous_seats(&departure, seat_count + 1) == 0);
+    CHECK(allocate_contiguous_seats(&departure, seat_count) == 1);
+    free(departure.seat_map);
+}
+
+int main(void) {
+    if (check_enter_scratch() != 0) {
+        printf("Cannot create a scratch directory.\n");
+        return 1;
+    }
+    const int seat_counts[] = { 1, 37, 63, 64, 65, 128, 130, TEST_MAX_SEATS };
+    srand(5);
+    for (size_t i = 0; i < sizeof(seat_counts) / sizeof(seat_counts[0]); i++) {
+        test_seat_count(seat_counts[i]);
+    }
+    return check_finish("seat_map_test");
+}